@@ -0,0 +1,208 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Advertisement deduplication window
+ *
+ * With active scanning a device can hit onResult many times per scan, and
+ * each hit used to pay for store(), getOUI() and getVendor(). This small
+ * open addressed table (keyed by binary address, holding a payload hash)
+ * absorbs the repeats in the callback: an advertisement with the same address
+ * and payload as one already seen in the current window only updates the
+ * RSSI min/max/last and a counter.
+ *
+ * A changed payload (e.g. the scan response arriving) goes through, and
+ * refreshes the scan cache slot the device already uses instead of taking
+ * a new one.
+ *
+ * A window never spans two scans: a device last heard at the end of a scan
+ * opens a new window with its first advertisement of the next one, so it
+ * is stored in that round too.
+ *
+ */
+
+#ifndef ADV_DEDUP_SIZE // override this from Settings.h
+#define ADV_DEDUP_SIZE 64 // must be a power of two
+#endif
+#ifndef ADV_DEDUP_WINDOW_MS // override this from Settings.h
+#define ADV_DEDUP_WINDOW_MS 10000 // enrichment runs at most once per device per window
+#endif
+#define ADV_DEDUP_PROBES 8 // linear probing distance
+
+static_assert( ( ADV_DEDUP_SIZE & (ADV_DEDUP_SIZE-1) ) == 0, "ADV_DEDUP_SIZE must be a power of two" );
+
+struct AdvDedupEntry
+{
+  bool     inUse = false;
+  uint8_t  address[6];     // native (LSB first) address
+  uint8_t  addrType = 0;
+  uint32_t payloadHash = 0;
+  uint32_t windowStart = 0; // millis
+  int      windowRound = -1; // scan round the window was opened during
+  uint32_t lastSeen = 0;    // millis
+  int8_t   rssiMin = 0;
+  int8_t   rssiMax = 0;
+  int8_t   rssiLast = 0;
+  uint16_t count = 0;       // advertisements received during the window
+  int      scanRound = -1;  // scan round the device was stored during
+  int16_t  scanSlot = -1;   // BLEDevScanCache index used during that round
+  BlueToothDeviceStats stats; // lifetime statistics, survive window changes
+};
+
+static AdvDedupEntry AdvDedupTable[ADV_DEDUP_SIZE];
+static uint32_t AdvDuplicatesCount = 0; // for statistics
+
+
+class AdvDedupUtils
+{
+  public:
+
+    static AdvDedupEntry* lookup( BLEAdvertisedDevice *advertisedDevice, bool &isDuplicate )
+    {
+      return lookup(
+        advertisedDevice->getAddress().getNative(),
+        advertisedDevice->getAddressType(),
+        payloadHash( advertisedDevice->getPayload(), advertisedDevice->getPayloadLength() ),
+        advertisedDevice->getRSSI(),
+        millis(),
+        isDuplicate
+      );
+    }
+
+    // finds or creates the entry for an address, isDuplicate is set when address and payload were seen during the window
+    static AdvDedupEntry* lookup( const uint8_t* address, uint8_t addrType, uint32_t hash, int rssi, uint32_t now, bool &isDuplicate )
+    {
+      isDuplicate = false;
+      uint16_t index = addressHash( address ) & (ADV_DEDUP_SIZE-1);
+      AdvDedupEntry* entry = NULL;
+      AdvDedupEntry* freeSlot = NULL;
+      AdvDedupEntry* oldest = NULL;
+      for( uint8_t i=0; i<ADV_DEDUP_PROBES; i++ ) {
+        AdvDedupEntry* e = &AdvDedupTable[ (index + i) & (ADV_DEDUP_SIZE-1) ];
+        if( e->inUse && memcmp( e->address, address, 6 ) == 0 ) {
+          entry = e;
+          break;
+        }
+        if( !e->inUse || now - e->lastSeen > ADV_DEDUP_WINDOW_MS ) {
+          if( freeSlot == NULL ) freeSlot = e;
+        } else if( oldest == NULL || e->lastSeen < oldest->lastSeen ) {
+          oldest = e;
+        }
+      }
+
+      if( entry != NULL ) {
+        BLEDevHelper.statsUpdate( &entry->stats, now, rssi );
+      }
+
+      if( entry != NULL && now - entry->windowStart <= ADV_DEDUP_WINDOW_MS && entry->windowRound == scan_rounds ) {
+        if( rssi < entry->rssiMin ) entry->rssiMin = rssi;
+        if( rssi > entry->rssiMax ) entry->rssiMax = rssi;
+        entry->rssiLast = rssi;
+        entry->lastSeen = now;
+        entry->count++;
+        if( entry->payloadHash == hash ) {
+          isDuplicate = true;
+          AdvDuplicatesCount++;
+        } else {
+          entry->payloadHash = hash; // payload changed, let it through
+        }
+        return entry;
+      }
+
+      if( entry == NULL ) {
+        entry = freeSlot != NULL ? freeSlot : oldest;
+        *entry = AdvDedupEntry();
+        entry->inUse = true;
+        memcpy( entry->address, address, 6 );
+        BLEDevHelper.statsUpdate( &entry->stats, now, rssi );
+      }
+      // new window
+      entry->addrType    = addrType;
+      entry->payloadHash = hash;
+      entry->windowStart = now;
+      entry->windowRound = scan_rounds;
+      entry->lastSeen    = now;
+      entry->rssiMin     = rssi;
+      entry->rssiMax     = rssi;
+      entry->rssiLast    = rssi;
+      entry->count       = 1;
+      return entry;
+    }
+
+    // true when the device was stored in BLEDevScanCache during the current scan
+    static bool isInScan( const AdvDedupEntry* entry )
+    {
+      return entry->scanRound == scan_rounds && entry->scanSlot > -1 && entry->scanSlot < scan_cursor;
+    }
+
+    static void setScanSlot( AdvDedupEntry* entry, uint16_t slot )
+    {
+      entry->scanRound = scan_rounds;
+      entry->scanSlot  = slot;
+    }
+
+    // distinct addresses heard during the last dedup window
+    static uint16_t activeCount( uint32_t now )
+    {
+      uint16_t count = 0;
+      for( uint16_t i=0; i<ADV_DEDUP_SIZE; i++ ) {
+        if( AdvDedupTable[i].inUse && now - AdvDedupTable[i].lastSeen < ADV_DEDUP_WINDOW_MS ) count++;
+      }
+      return count;
+    }
+
+    // 32 bits FNV-1a
+    static uint32_t payloadHash( const uint8_t* payload, size_t len )
+    {
+      uint32_t hash = 2166136261u;
+      for( size_t i=0; i<len; i++ ) {
+        hash ^= payload[i];
+        hash *= 16777619u;
+      }
+      return hash;
+    }
+
+  private:
+
+    static uint16_t addressHash( const uint8_t* address )
+    {
+      // the low bytes are the most random ones (NIC specific part or random part)
+      return ( address[0] ^ (address[1] << 4) ^ (address[2] << 8) ) ^ ( address[3] * 31 );
+    }
+
+};
+
+
+AdvDedupUtils AdvDedup;
@@ -0,0 +1,291 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Synthetic BLE environment generator
+ *
+ * Simulates an advertisement stream in the trace format (see AdvTraceFormat.h)
+ * so the pipeline can be loaded with hundreds of devices through the replay
+ * driver. The population mixes:
+ *
+ *   - public addresses with an OUI and a company ID drawn from the real
+ *     vendor tables (mac-oui-light.db, ble-oui.db), some of them named
+ *   - phones using resolvable private addresses that rotate every
+ *     <rotation> ms while keeping the same payload layout
+ *   - iBeacons on static random addresses
+ *
+ * Each device has its own advertising interval (+ the 0-10ms advDelay from
+ * the spec) and an RSSI derived from a log-distance path loss model, the
+ * distance follows a random walk (wider steps for the mobile devices).
+ * The generator is seeded, the same parameters and vendor tables produce
+ * the same trace.
+ *
+ * Nothing in here touches the SD or the DB: the vendor tables are read
+ * through AdvSynthVendors and records go to an AdvSynthWriter. The host
+ * tool (host/tools/AdvSynthTool.cpp) reads the tables with sqlite, the
+ * 'synth' command uses the PSRam vendor caches.
+ *
+ */
+
+#ifndef ADV_SYNTH_DURATION_MS // override this from Settings.h
+#define ADV_SYNTH_DURATION_MS 60000 // simulated time span
+#endif
+#ifndef ADV_SYNTH_SEED // override this from Settings.h
+#define ADV_SYNTH_SEED 0x424c4543
+#endif
+#define ADV_SYNTH_DEFAULT_DEVICES 500
+#define ADV_SYNTH_MAX_DEVICES     2000
+#define ADV_SYNTH_TICK_MS         1     // simulation step, coarser steps would round the advDelay away
+#define ADV_SYNTH_ROTATION_MS     30000 // RPA rotation period, real devices use ~15mn
+#define ADV_SYNTH_MIN_INTERVAL_MS 100
+#define ADV_SYNTH_MAX_INTERVAL_MS 2000
+#define ADV_SYNTH_PUBLIC_PCT      40 // % of devices with a public address
+#define ADV_SYNTH_RPA_PCT         45 // % of devices with a rotating address, the rest are beacons
+#define ADV_SYNTH_MOBILE_PCT      20 // % of devices moving around
+#define ADV_SYNTH_NAMED_PCT       50 // % of public devices advertising a name
+#define ADV_SYNTH_RSSI_1M         -59 // RSSI at 1m
+#define ADV_SYNTH_PATH_LOSS_EXP   2.2f
+#define ADV_SYNTH_MOBILE_STEP     1.5f  // random walk step of the mobile devices (m)
+#define ADV_SYNTH_STATIC_STEP     0.05f // random walk step of the other devices (m)
+
+enum AdvSynthKind : uint8_t
+{
+  SYNTH_PUBLIC = 0,
+  SYNTH_RPA    = 1,
+  SYNTH_BEACON = 2
+};
+
+struct AdvSynthConfig
+{
+  uint16_t devices     = ADV_SYNTH_DEFAULT_DEVICES;
+  uint32_t duration    = ADV_SYNTH_DURATION_MS; // simulated time span (ms)
+  uint32_t seed        = ADV_SYNTH_SEED;
+  uint32_t rotation    = ADV_SYNTH_ROTATION_MS; // RPA rotation period (ms)
+  uint16_t minInterval = ADV_SYNTH_MIN_INTERVAL_MS;
+  uint16_t maxInterval = ADV_SYNTH_MAX_INTERVAL_MS;
+  uint8_t  publicPct   = ADV_SYNTH_PUBLIC_PCT;
+  uint8_t  rpaPct      = ADV_SYNTH_RPA_PCT;
+  uint8_t  mobilePct   = ADV_SYNTH_MOBILE_PCT;
+  uint8_t  namedPct    = ADV_SYNTH_NAMED_PCT;
+  float    mobileStep  = ADV_SYNTH_MOBILE_STEP;
+  float    staticStep  = ADV_SYNTH_STATIC_STEP;
+};
+
+// vendor tables the population is drawn from, entries are picked by index
+struct AdvSynthVendors
+{
+  uint32_t ouiCount;
+  void     (*oui)( uint32_t index, uint8_t oui[3] ); // MSB first
+  uint32_t companyCount;
+  uint16_t (*company)( uint32_t index );
+};
+
+typedef bool (*AdvSynthWriter)( const AdvTraceRecord &rec, void *ctx );
+typedef void (*AdvSynthProgress)( uint32_t now, uint32_t written ); // called every simulated second
+
+struct AdvSynthDevice
+{
+  uint8_t  address[6];
+  uint8_t  kind;
+  bool     mobile;
+  bool     named;
+  uint16_t company;
+  uint16_t interval;   // ms
+  uint32_t nextAdv;    // ms
+  uint32_t nextRotation; // ms
+  float    distance;   // m
+};
+
+static uint32_t AdvSynthState = ADV_SYNTH_SEED;
+
+
+class AdvSynthUtils
+{
+  public:
+
+    // simulates the population described by [config], returns the number of advertisements written
+    static uint32_t generate( const AdvSynthConfig &config, const AdvSynthVendors &vendors, AdvSynthWriter writer, void *ctx, AdvSynthProgress progress = NULL )
+    {
+      uint16_t devices = config.devices;
+      if( devices == 0 ) devices = ADV_SYNTH_DEFAULT_DEVICES;
+      if( devices > ADV_SYNTH_MAX_DEVICES ) devices = ADV_SYNTH_MAX_DEVICES;
+      if( vendors.ouiCount == 0 || vendors.companyCount == 0 ) {
+        log_e("Empty vendor tables, can't generate a trace");
+        return 0;
+      }
+      if( config.maxInterval <= config.minInterval || config.rotation == 0 ) {
+        log_e("Invalid synth config");
+        return 0;
+      }
+      AdvSynthDevice* population = (AdvSynthDevice*)ps_calloc( devices, sizeof( AdvSynthDevice ) );
+      if( population == NULL ) {
+        log_e("[ERROR][%d][%d] can't allocate %d synthetic devices", freeheap, freepsheap, devices );
+        return 0;
+      }
+      AdvSynthState = config.seed == 0 ? ADV_SYNTH_SEED : config.seed; // xorshift can't start from 0
+      for( uint16_t i=0; i<devices; i++ ) {
+        spawn( config, vendors, &population[i] );
+      }
+      AdvTraceRecord rec;
+      uint32_t written = 0;
+      for( uint32_t now=0; now<config.duration; now+=ADV_SYNTH_TICK_MS ) {
+        for( uint16_t i=0; i<devices; i++ ) {
+          AdvSynthDevice* device = &population[i];
+          if( device->nextAdv > now ) continue;
+          if( device->kind == SYNTH_RPA && device->nextRotation <= now ) {
+            randomAddress( device->address, 0x40 );
+            device->nextRotation = now + config.rotation;
+          }
+          advertise( config, device, now, rec );
+          if( !writer( rec, ctx ) ) {
+            log_e("Trace writer failed after %d advertisements", written );
+            free( population );
+            return written;
+          }
+          written++;
+          device->nextAdv = now + device->interval + rand( 11 ); // advDelay
+        }
+        if( progress != NULL && now % 1000 == 0 ) progress( now, written );
+      }
+      free( population );
+      return written;
+    }
+
+  private:
+
+    static uint32_t next()
+    {
+      // xorshift32
+      AdvSynthState ^= AdvSynthState << 13;
+      AdvSynthState ^= AdvSynthState >> 17;
+      AdvSynthState ^= AdvSynthState << 5;
+      return AdvSynthState;
+    }
+
+    static uint32_t rand( uint32_t max )
+    {
+      return next() % max;
+    }
+
+    static float randf( float min, float max )
+    {
+      return min + ( max - min ) * ( next() & 0xffff ) / 65535.0f;
+    }
+
+    // two most significant bits select the random address subtype (0x40 = resolvable, 0xC0 = static)
+    static void randomAddress( uint8_t* address, uint8_t subtype )
+    {
+      for( uint8_t i=0; i<6; i++ ) address[i] = next() & 0xff;
+      address[5] = ( address[5] & 0x3f ) | subtype; // native order: MSB last
+    }
+
+    static void publicAddress( const AdvSynthVendors &vendors, uint8_t* address )
+    {
+      uint8_t oui[3];
+      vendors.oui( rand( vendors.ouiCount ), oui );
+      for( uint8_t i=0; i<3; i++ ) address[i] = next() & 0xff;
+      address[3] = oui[2];
+      address[4] = oui[1];
+      address[5] = oui[0];
+    }
+
+    static void spawn( const AdvSynthConfig &config, const AdvSynthVendors &vendors, AdvSynthDevice* device )
+    {
+      uint32_t dice = rand( 100 );
+      device->kind = dice < config.publicPct ? SYNTH_PUBLIC : dice < config.publicPct+config.rpaPct ? SYNTH_RPA : SYNTH_BEACON;
+      device->mobile   = rand( 100 ) < config.mobilePct;
+      device->named    = device->kind == SYNTH_PUBLIC && rand( 100 ) < config.namedPct;
+      device->company  = device->kind == SYNTH_BEACON ? 0x004C : vendors.company( rand( vendors.companyCount ) );
+      device->interval = config.minInterval + rand( config.maxInterval - config.minInterval );
+      device->nextAdv  = rand( device->interval ); // devices are not in phase
+      device->nextRotation = rand( config.rotation );
+      device->distance = randf( 1.0f, 30.0f );
+      switch( device->kind ) {
+        case SYNTH_PUBLIC: publicAddress( vendors, device->address ); break;
+        case SYNTH_RPA:    randomAddress( device->address, 0x40 );    break;
+        default:           randomAddress( device->address, 0xC0 );    break;
+      }
+    }
+
+    static void advertise( const AdvSynthConfig &config, AdvSynthDevice* device, uint32_t now, AdvTraceRecord &rec )
+    {
+      float step = device->mobile ? config.mobileStep : config.staticStep;
+      device->distance += randf( -step, step );
+      if( device->distance < 0.5f ) device->distance = 0.5f;
+      if( device->distance > 50.0f ) device->distance = 50.0f;
+      float rssi = ADV_SYNTH_RSSI_1M - 10.0f * ADV_SYNTH_PATH_LOSS_EXP * log10f( device->distance ) + randf( -4.0f, 4.0f );
+
+      rec.timestamp = now;
+      memcpy( rec.address, device->address, 6 );
+      rec.addrType = device->kind == SYNTH_PUBLIC ? BLE_ADDR_PUBLIC : BLE_ADDR_RANDOM;
+      rec.rssi     = rssi < -127 ? -127 : (int8_t)rssi;
+      rec.length   = 0;
+
+      uint8_t* p = rec.payload;
+      // flags
+      *p++ = 0x02; *p++ = 0x01; *p++ = 0x06;
+      if( device->kind == SYNTH_BEACON ) {
+        // iBeacon: uuid derived from the address, major/minor from the company slot
+        *p++ = 0x1A; *p++ = AD_TYPE_MANUFACTURER_DATA; *p++ = 0x4C; *p++ = 0x00; *p++ = 0x02; *p++ = 0x15;
+        for( uint8_t i=0; i<16; i++ ) *p++ = device->address[i % 6] ^ i;
+        *p++ = 0x00; *p++ = 0x01; // major
+        *p++ = device->address[1]; *p++ = device->address[0]; // minor
+        *p++ = (uint8_t)ADV_SYNTH_RSSI_1M; // measured power
+      } else {
+        if( device->kind == SYNTH_RPA ) {
+          *p++ = 0x02; *p++ = 0x0A; *p++ = 0x0C; // tx power
+        }
+        // manufacturer data: company id + a per device constant
+        *p++ = 0x07; *p++ = AD_TYPE_MANUFACTURER_DATA;
+        *p++ = device->company & 0xff; *p++ = device->company >> 8;
+        *p++ = device->interval & 0xff; *p++ = device->interval >> 8; *p++ = device->kind; *p++ = device->mobile;
+        if( device->named ) {
+          char name[12];
+          snprintf( name, sizeof( name ), "Synth-%02X%02X", device->address[1], device->address[0] );
+          uint8_t len = strlen( name );
+          *p++ = len + 1; *p++ = 0x09; // complete local name
+          memcpy( p, name, len );
+          p += len;
+        }
+      }
+      rec.length = p - rec.payload;
+    }
+
+};
+
+
+AdvSynthUtils AdvSynth;
@@ -0,0 +1,425 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Advertisement trace recorder and replay driver
+ *
+ * The recorder copies every raw advertisement reaching onResult() into a
+ * queue, a writer task drains it into a compact binary file on the SD (see
+ * AdvTraceFormat.h).
+ *
+ * The callback never touches the SD: when the queue is full the
+ * advertisement is dropped and counted.
+ *
+ * The replay driver feeds a trace through the callback stages that work on
+ * raw data (deduplication, beacon decoding, RPA grouping) either at the
+ * recorded pace or as fast as possible, using the recorded timestamps as
+ * clock so both modes take the same decisions. It reports throughput and
+ * per-advertisement latency.
+ *
+ * With the scan pipeline hooks (see AdvTracePipeline) the surviving
+ * advertisements are also stored in the scan cache the way onResult does,
+ * the trace is cut into scan rounds (SCAN_DURATION or a full scan cache)
+ * and every round runs the post scan steps (populate, exists, render,
+ * propagate) and the persist queue. This adds the end-to-end latency from
+ * the scan cache store to the propagation, and the DB insert throughput.
+ *
+ */
+
+#ifndef ADV_TRACE_PATH // override this from Settings.h
+#define ADV_TRACE_PATH "/advtrace.bin"
+#endif
+#ifndef ADV_TRACE_QUEUE_SIZE // override this from Settings.h
+#define ADV_TRACE_QUEUE_SIZE 32 // advertisements buffered between onResult and the writer task
+#endif
+#define ADV_TRACE_FLUSH_EVERY 64 // records
+
+struct AdvTraceReplayStats
+{
+  uint32_t records;
+  uint32_t duplicates;
+  uint32_t beacons;
+  uint32_t grouped;
+  int64_t  elapsed;    // µs
+  int64_t  latencyMin; // µs
+  int64_t  latencyMax; // µs
+  int64_t  latencySum; // µs
+  // scan pipeline replay only
+  uint32_t rounds;
+  uint32_t stored;        // scan cache slots filled
+  uint32_t persisted;     // DB inserts
+  uint32_t persistFailed;
+  int64_t  roundsSum;     // µs spent in the post scan steps
+  uint32_t e2eCount;
+  int64_t  e2eMin;        // µs, scan cache store to propagation
+  int64_t  e2eMax;        // µs
+  int64_t  e2eSum;        // µs
+};
+
+// scan pipeline hooks for the replay, provided by BLE.h which is included later
+struct AdvTracePipeline
+{
+  void (*roundBegin)(); // same as before a scan
+  bool (*store)( const AdvTraceRecord &rec, AdvDedupEntry* advEntry, bool isDuplicate, uint32_t rpaGroup ); // onResult storage, false once the scan is done
+  void (*roundEnd)();   // same as after a scan, runs the post scan steps
+};
+
+static QueueHandle_t AdvTraceQueue = NULL;
+static fs::File AdvTraceFile;
+static volatile bool AdvTraceRecording = false;
+static volatile bool AdvTraceWriterRunning = false;
+static uint32_t AdvTraceStart = 0;
+static uint32_t AdvTraceRecorded = 0; // for statistics
+static AdvTraceReplayStats *AdvTraceReplaying = NULL; // pipeline replay in progress
+static bool AdvTraceRoundDone = false; // pipeline replay: the scan cache is full
+static int64_t AdvTraceStoredAt[MAX_DEVICES_PER_SCAN]; // pipeline replay: esp_timer us, 0 = slot not from the replay
+static uint32_t AdvTraceDropped = 0; // for statistics
+
+
+class AdvTraceUtils
+{
+  public:
+
+    static bool start( const char* path = ADV_TRACE_PATH )
+    {
+      if( AdvTraceRecording || AdvTraceWriterRunning ) {
+        log_w("Trace recorder already running");
+        return false;
+      }
+      if( AdvTraceQueue == NULL ) {
+        AdvTraceQueue = xQueueCreate( ADV_TRACE_QUEUE_SIZE, sizeof( AdvTraceRecord ) );
+        if( AdvTraceQueue == NULL ) {
+          log_e("[ERROR][%d][%d] can't allocate trace queue", freeheap, freepsheap );
+          return false;
+        }
+      }
+      takeDBLock(); // the SD may share the TFT bus
+      AdvTraceFile = BLE_FS.open( path, FILE_WRITE );
+      if( AdvTraceFile ) writeHeader( AdvTraceFile );
+      giveDBLock();
+      if( !AdvTraceFile ) {
+        log_e("Can't open %s for writing", path );
+        return false;
+      }
+      AdvTraceRecorded = 0;
+      AdvTraceDropped = 0;
+      AdvTraceStart = millis();
+      AdvTraceWriterRunning = true;
+      AdvTraceRecording = true;
+      xTaskCreatePinnedToCore( writerTask, "AdvTraceWriter", 4096, NULL, 1, NULL, ADVTRACE_CORE );
+      log_w("Recording advertisements to %s", path );
+      return true;
+    }
+
+    // the writer task drains the queue, closes the file and exits
+    static void stop()
+    {
+      AdvTraceRecording = false;
+    }
+
+    static bool isRecording()
+    {
+      return AdvTraceRecording;
+    }
+
+    // called from onResult, never blocks
+    static void record( BLEAdvertisedDevice *advertisedDevice )
+    {
+      if( !AdvTraceRecording ) return;
+      AdvTraceRecord rec;
+      size_t len = advertisedDevice->getPayloadLength();
+      rec.timestamp = millis() - AdvTraceStart;
+      memcpy( rec.address, advertisedDevice->getAddress().getNative(), 6 );
+      rec.addrType = advertisedDevice->getAddressType();
+      rec.rssi     = advertisedDevice->getRSSI();
+      rec.length   = len > ADV_TRACE_MAX_PAYLOAD ? ADV_TRACE_MAX_PAYLOAD : len;
+      memcpy( rec.payload, advertisedDevice->getPayload(), rec.length );
+      if( xQueueSend( AdvTraceQueue, &rec, 0 ) != pdTRUE ) {
+        AdvTraceDropped++;
+      }
+    }
+
+    static void writeHeader( fs::File &traceFile )
+    {
+      uint8_t header[ADV_TRACE_HEADER_LEN];
+      advTraceHeader( header );
+      traceFile.write( header, sizeof( header ) );
+    }
+
+    static size_t writeRecord( fs::File &traceFile, const AdvTraceRecord &rec )
+    {
+      return traceFile.write( (const uint8_t*)&rec, advTraceRecordLen( rec ) );
+    }
+
+    // replays a trace file, the scan must be stopped
+    static bool replay( const char* path, bool realtime, AdvTraceReplayStats &stats, const AdvTracePipeline* pipeline = NULL )
+    {
+      memset( &stats, 0, sizeof( AdvTraceReplayStats ) );
+      fs::File traceFile = BLE_FS.open( path, FILE_READ );
+      if( !traceFile ) {
+        log_e("Can't open %s for reading", path );
+        return false;
+      }
+      uint8_t header[ADV_TRACE_HEADER_LEN];
+      if( traceFile.read( header, sizeof( header ) ) != sizeof( header ) || !advTraceHeaderValid( header ) ) {
+        log_e("%s is not a v%d advertisement trace", path, ADV_TRACE_VERSION );
+        traceFile.close();
+        return false;
+      }
+      AdvTraceRecord rec;
+      uint32_t clockBase = millis(); // recorded timestamps are shifted onto the live clock
+      int64_t  replayStart = esp_timer_get_time();
+      int64_t  paused = 0; // post scan steps, the realtime pace resumes after them like a scan does
+      uint32_t persistedBase = PersistQueued + PersistInline;
+      uint32_t failedBase = PersistFailed;
+      uint32_t roundStart = 0;
+      bool inRound = false;
+      stats.latencyMin = INT64_MAX;
+      stats.e2eMin = INT64_MAX;
+      if( pipeline == NULL ) {
+        RPAGroups.scanBegin( clockBase ); // the trace is one continuous scan window
+      } else {
+        memset( AdvTraceStoredAt, 0, sizeof( AdvTraceStoredAt ) );
+        AdvTraceReplaying = &stats;
+      }
+      while( read( traceFile, rec ) ) {
+        if( realtime ) {
+          int64_t due = replayStart + paused + (int64_t)rec.timestamp * 1000;
+          int64_t wait = due - esp_timer_get_time();
+          if( wait >= 1000 ) vTaskDelay( pdMS_TO_TICKS( wait / 1000 ) );
+        }
+        uint32_t now = clockBase + rec.timestamp;
+        if( pipeline != NULL ) {
+          if( inRound && ( AdvTraceRoundDone || now - roundStart >= (uint32_t)SCAN_DURATION * 1000 ) ) {
+            paused += roundEnd( pipeline, stats );
+            inRound = false;
+          }
+          if( !inRound ) {
+            roundBegin( pipeline, now );
+            roundStart = now;
+            inRound = true;
+          }
+        }
+        int64_t t0 = esp_timer_get_time();
+        feed( rec, now, stats, pipeline );
+        int64_t latency = esp_timer_get_time() - t0;
+        stats.records++;
+        stats.latencySum += latency;
+        if( latency < stats.latencyMin ) stats.latencyMin = latency;
+        if( latency > stats.latencyMax ) stats.latencyMax = latency;
+      }
+      if( pipeline == NULL ) {
+        RPAGroups.scanEnd();
+      } else {
+        if( inRound ) roundEnd( pipeline, stats );
+        Persist.drain(); // the DB throughput counts the inserts still queued
+        stats.persisted = PersistQueued + PersistInline - persistedBase;
+        stats.persistFailed = PersistFailed - failedBase;
+        AdvTraceReplaying = NULL;
+      }
+      stats.elapsed = esp_timer_get_time() - replayStart;
+      if( stats.records == 0 ) stats.latencyMin = 0;
+      if( stats.e2eCount == 0 ) stats.e2eMin = 0;
+      traceFile.close();
+      return true;
+    }
+
+    // pipeline replay: called by the post scan steps once a scan cache slot is propagated
+    static void propagated( uint16_t slot )
+    {
+      if( AdvTraceReplaying == NULL || slot >= MAX_DEVICES_PER_SCAN || AdvTraceStoredAt[slot] == 0 ) return;
+      int64_t latency = esp_timer_get_time() - AdvTraceStoredAt[slot];
+      AdvTraceStoredAt[slot] = 0;
+      AdvTraceReplaying->e2eCount++;
+      AdvTraceReplaying->e2eSum += latency;
+      if( latency < AdvTraceReplaying->e2eMin ) AdvTraceReplaying->e2eMin = latency;
+      if( latency > AdvTraceReplaying->e2eMax ) AdvTraceReplaying->e2eMax = latency;
+    }
+
+    // generates a synthetic trace of [devices] devices into [path], returns the number of advertisements written
+    static uint32_t synthesize( const char* path, uint16_t devices )
+    {
+      if( !DB.hasPsram || OuiPsramCache == NULL || VendorPsramCache == NULL ) {
+        log_e("The vendor tables are only cached with PSRam, use the host tool (host/tools/AdvSynthTool.cpp) and copy the trace to the SD");
+        return 0;
+      }
+      fs::File traceFile = BLE_FS.open( path, FILE_WRITE );
+      if( !traceFile ) {
+        log_e("Can't open %s for writing", path );
+        return 0;
+      }
+      writeHeader( traceFile );
+      AdvSynthConfig config;
+      config.devices = devices;
+      AdvSynthVendors vendors = { OUIDBSize, synthOUI, VendorDBSize, synthCompany };
+      uint32_t written = AdvSynth.generate( config, vendors, synthWrite, &traceFile, synthProgress );
+      traceFile.close();
+      return written;
+    }
+
+    static void printReplayStats( const AdvTraceReplayStats &stats )
+    {
+      float seconds = stats.elapsed / 1000000.0;
+      Serial.printf("[Replay] %d advertisements in %.3f s (%.1f adv/s)\n", stats.records, seconds, seconds > 0 ? stats.records / seconds : 0 );
+      Serial.printf("[Replay] duplicates: %d, beacon frames: %d, grouped addresses: %d\n", stats.duplicates, stats.beacons, stats.grouped );
+      Serial.printf("[Replay] latency us min/avg/max: %lld / %lld / %lld\n",
+        stats.latencyMin,
+        stats.records > 0 ? stats.latencySum / stats.records : 0,
+        stats.latencyMax
+      );
+      if( stats.rounds == 0 ) return;
+      Serial.printf("[Replay] %d scan rounds, %d devices stored, post scan steps avg %lld ms\n", stats.rounds, stats.stored, stats.roundsSum / stats.rounds / 1000 );
+      Serial.printf("[Replay] store to propagate us min/avg/max: %lld / %lld / %lld\n",
+        stats.e2eMin,
+        stats.e2eCount > 0 ? stats.e2eSum / stats.e2eCount : 0,
+        stats.e2eMax
+      );
+      Serial.printf("[Replay] DB: %d inserts (%.1f/s), %d failed\n", stats.persisted, seconds > 0 ? stats.persisted / seconds : 0, stats.persistFailed );
+    }
+
+  private:
+
+    static void writerTask( void * param = NULL )
+    {
+      AdvTraceRecord rec;
+      uint32_t unflushed = 0;
+      while( AdvTraceRecording || uxQueueMessagesWaiting( AdvTraceQueue ) > 0 ) {
+        if( xQueueReceive( AdvTraceQueue, &rec, pdMS_TO_TICKS( 100 ) ) != pdTRUE ) continue;
+        takeDBLock(); // the SD may share the TFT bus
+        writeRecord( AdvTraceFile, rec );
+        if( ++unflushed >= ADV_TRACE_FLUSH_EVERY ) {
+          AdvTraceFile.flush();
+          unflushed = 0;
+        }
+        giveDBLock();
+        AdvTraceRecorded++;
+      }
+      takeDBLock();
+      AdvTraceFile.close();
+      giveDBLock();
+      log_w("Trace recorder stopped, %d advertisements recorded, %d dropped", AdvTraceRecorded, AdvTraceDropped );
+      AdvTraceWriterRunning = false;
+      vTaskDelete( NULL );
+    }
+
+    static void synthOUI( uint32_t index, uint8_t oui[3] )
+    {
+      const char* mac = OuiPsramCache[index]->mac;
+      for( uint8_t i=0; i<3; i++ ) {
+        oui[i] = BLEDevHelper.hexToUInt16( mac + i*2, 2 );
+      }
+    }
+
+    static uint16_t synthCompany( uint32_t index )
+    {
+      return *VendorPsramCache[index]->devid;
+    }
+
+    static bool synthWrite( const AdvTraceRecord &rec, void *ctx )
+    {
+      return writeRecord( *(fs::File*)ctx, rec ) == advTraceRecordLen( rec );
+    }
+
+    static void synthProgress( uint32_t now, uint32_t written )
+    {
+      vTaskDelay(1);
+      if( now % 10000 == 0 ) Serial.printf("[Synth] %d s simulated, %d advertisements\n", now / 1000, written );
+    }
+
+    static bool read( fs::File &traceFile, AdvTraceRecord &rec )
+    {
+      if( traceFile.read( (uint8_t*)&rec, ADV_TRACE_RECORD_HEADER_LEN ) != ADV_TRACE_RECORD_HEADER_LEN ) return false;
+      if( rec.length > ADV_TRACE_MAX_PAYLOAD ) {
+        log_e("Corrupted trace record (payload length %d)", rec.length );
+        return false;
+      }
+      return traceFile.read( rec.payload, rec.length ) == rec.length;
+    }
+
+    static void roundBegin( const AdvTracePipeline* pipeline, uint32_t now )
+    {
+      pipeline->roundBegin();
+      RPAGroups.scanBegin( now ); // on the replay clock
+      AdvTraceRoundDone = false;
+    }
+
+    // returns the time spent in the post scan steps (µs)
+    static int64_t roundEnd( const AdvTracePipeline* pipeline, AdvTraceReplayStats &stats )
+    {
+      int64_t t0 = esp_timer_get_time();
+      pipeline->roundEnd();
+      int64_t elapsed = esp_timer_get_time() - t0;
+      stats.rounds++;
+      stats.roundsSum += elapsed;
+      return elapsed;
+    }
+
+    // same stages as onResult(), the scan cache storage only with the pipeline hooks
+    static void feed( const AdvTraceRecord &rec, uint32_t now, AdvTraceReplayStats &stats, const AdvTracePipeline* pipeline )
+    {
+      bool isDuplicate = false;
+      uint32_t rpaGroup = 0;
+      uint32_t hash = AdvDedup.payloadHash( rec.payload, rec.length );
+      AdvDedupEntry* advEntry = AdvDedup.lookup( rec.address, rec.addrType, hash, rec.rssi, now, isDuplicate );
+      bool isRotating = RPAGroups.isRotating( rec.address, rec.addrType );
+      if( isDuplicate ) {
+        if( isRotating ) RPAGroups.touch( rec.address, now );
+        stats.duplicates++;
+      } else {
+        BeaconFrame frame;
+        if( Beacons.decode( rec.payload, rec.length, &frame ) ) {
+          Beacons.update( rec.address, rec.rssi, &frame );
+          stats.beacons++;
+        }
+        if( isRotating ) {
+          uint32_t fp = RPAGroups.fingerprint( rec.payload, rec.length );
+          if( fp != 0 ) rpaGroup = RPAGroups.resolve( rec.address, fp, now );
+          if( rpaGroup != 0 ) stats.grouped++;
+        }
+      }
+      if( pipeline == NULL || AdvTraceRoundDone ) return;
+      uint16_t slot = scan_cursor;
+      if( !pipeline->store( rec, advEntry, isDuplicate, rpaGroup ) ) AdvTraceRoundDone = true;
+      if( scan_cursor > slot ) {
+        AdvTraceStoredAt[slot] = esp_timer_get_time();
+        stats.stored++;
+      }
+    }
+
+};
+
+
+AdvTraceUtils AdvTrace;
@@ -0,0 +1,85 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Advertisement trace file format
+ *
+ *   header : "BLET" + version (1 byte) + 3 reserved bytes
+ *   record : timestamp (uint32 LE, ms since recording started), address (6 bytes,
+ *            native order), address type (1 byte), RSSI (int8), payload
+ *            length (1 byte), payload (length bytes)
+ *
+ * Shared by the recorder/replay driver (AdvTrace.h), the synthetic trace
+ * generator (AdvSynth.h) and the host tools.
+ *
+ */
+
+#define ADV_TRACE_MAX_PAYLOAD 62 // advertisement + scan response
+#define ADV_TRACE_VERSION 1
+#define ADV_TRACE_HEADER_LEN 8
+
+struct __attribute__((packed)) AdvTraceRecord
+{
+  uint32_t timestamp;
+  uint8_t  address[6];
+  uint8_t  addrType;
+  int8_t   rssi;
+  uint8_t  length;
+  uint8_t  payload[ADV_TRACE_MAX_PAYLOAD];
+};
+
+#define ADV_TRACE_RECORD_HEADER_LEN ( sizeof( AdvTraceRecord ) - ADV_TRACE_MAX_PAYLOAD )
+
+static const uint8_t AdvTraceMagic[4] = { 'B', 'L', 'E', 'T' };
+
+static void advTraceHeader( uint8_t header[ADV_TRACE_HEADER_LEN] )
+{
+  memset( header, 0, ADV_TRACE_HEADER_LEN );
+  memcpy( header, AdvTraceMagic, 4 );
+  header[4] = ADV_TRACE_VERSION;
+}
+
+static bool advTraceHeaderValid( const uint8_t header[ADV_TRACE_HEADER_LEN] )
+{
+  return memcmp( header, AdvTraceMagic, 4 ) == 0 && header[4] == ADV_TRACE_VERSION;
+}
+
+// size of a record on file
+static size_t advTraceRecordLen( const AdvTraceRecord &rec )
+{
+  return ADV_TRACE_RECORD_HEADER_LEN + rec.length;
+}
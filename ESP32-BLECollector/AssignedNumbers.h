@@ -0,0 +1,259 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Bluetooth SIG assigned numbers (GATT services, GATT characteristics,
+ * appearance categories, company identifiers).
+ *
+ * All tables are constexpr (they live in flash, no RAM is used) and must be
+ * sorted by ascending assignedNumber: this is enforced at compile time by
+ * static_assert so lookups can be done by binary search.
+ *
+ */
+
+struct BLEAssignedNumber
+{
+  const char* name;
+  const char* type;
+  uint32_t    assignedNumber;
+};
+
+typedef BLEAssignedNumber BLEGATTService;
+
+static constexpr BLEAssignedNumber BLE_unknownService = {"Unknown", "", 0 };
+
+
+static constexpr BLEAssignedNumber BLE_gattServices[] =
+{
+  {"Generic Access",                "org.bluetooth.service.generic_access",                 0x1800},
+  {"Generic Attribute",             "org.bluetooth.service.generic_attribute",              0x1801},
+  {"Immediate Alert",               "org.bluetooth.service.immediate_alert",                0x1802},
+  {"Link Loss",                     "org.bluetooth.service.link_loss",                      0x1803},
+  {"Tx Power",                      "org.bluetooth.service.tx_power",                       0x1804},
+  {"Current Time Service",          "org.bluetooth.service.current_time",                   0x1805},
+  {"Reference Time Update Service", "org.bluetooth.service.reference_time_update",          0x1806},
+  {"Next DST Change Service",       "org.bluetooth.service.next_dst_change",                0x1807},
+  {"Glucose",                       "org.bluetooth.service.glucose",                        0x1808},
+  {"Health Thermometer",            "org.bluetooth.service.health_thermometer",             0x1809},
+  {"Device Information",            "org.bluetooth.service.device_information",             0x180A},
+  {"Heart Rate",                    "org.bluetooth.service.heart_rate",                     0x180D},
+  {"Phone Alert Status Service",    "org.bluetooth.service.phone_alert_status",             0x180E},
+  {"Battery Service",               "org.bluetooth.service.battery_service",                0x180F},
+  {"Blood Pressure",                "org.bluetooth.service.blood_pressure",                 0x1810},
+  {"Alert Notification Service",    "org.bluetooth.service.alert_notification",             0x1811},
+  {"Human Interface Device",        "org.bluetooth.service.human_interface_device",         0x1812},
+  {"Scan Parameters",               "org.bluetooth.service.scan_parameters",                0x1813},
+  {"Running Speed and Cadence",     "org.bluetooth.service.running_speed_and_cadence",      0x1814},
+  {"Automation IO",                 "org.bluetooth.service.automation_io",                  0x1815},
+  {"Cycling Speed and Cadence",     "org.bluetooth.service.cycling_speed_and_cadence",      0x1816},
+  {"Cycling Power",                 "org.bluetooth.service.cycling_power",                  0x1818},
+  {"Location and Navigation",       "org.bluetooth.service.location_and_navigation",        0x1819},
+  {"Environmental Sensing",         "org.bluetooth.service.environmental_sensing",          0x181A},
+  {"Body Composition",              "org.bluetooth.service.body_composition",               0x181B},
+  {"User Data",                     "org.bluetooth.service.user_data",                      0x181C},
+  {"Weight Scale",                  "org.bluetooth.service.weight_scale",                   0x181D},
+  {"Bond Management",               "org.bluetooth.service.bond_management",                0x181E},
+  {"Continuous Glucose Monitoring", "org.bluetooth.service.continuous_glucose_monitoring",  0x181F},
+  {"Internet Protocol Support",     "org.bluetooth.service.internet_protocol_support",      0x1820},
+  {"Indoor Positioning",            "org.bluetooth.service.indoor_positioning",             0x1821},
+  {"Pulse Oximeter",                "org.bluetooth.service.pulse_oximeter",                 0x1822},
+  {"HTTP Proxy",                    "org.bluetooth.service.http_proxy",                     0x1823},
+  {"Transport Discovery",           "org.bluetooth.service.transport_discovery",            0x1824},
+  {"Object Transfer",               "org.bluetooth.service.object_transfer",                0x1825},
+};
+
+
+static constexpr BLEAssignedNumber BLE_gattCharacteristics[] =
+{
+  {"Device Name",                   "org.bluetooth.characteristic.gap.device_name",         0x2A00},
+  {"Appearance",                    "org.bluetooth.characteristic.gap.appearance",          0x2A01},
+  {"Service Changed",               "org.bluetooth.characteristic.gatt.service_changed",    0x2A05},
+  {"Alert Level",                   "org.bluetooth.characteristic.alert_level",             0x2A06},
+  {"Tx Power Level",                "org.bluetooth.characteristic.tx_power_level",          0x2A07},
+  {"Date Time",                     "org.bluetooth.characteristic.date_time",               0x2A08},
+  {"Local Time Information",        "org.bluetooth.characteristic.local_time_information",  0x2A0F},
+  {"Battery Level",                 "org.bluetooth.characteristic.battery_level",           0x2A19},
+  {"Temperature Measurement",       "org.bluetooth.characteristic.temperature_measurement", 0x2A1C},
+  {"System ID",                     "org.bluetooth.characteristic.system_id",               0x2A23},
+  {"Model Number String",           "org.bluetooth.characteristic.model_number_string",     0x2A24},
+  {"Serial Number String",          "org.bluetooth.characteristic.serial_number_string",    0x2A25},
+  {"Firmware Revision String",      "org.bluetooth.characteristic.firmware_revision_string",0x2A26},
+  {"Hardware Revision String",      "org.bluetooth.characteristic.hardware_revision_string",0x2A27},
+  {"Software Revision String",      "org.bluetooth.characteristic.software_revision_string",0x2A28},
+  {"Manufacturer Name String",      "org.bluetooth.characteristic.manufacturer_name_string",0x2A29},
+  {"Current Time",                  "org.bluetooth.characteristic.current_time",            0x2A2B},
+  {"Heart Rate Measurement",        "org.bluetooth.characteristic.heart_rate_measurement",  0x2A37},
+  {"Body Sensor Location",          "org.bluetooth.characteristic.body_sensor_location",    0x2A38},
+  {"Report",                        "org.bluetooth.characteristic.report",                  0x2A4D},
+  {"PnP ID",                        "org.bluetooth.characteristic.pnp_id",                  0x2A50},
+  {"Pressure",                      "org.bluetooth.characteristic.pressure",                0x2A6D},
+  {"Temperature",                   "org.bluetooth.characteristic.temperature",             0x2A6E},
+  {"Humidity",                      "org.bluetooth.characteristic.humidity",                0x2A6F},
+};
+
+
+// appearance values are looked up by category (appearance >> 6)
+static constexpr BLEAssignedNumber BLE_appearanceCategories[] =
+{
+  {"Unknown",                       "org.bluetooth.appearance.unknown",                     0},
+  {"Phone",                         "org.bluetooth.appearance.phone",                       1},
+  {"Computer",                      "org.bluetooth.appearance.computer",                    2},
+  {"Watch",                         "org.bluetooth.appearance.watch",                       3},
+  {"Clock",                         "org.bluetooth.appearance.clock",                       4},
+  {"Display",                       "org.bluetooth.appearance.display",                     5},
+  {"Remote Control",                "org.bluetooth.appearance.remote_control",              6},
+  {"Eye-glasses",                   "org.bluetooth.appearance.eye_glasses",                 7},
+  {"Tag",                           "org.bluetooth.appearance.tag",                         8},
+  {"Keyring",                       "org.bluetooth.appearance.keyring",                     9},
+  {"Media Player",                  "org.bluetooth.appearance.media_player",                10},
+  {"Barcode Scanner",               "org.bluetooth.appearance.barcode_scanner",             11},
+  {"Thermometer",                   "org.bluetooth.appearance.thermometer",                 12},
+  {"Heart Rate Sensor",             "org.bluetooth.appearance.heart_rate_sensor",           13},
+  {"Blood Pressure",                "org.bluetooth.appearance.blood_pressure",              14},
+  {"Human Interface Device",        "org.bluetooth.appearance.hid",                         15},
+  {"Glucose Meter",                 "org.bluetooth.appearance.glucose_meter",               16},
+  {"Running Walking Sensor",        "org.bluetooth.appearance.running_walking_sensor",      17},
+  {"Cycling",                       "org.bluetooth.appearance.cycling",                     18},
+  {"Control Device",                "org.bluetooth.appearance.control_device",              19},
+  {"Network Device",                "org.bluetooth.appearance.network_device",              20},
+  {"Sensor",                        "org.bluetooth.appearance.sensor",                      21},
+  {"Light Fixtures",                "org.bluetooth.appearance.light_fixtures",              22},
+  {"Fan",                           "org.bluetooth.appearance.fan",                         23},
+  {"HVAC",                          "org.bluetooth.appearance.hvac",                        24},
+  {"Air Conditioning",              "org.bluetooth.appearance.air_conditioning",            25},
+  {"Humidifier",                    "org.bluetooth.appearance.humidifier",                  26},
+  {"Heating",                       "org.bluetooth.appearance.heating",                     27},
+  {"Access Control",                "org.bluetooth.appearance.access_control",              28},
+  {"Motorized Device",              "org.bluetooth.appearance.motorized_device",            29},
+  {"Power Device",                  "org.bluetooth.appearance.power_device",                30},
+  {"Light Source",                  "org.bluetooth.appearance.light_source",                31},
+  {"Window Covering",               "org.bluetooth.appearance.window_covering",             32},
+  {"Audio Sink",                    "org.bluetooth.appearance.audio_sink",                  33},
+  {"Audio Source",                  "org.bluetooth.appearance.audio_source",                34},
+  {"Motorized Vehicle",             "org.bluetooth.appearance.motorized_vehicle",           35},
+  {"Domestic Appliance",            "org.bluetooth.appearance.domestic_appliance",          36},
+  {"Wearable Audio Device",         "org.bluetooth.appearance.wearable_audio_device",       37},
+  {"Aircraft",                      "org.bluetooth.appearance.aircraft",                    38},
+  {"AV Equipment",                  "org.bluetooth.appearance.av_equipment",                39},
+  {"Display Equipment",             "org.bluetooth.appearance.display_equipment",           40},
+  {"Hearing aid",                   "org.bluetooth.appearance.hearing_aid",                 41},
+  {"Gaming",                        "org.bluetooth.appearance.gaming",                      42},
+  {"Signage",                       "org.bluetooth.appearance.signage",                     43},
+  {"Pulse Oximeter",                "org.bluetooth.appearance.pulse_oximeter",              49},
+  {"Weight Scale",                  "org.bluetooth.appearance.weight_scale",                50},
+  {"Personal Mobility Device",      "org.bluetooth.appearance.personal_mobility_device",    51},
+  {"Continuous Glucose Monitor",    "org.bluetooth.appearance.continuous_glucose_monitor",  52},
+  {"Insulin Pump",                  "org.bluetooth.appearance.insulin_pump",                53},
+  {"Medication Delivery",           "org.bluetooth.appearance.medication_delivery",         54},
+  {"Spirometer",                    "org.bluetooth.appearance.spirometer",                  55},
+  {"Outdoor Sports Activity",       "org.bluetooth.appearance.outdoor_sports_activity",     81},
+};
+
+
+// most frequently seen company identifiers, spares a ble-oui.db query for those
+static constexpr BLEAssignedNumber BLE_companyIdentifiers[] =
+{
+  {"Ericsson Technology Licensing", "org.bluetooth.company",                                0x0000},
+  {"Nokia Mobile Phones",           "org.bluetooth.company",                                0x0001},
+  {"Intel Corp.",                   "org.bluetooth.company",                                0x0002},
+  {"IBM Corp.",                     "org.bluetooth.company",                                0x0003},
+  {"Toshiba Corp.",                 "org.bluetooth.company",                                0x0004},
+  {"Microsoft",                     "org.bluetooth.company",                                0x0006},
+  {"Texas Instruments Inc.",        "org.bluetooth.company",                                0x000D},
+  {"Broadcom Corporation",          "org.bluetooth.company",                                0x000F},
+  {"MediaTek, Inc.",                "org.bluetooth.company",                                0x0046},
+  {"Apple, Inc.",                   "org.bluetooth.company",                                0x004C},
+  {"Nordic Semiconductor ASA",      "org.bluetooth.company",                                0x0059},
+  {"Samsung Electronics Co. Ltd.",  "org.bluetooth.company",                                0x0075},
+  {"Garmin International, Inc.",    "org.bluetooth.company",                                0x0087},
+  {"Bose Corporation",              "org.bluetooth.company",                                0x009E},
+  {"Google",                        "org.bluetooth.company",                                0x00E0},
+  {"Radius Networks, Inc.",         "org.bluetooth.company",                                0x0118},
+  {"Cypress Semiconductor",         "org.bluetooth.company",                                0x0131},
+  {"Anhui Huami Information Technology Co., Ltd.", "org.bluetooth.company",                 0x0157},
+  {"Amazon.com Services, Inc.",     "org.bluetooth.company",                                0x0171},
+  {"Logitech International SA",     "org.bluetooth.company",                                0x01DA},
+  {"Espressif Incorporated",        "org.bluetooth.company",                                0x02E5},
+  {"Xiaomi Inc.",                   "org.bluetooth.company",                                0x038F},
+  {"Ruuvi Innovations Ltd.",        "org.bluetooth.company",                                0x0499},
+};
+
+
+template <size_t N>
+static constexpr bool assignedNumbersSorted( const BLEAssignedNumber (&table)[N], size_t i = 1 )
+{
+  return i >= N ? true : ( table[i-1].assignedNumber < table[i].assignedNumber && assignedNumbersSorted( table, i+1 ) );
+}
+
+static_assert( assignedNumbersSorted( BLE_gattServices ),         "BLE_gattServices[] must be sorted by assignedNumber" );
+static_assert( assignedNumbersSorted( BLE_gattCharacteristics ),  "BLE_gattCharacteristics[] must be sorted by assignedNumber" );
+static_assert( assignedNumbersSorted( BLE_appearanceCategories ), "BLE_appearanceCategories[] must be sorted by assignedNumber" );
+static_assert( assignedNumbersSorted( BLE_companyIdentifiers ),   "BLE_companyIdentifiers[] must be sorted by assignedNumber" );
+
+
+// binary search, returns NULL when not found
+template <size_t N>
+static const BLEAssignedNumber* assignedNumberFind( const BLEAssignedNumber (&table)[N], uint32_t assignedNumber )
+{
+  size_t lo = 0, hi = N;
+  while( lo < hi ) {
+    size_t mid = (lo + hi) >> 1;
+    if( table[mid].assignedNumber < assignedNumber ) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if( lo < N && table[lo].assignedNumber == assignedNumber ) {
+    return &table[lo];
+  }
+  return NULL;
+}
+
+
+static const BLEAssignedNumber* gattCharacteristicFind( uint16_t uuid16 )
+{
+  return assignedNumberFind( BLE_gattCharacteristics, uuid16 );
+}
+
+static const BLEAssignedNumber* appearanceFind( uint16_t appearance )
+{
+  return assignedNumberFind( BLE_appearanceCategories, appearance >> 6 );
+}
+
+static const BLEAssignedNumber* companyFind( uint16_t companyId )
+{
+  return assignedNumberFind( BLE_companyIdentifiers, companyId );
+}
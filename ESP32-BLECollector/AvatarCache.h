@@ -0,0 +1,160 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * MAC avatar cache
+ *
+ * The github style avatar of a mac address (see MacAddressColors in UI.h) is
+ * an 8x8 vertically symetrical 1-bit matrix made from the four last bytes of
+ * the address, painted with a color made from the two first bytes.
+ *
+ * Hall of mac and BLE cards keep drawing the same handful of addresses, so
+ * the decoded matrix is kept in a small LRU keyed by binary mac address
+ * instead of re-tokenizing the address string on every draw. Entries are
+ * warmed when a device lands in the RAM cache.
+ *
+ */
+
+#ifndef AVATAR_CACHE_SIZE // override this from Settings.h
+#define AVATAR_CACHE_SIZE 32 // how many avatars are kept
+#endif
+
+struct MacAvatar
+{
+  uint8_t  mac[6];       // binary address, cache key
+  uint8_t  mask[8];      // 1-bit matrix, one byte per column, bit n = row n
+  uint16_t color;
+  uint32_t lastUse = 0;  // LRU tick, 0 = free slot
+};
+
+static MacAvatar AvatarCache[AVATAR_CACHE_SIZE];
+static uint32_t AvatarCacheTick      = 0;
+static uint32_t AvatarCacheHits      = 0;
+static uint32_t AvatarCacheMisses    = 0;
+static uint32_t AvatarCacheEvictions = 0;
+static portMUX_TYPE AvatarMux = portMUX_INITIALIZER_UNLOCKED;
+
+
+class AvatarCacheUtils
+{
+  public:
+
+    // copies the avatar for this address, building (and caching) it on miss
+    static bool get( const char* address, MacAvatar &avatar )
+    {
+      uint8_t mac[6];
+      if( !parse( address, mac ) ) {
+        log_w("Invalid address: %s", address);
+        return false;
+      }
+      portENTER_CRITICAL( &AvatarMux );
+      AvatarCacheTick++;
+      int16_t slot = -1, lru = 0;
+      for( uint16_t i=0; i<AVATAR_CACHE_SIZE; i++ ) {
+        if( AvatarCache[i].lastUse != 0 && memcmp( AvatarCache[i].mac, mac, 6 ) == 0 ) {
+          slot = i;
+          break;
+        }
+        if( AvatarCache[i].lastUse < AvatarCache[lru].lastUse ) lru = i;
+      }
+      if( slot > -1 ) {
+        AvatarCacheHits++;
+      } else {
+        AvatarCacheMisses++;
+        if( AvatarCache[lru].lastUse != 0 ) AvatarCacheEvictions++;
+        slot = lru;
+        build( mac, AvatarCache[slot] );
+      }
+      AvatarCache[slot].lastUse = AvatarCacheTick;
+      avatar = AvatarCache[slot];
+      portEXIT_CRITICAL( &AvatarMux );
+      return true;
+    }
+
+    static void warm( const char* address )
+    {
+      MacAvatar avatar;
+      get( address, avatar );
+    }
+
+    static void dump()
+    {
+      Serial.printf("Avatars: %d hits, %d misses, %d evictions (%d slots)\n",
+        AvatarCacheHits,
+        AvatarCacheMisses,
+        AvatarCacheEvictions,
+        AVATAR_CACHE_SIZE
+      );
+    }
+
+  private:
+
+    static int8_t hexval( char c )
+    {
+      if( c >= '0' && c <= '9' ) return c - '0';
+      if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+      if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+      return -1;
+    }
+
+    // "aa:bb:cc:dd:ee:ff" => { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff }
+    static bool parse( const char* address, uint8_t *mac )
+    {
+      for( uint8_t i=0; i<6; i++ ) {
+        int8_t hi = hexval( address[i*3] );
+        int8_t lo = hexval( address[i*3+1] );
+        if( hi < 0 || lo < 0 ) return false;
+        mac[i] = ( hi << 4 ) | lo;
+      }
+      return true;
+    }
+
+    static void build( const uint8_t *mac, MacAvatar &avatar )
+    {
+      memcpy( avatar.mac, mac, 6 );
+      avatar.color = ( mac[0] << 8 ) | mac[1];
+      for( uint8_t i=0; i<4; i++ ) {
+        avatar.mask[i]   = mac[i+2];
+        avatar.mask[7-i] = mac[i+2];
+      }
+    }
+
+};
+
+
+AvatarCacheUtils Avatars;
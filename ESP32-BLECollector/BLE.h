@@ -185,45 +185,109 @@ static bool deviceHasKnownPayload( BLEAdvertisedDevice *advertisedDevice )
 
 class FoundDeviceCallbacks: public BLEAdvertisedDeviceCallbacks
 {
-    void onResult( BLEAdvertisedDevice *advertisedDevice )
+  public:
+
+    static bool isGroupInScanCache( uint32_t rpaGroup )
     {
-      devicesStatCount++; // raw stats for heapgraph
+      for ( uint16_t i = 0; i < scan_cursor; i++ ) {
+        if ( BLEDevScanCache[i]->rpa_group == rpaGroup ) return true;
+      }
+      return false;
+    }
 
-      bool scanShouldStop =  deviceHasKnownPayload( advertisedDevice );
+    // same address and payload during the dedup window: only refresh the RSSI
+    static void onDuplicate( AdvDedupEntry* advEntry )
+    {
+      if ( RPAGroups.isRotating( advEntry->address, advEntry->addrType ) ) {
+        RPAGroups.touch( advEntry->address, advEntry->lastSeen );
+      }
+      if ( !onScanDone && AdvDedup.isInScan( advEntry ) ) {
+        BLEDevScanCache[advEntry->scanSlot]->rssi = advEntry->rssiLast;
+        BLEDevScanCache[advEntry->scanSlot]->stats = advEntry->stats;
+      }
+    }
 
-      if ( onScanDone  ) return;
+    // picks the scan cache slot of a new advertisement, false when it won't be stored (onScanDone is set when the cache is full)
+    static bool scanSlot( AdvDedupEntry* advEntry, uint32_t rpaGroup, bool scanShouldStop, uint16_t &slot, bool &refresh )
+    {
+      // payload changed (e.g. scan response) for a device stored during this scan: refresh its slot
+      refresh = AdvDedup.isInScan( advEntry );
+      slot = refresh ? advEntry->scanSlot : scan_cursor;
+      if ( !refresh && rpaGroup != 0 && !scanShouldStop && isGroupInScanCache( rpaGroup ) ) {
+        return false; // same logical device already stored during this scan under its previous address
+      }
+      if ( slot >= MAX_DEVICES_PER_SCAN ) {
+        onScanDone = true;
+        return false;
+      }
+      return true;
+    }
 
-      if ( scan_cursor < MAX_DEVICES_PER_SCAN ) {
-        log_i("will store advertisedDevice in cache #%d", scan_cursor);
-        BLEDevHelper.store( BLEDevScanCache[scan_cursor], advertisedDevice );
-        //bool is_random = strcmp( BLEDevScanCache[scan_cursor]->ouiname, "[random]" ) == 0;
-        bool is_random = (BLEDevScanCache[scan_cursor]->addr_type == BLE_ADDR_RANDOM );
-        //bool is_blacklisted = isBlackListed( BLEDevScanCache[scan_cursor]->address );
-        if ( UI.filterVendors && is_random ) {
-          //TODO: scan_cursor++
-          log_i( "Filtering %s", BLEDevScanCache[scan_cursor]->address );
-        } else {
-          if ( DB.hasPsram ) {
-            if ( !is_random ) {
-              DB.getOUI( BLEDevScanCache[scan_cursor]->address, BLEDevScanCache[scan_cursor]->ouiname );
-            }
-            if ( BLEDevScanCache[scan_cursor]->manufid > -1 ) {
-              DB.getVendor( BLEDevScanCache[scan_cursor]->manufid, BLEDevScanCache[scan_cursor]->manufname );
-            }
-            BLEDevScanCache[scan_cursor]->is_anonymous = BLEDevHelper.isAnonymous( BLEDevScanCache[scan_cursor] );
-            log_i(  "  stored and populated #%02d : %s", scan_cursor, advertisedDevice->getName().c_str());
-          } else {
-            log_i(  "  stored #%02d : %s", scan_cursor, advertisedDevice->getName().c_str());
+    // completes a scan cache slot filled by BLEDevHelper.store()
+    static void scanStored( AdvDedupEntry* advEntry, uint32_t rpaGroup, uint16_t slot, bool refresh )
+    {
+      BLEDevScanCache[slot]->stats = advEntry->stats;
+      BLEDevScanCache[slot]->rpa_group = rpaGroup;
+      //bool is_random = strcmp( BLEDevScanCache[slot]->ouiname, "[random]" ) == 0;
+      bool is_random = (BLEDevScanCache[slot]->addr_type == BLE_ADDR_RANDOM );
+      //bool is_blacklisted = isBlackListed( BLEDevScanCache[slot]->address );
+      if ( UI.filterVendors && is_random ) {
+        //TODO: scan_cursor++
+        log_i( "Filtering %s", BLEDevScanCache[slot]->address );
+      } else {
+        if ( DB.hasPsram ) {
+          if ( !is_random ) {
+            Backend.vendors->oui( BLEDevScanCache[slot]->address, BLEDevScanCache[slot]->ouiname );
+          }
+          if ( BLEDevScanCache[slot]->manufid > -1 ) {
+            Backend.vendors->vendor( BLEDevScanCache[slot]->manufid, BLEDevScanCache[slot]->manufname );
           }
+          BLEDevScanCache[slot]->is_anonymous = BLEDevHelper.isAnonymous( BLEDevScanCache[slot] );
+          log_i(  "  stored and populated #%02d : %s", slot, BLEDevScanCache[slot]->name );
+        } else {
+          log_i(  "  stored #%02d : %s", slot, BLEDevScanCache[slot]->name );
+        }
+        if ( !refresh ) {
+          AdvDedup.setScanSlot( advEntry, slot );
           scan_cursor++;
           processedDevicesCount++;
         }
-        if ( scan_cursor == MAX_DEVICES_PER_SCAN ) {
-          onScanDone = true;
-        }
-      } else {
+      }
+      if ( scan_cursor == MAX_DEVICES_PER_SCAN ) {
         onScanDone = true;
       }
+    }
+
+    void onResult( BLEAdvertisedDevice *advertisedDevice )
+    {
+      LatencyProbe probe( PROBE_ON_RESULT );
+      devicesStatCount++; // raw stats for heapgraph
+      AdvReceivedCount++;
+      AdvTrace.record( advertisedDevice );
+
+      bool isDuplicate = false;
+      AdvDedupEntry* advEntry = AdvDedup.lookup( advertisedDevice, isDuplicate );
+      if ( isDuplicate ) {
+        onDuplicate( advEntry );
+        return;
+      }
+
+      Beacons.onAdvertisement( advertisedDevice ); // decode beacon frames from all advertisements
+      uint32_t rpaGroup = RPAGroups.resolve( advertisedDevice ); // logical device of rotating random addresses
+
+      bool scanShouldStop =  deviceHasKnownPayload( advertisedDevice );
+
+      if ( onScanDone  ) return;
+
+      uint16_t slot;
+      bool refresh;
+      if ( scanSlot( advEntry, rpaGroup, scanShouldStop, slot, refresh ) ) {
+        log_i("will store advertisedDevice in cache #%d", slot);
+        BLEDevHelper.store( BLEDevScanCache[slot], advertisedDevice );
+        scanStored( advEntry, rpaGroup, slot, refresh );
+      } else if ( !onScanDone ) {
+        return;
+      }
       if ( onScanDone ) {
         advertisedDevice->getScan()->stop();
         scan_cursor = 0;
@@ -286,8 +350,11 @@ class BLEScanUtils
     void init()
     {
       Serial.begin(115200);
-      mux = xSemaphoreCreateMutex();
-      BLEDevice::init( PLATFORM_NAME " BLE Collector");
+      Lock.init();
+      {
+        HeapTraceScope trace( HEAP_TAG_BLE );
+        BLEDevice::init( PLATFORM_NAME " BLE Collector");
+      }
       getPrefs(); // load prefs from NVS
       UI.init(); // launch all UI tasks
       UI.BLEStarted = true;
@@ -338,14 +405,16 @@ class BLEScanUtils
 
     static void startDBInit( void * param )
     {
+      Backend.devices = &SDDevices;
+      Backend.vendors = &SDVendors;
       if ( ! DB.init() ) { // mount DB
         log_e("Error with .db files (not found or corrupted)");
         UI.stopUITasks();
-        takeMuxSemaphore();
+        takeDisplayLock();
         Out.scrollNextPage();
         Out.println();
         Out.scrollNextPage();
-        giveMuxSemaphore();
+        giveDisplayLock();
         //UI.PrintMessage( "[ERROR]: .db files not found", Out.scrollPosY );
         UI.PrintMessage( "Some db files were not found or corrupted"  );
         #ifdef WITH_WIFI
@@ -444,6 +513,7 @@ class BLEScanUtils
         Serial.println(WiFi.localIP());
         Serial.println("");
         WiFiStarted = true;
+        Metrics.startServer();
         vTaskDelete( NULL );
       }
 
@@ -653,7 +723,7 @@ class BLEScanUtils
             bytesDownloaded += c;
             Serial.printf("%d bytes left\n", bytesLeftToDownload );
             float progress = (((float)bytesDownloaded / (float)len) * 100.00);
-            UI.PrintProgressBar( progress, 100.0 );
+            Render.progress( (Out.width * progress) / 100.0 );
           }
           if( bytesLeftToDownload == 0 ) break;
         }
@@ -701,7 +771,7 @@ class BLEScanUtils
           vTaskDelay(1000);
         }
         Serial.println("Scan started...");
-        UI.headerStats("Scan started...");
+        Render.header("Scan started...");
       }
     }
 
@@ -716,7 +786,7 @@ class BLEScanUtils
           vTaskDelay(100);
         }
         Serial.println("Scan stopped...");
-        UI.headerStats("Scan stopped...");
+        Render.header("Scan stopped...");
       }
     }
 
@@ -790,7 +860,7 @@ class BLEScanUtils
       timeServerIsRunning = true;
       timeServerStarted   = false; // will be updated from task
       BLERoleIcon.setStatus(ICON_STATUS_ROLE_CLOCK_SHARING );
-      UI.headerStats( "Starting Time Server" );
+      Render.header( "Starting Time Server" );
       vTaskDelay(1);
       xTaskCreatePinnedToCore( TimeServerTask, "TimeServerTask", 4096, NULL, 1, &TimeServerTaskHandle, TIMESERVERTASK_CORE ); // TimeServerTask prefers core 1
       log_w("TimeServerTask started");
@@ -808,9 +878,13 @@ class BLEScanUtils
       if( param != NULL ) {
         UI.brightness = atoi( (const char*) param );
       }
-      takeMuxSemaphore();
-      tft_setBrightness( UI.brightness );
-      giveMuxSemaphore();
+      if( RenderTaskIsRunning ) {
+        Render.brightness();
+      } else {
+        takeDisplayLock();
+        tft_setBrightness( UI.brightness );
+        giveDisplayLock();
+      }
       setPrefs();
       log_w("Brightness is now at %d", UI.brightness);
     }
@@ -834,11 +908,167 @@ class BLEScanUtils
       startScanCB();
     }
 
+    static void beaconsCB( void * param = NULL )
+    {
+      Beacons.dump();
+    }
+
+    static void benchCB( void * param = NULL )
+    {
+      bool scanWasRunning = scanTaskRunning;
+      if ( scanTaskRunning ) stopScanCB();
+      Bench.run();
+      Bench.measure( "getDeviceCacheIndex (miss)", []( uint32_t i ) { getDeviceCacheIndex( "00:00:00:00:00:00" ); }, 4 );
+      if ( scanWasRunning ) startScanCB();
+    }
+
+    static void traceCB( void * param = NULL )
+    {
+      if ( AdvTrace.isRecording() ) {
+        AdvTrace.stop();
+        Serial.println("Trace recording stopped");
+      } else if ( AdvTrace.start( ADV_TRACE_PATH ) ) {
+        Serial.println("Trace recording started, run 'trace' again to stop");
+      } else {
+        Serial.println("Trace recording failed to start");
+      }
+    }
+
+    static void replayCB( void * param = NULL )
+    {
+      xTaskCreatePinnedToCore(replayTask, "replayTask", 8192, param, 2, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+    }
+
+    static void replayTask( void * param = NULL )
+    {
+      bool realtime = !( param != NULL && strstr( (const char*)param, "fast" ) != NULL );
+      bool pipeline = param != NULL && strstr( (const char*)param, "pipeline" ) != NULL;
+      if ( AdvTrace.isRecording() ) {
+        Serial.println("Can't replay while recording");
+        vTaskDelete( NULL );
+        return;
+      }
+      bool scanWasRunning = scanTaskRunning;
+      if ( scanTaskRunning ) stopScanCB();
+      AdvTraceReplayStats stats;
+      AdvTracePipeline scanPipeline = { replayRoundBegin, replayStore, replayRoundEnd };
+      Serial.printf("Replaying %s (%s%s)\n", ADV_TRACE_PATH, realtime ? "realtime" : "max speed", pipeline ? ", through the scan pipeline" : "" );
+      if ( pipeline ) Persist.init();
+      if ( AdvTrace.replay( ADV_TRACE_PATH, realtime, stats, pipeline ? &scanPipeline : NULL ) ) {
+        AdvTrace.printReplayStats( stats );
+      }
+      if ( scanWasRunning ) startScanCB();
+      vTaskDelete( NULL );
+    }
+
+    // trace replay adapter: a scan round without the radio, the records are stored by replayStore()
+    static void replayRoundBegin()
+    {
+      onBeforeScan();
+    }
+
+    static bool replayStore( const AdvTraceRecord &rec, AdvDedupEntry* advEntry, bool isDuplicate, uint32_t rpaGroup )
+    {
+      if ( isDuplicate ) {
+        FoundDeviceCallbacks::onDuplicate( advEntry );
+        return !onScanDone;
+      }
+      if ( onScanDone ) return false;
+      uint16_t slot;
+      bool refresh;
+      if ( FoundDeviceCallbacks::scanSlot( advEntry, rpaGroup, false, slot, refresh ) ) {
+        BLEDevHelper.storeRaw( BLEDevScanCache[slot], rec.address, rec.addrType, rec.rssi, rec.payload, rec.length );
+        FoundDeviceCallbacks::scanStored( advEntry, rpaGroup, slot, refresh );
+      }
+      return !onScanDone;
+    }
+
+    // same as scanTask() from the end of a scan to the next one
+    static void replayRoundEnd()
+    {
+      onAfterScan();
+      scan_rounds++;
+      byte onAfterScanStep = 0;
+      StageBusy busy( STAGE_ENRICH );
+      while ( true ) {
+        bool propagating = onAfterScanStep == PROPAGATE;
+        uint16_t slot = scan_cursor;
+        if ( !onAfterScanSteps( onAfterScanStep, scan_cursor ) ) break;
+        if ( propagating ) AdvTrace.propagated( slot );
+      }
+    }
+
+    static void synthCB( void * param = NULL )
+    {
+      uint16_t devices = param != NULL ? atoi( (const char*) param ) : 0;
+      xTaskCreatePinnedToCore(synthTask, "synthTask", 8192, (void*)(uintptr_t)devices, 1, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
+    }
+
+    static void synthTask( void * param = NULL )
+    {
+      uint16_t devices = (uint16_t)(uintptr_t)param;
+      if ( AdvTrace.isRecording() ) {
+        Serial.println("Can't generate a trace while recording");
+      } else {
+        uint32_t written = AdvTrace.synthesize( ADV_TRACE_PATH, devices );
+        Serial.printf("[Synth] %d advertisements written to %s, use 'replay' to run them\n", written, ADV_TRACE_PATH );
+      }
+      vTaskDelete( NULL );
+    }
+
+    static void statsCB( void * param = NULL )
+    {
+      if ( param != NULL && strcmp( (const char*)param, "reset" ) == 0 ) {
+        Probes.reset();
+        Persist.reset();
+        Serial.println("Latency probes reset");
+        return;
+      }
+      Probes.dump();
+      Probes.dumpStages();
+      Lock.dump();
+      Render.dump();
+      Persist.dump();
+      Avatars.dump();
+    }
+
+    static void persistCB( void * param = NULL )
+    {
+      if ( param != NULL ) {
+        bool async = strcmp( (const char*)param, "off" ) != 0;
+        if ( !async ) Persist.drain();
+        PersistAsync = async;
+      }
+      Serial.printf( "DB inserts run %s\n", PersistAsync ? "on the persist task" : "inline on the scan task" );
+    }
+
+    static void metricsCB( void * param = NULL )
+    {
+      bool json = param != NULL && strcmp( (const char*)param, "json" ) == 0;
+      Metrics.write( Serial, json ? METRICS_JSON : METRICS_PROMETHEUS );
+    }
+
+    static void topCB( void * param = NULL )
+    {
+      if ( param != NULL ) {
+        uint32_t seconds = atoi( (const char*) param );
+        TaskProfiler.startSampler( seconds );
+        Serial.printf( seconds > 0 ? "Task profiler will log every %d seconds\n" : "Task profiler stopped\n", seconds );
+        return;
+      }
+      TaskProfiler.top();
+    }
+
+    static void heapCB( void * param = NULL )
+    {
+      HeapTrace.dump();
+    }
+
     static void toggleFilterCB( void * param = NULL )
     {
       UI.filterVendors = ! UI.filterVendors;
       VendorFilterIcon.setStatus( UI.filterVendors ? ICON_STATUS_filter : ICON_STATUS_filter_unset );
-      UI.cacheStats(); // refresh icon
+      Render.cacheStats(); // refresh icon
       setPrefs(); // save prefs
       Serial.printf("UI.filterVendors = %s\n", UI.filterVendors ? "true" : "false" );
     }
@@ -955,14 +1185,14 @@ class BLEScanUtils
         if(! BLE_FS.exists( (const char*)param ) ) {
           Serial.printf("Directory %s does not exist\n", (const char*)param );
         } else {
-          takeMuxSemaphore();
+          takeDBLock();
           listDir(BLE_FS, (const char*)param, 0, DB.BLEMacsDbFSPath);
-          giveMuxSemaphore();
+          giveDBLock();
         }
       } else {
-        takeMuxSemaphore();
+        takeDBLock();
         listDir(BLE_FS, "/", 0, DB.BLEMacsDbFSPath);
-        giveMuxSemaphore();
+        giveDBLock();
       }
       if ( scanWasRunning ) startScanCB();
       isQuerying = false;
@@ -1059,6 +1289,16 @@ class BLEScanUtils
         { "toggle",        o->toggleCB,               "toggle a bool value" },
         { "resetDB",       o->resetCB,                "Hard Reset DB + forced restart" },
         { "pruneDB",       o->pruneCB,                "Soft Reset DB without restarting (hopefully)" },
+        { "beacons",       o->beaconsCB,              "Show decoded beacons and their telemetry" },
+        { "bench",         o->benchCB,                "Run the core micro benchmarks (pauses scan)" },
+        { "trace",         o->traceCB,                "Start/stop recording raw advertisements to the SD" },
+        { "replay",        o->replayCB,               "Replay the advertisements trace ('replay fast' for max speed, add 'pipeline' to run the scan cache, rendering and DB stages)" },
+        { "synth",         o->synthCB,                "Generate a synthetic trace of [n] devices (default 500, needs PSRam, see AdvSynthTool)" },
+        { "stats",         o->statsCB,                "Show pipeline latency histograms, stage utilization, lock contention, render/persist queues and avatar cache ('stats reset' to clear)" },
+        { "persist",       o->persistCB,              "Run DB inserts on the persist task or inline ('persist on|off')" },
+        { "metrics",       o->metricsCB,              "Print metrics in Prometheus format ('metrics json' for JSON)" },
+        { "top",           o->topCB,                  "Show CPU share and stack per task ('top [seconds]' to repeat, 'top 0' to stop)" },
+        { "heap",          o->heapCB,                 "Show heap fragmentation and traced allocations per tag" },
         #if HAS_EXTERNAL_RTC
           { "bleclock",      o->setTimeServerOn,        "Broadcast time to another BLE Device (implicit)" },
           { "bletime",       o->setTimeClientOn,        "Get time from another BLE Device (explicit)" },
@@ -1179,9 +1419,9 @@ class BLEScanUtils
     static void M5ButtonCheck( unsigned long &lastHidCheck )
     {
       if( lastHidCheck + 150 < millis() ) {
-        takeMuxSemaphore();
+        takeDisplayLock();
         M5.update();
-        giveMuxSemaphore();
+        giveDisplayLock();
         if( M5.BtnA.wasPressed() ) {
           UI.brightness -= UI.brightnessIncrement;
           setBrightnessCB();
@@ -1201,6 +1441,7 @@ class BLEScanUtils
     {
       UI.update(); // run after-scan display stuff
       DB.maintain();
+      Persist.init();
       scanTaskRunning = true;
       scanTaskStopped = false;
 
@@ -1217,6 +1458,7 @@ class BLEScanUtils
 
     static void scanDeInit()
     {
+      Persist.drain(); // callers expect the DB to be up to date once the scan is stopped
       scanTaskStopped = true;
       delete FoundDeviceCallback; FoundDeviceCallback = NULL;
     }
@@ -1226,13 +1468,20 @@ class BLEScanUtils
       scanInit();
       byte onAfterScanStep = 0;
       while ( scanTaskRunning ) {
-        if ( onAfterScanSteps( onAfterScanStep, scan_cursor ) ) continue;
+        {
+          StageBusy busy( STAGE_ENRICH );
+          if ( onAfterScanSteps( onAfterScanStep, scan_cursor ) ) continue;
+        }
         dumpStats("BeforeScan::");
         onBeforeScan();
-        pBLEScan->start(SCAN_DURATION);
+        {
+          HeapTraceScope trace( HEAP_TAG_BLE );
+          pBLEScan->start(SCAN_DURATION);
+        }
         onAfterScan();
         //DB.maintain();
         dumpStats("AfterScan:::");
+        Probes.logPeriodic();
         scan_rounds++;
       }
       scanDeInit();
@@ -1287,7 +1536,11 @@ class BLEScanUtils
         log_w("empty addess");
         return true; // end of cache
       }
+      LatencyProbe probe( PROBE_POPULATE );
+      bool dbLookup = !DB.hasPsram; // heap OUI/vendor caches fall back to sqlite, shared with the persist task
+      if ( dbLookup ) takeDBLock();
       populate( BLEDevScanCache[_scan_cursor] );
+      if ( dbLookup ) giveDBLock();
       return true;
     }
 
@@ -1302,11 +1555,22 @@ class BLEScanUtils
         onScanPostPopulated = true;
         return false;
       }
+      LatencyProbe probe( PROBE_IFEXISTS );
       int deviceIndexIfExists = -1;
       deviceIndexIfExists = getDeviceCacheIndex( BLEDevScanCache[_scan_cursor]->address );
+      if ( deviceIndexIfExists < 0 && BLEDevScanCache[_scan_cursor]->rpa_group != 0 ) {
+        deviceIndexIfExists = getGroupCacheIndex( BLEDevScanCache[_scan_cursor]->rpa_group );
+        if ( deviceIndexIfExists > -1 ) {
+          // rotated address of a cached device, merged under the cached address
+          log_d( "Device %d / %s is a rotation of %s", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevRAMCache[deviceIndexIfExists]->address );
+          BLEDevHelper.set( BLEDevScanCache[_scan_cursor], "address", BLEDevRAMCache[deviceIndexIfExists]->address );
+        }
+      }
       if ( deviceIndexIfExists > -1 ) {
         inCacheCount++;
+        Lock.cacheWriteBegin();
         BLEDevRAMCache[deviceIndexIfExists]->hits++;
+        BLEDevLRU.touch( deviceIndexIfExists );
         if ( TimeIsSet ) {
           if ( BLEDevRAMCache[deviceIndexIfExists]->created_at.year() <= 1970 ) {
             BLEDevRAMCache[deviceIndexIfExists]->created_at = nowDateTime;
@@ -1315,20 +1579,29 @@ class BLEScanUtils
         }
         BLEDevHelper.mergeItems( BLEDevScanCache[_scan_cursor], BLEDevRAMCache[deviceIndexIfExists] ); // merge scan data into existing psram cache
         BLEDevHelper.copyItem( BLEDevRAMCache[deviceIndexIfExists], BLEDevScanCache[_scan_cursor] ); // copy back merged data for rendering
+        BLEDevTopK.update( deviceIndexIfExists, BLEDevRAMCache[deviceIndexIfExists]->hits );
+        Lock.cacheWriteEnd();
         log_i( "Device %d / %s exists in cache, increased hits to %d", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
       } else {
         if ( BLEDevScanCache[_scan_cursor]->is_anonymous ) {
           // won't land in DB (won't be checked either) but will land in cache
-          uint16_t nextCacheIndex = BLEDevHelper.getNextCacheIndex( BLEDevRAMCache, BLEDevCacheIndex );
+          Lock.cacheWriteBegin();
+          uint16_t nextCacheIndex = BLEDevLRU.acquire();
           BLEDevHelper.reset( BLEDevRAMCache[nextCacheIndex] );
           BLEDevScanCache[_scan_cursor]->hits++;
           BLEDevHelper.copyItem( BLEDevScanCache[_scan_cursor], BLEDevRAMCache[nextCacheIndex] );
+          BLEDevTopK.update( nextCacheIndex, BLEDevRAMCache[nextCacheIndex]->hits );
+          Lock.cacheWriteEnd();
+          Avatars.warm( BLEDevScanCache[_scan_cursor]->address );
           log_v( "Device %d / %s is anonymous, won't be inserted", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
         } else {
-          deviceIndexIfExists = DB.deviceExists( BLEDevScanCache[_scan_cursor]->address ); // will load returning devices from DB if necessary
+          if ( Persist.isPending( BLEDevScanCache[_scan_cursor]->address ) ) {
+            Persist.drain(); // seen last round and not saved yet, don't insert it twice
+          }
+          takeDBLock();
+          deviceIndexIfExists = Backend.devices->exists( BLEDevScanCache[_scan_cursor]->address ); // will load returning devices from DB if necessary
+          giveDBLock();
           if (deviceIndexIfExists > -1) {
-            uint16_t nextCacheIndex = BLEDevHelper.getNextCacheIndex( BLEDevRAMCache, BLEDevCacheIndex );
-            BLEDevHelper.reset( BLEDevRAMCache[nextCacheIndex] );
             BLEDevDBCache->hits++;
             if ( TimeIsSet ) {
               if ( BLEDevDBCache->created_at.year() <= 1970 ) {
@@ -1337,7 +1610,14 @@ class BLEScanUtils
               BLEDevDBCache->updated_at = nowDateTime;
             }
             BLEDevHelper.mergeItems( BLEDevScanCache[_scan_cursor], BLEDevDBCache ); // merge scan data into BLEDevDBCache
+            Lock.cacheWriteBegin();
+            uint16_t nextCacheIndex = BLEDevLRU.acquire();
+            BLEDevLRU.touch( nextCacheIndex ); // returning device, skip probation
+            BLEDevHelper.reset( BLEDevRAMCache[nextCacheIndex] );
             BLEDevHelper.copyItem( BLEDevDBCache, BLEDevRAMCache[nextCacheIndex] ); // copy merged data to assigned psram cache
+            BLEDevTopK.update( nextCacheIndex, BLEDevRAMCache[nextCacheIndex]->hits );
+            Lock.cacheWriteEnd();
+            Avatars.warm( BLEDevDBCache->address );
             BLEDevHelper.copyItem( BLEDevDBCache, BLEDevScanCache[_scan_cursor] ); // copy back merged data for rendering
 
             log_v( "Device %d / %s is already in DB, increased hits to %d", _scan_cursor, BLEDevScanCache[_scan_cursor]->address, BLEDevScanCache[_scan_cursor]->hits );
@@ -1362,17 +1642,12 @@ class BLEScanUtils
         onScanRendered = true;
         return false;
       }
-      UI.BLECardTheme.setTheme( IN_CACHE_ANON );
-      BLEDevTmp = BLEDevScanCache[_scan_cursor];
-      UI.printBLECard( (BlueToothDeviceLink){.cacheIndex=_scan_cursor,.device=BLEDevTmp} ); // render
-      delay(1);
+      LatencyProbe probe( PROBE_RENDER );
+      Render.card( (BlueToothDeviceLink){.cacheIndex=_scan_cursor,.device=BLEDevScanCache[_scan_cursor]} ); // queued for the display task
       sprintf( processMessage, processTemplateLong, "Rendered ", _scan_cursor + 1, " / ", devicesCount );
-      UI.headerStats( processMessage );
-      delay(1);
-      UI.cacheStats();
-      delay(1);
-      UI.footerStats();
-      delay(1);
+      Render.header( processMessage );
+      Render.cacheStats();
+      Render.footer();
       return true;
     }
 
@@ -1386,34 +1661,36 @@ class BLEScanUtils
         log_v("done all");
         onScanPropagated = true;
         _scan_cursor = 0;
+        takeDBLock();
+        DBUtils::DBMessage beaconsInserted = DB.insertBeacons(); // stays here: the beacon table is fed by the scan callback
+        giveDBLock();
+        if ( beaconsInserted == DBUtils::INSERTION_FAILED ) {
+          log_e( "  [!!! BD INSERT FAIL !!!] Beacon telemetry could not be saved" );
+        }
+        Persist.roundEnd();
         return false;
       }
       //BLEDevScanCacheIndex = _scan_cursor;
       if ( isEmpty( BLEDevScanCache[_scan_cursor]->address ) ) {
         return true;
       }
+      LatencyProbe probe( PROBE_PROPAGATE );
       if ( BLEDevScanCache[_scan_cursor]->is_anonymous || BLEDevScanCache[_scan_cursor]->in_db ) { // don't DB-insert anon or duplicates
         sprintf( processMessage, processTemplateLong, "Released ", _scan_cursor + 1, " / ", devicesCount );
         if ( BLEDevScanCache[_scan_cursor]->is_anonymous ) AnonymousCacheHit++;
+        Render.header( processMessage );
       } else {
-        if ( DB.insertBTDevice( BLEDevScanCache[_scan_cursor] ) == DBUtils::INSERTION_SUCCESS ) {
-          sprintf( processMessage, processTemplateLong, "Saved ", _scan_cursor + 1, " / ", devicesCount );
-          log_d( "Device %d successfully inserted in DB", _scan_cursor );
-          entries++;
-        } else {
-          log_e( "  [!!! BD INSERT FAIL !!!] Device %d could not be inserted", _scan_cursor );
-          sprintf( processMessage, processTemplateLong, "Failed ", _scan_cursor + 1, " / ", devicesCount );
-        }
+        Persist.save( BLEDevScanCache[_scan_cursor], _scan_cursor, devicesCount ); // header is updated once saved
       }
       BLEDevHelper.reset( BLEDevScanCache[_scan_cursor] ); // discard
-      UI.headerStats( processMessage );
       return true;
     }
 
     static void onBeforeScan()
     {
+      if ( DB.maintenancePending() ) Persist.drain(); // maintenance may rotate or rewrite the DB
       DB.maintain();
-      UI.headerStats("Scan in progress");
+      Render.header("Scan in progress");
       UI.startBlink();
       processedDevicesCount = 0;
       devicesCount = 0;
@@ -1425,15 +1702,17 @@ class BLEScanUtils
       onScanPostPopulated = false;
       onScanRendered = false;
       foundTimeServer = false;
+      RPAGroups.scanBegin( millis() );
     }
 
     static void onAfterScan()
     {
+      RPAGroups.scanEnd(); // the processing gap until the next scan doesn't count as silence
       UI.stopBlink();
       if ( foundTimeServer && (!TimeIsSet || ForceBleTime) ) {
         if( ! timeClientisStarted ) {
           if( timeServerBLEAddress != "" ) {
-            UI.headerStats("BLE Time sync ...");
+            Render.header("BLE Time sync ...");
             log_w("HOBO mode: found a peer with time provider service, launching BLE TimeClient Task");
             xTaskCreatePinnedToCore(startTimeClient, "startTimeClient", 2048, NULL, 0, NULL, TASKLAUNCHER_CORE ); /* last = Task Core */
             while( scanTaskRunning ) {
@@ -1443,7 +1722,7 @@ class BLEScanUtils
           }
         }
       }
-      UI.headerStats("Showing results ...");
+      Render.header("Showing results ...");
       devicesCount = processedDevicesCount;
       BLEDevice::getScan()->clearResults();
       if ( devicesCount < MAX_DEVICES_PER_SCAN ) {
@@ -1465,6 +1744,7 @@ class BLEScanUtils
       onScanDone = true;
       scan_cursor = 0;
       UI.update();
+      Persist.roundBegin( devicesCount );
     }
 
     static int getDeviceCacheIndex(const char* address)
@@ -1476,7 +1756,17 @@ class BLEScanUtils
           log_v("[CACHE HIT] BLEDevCache ID #%s has %d cache hits", address, BLEDevRAMCache[i]->hits);
           return i;
         }
-        delay(1);
+      }
+      return -1;
+    }
+
+    static int getGroupCacheIndex( uint32_t rpaGroup )
+    {
+      for (int i = 0; i < BLEDEVCACHE_SIZE; i++) {
+        if ( BLEDevRAMCache[i]->rpa_group == rpaGroup ) {
+          BLEDevCacheHit++;
+          return i;
+        }
       }
       return -1;
     }
@@ -1503,7 +1793,7 @@ class BLEScanUtils
       }
       lastheap = freeheap;
       lastscanduration = SCAN_DURATION;
-      log_i("%s[Scan#%02d][%s][Duration%s%d][Processed:%d of %d][Heap%s%d / %d] [Cache hits][BLEDevCards:%d][Anonymous:%d][Oui:%d][Vendor:%d]",
+      log_i("%s[Scan#%02d][%s][Duration%s%d][Processed:%d of %d][Heap%s%d / %d] [Cache hits][BLEDevCards:%d][Anonymous:%d][Oui:%d][Vendor:%d] [Cache evictions:%d promotions:%d protected:%d][RPA groups:%d rotations:%d][Duplicates:%d]",
         prefixStr,
         scan_rounds,
         hhmmssString,
@@ -1517,7 +1807,13 @@ class BLEScanUtils
         BLEDevCacheHit,
         AnonymousCacheHit,
         OuiCacheHit,
-        VendorCacheHit
+        VendorCacheHit,
+        BLEDevCacheEvictions,
+        BLEDevCachePromotions,
+        BLEDevLRU.protectedCount(),
+        RPAGroups.groupedCount(),
+        RPARotationsCount,
+        AdvDuplicatesCount
       );
     }
 
@@ -1560,12 +1856,12 @@ class BLEScanUtils
     {
       if ( strcmp( CacheItem->ouiname, "[unpopulated]" ) == 0 ) {
         log_d("  [populating OUI for %s]", CacheItem->address);
-        DB.getOUI( CacheItem->address, CacheItem->ouiname );
+        Backend.vendors->oui( CacheItem->address, CacheItem->ouiname );
       }
       if ( strcmp( CacheItem->manufname, "[unpopulated]" ) == 0 ) {
         if ( CacheItem->manufid != -1 ) {
           log_d("  [populating Vendor for :%d]", CacheItem->manufid );
-          DB.getVendor( CacheItem->manufid, CacheItem->manufname );
+          Backend.vendors->vendor( CacheItem->manufid, CacheItem->manufname );
         } else {
           BLEDevHelper.set( CacheItem, "manufname", '\0');
         }
@@ -0,0 +1,556 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Beacon decoding stage
+ *
+ * Every advertisement payload is handed to the BeaconDecoders[] table, the
+ * first decoder to recognize the payload fills a typed BeaconFrame. Decoded
+ * frames are kept in a fixed size BeaconTable along with a short history of
+ * the Eddystone telemetry (battery, temperature, counters), the table is
+ * flushed to the beacons DB table after each scan.
+ *
+ * The table is written from the scan callback and flushed from the scan
+ * task: both sides go through BeaconMux, the flush works on snapshots so
+ * no update gets lost between the copy and the dirty flag reset. A beacon
+ * only sending TLM frames has no identity yet and is not flushed until an
+ * identity frame shows up.
+ *
+ * Nothing in here allocates memory: payloads are parsed in place and all
+ * storage is static.
+ *
+ */
+
+#ifndef BEACON_TABLE_SIZE // override this from Settings.h
+#define BEACON_TABLE_SIZE 16 // how many beacons are tracked
+#endif
+#ifndef BEACON_TLM_HISTORY_SIZE // override this from Settings.h
+#define BEACON_TLM_HISTORY_SIZE 8 // how many telemetry samples are kept per beacon
+#endif
+#define BEACON_URL_LEN 64 // max length of a decoded Eddystone URL
+#define BEACON_IDENT_LEN 80 // max length of a beacon identity string (see describe())
+
+#define EDDYSTONE_TLM_TEMP_UNSUPPORTED (int16_t)0x8000
+
+enum BeaconType : uint8_t
+{
+  BEACON_NONE = 0,
+  BEACON_IBEACON,
+  BEACON_ALTBEACON,
+  BEACON_EDDYSTONE_UID,
+  BEACON_EDDYSTONE_URL,
+  BEACON_EDDYSTONE_TLM,
+  BEACON_EDDYSTONE_EID
+};
+
+static const char* BeaconTypeNames[] =
+{
+  "None",
+  "iBeacon",
+  "AltBeacon",
+  "Eddystone-UID",
+  "Eddystone-URL",
+  "Eddystone-TLM",
+  "Eddystone-EID"
+};
+
+struct iBeaconFrame
+{
+  uint8_t  uuid[16];
+  uint16_t major;
+  uint16_t minor;
+  int8_t   txPower; // measured power at 1m
+};
+
+struct AltBeaconFrame
+{
+  uint16_t manufid;
+  uint8_t  beaconId[20];
+  int8_t   refRSSI; // reference RSSI at 1m
+  uint8_t  reserved;
+};
+
+struct EddystoneUIDFrame
+{
+  int8_t  txPower; // calibrated power at 0m
+  uint8_t nid[10]; // namespace
+  uint8_t bid[6];  // instance
+};
+
+struct EddystoneURLFrame
+{
+  int8_t txPower; // calibrated power at 0m
+  char   url[BEACON_URL_LEN+1];
+};
+
+struct EddystoneTLMFrame
+{
+  uint8_t  version;
+  uint16_t vbatt;    // mV, 0 = not supported
+  int16_t  temp;     // 8.8 fixed point Celsius, 0x8000 = not supported
+  uint32_t advCount; // advertisements since boot
+  uint32_t secCount; // 0.1s resolution time since boot
+};
+
+struct EddystoneEIDFrame
+{
+  int8_t  txPower; // calibrated power at 0m
+  uint8_t eid[8];
+};
+
+struct BeaconFrame
+{
+  BeaconType type = BEACON_NONE;
+  union {
+    iBeaconFrame      iBeacon;
+    AltBeaconFrame    altBeacon;
+    EddystoneUIDFrame uid;
+    EddystoneURLFrame url;
+    EddystoneTLMFrame tlm;
+    EddystoneEIDFrame eid;
+  };
+};
+
+struct BeaconTLMSample
+{
+  uint32_t seenAt;   // uptime (seconds) when the sample was received
+  uint16_t vbatt;
+  int16_t  temp;
+  uint32_t advCount;
+  uint32_t secCount;
+};
+
+struct BeaconTableEntry
+{
+  uint8_t  address[6]; // native (LSB first) address
+  bool     inUse    = false;
+  bool     dirty    = false; // has unsaved data
+  int8_t   rssi     = 0;
+  uint32_t seen     = 0; // frames received
+  uint32_t lastSeen = 0; // uptime (seconds)
+  BeaconFrame frame;     // last identity frame (anything but TLM)
+  BeaconTLMSample tlm[BEACON_TLM_HISTORY_SIZE]; // circular telemetry history
+  uint8_t  tlmIndex = 0; // next write position in tlm[]
+  uint8_t  tlmCount = 0; // valid samples in tlm[]
+};
+
+static BeaconTableEntry BeaconTable[BEACON_TABLE_SIZE];
+static portMUX_TYPE BeaconMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t BeaconFramesCount = 0; // for statistics
+
+typedef bool (*BeaconDecoderCb)( const uint8_t* payload, size_t len, BeaconFrame* frame );
+
+struct BeaconDecoder
+{
+  const char*     name;
+  BeaconDecoderCb decode;
+};
+
+
+// finds the next AD structure of the given type, starting at offset (updated)
+static bool adStructureNext( const uint8_t* payload, size_t len, size_t &offset, uint8_t adType, const uint8_t* &data, uint8_t &dataLen )
+{
+  while( offset < len ) {
+    uint8_t fieldLen = payload[offset];
+    if( fieldLen == 0 || offset + 1 + fieldLen > len ) return false; // end of significant part or malformed
+    uint8_t fieldType = payload[offset+1];
+    size_t fieldOffset = offset;
+    offset += 1 + fieldLen;
+    if( fieldType == adType ) {
+      data    = &payload[fieldOffset+2];
+      dataLen = fieldLen - 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint16_t readUInt16BE( const uint8_t* data )
+{
+  return (data[0] << 8) | data[1];
+}
+
+static uint32_t readUInt32BE( const uint8_t* data )
+{
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+#define AD_TYPE_SERVICE_DATA_16 0x16
+#define AD_TYPE_MANUFACTURER_DATA 0xFF
+
+
+static bool iBeaconDecode( const uint8_t* payload, size_t len, BeaconFrame* frame )
+{
+  size_t offset = 0;
+  const uint8_t* data; uint8_t dataLen;
+  while( adStructureNext( payload, len, offset, AD_TYPE_MANUFACTURER_DATA, data, dataLen ) ) {
+    // Apple company id (0x004C) + type 0x02 + length 0x15
+    if( dataLen < 25 || data[0] != 0x4C || data[1] != 0x00 || data[2] != 0x02 || data[3] != 0x15 ) continue;
+    frame->type = BEACON_IBEACON;
+    memcpy( frame->iBeacon.uuid, &data[4], 16 );
+    frame->iBeacon.major   = readUInt16BE( &data[20] );
+    frame->iBeacon.minor   = readUInt16BE( &data[22] );
+    frame->iBeacon.txPower = (int8_t)data[24];
+    return true;
+  }
+  return false;
+}
+
+
+static bool altBeaconDecode( const uint8_t* payload, size_t len, BeaconFrame* frame )
+{
+  size_t offset = 0;
+  const uint8_t* data; uint8_t dataLen;
+  while( adStructureNext( payload, len, offset, AD_TYPE_MANUFACTURER_DATA, data, dataLen ) ) {
+    // any company id + beacon code 0xBEAC
+    if( dataLen < 26 || data[2] != 0xBE || data[3] != 0xAC ) continue;
+    frame->type = BEACON_ALTBEACON;
+    frame->altBeacon.manufid  = data[0] | (data[1] << 8);
+    memcpy( frame->altBeacon.beaconId, &data[4], 20 );
+    frame->altBeacon.refRSSI  = (int8_t)data[24];
+    frame->altBeacon.reserved = data[25];
+    return true;
+  }
+  return false;
+}
+
+
+static const char* EddystoneURLSchemes[] = { "http://www.", "https://www.", "http://", "https://" };
+static const char* EddystoneURLExpansions[] = {
+  ".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/",
+  ".com",  ".org",  ".edu",  ".net",  ".info",  ".biz",  ".gov"
+};
+
+static void eddystoneURLAppend( char* url, size_t &urlLen, const char* str )
+{
+  while( *str && urlLen < BEACON_URL_LEN ) {
+    url[urlLen++] = *str++;
+  }
+  url[urlLen] = '\0';
+}
+
+static bool eddystoneDecode( const uint8_t* payload, size_t len, BeaconFrame* frame )
+{
+  size_t offset = 0;
+  const uint8_t* data; uint8_t dataLen;
+  while( adStructureNext( payload, len, offset, AD_TYPE_SERVICE_DATA_16, data, dataLen ) ) {
+    // Eddystone service UUID 0xFEAA (little endian) + frame type
+    if( dataLen < 3 || data[0] != 0xAA || data[1] != 0xFE ) continue;
+    const uint8_t* ed = &data[2];
+    uint8_t edLen = dataLen - 2;
+    switch( ed[0] ) {
+      case 0x00: // UID
+        if( edLen < 18 ) return false;
+        frame->type = BEACON_EDDYSTONE_UID;
+        frame->uid.txPower = (int8_t)ed[1];
+        memcpy( frame->uid.nid, &ed[2], 10 );
+        memcpy( frame->uid.bid, &ed[12], 6 );
+        return true;
+      case 0x10: // URL
+      {
+        if( edLen < 3 || ed[2] >= 4 ) return false;
+        frame->type = BEACON_EDDYSTONE_URL;
+        frame->url.txPower = (int8_t)ed[1];
+        size_t urlLen = 0;
+        frame->url.url[0] = '\0';
+        eddystoneURLAppend( frame->url.url, urlLen, EddystoneURLSchemes[ed[2]] );
+        for( uint8_t i=3; i<edLen; i++ ) {
+          if( ed[i] < 14 ) {
+            eddystoneURLAppend( frame->url.url, urlLen, EddystoneURLExpansions[ed[i]] );
+          } else if( ed[i] > 0x20 && ed[i] < 0x7f ) {
+            char c[2] = { (char)ed[i], '\0' };
+            eddystoneURLAppend( frame->url.url, urlLen, c );
+          }
+        }
+        return true;
+      }
+      case 0x20: // TLM
+        if( edLen < 14 || ed[1] != 0x00 ) return false; // only unencrypted TLM is supported
+        frame->type = BEACON_EDDYSTONE_TLM;
+        frame->tlm.version  = ed[1];
+        frame->tlm.vbatt    = readUInt16BE( &ed[2] );
+        frame->tlm.temp     = (int16_t)readUInt16BE( &ed[4] );
+        frame->tlm.advCount = readUInt32BE( &ed[6] );
+        frame->tlm.secCount = readUInt32BE( &ed[10] );
+        return true;
+      case 0x30: // EID
+        if( edLen < 10 ) return false;
+        frame->type = BEACON_EDDYSTONE_EID;
+        frame->eid.txPower = (int8_t)ed[1];
+        memcpy( frame->eid.eid, &ed[2], 8 );
+        return true;
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+
+static const BeaconDecoder BeaconDecoders[] =
+{
+  { "iBeacon",   iBeaconDecode },
+  { "AltBeacon", altBeaconDecode },
+  { "Eddystone", eddystoneDecode },
+};
+
+static const size_t BeaconDecodersCount = sizeof BeaconDecoders / sizeof BeaconDecoders[0];
+
+
+class BeaconUtils
+{
+  public:
+
+    // runs the decoder table against a raw advertisement payload
+    static bool decode( const uint8_t* payload, size_t len, BeaconFrame* frame )
+    {
+      if( payload == NULL || len == 0 ) return false;
+      for( size_t i=0; i<BeaconDecodersCount; i++ ) {
+        if( BeaconDecoders[i].decode( payload, len, frame ) ) {
+          log_v("[%s] decoded %s frame", BeaconDecoders[i].name, BeaconTypeNames[frame->type] );
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static void onAdvertisement( BLEAdvertisedDevice *advertisedDevice )
+    {
+      BeaconFrame frame;
+      if( !decode( advertisedDevice->getPayload(), advertisedDevice->getPayloadLength(), &frame ) ) return;
+      update( advertisedDevice->getAddress().getNative(), advertisedDevice->getRSSI(), &frame );
+    }
+
+    // stores a decoded frame in the beacon table, evicts the least recently seen beacon when full
+    static BeaconTableEntry* update( const uint8_t* address, int rssi, const BeaconFrame* frame )
+    {
+      uint32_t now = millis() / 1000;
+      portENTER_CRITICAL( &BeaconMux );
+      BeaconTableEntry* entry = NULL;
+      BeaconTableEntry* oldest = &BeaconTable[0];
+      for( uint16_t i=0; i<BEACON_TABLE_SIZE; i++ ) {
+        if( !BeaconTable[i].inUse ) {
+          if( entry == NULL ) entry = &BeaconTable[i];
+          continue;
+        }
+        if( memcmp( BeaconTable[i].address, address, 6 ) == 0 ) {
+          entry = &BeaconTable[i];
+          break;
+        }
+        if( BeaconTable[i].lastSeen < oldest->lastSeen ) {
+          oldest = &BeaconTable[i];
+        }
+      }
+      if( entry == NULL ) entry = oldest;
+      if( !entry->inUse || memcmp( entry->address, address, 6 ) != 0 ) {
+        *entry = BeaconTableEntry();
+        memcpy( entry->address, address, 6 );
+        entry->inUse = true;
+      }
+      if( frame->type == BEACON_EDDYSTONE_TLM ) {
+        BeaconTLMSample &sample = entry->tlm[entry->tlmIndex];
+        sample.seenAt   = now;
+        sample.vbatt    = frame->tlm.vbatt;
+        sample.temp     = frame->tlm.temp;
+        sample.advCount = frame->tlm.advCount;
+        sample.secCount = frame->tlm.secCount;
+        entry->tlmIndex = (entry->tlmIndex + 1) % BEACON_TLM_HISTORY_SIZE;
+        if( entry->tlmCount < BEACON_TLM_HISTORY_SIZE ) entry->tlmCount++;
+      } else {
+        entry->frame = *frame;
+      }
+      entry->rssi     = rssi;
+      entry->lastSeen = now;
+      entry->seen++;
+      entry->dirty = true;
+      BeaconFramesCount++;
+      portEXIT_CRITICAL( &BeaconMux );
+      return entry;
+    }
+
+    static bool isIdentified( const BeaconTableEntry* entry )
+    {
+      return entry->frame.type != BEACON_NONE;
+    }
+
+    // true when at least one identified beacon has unsaved data
+    static bool hasDirty()
+    {
+      bool ret = false;
+      portENTER_CRITICAL( &BeaconMux );
+      for( uint16_t i=0; i<BEACON_TABLE_SIZE && !ret; i++ ) {
+        ret = BeaconTable[i].inUse && BeaconTable[i].dirty && isIdentified( &BeaconTable[i] );
+      }
+      portEXIT_CRITICAL( &BeaconMux );
+      return ret;
+    }
+
+    // copies an identified beacon with unsaved data and clears its dirty flag in the same critical section
+    static bool takeDirty( uint16_t index, BeaconTableEntry &copy )
+    {
+      bool ret = false;
+      portENTER_CRITICAL( &BeaconMux );
+      BeaconTableEntry* entry = &BeaconTable[index];
+      if( entry->inUse && entry->dirty && isIdentified( entry ) ) {
+        copy = *entry;
+        entry->dirty = false;
+        ret = true;
+      }
+      portEXIT_CRITICAL( &BeaconMux );
+      return ret;
+    }
+
+    // flags a snapshot taken with takeDirty() as unsaved again, unless the slot went to another beacon since
+    static void markDirty( uint16_t index, const uint8_t* address )
+    {
+      portENTER_CRITICAL( &BeaconMux );
+      BeaconTableEntry* entry = &BeaconTable[index];
+      if( entry->inUse && memcmp( entry->address, address, 6 ) == 0 ) entry->dirty = true;
+      portEXIT_CRITICAL( &BeaconMux );
+    }
+
+    static bool snapshot( uint16_t index, BeaconTableEntry &copy )
+    {
+      portENTER_CRITICAL( &BeaconMux );
+      copy = BeaconTable[index];
+      portEXIT_CRITICAL( &BeaconMux );
+      return copy.inUse;
+    }
+
+    // most recent telemetry sample or NULL
+    static const BeaconTLMSample* lastTLM( const BeaconTableEntry* entry )
+    {
+      if( entry->tlmCount == 0 ) return NULL;
+      return &entry->tlm[ (entry->tlmIndex + BEACON_TLM_HISTORY_SIZE - 1) % BEACON_TLM_HISTORY_SIZE ];
+    }
+
+    static float TLMTemperature( int16_t temp )
+    {
+      return temp / 256.0f;
+    }
+
+    static void addressToString( const uint8_t* address, char* out )
+    {
+      sprintf( out, "%02x:%02x:%02x:%02x:%02x:%02x", address[5], address[4], address[3], address[2], address[1], address[0] );
+    }
+
+    // human readable beacon identity, out must hold BEACON_IDENT_LEN+1 chars
+    static void describe( const BeaconFrame* frame, char* out )
+    {
+      const uint8_t* b;
+      switch( frame->type ) {
+        case BEACON_IBEACON:
+          b = frame->iBeacon.uuid;
+          snprintf( out, BEACON_IDENT_LEN+1, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x %d/%d",
+            b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], b[8], b[9], b[10], b[11], b[12], b[13], b[14], b[15],
+            frame->iBeacon.major, frame->iBeacon.minor
+          );
+        break;
+        case BEACON_ALTBEACON:
+          b = frame->altBeacon.beaconId;
+          snprintf( out, BEACON_IDENT_LEN+1, "%04x:%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
+            frame->altBeacon.manufid, b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], b[8], b[9],
+            b[10], b[11], b[12], b[13], b[14], b[15], b[16], b[17], b[18], b[19]
+          );
+        break;
+        case BEACON_EDDYSTONE_UID:
+          b = frame->uid.nid;
+          snprintf( out, BEACON_IDENT_LEN+1, "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x:%02x%02x%02x%02x%02x%02x",
+            b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], b[8], b[9],
+            frame->uid.bid[0], frame->uid.bid[1], frame->uid.bid[2], frame->uid.bid[3], frame->uid.bid[4], frame->uid.bid[5]
+          );
+        break;
+        case BEACON_EDDYSTONE_URL:
+          snprintf( out, BEACON_IDENT_LEN+1, "%s", frame->url.url );
+        break;
+        case BEACON_EDDYSTONE_EID:
+          b = frame->eid.eid;
+          snprintf( out, BEACON_IDENT_LEN+1, "%02x%02x%02x%02x%02x%02x%02x%02x", b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7] );
+        break;
+        default:
+          *out = '\0';
+        break;
+      }
+    }
+
+    static int8_t txPower( const BeaconFrame* frame )
+    {
+      switch( frame->type ) {
+        case BEACON_IBEACON:       return frame->iBeacon.txPower;
+        case BEACON_ALTBEACON:     return frame->altBeacon.refRSSI;
+        case BEACON_EDDYSTONE_UID: return frame->uid.txPower;
+        case BEACON_EDDYSTONE_URL: return frame->url.txPower;
+        case BEACON_EDDYSTONE_EID: return frame->eid.txPower;
+        default:                   return 0;
+      }
+    }
+
+    static uint16_t count()
+    {
+      uint16_t total = 0;
+      for( uint16_t i=0; i<BEACON_TABLE_SIZE; i++ ) {
+        if( BeaconTable[i].inUse ) total++;
+      }
+      return total;
+    }
+
+    static void dump()
+    {
+      char address[MAC_LEN+1];
+      char ident[BEACON_IDENT_LEN+1];
+      Serial.printf("\nBeacons: %d tracked, %u frames decoded\n\n", count(), BeaconFramesCount );
+      BeaconTableEntry copy;
+      for( uint16_t i=0; i<BEACON_TABLE_SIZE; i++ ) {
+        if( !snapshot( i, copy ) ) continue;
+        BeaconTableEntry* entry = &copy;
+        addressToString( entry->address, address );
+        describe( &entry->frame, ident );
+        Serial.printf("  %s %-14s rssi:%4d seen:%6u %s\n", address, BeaconTypeNames[entry->frame.type], entry->rssi, entry->seen, ident );
+        for( uint8_t j=0; j<entry->tlmCount; j++ ) {
+          const BeaconTLMSample* s = &entry->tlm[ (entry->tlmIndex + BEACON_TLM_HISTORY_SIZE - entry->tlmCount + j) % BEACON_TLM_HISTORY_SIZE ];
+          if( s->temp == EDDYSTONE_TLM_TEMP_UNSUPPORTED ) {
+            Serial.printf("      [%6us] batt:%5umV temp:    n/a adv:%8u up:%8us\n", s->seenAt, s->vbatt, s->advCount, s->secCount/10 );
+          } else {
+            Serial.printf("      [%6us] batt:%5umV temp:%6.2fC adv:%8u up:%8us\n", s->seenAt, s->vbatt, TLMTemperature( s->temp ), s->advCount, s->secCount/10 );
+          }
+        }
+      }
+      Serial.println();
+    }
+
+};
+
+
+BeaconUtils Beacons;
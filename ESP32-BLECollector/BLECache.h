@@ -59,55 +59,6 @@
 
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
-struct BLEGATTService
-{
-  const char* name;
-  const char* type;
-  uint32_t    assignedNumber;
-};
-
-static const BLEGATTService BLE_unknownService = {"Unknown", "", 0 };
-
-static const BLEGATTService BLE_gattServices[] =
-{
-  {"Alert Notification Service",    "org.bluetooth.service.alert_notification",             0x1811},
-  {"Automation IO",                 "org.bluetooth.service.automation_io",                  0x1815},
-  {"Battery Service",               "org.bluetooth.service.battery_service",                0x180F},
-  {"Blood Pressure",                "org.bluetooth.service.blood_pressure",                 0x1810},
-  {"Body Composition",              "org.bluetooth.service.body_composition",               0x181B},
-  {"Bond Management",               "org.bluetooth.service.bond_management",                0x181E},
-  {"Continuous Glucose Monitoring", "org.bluetooth.service.continuous_glucose_monitoring",  0x181F},
-  {"Current Time Service",          "org.bluetooth.service.current_time",                   0x1805},
-  {"Cycling Power",                 "org.bluetooth.service.cycling_power",                  0x1818},
-  {"Cycling Speed and Cadence",     "org.bluetooth.service.cycling_speed_and_cadence",      0x1816},
-  {"Device Information",            "org.bluetooth.service.device_information",             0x180A},
-  {"Environmental Sensing",         "org.bluetooth.service.environmental_sensing",          0x181A},
-  {"Generic Access",                "org.bluetooth.service.generic_access",                 0x1800},
-  {"Generic Attribute",             "org.bluetooth.service.generic_attribute",              0x1801},
-  {"Glucose",                       "org.bluetooth.service.glucose",                        0x1808},
-  {"Health Thermometer",            "org.bluetooth.service.health_thermometer",             0x1809},
-  {"Heart Rate",                    "org.bluetooth.service.heart_rate",                     0x180D},
-  {"HTTP Proxy",                    "org.bluetooth.service.http_proxy",                     0x1823},
-  {"Human Interface Device",        "org.bluetooth.service.human_interface_device",         0x1812},
-  {"Immediate Alert",               "org.bluetooth.service.immediate_alert",                0x1802},
-  {"Indoor Positioning",            "org.bluetooth.service.indoor_positioning",             0x1821},
-  {"Internet Protocol Support",     "org.bluetooth.service.internet_protocol_support",      0x1820},
-  {"Link Loss",                     "org.bluetooth.service.link_loss",                      0x1803},
-  {"Location and Navigation",       "org.bluetooth.service.location_and_navigation",        0x1819},
-  {"Next DST Change Service",       "org.bluetooth.service.next_dst_change",                0x1807},
-  {"Object Transfer",               "org.bluetooth.service.object_transfer",                0x1825},
-  {"Phone Alert Status Service",    "org.bluetooth.service.phone_alert_status",             0x180E},
-  {"Pulse Oximeter",                "org.bluetooth.service.pulse_oximeter",                 0x1822},
-  {"Reference Time Update Service", "org.bluetooth.service.reference_time_update",          0x1806},
-  {"Running Speed and Cadence",     "org.bluetooth.service.running_speed_and_cadence",      0x1814},
-  {"Scan Parameters",               "org.bluetooth.service.scan_parameters",                0x1813},
-  {"Transport Discovery",           "org.bluetooth.service.transport_discovery",            0x1824},
-  {"Tx Power",                      "org.bluetooth.service.tx_power",                       0x1804},
-  {"User Data",                     "org.bluetooth.service.user_data",                      0x181C},
-  {"Weight Scale",                  "org.bluetooth.service.weight_scale",                   0x181D},
-  BLE_unknownService // terminator
-};
-
 static bool isEmpty(const char* str )
 {
   if ( !str ) return true;
@@ -151,12 +102,31 @@ static int scan_rounds = 0; // how many scans
 static uint16_t scan_cursor = 0; // what scan index is being processed
 
 static uint16_t BLEDevCacheUsed = 0; // for statistics
+static uint32_t BLEDevCacheEvictions = 0; // for statistics
+static uint32_t BLEDevCachePromotions = 0; // for statistics
 static uint16_t VendorCacheUsed = 0; // for statistics
 static uint16_t OuiCacheUsed = 0; // for statistics
 
 static DateTime lastSyncDateTime;
 static DateTime nowDateTime;
 
+#define BLEDEVSTATS_ALPHA 0.125f // EWMA smoothing factor for RSSI and advertising interval
+#define BLEDEVSTATS_MIN_INTERVAL_MS 20    // shortest legal advertising interval, anything below is a scan response
+#define BLEDEVSTATS_MAX_INTERVAL_MS 10240 // longest legal advertising interval, anything above is a scan pause
+
+// online advertising statistics, constant size per device
+struct BlueToothDeviceStats
+{
+  uint32_t firstSeen;   // millis
+  uint32_t lastSeen;    // millis
+  uint32_t samples;     // advertisements accounted
+  uint32_t intervals;   // inter-arrival samples accounted
+  float    intervalAvg; // EWMA of the advertising interval (ms)
+  float    intervalVar; // EW variance of the advertising interval (jitter = sqrt)
+  float    rssiAvg;     // EWMA of the RSSI (dBm)
+  float    rssiVar;     // EW variance of the RSSI
+};
+
 struct BlueToothDevice
 {
   bool in_db          = false;
@@ -166,6 +136,7 @@ struct BlueToothDevice
   int rssi            = 0; // RSSI
   int manufid         = -1;// manufacturer data (or ID)
   uint8_t addr_type;
+  uint32_t rpa_group  = 0; // RPAGroups id of a rotating address, 0 = not grouped
   char* name      = NULL;// device name
   char* address   = NULL;// device mac address
   char* ouiname   = NULL;// oui vendor name (from mac address, see oui.h)
@@ -173,6 +144,7 @@ struct BlueToothDevice
   char* uuid      = NULL;// service uuid
   DateTime created_at = 0;
   DateTime updated_at = 0;
+  BlueToothDeviceStats stats;
 };
 
 struct BlueToothDeviceLink
@@ -204,8 +176,6 @@ static void copy(char* dest, const char* source, byte maxlen)
   }
 }
 
-BLEUUID checkUrlUUID = (uint16_t)0xfeaa;
-
 
 class BlueToothDeviceHelper
 {
@@ -219,6 +189,7 @@ class BlueToothDeviceHelper
       CacheItem->appearance = 0;
       CacheItem->rssi       = 0;
       CacheItem->manufid    = -1;
+      CacheItem->rpa_group  = 0;
       if( hasPsram ) {
         CacheItem->name      = (char*)ps_calloc(MAX_FIELD_LEN+1, sizeof(char));
         CacheItem->address   = (char*)ps_calloc(MAC_LEN+1, sizeof(char));
@@ -234,6 +205,7 @@ class BlueToothDeviceHelper
       }
       CacheItem->created_at = 0;
       CacheItem->updated_at = 0;
+      memset( &CacheItem->stats, 0, sizeof( BlueToothDeviceStats ) );
     }
 
     static void reset( BlueToothDevice *CacheItem )
@@ -244,6 +216,7 @@ class BlueToothDeviceHelper
       CacheItem->appearance = 0;
       CacheItem->rssi       = 0;
       CacheItem->manufid    = -1;
+      CacheItem->rpa_group  = 0;
       memset( CacheItem->name,      0, MAX_FIELD_LEN+1 );
       memset( CacheItem->address,   0, MAC_LEN+1 );
       memset( CacheItem->ouiname,   0, MAX_FIELD_LEN+1 );
@@ -251,6 +224,7 @@ class BlueToothDeviceHelper
       memset( CacheItem->uuid,      0, MAX_FIELD_LEN+1 );
       CacheItem->created_at = 0;
       CacheItem->updated_at = 0;
+      memset( &CacheItem->stats, 0, sizeof( BlueToothDeviceStats ) );
     }
 
     static void set( BlueToothDevice *CacheItem, const char* prop, bool val )
@@ -312,6 +286,7 @@ class BlueToothDeviceHelper
       if(overwrite) set( DestItem, "hits",         SourceItem->hits );
       if(overwrite) set( DestItem, "rssi",         SourceItem->rssi );
       if(overwrite) set( DestItem, "addr_type",    SourceItem->addr_type );
+      if(overwrite || DestItem->rpa_group==0)             DestItem->rpa_group = SourceItem->rpa_group;
       if(overwrite || DestItem->appearance==0)            set( DestItem, "appearance", SourceItem->appearance );
       if(overwrite || DestItem->manufid==-1)              set( DestItem, "manufid",    SourceItem->manufid );
       if(overwrite || isEmpty(DestItem->name))            set( DestItem, "name",       SourceItem->name );
@@ -320,6 +295,75 @@ class BlueToothDeviceHelper
       if(overwrite || DestItem->uuid==0)                  set( DestItem, "uuid",       SourceItem->uuid );
       if(overwrite || DestItem->created_at.unixtime()==0) set( DestItem, "created_at", SourceItem->created_at );
       if(overwrite || DestItem->updated_at.unixtime()==0) set( DestItem, "updated_at", SourceItem->updated_at );
+      if(overwrite) DestItem->stats = SourceItem->stats;
+      else          statsMerge( &SourceItem->stats, &DestItem->stats );
+    }
+
+    // feeds one advertisement to the estimator
+    static void statsUpdate( BlueToothDeviceStats *stats, uint32_t now, int rssi )
+    {
+      if( stats->samples == 0 ) {
+        stats->firstSeen = now;
+        stats->rssiAvg   = rssi;
+        stats->rssiVar   = 0;
+      } else {
+        uint32_t interval = now - stats->lastSeen;
+        if( interval >= BLEDEVSTATS_MIN_INTERVAL_MS && interval <= BLEDEVSTATS_MAX_INTERVAL_MS ) {
+          if( stats->intervals == 0 ) {
+            stats->intervalAvg = interval;
+            stats->intervalVar = 0;
+          } else {
+            ewma( stats->intervalAvg, stats->intervalVar, interval );
+          }
+          stats->intervals++;
+        }
+        ewma( stats->rssiAvg, stats->rssiVar, rssi );
+      }
+      stats->lastSeen = now;
+      stats->samples++;
+    }
+
+    // merges fresh scan statistics into a cached device
+    static void statsMerge( const BlueToothDeviceStats *src, BlueToothDeviceStats *dst )
+    {
+      if( src->samples == 0 ) return;
+      if( dst->samples == 0 ) {
+        *dst = *src;
+        return;
+      }
+      uint32_t firstSeen = dst->firstSeen < src->firstSeen ? dst->firstSeen : src->firstSeen;
+      if( src->samples >= dst->samples ) { // src is a continuation of dst
+        *dst = *src;
+      } else { // src restarted (e.g. evicted from the dedup table), blend it in
+        ewma( dst->rssiAvg, dst->rssiVar, src->rssiAvg );
+        if( src->intervals > 0 ) {
+          ewma( dst->intervalAvg, dst->intervalVar, src->intervalAvg );
+          dst->intervals += src->intervals;
+        }
+        dst->samples += src->samples;
+        if( src->lastSeen > dst->lastSeen ) dst->lastSeen = src->lastSeen;
+      }
+      dst->firstSeen = firstSeen;
+    }
+
+    static float statsJitter( const BlueToothDeviceStats *stats )
+    {
+      return sqrtf( stats->intervalVar );
+    }
+
+    static int statsRSSI( BlueToothDevice *CacheItem )
+    {
+      if( CacheItem->stats.samples > 1 ) return (int)lroundf( CacheItem->stats.rssiAvg );
+      return CacheItem->rssi;
+    }
+
+    // exponentially weighted moving average and variance
+    static void ewma( float &avg, float &var, float value )
+    {
+      float diff = value - avg;
+      float incr = BLEDEVSTATS_ALPHA * diff;
+      avg += incr;
+      var = (1.0f - BLEDEVSTATS_ALPHA) * (var + diff * incr);
     }
 
     // stores in cache a given advertised device
@@ -368,61 +412,7 @@ class BlueToothDeviceHelper
 
       if ( advertisedDevice->haveServiceUUID() ) {
         set(CacheItem, "uuid", advertisedDevice->getServiceUUID().toString().c_str());
-        BLEGATTService srv = gattServiceDescription( CacheItem->uuid );
-
-        //const char* serviceStr = gattServiceDescription( advertisedDevice->getServiceUUID() );
-        if( strcmp( srv.name, "Unknown" ) != 0 ) {
-          log_w("Gatt Service UUID to string %s = %s", advertisedDevice->getServiceUUID().toString().c_str(), srv.name );
-        }
-
-        // beacon check
-        uint8_t *payLoad = advertisedDevice->getPayload();
-
-        if (advertisedDevice->getServiceUUID().equals(checkUrlUUID)) {
-          if (payLoad[11] == 0x10) {
-            Serial.println("Found an EddystoneURL beacon!");
-            BLEEddystoneURL foundEddyURL = BLEEddystoneURL();
-            std::string eddyContent((char *)&payLoad[11]); // incomplete EddystoneURL struct!
-
-            foundEddyURL.setData(eddyContent);
-            std::string bareURL = foundEddyURL.getURL();
-            if (bareURL[0] == 0x00) {
-              size_t payLoadLen = advertisedDevice->getPayloadLength();
-              Serial.println("DATA-->");
-              for (int idx = 0; idx < payLoadLen; idx++) {
-                Serial.printf("0x%08X ", payLoad[idx]);
-              }
-              Serial.println("\nInvalid Data");
-            } else {
-              Serial.printf("Found URL: %s\n", foundEddyURL.getURL().c_str());
-              Serial.printf("Decoded URL: %s\n", foundEddyURL.getDecodedURL().c_str());
-              Serial.printf("TX power %d\n", foundEddyURL.getPower());
-              Serial.println("\n");
-            }
-          } else if (payLoad[11] == 0x20) {
-            Serial.println("Found an EddystoneTLM beacon!");
-            BLEEddystoneTLM foundEddyURL = BLEEddystoneTLM();
-            std::string eddyContent((char *)&payLoad[11]); // incomplete EddystoneURL struct!
-
-            eddyContent = "01234567890123";
-
-            for (int idx = 0; idx < 14; idx++) {
-              eddyContent[idx] = payLoad[idx + 11];
-            }
-
-            foundEddyURL.setData(eddyContent);
-            Serial.printf("Reported battery voltage: %dmV\n", foundEddyURL.getVolt());
-            Serial.printf("Reported temperature from TLM class: %.2fC\n", (double)foundEddyURL.getTemp());
-            int temp = (int)payLoad[16] + (int)(payLoad[15] << 8);
-            float calcTemp = temp / 256.0f;
-            Serial.printf("Reported temperature from data: %.2fC\n", calcTemp);
-            Serial.printf("Reported advertise count: %d\n", foundEddyURL.getCount());
-            Serial.printf("Reported time since last reboot: %ds\n", foundEddyURL.getTime());
-            Serial.println("\n");
-            Serial.print(foundEddyURL.toString().c_str());
-            Serial.println("\n");
-          }
-        }
+        // the service name is looked up when the card is rendered (see Backend.gatt)
         //log_w("Gatt Service UUID to string %s = %s", advertisedDevice->getServiceUUID().toString().c_str(), gattServiceDescription( advertisedDevice->getServiceUUID() ) );
         //uint16_t sUUID = (uint16_t)advertisedDevice->getServiceUUID().getNative();
         //Serial.printf("[%s] GATT ServiceUUID:     '%s'\n", CacheItem->address, advertisedDevice->getServiceUUID().toString().c_str() );
@@ -434,6 +424,67 @@ class BlueToothDeviceHelper
       CacheItem->hits = 1;
     }
 
+    // same as store() from a raw advertisement (e.g. a replayed trace record), the AD structures are parsed the way NimBLE does (16 bits service uuids only)
+    static void storeRaw( BlueToothDevice *CacheItem, const uint8_t* address, uint8_t addrType, int rssi, const uint8_t* payload, size_t len )
+    {
+      char str[MAX_FIELD_LEN+1];
+      uint8_t fieldLen = 0;
+      const uint8_t* field;
+      reset(CacheItem);// avoid mixing new and old data
+      sprintf( str, "%02x:%02x:%02x:%02x:%02x:%02x", address[5], address[4], address[3], address[2], address[1], address[0] );
+      set(CacheItem, "address", str);
+      set(CacheItem, "rssi", rssi);
+      set(CacheItem, "addr_type", addrType);
+      if( addrType == BLE_ADDR_RANDOM ) {
+        set(CacheItem, "ouiname", "[random]");
+      } else {
+        set(CacheItem, "ouiname", "[unpopulated]");
+      }
+      field = adField( payload, len, 0x09, fieldLen ); // complete local name
+      if( field == NULL ) field = adField( payload, len, 0x08, fieldLen ); // shortened local name
+      if( field != NULL ) {
+        if( fieldLen > MAX_FIELD_LEN ) fieldLen = MAX_FIELD_LEN;
+        memcpy( str, field, fieldLen );
+        str[fieldLen] = '\0';
+        set(CacheItem, "name", str);
+      }
+      field = adField( payload, len, 0x19, fieldLen ); // appearance
+      if( field != NULL && fieldLen >= 2 ) {
+        set(CacheItem, "appearance", field[0] | ( field[1] << 8 ) );
+      }
+      field = adField( payload, len, 0xff, fieldLen ); // manufacturer specific data
+      if( field != NULL && fieldLen >= 2 ) {
+        set(CacheItem, "manufname", "[unpopulated]");
+        set(CacheItem, "manufid", field[0] | ( field[1] << 8 ) );
+      }
+      field = adField( payload, len, 0x03, fieldLen ); // complete list of 16 bits service uuids
+      if( field == NULL ) field = adField( payload, len, 0x02, fieldLen ); // incomplete list
+      if( field != NULL && fieldLen >= 2 ) {
+        sprintf( str, "0x%04x", field[0] | ( field[1] << 8 ) );
+        set(CacheItem, "uuid", str);
+      }
+      if( TimeIsSet ) {
+        CacheItem->created_at = nowDateTime;
+      }
+      CacheItem->hits = 1;
+    }
+
+    // data of the first AD structure of this type in a raw advertisement, NULL if none
+    static const uint8_t* adField( const uint8_t* payload, size_t len, uint8_t type, uint8_t &fieldLen )
+    {
+      size_t offset = 0;
+      while( offset + 1 < len ) {
+        uint8_t adLen = payload[offset];
+        if( adLen == 0 || offset + 1 + adLen > len ) break;
+        if( payload[offset+1] == type ) {
+          fieldLen = adLen - 1;
+          return &payload[offset+2];
+        }
+        offset += 1 + adLen;
+      }
+      return NULL;
+    }
+
     // determines whether a device is worth saving or not
     static bool isAnonymous( BlueToothDevice *CacheItem )
     {
@@ -467,78 +518,340 @@ class BlueToothDeviceHelper
 
     static const BLEGATTService gattServiceDescription( const char* serviceUUIDStr )
     {
-      //const char* serviceUUIDStr = serviceUUID.toString().c_str();
       if( serviceUUIDStr == NULL ) return BLE_unknownService;
       if( strcmp(serviceUUIDStr, "<NULL>") == 0 ) return BLE_unknownService; // wtf ??
-      size_t heapbefore = freeheap;
+      uint16_t serviceId = 0;
+      if( serviceUUIDStr[0] == '0' && serviceUUIDStr[1] == 'x' ) {
+        // e.g. serviceUUID = "0xfe9f", only the 4 last digits matter
+        size_t hexLen = strlen( serviceUUIDStr+2 );
+        serviceId = hexToUInt16( serviceUUIDStr+2 + (hexLen > 4 ? hexLen-4 : 0), hexLen );
+      } else if( strlen( serviceUUIDStr ) >= 8 ) {
+        // e.g. serviceUUID = "cbbfe0e1-f7f3-4206-84e0-84cbb3d09dfc"
+        serviceId = hexToUInt16( serviceUUIDStr+4, 4 );
+      }
+      const BLEAssignedNumber* srv = assignedNumberFind( BLE_gattServices, serviceId );
+      if( srv == NULL ) return BLE_unknownService;
+      log_d("Gatt Service UUID to string %04x => %s", serviceId, srv->name );
+      return *srv;
+    } // gattServiceDescription
 
-      uint32_t serviceId = 0;
+    // parses up to 4 hex digits without allocating, stops on the first non hex char
+    static uint16_t hexToUInt16( const char* hex, size_t len )
+    {
+      uint16_t out = 0;
+      for( size_t i=0; i<len && i<4; i++ ) {
+        char c = hex[i];
+        if( c >= '0' && c <= '9' )      out = (out << 4) | (c - '0');
+        else if( c >= 'a' && c <= 'f' ) out = (out << 4) | (c - 'a' + 10);
+        else if( c >= 'A' && c <= 'F' ) out = (out << 4) | (c - 'A' + 10);
+        else break;
+      }
+      return out;
+    }
 
-      char* prefix = substr( serviceUUIDStr, 0, 2 );
+};
 
-      if( strcmp( prefix, "0x" ) == 0 ) {
-        // e.g. serviceUUID = "0xfe9f"
-        int uuidWidth = strlen( serviceUUIDStr ) - 2;
-        char* gattUUIDchar = substr( serviceUUIDStr, 2, uuidWidth );
-        serviceId = (int)strtol(gattUUIDchar, NULL, 16);
-        log_d("[gattServiceDescription(%s)] UUIDchar = '%s', serviceId = '%d'", serviceUUIDStr, gattUUIDchar, serviceId );
-        free(gattUUIDchar);
-      } else {
-        // e.g. serviceUUID = "cbbfe0e1-f7f3-4206-84e0-84cbb3d09dfc"
-        char* gattUUIDblock = substr( serviceUUIDStr, 0, 8 );
-        char* gattUUIDchar = substr( gattUUIDblock, 4, 4 );
-        serviceId = (int)strtol(gattUUIDchar, NULL, 16);
-        log_d("[gattServiceDescription(%s)] UUIDblock = '%s', UUIDchar = '%s', serviceId = '%d'", serviceUUIDStr, gattUUIDblock, gattUUIDchar, serviceId );
-        free(gattUUIDblock);
-        free(gattUUIDchar);
-      }
-
-      free( prefix );
-
-      size_t heapafter = freeheap;
-      int heapdiff = heapbefore - heapafter;
-      byte i = 0;
-      while( true ) {
-        if (BLE_gattServices[i].assignedNumber == 0) {
-          break;
-        }
-        if (BLE_gattServices[i].assignedNumber == serviceId) {
-          log_d("[%d (%d)] Gatt Service UUID to string %04x => %s", freeheap, heapdiff, serviceId, BLE_gattServices[i].name );
-          return BLE_gattServices[i]/*.name*/;
+
+BlueToothDeviceHelper BLEDevHelper;
+
+
+/*
+ * Top hits in BLEDevRAMCache (hall of mac)
+ *
+ * The BLEDEVCACHE_TOPK most hit cache indexes, kept sorted by hits (most hit
+ * first) and updated by the cache writers whenever hits change, so readers
+ * get the top entries without scanning the whole cache. K is small: a sorted
+ * array with insertion is cheaper than a heap and reads need no sorting.
+ * Same locking as the cache: written inside Lock.cacheWriteBegin/End().
+ *
+ */
+
+#ifndef BLEDEVCACHE_TOPK // override this from Settings.h
+#define BLEDEVCACHE_TOPK 16 // must be >= hallOfMacSize
+#endif
+
+class BlueToothDeviceTopK
+{
+  public:
+
+    // hits changed for this cache index
+    void update( uint16_t index, uint32_t hits )
+    {
+      int16_t pos = find( index );
+      if( pos == -1 ) {
+        if( hits == 0 ) return;
+        if( size == BLEDEVCACHE_TOPK ) {
+          if( hits <= entries[size-1].hits ) return; // not a contender
+          pos = size-1; // evict the least hit
+        } else {
+          pos = size++;
         }
-        i++;
+        entries[pos].index = index;
       }
-      return BLE_unknownService;
-    } // gattServiceDescription
+      entries[pos].hits = hits;
+      // restore order, entries only move by a few positions
+      while( pos > 0 && entries[pos-1].hits < entries[pos].hits ) {
+        swap( pos-1, pos );
+        pos--;
+      }
+      while( pos < size-1 && entries[pos+1].hits > entries[pos].hits ) {
+        swap( pos, pos+1 );
+        pos++;
+      }
+    }
 
-    static uint16_t getNextCacheIndex( BlueToothDevice **CacheItem, uint16_t CacheItemIndex )
-    {
-      uint16_t minCacheValue = 65535;
-      uint16_t maxCacheValue = 0;
-      uint16_t defaultIndex = CacheItemIndex;
-      defaultIndex++;
-      defaultIndex = defaultIndex%BLEDEVCACHE_SIZE;
-      uint16_t outIndex = defaultIndex;
-      // find first index with least hits
-      for(int i=defaultIndex;i<defaultIndex+BLEDEVCACHE_SIZE;i++) {
-        uint16_t tempIndex = i%BLEDEVCACHE_SIZE;
-        if( isEmpty( CacheItem[tempIndex]->address ) ) {
-          return tempIndex;
-        }
-        if( CacheItem[tempIndex]->hits > maxCacheValue ) {
-          maxCacheValue = CacheItem[tempIndex]->hits;
-        }
-        if( CacheItem[tempIndex]->hits < minCacheValue ) {
-          minCacheValue = CacheItem[tempIndex]->hits;
-          outIndex = tempIndex;
+    // this cache index was evicted or discarded
+    void remove( uint16_t index )
+    {
+      int16_t pos = find( index );
+      if( pos == -1 ) return;
+      for( uint8_t i=pos; i<size-1; i++ ) {
+        entries[i] = entries[i+1];
+      }
+      size--;
+    }
+
+    // copies up to k cache indexes, most hit first, returns how many
+    size_t read( int32_t *sorted, size_t k )
+    {
+      if( k > size ) k = size;
+      for( size_t i=0; i<k; i++ ) {
+        sorted[i] = entries[i].index;
+      }
+      return k;
+    }
+
+  private:
+
+    struct Entry
+    {
+      uint16_t index;
+      uint32_t hits;
+    };
+
+    Entry   entries[BLEDEVCACHE_TOPK];
+    uint8_t size = 0;
+
+    int16_t find( uint16_t index )
+    {
+      for( uint8_t i=0; i<size; i++ ) {
+        if( entries[i].index == index ) return i;
+      }
+      return -1;
+    }
+
+    void swap( uint8_t a, uint8_t b )
+    {
+      Entry tmp = entries[a];
+      entries[a] = entries[b];
+      entries[b] = tmp;
+    }
+
+};
+
+
+BlueToothDeviceTopK BLEDevTopK;
+
+
+/*
+ * Segmented LRU eviction for BLEDevRAMCache
+ *
+ * New devices enter the probation segment, a second hit promotes them to the
+ * protected segment (capped at BLEDEVCACHE_PROTECTED_RATIO % of the cache),
+ * overflowing protected devices are demoted back to probation instead of
+ * being evicted. Victims are taken from the probation tail so one-shot
+ * devices churn out first, while frequent devices that stopped showing up
+ * age out through demotion.
+ *
+ * Among the BLEDEVCACHE_VICTIM_SAMPLES least recent probation devices, the
+ * victim is the one that missed the most advertisements according to its
+ * statistics (silence / average interval): a beacon silent for a minute
+ * after advertising every 100ms left, a device advertising every 10s may
+ * just be between two scans. Devices without interval statistics count as
+ * advertising every BLEDEVSTATS_MAX_INTERVAL_MS, ties keep the LRU order.
+ *
+ * Both segments (and the free list) are doubly linked lists over cache
+ * indexes: insert, hit and eviction are O(1).
+ *
+ */
+
+#define BLEDEVCACHE_PROTECTED_RATIO 80 // % of the device cache reserved for devices seen more than once
+#define BLEDEVCACHE_NIL 0xffff
+#ifndef BLEDEVCACHE_VICTIM_SAMPLES // override this from Settings.h
+#define BLEDEVCACHE_VICTIM_SAMPLES 4 // probation tail devices compared on eviction
+#endif
+
+class BlueToothDeviceLRU
+{
+  public:
+
+    enum Segment : uint8_t
+    {
+      SEGMENT_FREE      = 0,
+      SEGMENT_PROBATION = 1,
+      SEGMENT_PROTECTED = 2
+    };
+
+    // items (optional) are the cached devices, their statistics pick the victim
+    bool init( uint16_t size, bool hasPsram=true, BlueToothDevice** cachedItems=NULL )
+    {
+      items = cachedItems;
+      if( hasPsram ) {
+        prevs    = (uint16_t*)ps_calloc( size, sizeof(uint16_t) );
+        nexts    = (uint16_t*)ps_calloc( size, sizeof(uint16_t) );
+        segments = (uint8_t*) ps_calloc( size, sizeof(uint8_t) );
+      } else {
+        prevs    = (uint16_t*)calloc( size, sizeof(uint16_t) );
+        nexts    = (uint16_t*)calloc( size, sizeof(uint16_t) );
+        segments = (uint8_t*) calloc( size, sizeof(uint8_t) );
+      }
+      if( prevs == NULL || nexts == NULL || segments == NULL ) {
+        log_e("[ERROR][%d][%d] can't allocate LRU for %d items", freeheap, freepsheap, size );
+        return false;
+      }
+      capacity = size;
+      protectedMax = ( (uint32_t)size * BLEDEVCACHE_PROTECTED_RATIO ) / 100;
+      for( uint8_t i=0; i<3; i++ ) {
+        lists[i] = { BLEDEVCACHE_NIL, BLEDEVCACHE_NIL, 0 };
+      }
+      for( uint16_t i=0; i<size; i++ ) {
+        pushTail( SEGMENT_FREE, i );
+      }
+      return true;
+    }
+
+    // returns the cache index to store a new device in, evicting if needed
+    uint16_t acquire()
+    {
+      uint16_t index;
+      if( lists[SEGMENT_FREE].size > 0 ) {
+        index = lists[SEGMENT_FREE].head;
+      } else if( lists[SEGMENT_PROBATION].size > 0 ) {
+        index = probationVictim( millis() );
+        BLEDevCacheEvictions++;
+      } else {
+        index = lists[SEGMENT_PROTECTED].tail;
+        BLEDevCacheEvictions++;
+      }
+      BLEDevTopK.remove( index );
+      unlink( index );
+      pushHead( SEGMENT_PROBATION, index );
+      return index;
+    }
+
+    // a cached device was seen again
+    void touch( uint16_t index )
+    {
+      if( index >= capacity || segments[index] == SEGMENT_FREE ) return;
+      if( segments[index] == SEGMENT_PROBATION ) {
+        BLEDevCachePromotions++;
+      }
+      unlink( index );
+      pushHead( SEGMENT_PROTECTED, index );
+      if( lists[SEGMENT_PROTECTED].size > protectedMax ) {
+        // demote least recent protected device
+        uint16_t demoted = lists[SEGMENT_PROTECTED].tail;
+        unlink( demoted );
+        pushHead( SEGMENT_PROBATION, demoted );
+      }
+    }
+
+    // a cached device was discarded
+    void release( uint16_t index )
+    {
+      if( index >= capacity || segments[index] == SEGMENT_FREE ) return;
+      BLEDevTopK.remove( index );
+      unlink( index );
+      pushHead( SEGMENT_FREE, index );
+    }
+
+    uint16_t used()
+    {
+      return capacity - lists[SEGMENT_FREE].size;
+    }
+
+    uint16_t protectedCount()
+    {
+      return lists[SEGMENT_PROTECTED].size;
+    }
+
+  private:
+
+    struct List
+    {
+      uint16_t head; // most recent
+      uint16_t tail; // least recent
+      uint16_t size;
+    };
+
+    List lists[3];
+    BlueToothDevice** items = NULL;
+    uint16_t* prevs = NULL;
+    uint16_t* nexts = NULL;
+    uint8_t*  segments = NULL;
+    uint16_t  capacity = 0;
+    uint16_t  protectedMax = 0;
+
+    uint16_t probationVictim( uint32_t now )
+    {
+      uint16_t index = lists[SEGMENT_PROBATION].tail;
+      if( items == NULL ) return index;
+      uint16_t victim = index;
+      uint32_t worst = 0;
+      for( uint8_t i=0; i<BLEDEVCACHE_VICTIM_SAMPLES && index != BLEDEVCACHE_NIL; i++ ) {
+        uint32_t missed = missedAdvertisements( &items[index]->stats, now );
+        if( missed > worst ) {
+          worst  = missed;
+          victim = index;
         }
-        delay(1);
+        index = prevs[index];
       }
-      return outIndex;
+      return victim;
     }
 
+    static uint32_t missedAdvertisements( const BlueToothDeviceStats *stats, uint32_t now )
+    {
+      if( stats->samples == 0 || (int32_t)( now - stats->lastSeen ) <= 0 ) return 0;
+      uint32_t interval = stats->intervals > 0 ? (uint32_t)stats->intervalAvg : BLEDEVSTATS_MAX_INTERVAL_MS;
+      if( interval < BLEDEVSTATS_MIN_INTERVAL_MS ) interval = BLEDEVSTATS_MIN_INTERVAL_MS;
+      return ( now - stats->lastSeen ) / interval;
+    }
+
+    void unlink( uint16_t index )
+    {
+      List &list = lists[segments[index]];
+      if( prevs[index] != BLEDEVCACHE_NIL ) nexts[prevs[index]] = nexts[index];
+      else list.head = nexts[index];
+      if( nexts[index] != BLEDEVCACHE_NIL ) prevs[nexts[index]] = prevs[index];
+      else list.tail = prevs[index];
+      list.size--;
+    }
+
+    void pushHead( uint8_t segment, uint16_t index )
+    {
+      List &list = lists[segment];
+      segments[index] = segment;
+      prevs[index] = BLEDEVCACHE_NIL;
+      nexts[index] = list.head;
+      if( list.head != BLEDEVCACHE_NIL ) prevs[list.head] = index;
+      else list.tail = index;
+      list.head = index;
+      list.size++;
+    }
+
+    void pushTail( uint8_t segment, uint16_t index )
+    {
+      List &list = lists[segment];
+      segments[index] = segment;
+      nexts[index] = BLEDEVCACHE_NIL;
+      prevs[index] = list.tail;
+      if( list.tail != BLEDEVCACHE_NIL ) nexts[list.tail] = index;
+      else list.head = index;
+      list.tail = index;
+      list.size++;
+    }
 
 };
 
 
-BlueToothDeviceHelper BLEDevHelper;
+BlueToothDeviceLRU BLEDevLRU;
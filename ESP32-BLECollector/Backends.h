@@ -0,0 +1,77 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Storage and lookup backends
+ *
+ * The scan pipeline reaches the devices DB, the OUI/company names and the
+ * GATT service names through these small tables of function pointers
+ * instead of calling DB.h directly. The firmware plugs the SD card backends
+ * in before mounting the DB (see DB.h), the host trace bench plugs its own
+ * (host/bench/TraceBench.cpp) so the same stages run off-device.
+ *
+ * Locking stays with the callers: the SD backends share the DB lock.
+ *
+ */
+
+struct DeviceStore
+{
+  int  (*exists)( const char* address ); // > -1 when known, the device is then loaded into BLEDevDBCache
+  bool (*insert)( BlueToothDevice *device ); // false when the insert failed or was ignored
+};
+
+struct VendorLookup
+{
+  void (*oui)( const char* address, char* ouiname ); // MAC address assignment
+  void (*vendor)( uint16_t manufid, char* manufname ); // BLE SIG company identifier
+};
+
+struct GATTLookup
+{
+  const BLEGATTService (*service)( const char* uuid ); // "0x180f" or a full 128 bits uuid
+};
+
+static const GATTLookup AssignedNumbersGATT = { BlueToothDeviceHelper::gattServiceDescription };
+
+struct BackendTable
+{
+  const DeviceStore*  devices; // set with the DB
+  const VendorLookup* vendors; // set with the DB
+  const GATTLookup*   gatt;
+};
+
+static BackendTable Backend = { NULL, NULL, &AssignedNumbersGATT };
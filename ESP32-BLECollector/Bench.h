@@ -0,0 +1,202 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Core micro benchmarks
+ *
+ * Times the storage-agnostic building blocks of the scan pipeline (device
+ * cache, merge, anonymity check, assigned numbers, OUI and vendor lookups)
+ * on synthetic items, so performance changes can be compared from the serial
+ * console on the target itself. Results are printed as µs/op.
+ *
+ * Benchmarks needing collaborators declared later (e.g. the BLECollector
+ * scan cache lookup) are measured by the caller through measure().
+ *
+ * The storage-agnostic parts are also benchmarked on a Linux host, see
+ * host/bench/CoreBench.cpp.
+ *
+ */
+
+#ifndef BENCH_ITERATIONS // override this from Settings.h
+#define BENCH_ITERATIONS 1000
+#endif
+
+typedef void (*BenchFunction)( uint32_t iteration );
+
+struct BenchResult
+{
+  const char* name;
+  uint32_t    iterations;
+  int64_t     elapsed; // µs
+};
+
+#define BENCH_LRU_SIZE 256
+
+static BlueToothDeviceLRU BenchLRU; // private instance, BLEDevLRU recency must not be disturbed
+static BlueToothDevice* BenchItemA = NULL;
+static BlueToothDevice* BenchItemB = NULL;
+static char BenchOutput[MAX_FIELD_LEN+1];
+
+static const uint16_t BenchCompanies[]   = { 0x0006, 0x004C, 0x0075, 0x00E0, 0x0131, 0xFFFE };
+static const uint16_t BenchServices[]    = { 0x1800, 0x180F, 0x181A, 0xFE9F, 0xFEAA, 0x1234 };
+static const char*    BenchServiceStrs[] = { "0x180f", "0000feaa-0000-1000-8000-00805f9b34fb", "0x1234" };
+static const char*    BenchOUIs[]        = { "B4:99:BA:01:02:03", "00:1D:A5:04:05:06", "DC:A6:32:07:08:09" };
+static const uint16_t BenchVendors[]     = { 0x001D, 0x004C, 0x0006, 0x0075 };
+
+#define BENCH_ITEMS(x) ( sizeof(x) / sizeof(x[0]) )
+
+
+class BenchUtils
+{
+  public:
+
+    static BenchResult measure( const char* name, BenchFunction fn, uint32_t iterations=BENCH_ITERATIONS )
+    {
+      BenchResult result = { name, iterations, 0 };
+      int64_t start = esp_timer_get_time();
+      for( uint32_t i=0; i<iterations; i++ ) {
+        fn( i );
+      }
+      result.elapsed = esp_timer_get_time() - start;
+      print( result );
+      return result;
+    }
+
+    static void print( BenchResult result )
+    {
+      float perOp = result.iterations > 0 ? (float)result.elapsed / result.iterations : 0;
+      Serial.printf("  %-32s %8d ops %10lld us %10.3f us/op\n", result.name, result.iterations, result.elapsed, perOp );
+    }
+
+    // runs the core benchmarks, the scan task should be stopped first
+    static void run()
+    {
+      if( !setup() ) return;
+      Serial.printf("[Bench] %d iterations, heap: %d, psram: %d\n", BENCH_ITERATIONS, freeheap, freepsheap );
+      measure( "companyFind",            benchCompanyFind );
+      measure( "assignedNumberFind",     benchServiceFind );
+      measure( "gattServiceDescription", benchServiceDescription );
+      measure( "isAnonymous",            benchIsAnonymous );
+      measure( "mergeItems",             benchMergeItems );
+      measure( "copyItem",               benchCopyItem );
+      measure( "statsUpdate",            benchStatsUpdate );
+      measure( "BlueToothDeviceLRU.acquire", benchLRUAcquire );
+      measure( "BlueToothDeviceLRU.touch",   benchLRUTouch );
+      measure( "DB.getOUI",              benchGetOUI, BENCH_ITERATIONS/10 );
+      measure( "DB.getVendor",           benchGetVendor, BENCH_ITERATIONS/10 );
+    }
+
+  private:
+
+    static bool setup()
+    {
+      if( BenchItemA != NULL ) return true;
+      BenchItemA = (BlueToothDevice*)calloc( 1, sizeof( BlueToothDevice ) );
+      BenchItemB = (BlueToothDevice*)calloc( 1, sizeof( BlueToothDevice ) );
+      if( BenchItemA == NULL || BenchItemB == NULL ) {
+        log_e("[ERROR][%d][%d] can't allocate bench items", freeheap, freepsheap );
+        return false;
+      }
+      BLEDevHelper.init( BenchItemA, false );
+      BLEDevHelper.init( BenchItemB, false );
+      BLEDevHelper.set( BenchItemA, "address", "de:ad:be:ef:ca:fe" );
+      BLEDevHelper.set( BenchItemA, "name", "BenchItem" );
+      BLEDevHelper.set( BenchItemA, "ouiname", "[random]" );
+      BLEDevHelper.set( BenchItemA, "manufname", "Apple, Inc." );
+      BLEDevHelper.set( BenchItemA, "uuid", "0000feaa-0000-1000-8000-00805f9b34fb" );
+      BLEDevHelper.copyItem( BenchItemA, BenchItemB );
+      return BenchLRU.init( BENCH_LRU_SIZE, false );
+    }
+
+    static void benchCompanyFind( uint32_t i )
+    {
+      companyFind( BenchCompanies[i % BENCH_ITEMS(BenchCompanies)] );
+    }
+
+    static void benchServiceFind( uint32_t i )
+    {
+      assignedNumberFind( BLE_gattServices, BenchServices[i % BENCH_ITEMS(BenchServices)] );
+    }
+
+    static void benchServiceDescription( uint32_t i )
+    {
+      BLEDevHelper.gattServiceDescription( BenchServiceStrs[i % BENCH_ITEMS(BenchServiceStrs)] );
+    }
+
+    static void benchIsAnonymous( uint32_t i )
+    {
+      BLEDevHelper.isAnonymous( i&1 ? BenchItemA : BenchItemB );
+    }
+
+    static void benchMergeItems( uint32_t i )
+    {
+      BLEDevHelper.mergeItems( BenchItemA, BenchItemB );
+    }
+
+    static void benchCopyItem( uint32_t i )
+    {
+      BLEDevHelper.copyItem( BenchItemA, BenchItemB );
+    }
+
+    static void benchStatsUpdate( uint32_t i )
+    {
+      BLEDevHelper.statsUpdate( &BenchItemA->stats, i * 100, -60 - (i % 30) );
+    }
+
+    static void benchLRUAcquire( uint32_t i )
+    {
+      BenchLRU.acquire();
+    }
+
+    static void benchLRUTouch( uint32_t i )
+    {
+      BenchLRU.touch( i % BENCH_LRU_SIZE );
+    }
+
+    static void benchGetOUI( uint32_t i )
+    {
+      DB.getOUI( BenchOUIs[i % BENCH_ITEMS(BenchOUIs)], BenchOutput );
+    }
+
+    static void benchGetVendor( uint32_t i )
+    {
+      DB.getVendor( BenchVendors[i % BENCH_ITEMS(BenchVendors)], BenchOutput );
+    }
+
+};
+
+
+BenchUtils Bench;
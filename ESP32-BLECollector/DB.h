@@ -98,6 +98,8 @@ static bool DBneedsReplication = false;
 static char insertQuery[1024]; // stack overflow ? pray that 1024 is enough :D
 #define searchDeviceTemplate "SELECT " BLEMAC_SELECT_FIELDNAMES " FROM blemacs WHERE address='%s'"
 static char searchDeviceQuery[1024];
+#define beaconsCreateTableQuery "CREATE TABLE IF NOT EXISTS beacons( address, type, ident, tx_power INTEGER, rssi INTEGER, battery INTEGER, temperature REAL, adv_count INTEGER, sec_count INTEGER, seen INTEGER, created_at DATETIME )"
+#define beaconInsertQueryTemplate "INSERT INTO beacons(address, type, ident, tx_power, rssi, battery, temperature, adv_count, sec_count, seen, created_at) VALUES('%s','%s','%s',%d,%d,%d,%.2f,%u,%u,%u,'%s.000000')"
 #define vendorRequestTpl "SELECT vendor FROM 'ble-oui' WHERE id='%d'"
 #define OUIRequestTpl "SELECT * FROM 'oui-light' WHERE Assignment=UPPER('%s');"
 
@@ -256,9 +258,9 @@ class DBUtils
     bool init()
     {
       while(SDSetup()==false) {
-        UI.headerStats("Card Mount Failed");
+        Render.header("Card Mount Failed");
         delay(500);
-        UI.headerStats(" ");
+        Render.header(" ");
         delay(300);
       }
       hasPsram = psramInit();
@@ -280,9 +282,10 @@ class DBUtils
 
       initial_free_heap = freeheap;
       isQuerying = true;
+      HeapTrace.init(); // allocator hook must be set before sqlite3_initialize()
       sqlite3_initialize();
 
-      takeMuxSemaphore();
+      takeDBLock();
 
       bool create_DB = false;
 
@@ -307,7 +310,7 @@ class DBUtils
 
       entries = getEntries();
 
-      giveMuxSemaphore();
+      giveDBLock();
 
       return cacheWarmup();
     }
@@ -438,6 +441,7 @@ class DBUtils
 
     void BLEDevCacheWarmup()
     {
+      HeapTraceScope trace( HEAP_TAG_CACHE );
       BLEDevRAMCache = (BlueToothDevice**)ble_calloc(BLEDEVCACHE_SIZE, sizeof( BlueToothDevice ) );
       for(uint16_t i=0; i<BLEDEVCACHE_SIZE; i++) {
         BLEDevRAMCache[i] = (BlueToothDevice*)ble_calloc(1, sizeof( BlueToothDevice ) );
@@ -448,6 +452,7 @@ class DBUtils
         BLEDevHelper.init( BLEDevRAMCache[i], hasPsram );
         delay(1);
       }
+      BLEDevLRU.init( BLEDEVCACHE_SIZE, hasPsram, BLEDevRAMCache );
       BLEDevScanCache = (BlueToothDevice**)ble_calloc(MAX_DEVICES_PER_SCAN, sizeof( BlueToothDevice ) );
       for(uint16_t i=0; i<MAX_DEVICES_PER_SCAN; i++) {
         BLEDevScanCache[i] = (BlueToothDevice*)ble_calloc(1, sizeof( BlueToothDevice ) );
@@ -498,6 +503,14 @@ class DBUtils
     }
 
 
+    // true when maintain() has something to do
+    bool maintenancePending()
+    {
+      return isOOM || isCorrupt || needsPruning || needsReset || needsRestart
+          || DayChangeTrigger || HourChangeTrigger || DBneedsReplication;
+    }
+
+
     bool maintain()
     {
       bool ret = true;
@@ -560,12 +573,7 @@ class DBUtils
 
     void cacheState()
     {
-      BLEDevCacheUsed = 0;
-      for( uint16_t i=0; i<BLEDEVCACHE_SIZE; i++) {
-        if( !isEmpty( BLEDevRAMCache[i]->address ) ) {
-          BLEDevCacheUsed++;
-        }
-      }
+      BLEDevCacheUsed = BLEDevLRU.used();
       if( hasPsram ) {
         VendorCacheUsed = VENDORCACHE_SIZE;
         OuiCacheUsed = OUICACHE_SIZE;
@@ -654,6 +662,7 @@ class DBUtils
     // checks if a BLE Device exists, returns its cache index if found
     int deviceExists(const char* address)
     {
+      LatencyProbe probe( PROBE_DB_EXISTS );
       results = 0;
       if( isEmpty( address ) || strlen( address ) > MAC_LEN+1 || strlen( address ) < 17 || address[0]==3) {
         log_w("Cowardly refusing to perform an empty or invalid request : %s / %s", address, currentBLEAddress);
@@ -681,9 +690,9 @@ class DBUtils
       results = 0;
       open(BLE_VENDOR_NAMES_DB);
       //Out.println("Cloning Vendors DB to PSRam...");
-      UI.headerStats("PSRam Cloning...");
+      Render.header("PSRam Cloning...");
       int rc = sqlite3_exec(BLEVendorsDB, "SELECT id, SUBSTR(vendor, 0, 32) AS vendor FROM 'ble-oui' WHERE vendor!=''", VendorDBCallback, (void*)dataVendor, &zErrMsg);
-      UI.PrintProgressBar( Out.width );
+      Render.progress( Out.width );
       if (rc != SQLITE_OK) {
         error(zErrMsg);
         sqlite3_free(zErrMsg);
@@ -703,9 +712,9 @@ class DBUtils
       results = 0;
       open(MAC_OUI_NAMES_DB);
       //Out.println("Cloning Manufacturers DB to PSRam...");
-      UI.headerStats("PSRam Cloning...");
+      Render.header("PSRam Cloning...");
       int rc = sqlite3_exec(OUIVendorsDB, "SELECT LOWER(assignment) AS mac, SUBSTR(`Organization Name`, 0, 32) AS ouiname FROM 'oui-light' WHERE assignment!=''", OUIDBCallback, (void*)dataOUI, &zErrMsg);
-      UI.PrintProgressBar( Out.width );
+      Render.progress( Out.width );
       if (rc != SQLITE_OK) {
         error(zErrMsg);
         sqlite3_free(zErrMsg);
@@ -744,7 +753,7 @@ class DBUtils
       } else if(strstr("no such column", zErrMsg)) {
         needsReset = true;
       } else {
-        UI.headerStats(zErrMsg);
+        Render.header(zErrMsg);
         Out.println( zErrMsg );
         delay(1000);
       }
@@ -768,6 +777,7 @@ class DBUtils
 
     DBMessage insertBTDevice( BlueToothDevice *CacheItem)
     {
+      LatencyProbe probe( PROBE_DB_INSERT );
       if(isOOM) {
         // cowardly refusing to use DB when OOM
         return DB_IS_OOM;
@@ -788,6 +798,7 @@ class DBUtils
         return INSERTION_FAILED;
       }
 
+      HeapTraceScope trace( HEAP_TAG_STRING ); // temporary Strings must all be released
       String tmpName      = String( CacheItem->name );
       String tmpOuiname   = String ( CacheItem->ouiname );
       String tmpManufname = String( CacheItem->manufname );
@@ -842,6 +853,67 @@ class DBUtils
       return INSERTION_SUCCESS;
     }
 
+    // flushes updated beacon table entries (identity + last telemetry sample) to the beacons table
+    DBMessage insertBeacons()
+    {
+      LatencyProbe probe( PROBE_DB_BEACONS );
+      if(isOOM) {
+        return DB_IS_OOM;
+      }
+      if( !Beacons.hasDirty() ) return INSERTION_IGNORED;
+
+      if( open(BLE_COLLECTOR_DB, false) ) {
+        log_e("Can't open database");
+        return INSERTION_FAILED;
+      }
+      if( DBExec( BLECollectorDB, beaconsCreateTableQuery ) != SQLITE_OK ) {
+        close(BLE_COLLECTOR_DB);
+        return TABLE_CREATION_FAILED;
+      }
+      sprintf(YYYYMMDD_HHMMSS_Str, YYYYMMDD_HHMMSS_Tpl,
+        nowDateTime.year(),
+        nowDateTime.month(),
+        nowDateTime.day(),
+        nowDateTime.hour(),
+        nowDateTime.minute(),
+        nowDateTime.second()
+      );
+      char address[MAC_LEN+1];
+      char ident[BEACON_IDENT_LEN+1];
+      DBMessage ret = INSERTION_SUCCESS;
+      BeaconTableEntry copy; // the scan callback keeps updating the table meanwhile
+      for( uint16_t i=0; i<BEACON_TABLE_SIZE; i++ ) {
+        if( !Beacons.takeDirty( i, copy ) ) continue;
+        BeaconTableEntry* entry = &copy;
+        Beacons.addressToString( entry->address, address );
+        Beacons.describe( &entry->frame, ident );
+        String tmpIdent = String( ident );
+        tmpIdent.replace("'", "''");
+        const BeaconTLMSample* tlm = Beacons.lastTLM( entry );
+        sprintf(insertQuery, beaconInsertQueryTemplate,
+          address,
+          BeaconTypeNames[entry->frame.type],
+          tmpIdent.c_str(),
+          Beacons.txPower( &entry->frame ),
+          entry->rssi,
+          tlm ? tlm->vbatt : 0,
+          ( tlm && tlm->temp != EDDYSTONE_TLM_TEMP_UNSUPPORTED ) ? Beacons.TLMTemperature( tlm->temp ) : 0.0f,
+          tlm ? tlm->advCount : 0,
+          tlm ? tlm->secCount : 0,
+          entry->seen,
+          YYYYMMDD_HHMMSS_Str
+        );
+        log_d( "[INSERT QUERY] : %s", insertQuery );
+        if( DBExec( BLECollectorDB, insertQuery ) != SQLITE_OK ) {
+          Beacons.markDirty( i, entry->address );
+          ret = INSERTION_FAILED;
+        }
+      }
+      close(BLE_COLLECTOR_DB);
+      return ret;
+    }
+
+
     void deleteBLEDevice( const char* address )
     {
       char deleteItemStr[64];
@@ -854,6 +926,7 @@ class DBUtils
 
     void getVendor(uint16_t devid, char *dest)
     {
+      LatencyProbe probe( PROBE_DB_VENDOR );
       if( hasPsram ) {
         getPsramVendor(devid, dest);
       } else {
@@ -864,6 +937,7 @@ class DBUtils
 
     void getOUI(const char* mac, char* dest)
     {
+      LatencyProbe probe( PROBE_DB_OUI );
       if( hasPsram ) {
         getPsramOUI(mac, dest);
       } else {
@@ -900,7 +974,7 @@ class DBUtils
     void createDB()
     {
       log_w("Will create %s (POSIX path) database", BLEMacsDbSQLitePath);
-      //UI.headerStats("DB: creating...");
+      //Render.header("DB: creating...");
       vTaskDelay(1000 / portTICK_PERIOD_MS);
 
       if( strcmp( BLE_FS_TYPE, "littlefs" ) == 0 ) {
@@ -926,29 +1000,29 @@ class DBUtils
         while(1) vTaskDelay(1);
       }
       close(BLE_COLLECTOR_DB);
-      //UI.headerStats(" ");
+      //Render.header(" ");
     }
 
     void dropDB()
     {
-      UI.headerStats("Dropping DB");
+      Render.header("Dropping DB");
       open(BLE_COLLECTOR_DB, false);
       log_d("dropped if exists: %s DB", BLEMacsDbSQLitePath);
       DBExec( BLECollectorDB, dropTableQuery );
       close(BLE_COLLECTOR_DB);
-      UI.headerStats("DB Dropped");
+      Render.header("DB Dropped");
     }
 
     void pruneDB()
     {
-      UI.headerStats("Pruning DB");
+      Render.header("Pruning DB");
       open(BLE_COLLECTOR_DB, false);
       DBExec(BLECollectorDB, pruneTableQuery );
       close(BLE_COLLECTOR_DB);
       entries = getEntries();
       prune_trigger = 0;
-      UI.headerStats("DB Pruned");
-      UI.footerStats();
+      Render.header("DB Pruned");
+      Render.footer();
     }
 
     bool testVendorNames()
@@ -990,48 +1064,54 @@ class DBUtils
       if( insertBTDevice( CacheItem ) != INSERTION_SUCCESS ) {
         // whoops
         Serial.printf("[BUMMER] Failed to re-insert device %s\n", CacheItem->address);
-        //UI.headerStats("Updated failed");
+        //Render.header("Updated failed");
       } else {
-        //UI.headerStats("Updated item");
+        //Render.header("Updated item");
       }
     }
 
     bool updateDBFromCache( BlueToothDevice** SourceCache, bool showBLECards = true, bool resetAfter = true )
     {
-      UI.headerStats("DB replicating...");
-      UI.PrintProgressBar( Out.width );
+      Render.header("DB replicating...");
+      Render.progress( Out.width );
       for(uint16_t i=0; i<BLEDEVCACHE_SIZE ;i++) {
         //vTaskDelay(5);
 
         if( isEmpty( SourceCache[i]->address ) ) continue;
         if( SourceCache[i]->is_anonymous ) {
           if( resetAfter ) {
+            Lock.cacheWriteBegin();
             BLEDevHelper.reset( SourceCache[i] );
+            if( SourceCache == BLEDevRAMCache ) BLEDevLRU.release( i );
+            Lock.cacheWriteEnd();
           }
           continue;
         }
         BLEDevTmp = SourceCache[i];
 
-        takeMuxSemaphore();
+        takeDBLock();
         updateItemFromCache( SourceCache[i] );
-        giveMuxSemaphore();
+        giveDBLock();
 
         if( showBLECards ) {
           float percent = i*100 / BLEDEVCACHE_SIZE;
-          UI.PrintProgressBar( (Out.width * percent) / 100 );
-          UI.printBLECard( (BlueToothDeviceLink){.cacheIndex=i,.device=BLEDevTmp}/*BLEDevTmp*/ ); // render
+          Render.progress( (Out.width * percent) / 100 );
+          Render.card( (BlueToothDeviceLink){.cacheIndex=i,.device=BLEDevTmp}/*BLEDevTmp*/ ); // queued for the display task
         }
 
         //vTaskDelay(5);
 
         if( resetAfter ) {
+          Lock.cacheWriteBegin();
           BLEDevHelper.reset( SourceCache[i] );
+          if( SourceCache == BLEDevRAMCache ) BLEDevLRU.release( i );
+          Lock.cacheWriteEnd();
         }
       }
       cacheState();
-      UI.cacheStats();
-      UI.PrintProgressBar( Out.width );
-      UI.headerStats(" ");
+      Render.cacheStats();
+      Render.progress( Out.width );
+      Render.header(" ");
       return true;
     }
 
@@ -1068,6 +1148,11 @@ class DBUtils
     // vendor Heap/DB lookup
     void getHeapVendor(uint16_t devid, char *dest)
     {
+      const BLEAssignedNumber* company = companyFind( devid );
+      if( company != NULL ) { // well known company id, no need to query the DB
+        copy( dest, company->name, MAX_FIELD_LEN );
+        return;
+      }
       int vendorCacheIdIfExists = vendorHeapExists( devid );
       if(vendorCacheIdIfExists>-1) {
         uint16_t vendorCacheLen = strlen( VendorHeapCache[vendorCacheIdIfExists].vendor );
@@ -1248,7 +1333,6 @@ class DBUtils
     {
       results++;
       if(results < 2) {
-        //BLEDevCacheIndex = BLEDevHelper.getNextCacheIndex(BLEDevRAMCache, BLEDevCacheIndex);
         BLEDevHelper.reset( BLEDevDBCache ); // avoid mixing new and old data
         for (int i = 0; i < argc; i++) {
           BLEDevHelper.set( BLEDevDBCache, azColName[i], ( argv[i] ? argv[i] : "") );
@@ -1271,7 +1355,7 @@ class DBUtils
       if( results > VendorDBSize ) {
         log_w("Too many vendors (max=%d, resultid=%d), ignoring callback", VendorDBSize, results);
         float percent = 100;
-        UI.PrintProgressBar( (Out.width * percent) / 100 );
+        Render.progress( (Out.width * percent) / 100 );
         return 0;
       }
       for (int i = 0; i < argc; i++) {
@@ -1300,7 +1384,7 @@ class DBUtils
       if( results > OUIDBSize ) {
         log_w("Too many OUI's (max=%d, resultid=%d), ignoring callback", OUIDBSize, results);
         float percent = 100;
-        UI.PrintProgressBar( (Out.width * percent) / 100 );
+        Render.progress( (Out.width * percent) / 100 );
         return 0;
       }
       for (int i = 0; i < argc; i++) {
@@ -1346,3 +1430,12 @@ class DBUtils
 
 
 DBUtils DB;
+
+// SD card backends, see Backends.h
+static int  SDDeviceExists( const char* address ) { return DB.deviceExists( address ); }
+static bool SDDeviceInsert( BlueToothDevice *device ) { return DB.insertBTDevice( device ) == DBUtils::INSERTION_SUCCESS; }
+static void SDGetOUI( const char* address, char* ouiname ) { DB.getOUI( address, ouiname ); }
+static void SDGetVendor( uint16_t manufid, char* manufname ) { DB.getVendor( manufid, manufname ); }
+
+static const DeviceStore  SDDevices = { SDDeviceExists, SDDeviceInsert };
+static const VendorLookup SDVendors = { SDGetOUI, SDGetVendor };
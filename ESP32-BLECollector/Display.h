@@ -34,8 +34,19 @@
 #define tft_drawBitmap tft.drawBitmap
 #define SD_begin M5.sd_begin() //M5StackSDBegin // BLE_FS.begin
 #define hasHID() (bool)true // inherited M5.Button support
+#if defined SOFTWARE_SCROLL
+  #define hasHardwareScroll() (bool)false // software scroll (PSRAM ring of rows, see ScrollPanel.h)
+#else
+  #define hasHardwareScroll() (bool)true
+#endif
+#if defined HEADLESS
+  #define hasDisplay() (bool)false // LCD is never started, UI calls are no-ops and sprites never get allocated
+#else
+  #define hasDisplay() (bool)true
+#endif
 #define snapNeedsScrollReset() (bool)false // some TFT models need a scroll reset before screen capture
 #define BLE_FS_TYPE "sd" // sd = fs::SD, sdcard = fs::SD_MMC
+#define sdSharesDisplayBus() (bool)true // fs::SD sits on the TFT SPI bus, SD access also takes the display lock (see Locks.h)
 #define SKIP_INTRO // don't play intro (tft spi access messes up SD/DB init)
 static const int AMIGABALL_YPOS = 50;
 #define BASE_BRIGHTNESS 32 // multiple of 8 otherwise can't turn off ^^
@@ -47,6 +58,8 @@ static const int AMIGABALL_YPOS = 50;
 //#undef BLE_FS_TYPE
 //#define BLE_FS SPIFFS // inherited from ESP32-Chimera-Core
 //#define BLE_FS_TYPE "spiffs" // sd = fs::SD, sdcard = fs::SD_MMC
+//#undef sdSharesDisplayBus
+//#define sdSharesDisplayBus() (bool)false
 
 // Experimental, requires an ESP32-Wrover/Odroid-Go/M5Fire, a huge partition scheme and no OTA
 //#define WITH_WIFI
@@ -166,6 +179,8 @@ static const int AMIGABALL_YPOS = 50;
   #define scrollpanel_height() tft.width() // invert these if scroll fails
   #define scrollpanel_width() tft.height() // invert these if scroll fails
   #define BLE_FS_TYPE "sdcard" // sd = fs::SD, sdcard = fs::SD_MMC
+  #undef sdSharesDisplayBus
+  #define sdSharesDisplayBus() (bool)false // SD_MMC has its own bus
   #warning D-Duino32-XS detected !!
   // ST7789 uses 320x hardware vscroll def, but this model is 240x240 !!
   // https://www.rhydolabz.com/documents/33/ST7789.pdf
@@ -206,6 +221,8 @@ static const int AMIGABALL_YPOS = 50;
   #define GPS_RX 39 // io pin number
   #define GPS_TX 35 // io pin number
   #define BLE_FS_TYPE "sdcard" // "sd" = fs::SD, "sdcard" = fs::SD_MMC
+  #undef sdSharesDisplayBus
+  #define sdSharesDisplayBus() (bool)false // SD_MMC has its own bus
 
   #warning WROVER KIT DETECTED !!
 
@@ -233,6 +250,8 @@ static const int AMIGABALL_YPOS = 50;
   #elif defined LILYGO_WATCH_2019_WITH_TOUCH || defined LILYGO_WATCH_2019_NO_TOUCH
     #undef BLE_FS_TYPE
     #define BLE_FS_TYPE "sdcard" // "sd" = fs::SD, "sdcard" = fs::SD_MMC
+    #undef sdSharesDisplayBus
+    #define sdSharesDisplayBus() (bool)false // SD_MMC has its own bus
     #warning "Scroll is fucked up with LILYGO_WATCH_2019 displays :-("
   #else // TWatch 2020-v1 (default), defined ARDUINO_TWATCH_2020_V1 || defined ARDUINO_TWATCH_2020_V2 // TTGO T-Watch
     #undef BLE_FS
@@ -310,7 +329,12 @@ static const int AMIGABALL_YPOS = 50;
 
 static TFT_eSprite gradientSprite( &tft );  // gradient background
 static TFT_eSprite heapGraphSprite( &tft ); // activity graph
-static TFT_eSprite hallOfMacSprite( &tft ); // mac address badge holder
+static TFT_eSprite heapBarsSprite( &tft ); // activity graph heap columns, scrolled as samples come in
+static TFT_eSprite scrollBgSprite( &tft ); // scroll area background scanline (cached gradient)
+static TFT_eSprite softScrollSprite( &tft ); // scroll area copy when using software scroll
+static TFT_eSprite cardBandSpriteA( &tft ); // BLE card scanlines band
+static TFT_eSprite cardBandSpriteB( &tft ); // BLE card scanlines band (double buffer)
+static TFT_eSprite *cardBandSprites[2] = { &cardBandSpriteA, &cardBandSpriteB };
 
 
 void tft_hScrollTo(uint16_t vsp);
@@ -330,10 +354,10 @@ void tft_begin()
 {
 
   #ifdef __M5STACKUPDATER_H
-    M5.begin( true, false, false, false, false ); // don't start Serial and SD
+    M5.begin( hasDisplay(), false, false, false, false ); // don't start Serial and SD
     //M5.begin();
   #else
-    M5.begin( true, true, false, false, false ); // don't start Serial
+    M5.begin( hasDisplay(), true, false, false, false ); // don't start Serial
   #endif
 
   #if HAS_EXTERNAL_RTC
@@ -346,7 +370,7 @@ void tft_begin()
 
     tft_hScrollTo(0); // reset scroll position
 
-    if( hasHID() ) {
+    if( hasHID() && hasDisplay() ) {
       // build has buttons => enable SD Updater at boot
       // New SD Updater support, requires version >=1.2.8 of https://github.com/tobozo/M5Stack-SD-Updater/
       if( Flash::hasFactory() ) {
@@ -361,6 +385,7 @@ void tft_begin()
 
 void tft_setBrightness( uint8_t brightness )
 {
+  if( !hasDisplay() ) return;
   tft.setBrightness( brightness );
 }
 
@@ -427,7 +452,7 @@ void tft_scrollTo(int32_t vsp)
     tft.scroll(0, vsp);
     tft.pushImage(   s_x_tmp, yDest, s_w_tmp, blockHeight, scrollArea );
     log_v("[block] tft.scroll(0, %d); scrollRect( %d, %d, %d, %d ) ", vsp, s_x_tmp, s_y_tmp, s_w_tmp, s_h_tmp );
-    free( scrollArea );
+    delete[] scrollArea;
   } else {
     // scroll area doesn't fit into buffer, need to split
     log_v("[split] tft.scroll(0, %d); scrollRect( %d, %d, %d, %d ) ", vsp, s_x_tmp, s_y_tmp, s_w_tmp, s_h_tmp );
@@ -476,35 +501,38 @@ void tft_hScrollTo(uint16_t vsp)
 }
 
 
-void tft_fillGradientHRect( uint16_t x, uint16_t y, uint16_t width, uint16_t height, RGBColor colorstart, RGBColor colorend )
+// gradientSprite is kept between calls and only reallocated when its shape changes
+static bool tft_gradientSpriteFit( uint16_t width, uint16_t height )
 {
-  log_v("tft_fillGradientHRect( %d, %d, %d, %d )", x, y, width, height );
+  if( gradientSprite.getBuffer() != NULL && gradientSprite.width() == width && gradientSprite.height() == height ) return true;
+  gradientSprite.deleteSprite();
   gradientSprite.setPsram( false ); // don't bother using psram for that
   //gradientSprite.setSwapBytes( false );
   gradientSprite.setColorDepth( 16 );
-  gradientSprite.createSprite( width, 1);
+  return gradientSprite.createSprite( width, height ) != NULL;
+}
+
+void tft_fillGradientHRect( uint16_t x, uint16_t y, uint16_t width, uint16_t height, RGBColor colorstart, RGBColor colorend )
+{
+  log_v("tft_fillGradientHRect( %d, %d, %d, %d )", x, y, width, height );
+  if( !tft_gradientSpriteFit( width, 1 ) ) return;
   tft.startWrite();
   gradientSprite.drawGradientHLine( 0, 0, width, colorstart, colorend );
   for( uint16_t h = 0; h < height; h++ ) {
     gradientSprite.pushSprite( x, y+h );
   }
   tft.endWrite();
-  gradientSprite.deleteSprite();
 }
 
 void tft_fillGradientVRect( uint16_t x, uint16_t y, uint16_t width, uint16_t height, RGBColor colorstart, RGBColor colorend )
 {
-  gradientSprite.setPsram( false ); // don't bother using psram for that
-  //gradientSprite.setSwapBytes( false );
-  gradientSprite.setColorDepth( 16 );
-  gradientSprite.createSprite( 1, height);
+  if( !tft_gradientSpriteFit( 1, height ) ) return;
   tft.startWrite();
   gradientSprite.drawGradientVLine( 0, 0, height, colorstart, colorend );
   for( uint16_t w = 0; w < width; w++ ) {
     gradientSprite.pushSprite( x+w, y );
   }
   tft.endWrite();
-  gradientSprite.deleteSprite();
 }
 
 void tft_drawGradientHLine( uint32_t x, uint32_t y, uint32_t w, RGBColor colorstart, RGBColor colorend )
@@ -727,6 +755,7 @@ const char* addressTpl = "  %s";
 const char* dbmTpl = "%ddBm    ";
 const char* ouiTpl = "      %s";
 const char* appearanceTpl = "  Appearance: %d";
+const char* appearanceNamedTpl = "  Appearance: %s";
 const char* manufTpl = "      %s";
 const char* nameTpl = "      %s";
 const char* screenshotFilenameTpl = "/screenshot-%04d-%02d-%02d_%02dh%02dm%02ds.565";
@@ -740,6 +769,7 @@ static char hitsTimeStampStr[48] = {'\0'};
 static char hitsStr[29] = {'\0'};
 static char nameStr[38] = {'\0'};
 static char ouiStr[38] = {'\0'};
+static char serviceStr[38] = {'\0'};
 static char appearanceStr[48] = {'\0'};
 static char manufStr[38] = {'\0'};
 
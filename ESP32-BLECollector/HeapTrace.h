@@ -0,0 +1,255 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Heap fragmentation and allocation tracing
+ *
+ * The 'heap' command reports, for internal RAM and PSRAM separately, the
+ * free bytes, largest free block, lowest watermark, block counts and a
+ * fragmentation ratio (1 - largest free block / free bytes): a heap can have
+ * plenty of free bytes and still fail a 4KB allocation.
+ *
+ * With WITH_HEAP_TRACE defined (see Settings.h or use a build flag), memory
+ * is also attributed to tags:
+ *
+ *   - sqlite: exact, through a SQLITE_CONFIG_MALLOC wrapper around the
+ *     default allocator
+ *   - BLE stack, String, sprite, cache: HeapTraceScope measures the heap
+ *     retained (free before - free after) by a tagged block of code
+ *
+ * and failed allocations are counted from the heap_caps failure callback.
+ * The report lists the tags sorted by live bytes, a tag growing across
+ * reports is leaking.
+ *
+ */
+
+#include <esp_heap_caps.h>
+
+enum HeapTag : uint8_t
+{
+  HEAP_TAG_SQLITE = 0,
+  HEAP_TAG_BLE,
+  HEAP_TAG_STRING,
+  HEAP_TAG_SPRITE,
+  HEAP_TAG_CACHE,
+  HEAP_TAGS_COUNT
+};
+
+static const char* HeapTagNames[HEAP_TAGS_COUNT] = { "sqlite", "BLE stack", "String", "sprite", "cache" };
+
+struct HeapTagStats
+{
+  uint32_t calls;    // allocations (sqlite) or traced scopes
+  uint32_t frees;    // sqlite only
+  uint32_t failures; // sqlite only
+  int32_t  live;     // bytes currently attributed
+  int32_t  peak;     // highest live
+  int32_t  largest;  // biggest single allocation or scope retention
+};
+
+struct HeapRegionInfo
+{
+  const char* name;
+  uint32_t caps;
+  multi_heap_info_t info;
+  uint8_t fragmentation; // %
+};
+
+static HeapTagStats HeapTagsStats[HEAP_TAGS_COUNT];
+static uint32_t HeapFailedAllocs = 0; // for statistics
+static size_t   HeapLastFailedSize = 0;
+static uint32_t HeapLastFailedCaps = 0;
+#ifdef WITH_HEAP_TRACE
+static sqlite3_mem_methods SqliteDefaultMem; // wrapped allocator
+#endif
+
+
+class HeapTraceUtils
+{
+  public:
+
+    static void region( HeapRegionInfo &region, const char* name, uint32_t caps )
+    {
+      region.name = name;
+      region.caps = caps;
+      heap_caps_get_info( &region.info, caps );
+      region.fragmentation = region.info.total_free_bytes > 0 ? 100 - ( (uint64_t)region.info.largest_free_block * 100 / region.info.total_free_bytes ) : 0;
+    }
+
+    static void internal( HeapRegionInfo &info )
+    {
+      region( info, "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT );
+    }
+
+    static void psram( HeapRegionInfo &info )
+    {
+      region( info, "psram", MALLOC_CAP_SPIRAM );
+    }
+
+    static void record( HeapTag tag, int32_t bytes )
+    {
+      HeapTagStats &stats = HeapTagsStats[tag];
+      stats.calls++;
+      stats.live += bytes;
+      if( stats.live > stats.peak ) stats.peak = stats.live;
+      if( bytes > stats.largest ) stats.largest = bytes;
+    }
+
+    // must run before sqlite3_initialize()
+    static void init()
+    {
+      #ifdef WITH_HEAP_TRACE
+        static bool installed = false;
+        if( installed ) return;
+        installed = true;
+        heap_caps_register_failed_alloc_callback( onFailedAlloc );
+        if( sqlite3_config( SQLITE_CONFIG_GETMALLOC, &SqliteDefaultMem ) == SQLITE_OK ) {
+          sqlite3_mem_methods traced = SqliteDefaultMem;
+          traced.xMalloc  = sqliteMalloc;
+          traced.xFree    = sqliteFree;
+          traced.xRealloc = sqliteRealloc;
+          if( sqlite3_config( SQLITE_CONFIG_MALLOC, &traced ) != SQLITE_OK ) {
+            log_e("Can't install the sqlite allocator hook");
+          }
+        }
+      #endif
+    }
+
+    static void dump()
+    {
+      HeapRegionInfo regions[2];
+      internal( regions[0] );
+      psram( regions[1] );
+      Serial.printf("%-9s %10s %10s %10s %7s %7s %6s\n", "Region", "free", "largest", "min free", "blocks", "free b", "frag%");
+      for( uint8_t i=0; i<2; i++ ) {
+        if( regions[i].info.total_free_bytes == 0 && regions[i].info.total_allocated_bytes == 0 ) continue; // no psram
+        Serial.printf("%-9s %10d %10d %10d %7d %7d %6d\n",
+          regions[i].name,
+          regions[i].info.total_free_bytes,
+          regions[i].info.largest_free_block,
+          regions[i].info.minimum_free_bytes,
+          regions[i].info.allocated_blocks,
+          regions[i].info.free_blocks,
+          regions[i].fragmentation
+        );
+      }
+      #ifdef WITH_HEAP_TRACE
+        Serial.printf("Failed allocations: %d (last: %d bytes, caps 0x%08x)\n", HeapFailedAllocs, HeapLastFailedSize, HeapLastFailedCaps );
+        uint8_t order[HEAP_TAGS_COUNT];
+        for( uint8_t i=0; i<HEAP_TAGS_COUNT; i++ ) order[i] = i;
+        // insertion sort by live bytes, descending
+        for( uint8_t i=1; i<HEAP_TAGS_COUNT; i++ ) {
+          uint8_t tag = order[i];
+          int8_t j = i - 1;
+          while( j >= 0 && HeapTagsStats[order[j]].live < HeapTagsStats[tag].live ) {
+            order[j+1] = order[j];
+            j--;
+          }
+          order[j+1] = tag;
+        }
+        Serial.printf("%-10s %10s %10s %10s %8s %8s %8s\n", "Tag", "live", "peak", "largest", "calls", "frees", "failed");
+        for( uint8_t i=0; i<HEAP_TAGS_COUNT; i++ ) {
+          const HeapTagStats &stats = HeapTagsStats[order[i]];
+          Serial.printf("%-10s %10d %10d %10d %8d %8d %8d\n", HeapTagNames[order[i]], stats.live, stats.peak, stats.largest, stats.calls, stats.frees, stats.failures );
+        }
+      #else
+        Serial.println("Allocation tags disabled, build with WITH_HEAP_TRACE to enable");
+      #endif
+    }
+
+  private:
+
+    #ifdef WITH_HEAP_TRACE
+
+      static void onFailedAlloc( size_t size, uint32_t caps, const char *function_name )
+      {
+        // may run in a context where logging is unsafe, only record
+        HeapFailedAllocs++;
+        HeapLastFailedSize = size;
+        HeapLastFailedCaps = caps;
+      }
+
+      static void* sqliteMalloc( int size )
+      {
+        void* ptr = SqliteDefaultMem.xMalloc( size );
+        if( ptr == NULL ) {
+          HeapTagsStats[HEAP_TAG_SQLITE].failures++;
+          return NULL;
+        }
+        record( HEAP_TAG_SQLITE, SqliteDefaultMem.xSize( ptr ) );
+        return ptr;
+      }
+
+      static void sqliteFree( void* ptr )
+      {
+        if( ptr != NULL ) {
+          HeapTagsStats[HEAP_TAG_SQLITE].live -= SqliteDefaultMem.xSize( ptr );
+          HeapTagsStats[HEAP_TAG_SQLITE].frees++;
+        }
+        SqliteDefaultMem.xFree( ptr );
+      }
+
+      static void* sqliteRealloc( void* ptr, int size )
+      {
+        int32_t previous = ptr != NULL ? SqliteDefaultMem.xSize( ptr ) : 0;
+        void* newPtr = SqliteDefaultMem.xRealloc( ptr, size );
+        if( newPtr == NULL ) {
+          HeapTagsStats[HEAP_TAG_SQLITE].failures++;
+          return NULL;
+        }
+        record( HEAP_TAG_SQLITE, SqliteDefaultMem.xSize( newPtr ) - previous );
+        return newPtr;
+      }
+
+    #endif
+
+};
+
+HeapTraceUtils HeapTrace;
+
+
+// attributes the heap retained by the enclosing scope to a tag, no-op unless WITH_HEAP_TRACE
+struct HeapTraceScope
+{
+  #ifdef WITH_HEAP_TRACE
+    HeapTag tag;
+    size_t  freeBefore;
+    HeapTraceScope( HeapTag _tag ) : tag( _tag ), freeBefore( heap_caps_get_free_size( MALLOC_CAP_8BIT ) ) { }
+    ~HeapTraceScope() { HeapTrace.record( tag, (int32_t)freeBefore - (int32_t)heap_caps_get_free_size( MALLOC_CAP_8BIT ) ); }
+  #else
+    HeapTraceScope( HeapTag _tag ) { }
+  #endif
+};
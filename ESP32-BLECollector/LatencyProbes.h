@@ -0,0 +1,308 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Pipeline latency probes
+ *
+ * Scoped probes read the CPU cycle counter around each scan stage and DB
+ * call and record the elapsed cycles into a log2 histogram (bucket n holds
+ * durations in [2^(n-1), 2^n) cycles), percentiles are reported as the
+ * upper bound of the bucket they fall in. Recording is a few instructions
+ * and constant memory, so the probes stay enabled.
+ *
+ * The cycle counter is per core: a probe must start and stop on the same
+ * core, which holds for all the pinned tasks measured here. It wraps after
+ * 2^32 cycles (~17s at 240MHz), a longer stage is recorded modulo 2^32.
+ *
+ * The histograms are shared by the tasks of both cores, updates and reads
+ * go through ProbeMux (readers work on a copy).
+ *
+ * Stage meters are coarser: they add up the time each pipeline stage task
+ * spends working (as opposed to waiting on its queue) and turn it into a
+ * utilization ratio over a STAGE_WINDOW_MS window. They use esp_timer so
+ * the stages may live on either core.
+ *
+ */
+
+#ifndef PROBES_LOG_INTERVAL_MS // override this from Settings.h
+#define PROBES_LOG_INTERVAL_MS 60000 // how often the summary line is logged, 0 = never
+#endif
+#ifndef STAGE_WINDOW_MS // override this from Settings.h
+#define STAGE_WINDOW_MS 10000 // utilization averaging window
+#endif
+#define PROBES_BUCKETS 33
+
+enum ProbeId : uint8_t
+{
+  PROBE_ON_RESULT = 0,
+  PROBE_POPULATE,
+  PROBE_IFEXISTS,
+  PROBE_RENDER,
+  PROBE_PROPAGATE,
+  PROBE_DB_EXISTS,
+  PROBE_DB_INSERT,
+  PROBE_DB_BEACONS,
+  PROBE_DB_OUI,
+  PROBE_DB_VENDOR,
+  PROBES_COUNT
+};
+
+static const char* ProbeNames[PROBES_COUNT] =
+{
+  "onResult",
+  "onScanPopulate",
+  "onScanIfExists",
+  "onScanRender",
+  "onScanPropagate",
+  "DB.deviceExists",
+  "DB.insertBTDevice",
+  "DB.insertBeacons",
+  "DB.getOUI",
+  "DB.getVendor"
+};
+
+struct ProbeHistogram
+{
+  uint32_t buckets[PROBES_BUCKETS];
+  uint32_t count;
+  uint32_t max; // cycles
+  uint64_t sum; // cycles
+};
+
+enum StageId : uint8_t
+{
+  STAGE_ENRICH = 0, // scan task: populate, dedup/cache lookup, render and persist hand-off
+  STAGE_PERSIST,    // persist task: DB inserts
+  STAGE_RENDER,     // display task: cards, header, stats
+  STAGES_COUNT
+};
+
+static const char* StageNames[STAGES_COUNT] =
+{
+  "enrich",
+  "persist",
+  "render"
+};
+
+struct StageMeter
+{
+  uint64_t busyTotal;   // us
+  uint64_t windowBusy;  // us
+  int64_t  windowStart; // esp_timer us
+  float    utilization; // last completed window, 0..1
+};
+
+static ProbeHistogram ProbeHistograms[PROBES_COUNT];
+static StageMeter StageMeters[STAGES_COUNT];
+static portMUX_TYPE StageMux = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE ProbeMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t ProbesLastLog = 0;
+
+
+class LatencyProbesUtils
+{
+  public:
+
+    static uint32_t now()
+    {
+      return ESP.getCycleCount();
+    }
+
+    static void record( ProbeId id, uint32_t cycles )
+    {
+      uint8_t b = bucket( cycles );
+      portENTER_CRITICAL( &ProbeMux );
+      ProbeHistogram &h = ProbeHistograms[id];
+      h.buckets[b]++;
+      h.count++;
+      h.sum += cycles;
+      if( cycles > h.max ) h.max = cycles;
+      portEXIT_CRITICAL( &ProbeMux );
+    }
+
+    // consistent copy of a histogram
+    static void snapshot( ProbeId id, ProbeHistogram &h )
+    {
+      portENTER_CRITICAL( &ProbeMux );
+      h = ProbeHistograms[id];
+      portEXIT_CRITICAL( &ProbeMux );
+    }
+
+    // upper bound (µs) of the bucket holding the p-th percentile
+    static uint32_t percentile( ProbeId id, uint8_t p )
+    {
+      ProbeHistogram h;
+      snapshot( id, h );
+      return percentile( h, p );
+    }
+
+    static uint32_t percentile( const ProbeHistogram &h, uint8_t p )
+    {
+      if( h.count == 0 ) return 0;
+      uint32_t rank = ( (uint64_t)h.count * p + 99 ) / 100;
+      uint32_t seen = 0;
+      for( uint8_t i=0; i<PROBES_BUCKETS; i++ ) {
+        seen += h.buckets[i];
+        if( seen >= rank ) {
+          uint32_t upper = i == 0 ? 0 : i >= 32 ? 0xffffffff : ( 1UL << i ) - 1;
+          if( upper > h.max ) upper = h.max; // tighter bound for the last bucket
+          return toMicros( upper );
+        }
+      }
+      return toMicros( h.max );
+    }
+
+    static uint32_t toMicros( uint32_t cycles )
+    {
+      return cycles / ESP.getCpuFreqMHz();
+    }
+
+    static void reset()
+    {
+      portENTER_CRITICAL( &ProbeMux );
+      memset( ProbeHistograms, 0, sizeof( ProbeHistograms ) );
+      portEXIT_CRITICAL( &ProbeMux );
+      portENTER_CRITICAL( &StageMux );
+      memset( StageMeters, 0, sizeof( StageMeters ) );
+      portEXIT_CRITICAL( &StageMux );
+    }
+
+    static void busy( StageId id, int64_t start, int64_t end )
+    {
+      portENTER_CRITICAL( &StageMux );
+      StageMeter &m = StageMeters[id];
+      m.busyTotal  += end - start;
+      m.windowBusy += end - start;
+      roll( m, end );
+      portEXIT_CRITICAL( &StageMux );
+    }
+
+    // busy share of the last completed window, idle stages decay to 0
+    static float utilization( StageId id )
+    {
+      portENTER_CRITICAL( &StageMux );
+      roll( StageMeters[id], esp_timer_get_time() );
+      float ret = StageMeters[id].utilization;
+      portEXIT_CRITICAL( &StageMux );
+      return ret;
+    }
+
+    static void dumpStages()
+    {
+      Serial.printf("%-18s %10s %12s\n", "Stage", "util %", "busy ms");
+      for( uint8_t i=0; i<STAGES_COUNT; i++ ) {
+        StageId id = (StageId)i;
+        Serial.printf("%-18s %10.1f %12lld\n", StageNames[id], utilization( id ) * 100.0, StageMeters[id].busyTotal / 1000 );
+      }
+    }
+
+    static void dump()
+    {
+      Serial.printf("%-18s %8s %10s %10s %10s %10s\n", "Probe", "count", "avg us", "p50 us", "p99 us", "max us");
+      for( uint8_t i=0; i<PROBES_COUNT; i++ ) {
+        ProbeId id = (ProbeId)i;
+        ProbeHistogram h;
+        snapshot( id, h );
+        Serial.printf("%-18s %8d %10d %10d %10d %10d\n",
+          ProbeNames[id],
+          h.count,
+          h.count > 0 ? toMicros( h.sum / h.count ) : 0,
+          percentile( h, 50 ),
+          percentile( h, 99 ),
+          toMicros( h.max )
+        );
+      }
+    }
+
+    // one line summary, throttled to PROBES_LOG_INTERVAL_MS
+    static void logPeriodic()
+    {
+      if( PROBES_LOG_INTERVAL_MS == 0 || millis() - ProbesLastLog < PROBES_LOG_INTERVAL_MS ) return;
+      ProbesLastLog = millis();
+      char line[512];
+      size_t len = 0;
+      for( uint8_t i=0; i<PROBES_COUNT && len < sizeof( line ); i++ ) {
+        ProbeId id = (ProbeId)i;
+        ProbeHistogram h;
+        snapshot( id, h );
+        if( h.count == 0 ) continue;
+        len += snprintf( line+len, sizeof( line )-len, "[%s:%d/%d/%d]", ProbeNames[id], percentile( h, 50 ), percentile( h, 99 ), toMicros( h.max ) );
+      }
+      if( len > 0 ) log_i("[Latency p50/p99/max us]%s", line );
+    }
+
+  private:
+
+    static void roll( StageMeter &m, int64_t now )
+    {
+      if( m.windowStart == 0 ) m.windowStart = now;
+      int64_t elapsed = now - m.windowStart;
+      if( elapsed < STAGE_WINDOW_MS * 1000LL ) return;
+      float ratio = (float)m.windowBusy / elapsed;
+      m.utilization = ratio > 1.0 ? 1.0 : ratio; // a busy period may straddle two windows
+      m.windowBusy  = 0;
+      m.windowStart = now;
+    }
+
+    static uint8_t bucket( uint32_t cycles )
+    {
+      return cycles == 0 ? 0 : 32 - __builtin_clz( cycles );
+    }
+
+};
+
+
+LatencyProbesUtils Probes;
+
+
+// records the lifetime of the enclosing scope into a probe
+struct LatencyProbe
+{
+  ProbeId  id;
+  uint32_t start;
+  LatencyProbe( ProbeId _id ) : id( _id ), start( Probes.now() ) { }
+  ~LatencyProbe() { Probes.record( id, Probes.now() - start ); }
+};
+
+
+// adds the lifetime of the enclosing scope to a stage busy time
+struct StageBusy
+{
+  StageId id;
+  int64_t start;
+  StageBusy( StageId _id ) : id( _id ), start( esp_timer_get_time() ) { }
+  ~StageBusy() { Probes.busy( id, start, esp_timer_get_time() ); }
+};
@@ -0,0 +1,175 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Locks
+ *
+ * One mutex per shared resource instead of a global one, so rendering on
+ * core 1 doesn't stall DB work on core 0 (and vice versa):
+ *
+ *   LOCK_DB      : SD filesystem and sqlite (DB init, replication, directory listings)
+ *   LOCK_CACHE   : BLEDevRAMCache writers and BLEDevLRU
+ *   LOCK_DISPLAY : the TFT (and the M5 peripherals sharing its bus)
+ *
+ * When the SD shares the TFT SPI bus (sdSharesDisplayBus(), see Display.h)
+ * takeDBLock() also takes LOCK_DISPLAY, after LOCK_DB, so SD and TFT
+ * transactions never interleave.
+ *
+ * Lock order: always acquire in the enum order (DB, then cache, then
+ * display) and never take a lock while holding one that comes after it,
+ * violations are logged.
+ *
+ * Readers of BLEDevRAMCache don't lock: writers bump BLEDevCacheSeq before
+ * and after a change (odd = write in progress), readers copy what they need
+ * and retry if the sequence changed meanwhile (seqlock).
+ *
+ * Every lock counts its acquisitions, how many had to wait, and the total
+ * and max wait time.
+ *
+ */
+
+enum LockId : uint8_t
+{
+  LOCK_DB = 0,
+  LOCK_CACHE,
+  LOCK_DISPLAY,
+  LOCKS_COUNT
+};
+
+static const char* LockNames[LOCKS_COUNT] = { "db", "cache", "display" };
+
+struct LockStats
+{
+  uint32_t acquired;
+  uint32_t contended;
+  uint64_t waitTotal; // µs
+  uint32_t waitMax;   // µs
+};
+
+static SemaphoreHandle_t Locks[LOCKS_COUNT] = { NULL };
+static LockStats LocksStats[LOCKS_COUNT];
+static volatile uint32_t BLEDevCacheSeq = 0; // even = stable, odd = being written
+
+
+class LockUtils
+{
+  public:
+
+    static void init()
+    {
+      for( uint8_t i=0; i<LOCKS_COUNT; i++ ) {
+        if( Locks[i] == NULL ) Locks[i] = xSemaphoreCreateMutex();
+      }
+    }
+
+    static void take( LockId id )
+    {
+      if( Locks[id] == NULL ) return; // not initialized yet
+      checkOrder( id );
+      LockStats &stats = LocksStats[id];
+      if( xSemaphoreTake( Locks[id], 0 ) != pdTRUE ) {
+        int64_t start = esp_timer_get_time();
+        xSemaphoreTake( Locks[id], portMAX_DELAY );
+        uint32_t wait = esp_timer_get_time() - start;
+        stats.contended++;
+        stats.waitTotal += wait;
+        if( wait > stats.waitMax ) stats.waitMax = wait;
+      }
+      stats.acquired++;
+    }
+
+    static void give( LockId id )
+    {
+      if( Locks[id] == NULL ) return;
+      xSemaphoreGive( Locks[id] );
+    }
+
+    // BLEDevRAMCache writers
+    static void cacheWriteBegin()
+    {
+      take( LOCK_CACHE );
+      __atomic_add_fetch( &BLEDevCacheSeq, 1, __ATOMIC_ACQ_REL );
+    }
+
+    static void cacheWriteEnd()
+    {
+      __atomic_add_fetch( &BLEDevCacheSeq, 1, __ATOMIC_ACQ_REL );
+      give( LOCK_CACHE );
+    }
+
+    // BLEDevRAMCache readers, returns false if a write is in progress
+    static bool cacheReadBegin( uint32_t &seq )
+    {
+      seq = __atomic_load_n( &BLEDevCacheSeq, __ATOMIC_ACQUIRE );
+      return ( seq & 1 ) == 0;
+    }
+
+    // true when the data read since cacheReadBegin() is consistent
+    static bool cacheReadValid( uint32_t seq )
+    {
+      __atomic_thread_fence( __ATOMIC_ACQUIRE );
+      return __atomic_load_n( &BLEDevCacheSeq, __ATOMIC_ACQUIRE ) == seq;
+    }
+
+    static void dump()
+    {
+      Serial.printf("%-18s %8s %10s %10s %10s\n", "Lock", "taken", "contended", "wait us", "max us");
+      for( uint8_t i=0; i<LOCKS_COUNT; i++ ) {
+        Serial.printf("%-18s %8d %10d %10lld %10d\n", LockNames[i], LocksStats[i].acquired, LocksStats[i].contended, LocksStats[i].waitTotal, LocksStats[i].waitMax );
+      }
+    }
+
+  private:
+
+    static void checkOrder( LockId id )
+    {
+      TaskHandle_t self = xTaskGetCurrentTaskHandle();
+      for( uint8_t i=id+1; i<LOCKS_COUNT; i++ ) {
+        if( Locks[i] != NULL && xSemaphoreGetMutexHolder( Locks[i] ) == self ) {
+          log_e("[LOCK ORDER] taking '%s' while holding '%s'", LockNames[id], LockNames[i] );
+        }
+      }
+    }
+
+};
+
+
+LockUtils Lock;
+
+#define takeDisplayLock() Lock.take( LOCK_DISPLAY )
+#define giveDisplayLock() Lock.give( LOCK_DISPLAY )
+#define takeDBLock()      do { Lock.take( LOCK_DB ); if( sdSharesDisplayBus() && hasDisplay() ) Lock.take( LOCK_DISPLAY ); } while(0)
+#define giveDBLock()      do { if( sdSharesDisplayBus() && hasDisplay() ) Lock.give( LOCK_DISPLAY ); Lock.give( LOCK_DB ); } while(0)
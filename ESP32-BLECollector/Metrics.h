@@ -0,0 +1,297 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Machine readable metrics
+ *
+ * Snapshot of the collector counters and gauges in the Prometheus text
+ * exposition format or as a flat JSON object, written to any Print (Serial
+ * with the 'metrics' command). When WITH_WIFI is defined the same snapshot
+ * is served over HTTP on METRICS_HTTP_PORT (/metrics and /metrics.json)
+ * while WiFi is up.
+ *
+ */
+
+#ifndef METRICS_HTTP_PORT // override this from Settings.h
+#define METRICS_HTTP_PORT 8080
+#endif
+#define METRICS_PREFIX "blecollector_"
+
+#ifdef WITH_WIFI
+  #include <WebServer.h>
+  #include <StreamString.h>
+#endif
+
+enum MetricsFormat
+{
+  METRICS_PROMETHEUS,
+  METRICS_JSON
+};
+
+static uint32_t AdvReceivedCount = 0; // every onResult call, never reset
+static uint32_t MetricsLastPoll = 0;
+static uint32_t MetricsLastAdvCount = 0;
+#ifdef WITH_WIFI
+static bool MetricsServerRunning = false;
+#endif
+
+
+// emits one sample per call, labels come both as Prometheus labels and as a JSON key suffix
+struct MetricsWriter
+{
+  Print &out;
+  MetricsFormat format;
+  const char* lastName = NULL;
+  bool first = true;
+
+  MetricsWriter( Print &_out, MetricsFormat _format ) : out( _out ), format( _format ) { }
+
+  void begin()
+  {
+    if( format == METRICS_JSON ) out.print("{");
+  }
+
+  void end()
+  {
+    out.print( format == METRICS_JSON ? "}\n" : "" );
+  }
+
+  void counter( const char* name, const char* help, double value, const char* labels=NULL, const char* suffix=NULL )
+  {
+    sample( name, "counter", help, value, labels, suffix );
+  }
+
+  void gauge( const char* name, const char* help, double value, const char* labels=NULL, const char* suffix=NULL )
+  {
+    sample( name, "gauge", help, value, labels, suffix );
+  }
+
+  void sample( const char* name, const char* type, const char* help, double value, const char* labels, const char* suffix )
+  {
+    if( format == METRICS_JSON ) {
+      out.printf( "%s\"%s%s%s\":%.3f", first ? "" : ",", name, suffix ? "." : "", suffix ? suffix : "", value );
+    } else {
+      if( lastName == NULL || strcmp( lastName, name ) != 0 ) {
+        out.printf( "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s %s\n", name, help, name, type );
+      }
+      out.printf( METRICS_PREFIX "%s%s%s%s %.3f\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "", value );
+    }
+    lastName = name;
+    first = false;
+  }
+};
+
+
+class MetricsUtils
+{
+  public:
+
+    static void write( Print &out, MetricsFormat format )
+    {
+      MetricsWriter w( out, format );
+      uint32_t now = millis();
+      char labels[64];
+      char suffix[48];
+
+      w.begin();
+      w.gauge(   "uptime_seconds",          "Seconds since boot", now / 1000.0 );
+      w.counter( "scan_rounds_total",       "Completed scans", scan_rounds );
+      w.counter( "advertisements_total",    "Advertisements received by the scan callback", AdvReceivedCount );
+      w.gauge(   "advertisements_per_second", "Advertisements rate since the previous poll", advRate( now ) );
+      w.counter( "advertisements_duplicate_total", "Advertisements absorbed by the dedup window", AdvDuplicatesCount );
+      w.gauge(   "devices_window",          "Distinct addresses heard during the dedup window", AdvDedup.activeCount( now ) );
+      w.gauge(   "devices_per_scan",        "Devices processed by the last scan", devicesCount );
+      w.gauge(   "db_entries",              "Devices stored in the DB", entries );
+      w.gauge(   "rpa_groups",              "Rotating addresses grouped under a stable identity", RPAGroups.groupedCount() );
+      w.counter( "rpa_rotations_total",     "Random address rotations detected", RPARotationsCount );
+      w.gauge(   "beacons",                 "Beacons in the beacon table", Beacons.count() );
+
+      w.counter( "cache_hits_total",        "Cache hits per cache", BLEDevCacheHit,    "cache=\"device\"",    "device" );
+      w.counter( "cache_hits_total",        "Cache hits per cache", AnonymousCacheHit, "cache=\"anonymous\"", "anonymous" );
+      w.counter( "cache_hits_total",        "Cache hits per cache", OuiCacheHit,       "cache=\"oui\"",       "oui" );
+      w.counter( "cache_hits_total",        "Cache hits per cache", VendorCacheHit,    "cache=\"vendor\"",    "vendor" );
+      w.counter( "cache_lookups_total",     "Cache lookups per cache", ProbeHistograms[PROBE_IFEXISTS].count,  "cache=\"device\"", "device" );
+      w.counter( "cache_lookups_total",     "Cache lookups per cache", ProbeHistograms[PROBE_DB_OUI].count,    "cache=\"oui\"",    "oui" );
+      w.counter( "cache_lookups_total",     "Cache lookups per cache", ProbeHistograms[PROBE_DB_VENDOR].count, "cache=\"vendor\"", "vendor" );
+      w.gauge(   "cache_fill_percent",      "Cache fill level per cache", BLEDevCacheUsed, "cache=\"device\"", "device" );
+      w.gauge(   "cache_fill_percent",      "Cache fill level per cache", OuiCacheUsed,    "cache=\"oui\"",    "oui" );
+      w.gauge(   "cache_fill_percent",      "Cache fill level per cache", VendorCacheUsed, "cache=\"vendor\"", "vendor" );
+      w.counter( "cache_evictions_total",   "Device cache evictions", BLEDevCacheEvictions );
+      w.counter( "cache_promotions_total",  "Device cache promotions to the protected segment", BLEDevCachePromotions );
+
+      for( uint8_t i=0; i<PROBES_COUNT; i++ ) {
+        ProbeId id = (ProbeId)i;
+        const char* quantiles[] = { "0.5", "0.99", "1" };
+        const char* suffixes[]  = { "p50", "p99", "max" };
+        ProbeHistogram h;
+        Probes.snapshot( id, h );
+        uint32_t values[] = { Probes.percentile( h, 50 ), Probes.percentile( h, 99 ), Probes.toMicros( h.max ) };
+        for( uint8_t q=0; q<3; q++ ) {
+          snprintf( labels, sizeof( labels ), "probe=\"%s\",quantile=\"%s\"", ProbeNames[id], quantiles[q] );
+          snprintf( suffix, sizeof( suffix ), "%s.%s", ProbeNames[id], suffixes[q] );
+          w.gauge( "latency_microseconds", "Pipeline stage latency", values[q], labels, suffix );
+        }
+      }
+      for( uint8_t i=0; i<PROBES_COUNT; i++ ) {
+        snprintf( labels, sizeof( labels ), "probe=\"%s\"", ProbeNames[i] );
+        w.counter( "latency_samples_total", "Pipeline stage samples", ProbeHistograms[i].count, labels, ProbeNames[i] );
+      }
+
+      w.gauge(   "queue_depth",             "Items waiting per queue", AdvTraceQueue != NULL ? uxQueueMessagesWaiting( AdvTraceQueue ) : 0, "queue=\"trace\"", "trace" );
+      w.gauge(   "queue_depth",             "Items waiting per queue", scan_cursor, "queue=\"scan\"", "scan" );
+      w.gauge(   "queue_depth",             "Items waiting per queue", Render.depth(), "queue=\"render\"", "render" );
+      w.gauge(   "queue_depth",             "Items waiting per queue", Persist.depth(), "queue=\"persist\"", "persist" );
+      w.counter( "queue_dropped_total",     "Items dropped per queue", AdvTraceDropped, "queue=\"trace\"", "trace" );
+      w.counter( "queue_dropped_total",     "Items dropped per queue", RenderCardsDropped, "queue=\"render\"", "render" );
+      w.counter( "persist_queued_total",    "Devices handed over to the persist task", PersistQueued );
+      w.counter( "persist_inline_total",    "Devices inserted by the scan task (persist off or queue full)", PersistInline );
+      w.counter( "persist_stalls_total",    "Scan task waits for the persist queue to drain", PersistStalls );
+      w.counter( "persist_failed_total",    "Failed DB inserts", PersistFailed );
+      w.gauge(   "postscan_wall_microseconds", "Last post-scan processing wall time", PersistLastEnrichUs, "path=\"enrich\"", "enrich" );
+      w.gauge(   "postscan_wall_microseconds", "Last post-scan processing wall time", PersistLastTotalUs,  "path=\"persist\"", "persist" );
+      w.counter( "postscan_rounds_total",   "Scan rounds timed", PersistRounds );
+      for( uint8_t i=0; i<STAGES_COUNT; i++ ) {
+        snprintf( labels, sizeof( labels ), "stage=\"%s\"", StageNames[i] );
+        w.gauge( "stage_utilization_ratio", "Busy share of the pipeline stage task", Probes.utilization( (StageId)i ), labels, StageNames[i] );
+      }
+      for( uint8_t i=0; i<STAGES_COUNT; i++ ) {
+        snprintf( labels, sizeof( labels ), "stage=\"%s\"", StageNames[i] );
+        w.counter( "stage_busy_microseconds_total", "Time the pipeline stage task spent working", StageMeters[i].busyTotal, labels, StageNames[i] );
+      }
+      w.counter( "render_coalesced_total",  "Render commands merged into a pending one", RenderCoalesced );
+      w.counter( "render_frames_total",     "Display task frames that had something to draw", RenderFrames );
+      w.counter( "avatar_cache_hits_total",   "Mac avatars served from cache", AvatarCacheHits );
+      w.counter( "avatar_cache_misses_total", "Mac avatars decoded on miss", AvatarCacheMisses );
+
+      for( uint8_t i=0; i<LOCKS_COUNT; i++ ) {
+        snprintf( labels, sizeof( labels ), "lock=\"%s\"", LockNames[i] );
+        w.counter( "lock_acquired_total", "Lock acquisitions", LocksStats[i].acquired, labels, LockNames[i] );
+      }
+      for( uint8_t i=0; i<LOCKS_COUNT; i++ ) {
+        snprintf( labels, sizeof( labels ), "lock=\"%s\"", LockNames[i] );
+        w.counter( "lock_contended_total", "Lock acquisitions that had to wait", LocksStats[i].contended, labels, LockNames[i] );
+      }
+      for( uint8_t i=0; i<LOCKS_COUNT; i++ ) {
+        snprintf( labels, sizeof( labels ), "lock=\"%s\"", LockNames[i] );
+        w.counter( "lock_wait_microseconds_total", "Time spent waiting for a lock", LocksStats[i].waitTotal, labels, LockNames[i] );
+      }
+
+      w.gauge(   "heap_free_bytes",         "Free internal heap", freeheap );
+      w.gauge(   "heap_min_free_bytes",     "Lowest free internal heap since boot", heap_caps_get_minimum_free_size( MALLOC_CAP_INTERNAL ) );
+      w.gauge(   "psram_free_bytes",        "Free PSRAM", freepsheap );
+      HeapRegionInfo regions[2];
+      HeapTrace.internal( regions[0] );
+      HeapTrace.psram( regions[1] );
+      for( uint8_t i=0; i<2; i++ ) {
+        snprintf( labels, sizeof( labels ), "region=\"%s\"", regions[i].name );
+        w.gauge( "heap_largest_free_block_bytes", "Largest free block per region", regions[i].info.largest_free_block, labels, regions[i].name );
+      }
+      for( uint8_t i=0; i<2; i++ ) {
+        snprintf( labels, sizeof( labels ), "region=\"%s\"", regions[i].name );
+        w.gauge( "heap_fragmentation_percent", "1 - largest free block / free bytes, per region", regions[i].fragmentation, labels, regions[i].name );
+      }
+      w.counter( "heap_failed_allocations_total", "Failed allocations (WITH_HEAP_TRACE only)", HeapFailedAllocs );
+
+      stackHighWaterMarks( w );
+      w.end();
+    }
+
+    #ifdef WITH_WIFI
+
+      static void startServer()
+      {
+        if( MetricsServerRunning ) return;
+        MetricsServerRunning = true;
+        xTaskCreatePinnedToCore( serverTask, "MetricsServer", 8192, NULL, 1, NULL, WIFITASK_CORE ); /* last = Task Core */
+      }
+
+    #endif
+
+  private:
+
+    static float advRate( uint32_t now )
+    {
+      float rate = 0;
+      if( MetricsLastPoll > 0 && now > MetricsLastPoll ) {
+        rate = ( AdvReceivedCount - MetricsLastAdvCount ) * 1000.0 / ( now - MetricsLastPoll );
+      }
+      MetricsLastPoll = now;
+      MetricsLastAdvCount = AdvReceivedCount;
+      return rate;
+    }
+
+    static void stackHighWaterMarks( MetricsWriter &w )
+    {
+      TaskSnapshot snap;
+      if( !TaskProfiler.snapshot( snap ) ) return;
+      char labels[48];
+      for( UBaseType_t i=0; i<snap.count; i++ ) {
+        snprintf( labels, sizeof( labels ), "task=\"%s\"", snap.tasks[i].pcTaskName );
+        w.gauge( "task_stack_free_bytes", "Task stack high-water mark (lowest free stack)", snap.tasks[i].usStackHighWaterMark, labels, snap.tasks[i].pcTaskName );
+      }
+      TaskProfiler.release( snap );
+    }
+
+    #ifdef WITH_WIFI
+
+      static void serverTask( void * param = NULL )
+      {
+        WebServer server( METRICS_HTTP_PORT );
+        server.on("/metrics", [&server]() { respond( server, METRICS_PROMETHEUS ); });
+        server.on("/metrics.json", [&server]() { respond( server, METRICS_JSON ); });
+        server.begin();
+        log_w("Metrics served on http://%s:%d/metrics", WiFi.localIP().toString().c_str(), METRICS_HTTP_PORT );
+        while( WiFi.getMode() != WIFI_OFF ) {
+          server.handleClient();
+          vTaskDelay(10);
+        }
+        server.stop();
+        MetricsServerRunning = false;
+        vTaskDelete( NULL );
+      }
+
+      static void respond( WebServer &server, MetricsFormat format )
+      {
+        StreamString body;
+        write( body, format );
+        server.send( 200, format == METRICS_JSON ? "application/json" : "text/plain; version=0.0.4", body );
+      }
+
+    #endif
+
+};
+
+MetricsUtils Metrics;
@@ -0,0 +1,304 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Persist queue
+ *
+ * Splits the after-scan pipeline across both cores: the scan task (core 0)
+ * keeps populating, looking up and rendering devices while a persist task
+ * (PERSISTTASK_CORE) writes the new ones to the DB.
+ *
+ *   - devices to insert are deep copied into a small pool, the scan slot is
+ *     released right away; when the pool is full the scan task waits up to
+ *     PERSIST_ENQUEUE_TIMEOUT then inserts inline, a DB write is never dropped
+ *   - both tasks hit sqlite under the DB lock, the scan task waits for the
+ *     queue to drain before looking up an address that is still queued, and
+ *     before DB maintenance
+ *   - an end of round job follows the last device of a scan so the persist
+ *     task can time the whole post-scan processing
+ *
+ * Two wall times are kept per scan round, measured from the end of the scan:
+ * 'enrich' is how long the scan task was kept busy (the next scan starts
+ * right after), 'persist' is when the last device reached the DB. With
+ * 'persist off' both are the same inline path as before, for comparison.
+ *
+ */
+
+#ifndef PERSIST_POOL_SIZE // override this from Settings.h
+  #define PERSIST_POOL_SIZE 16
+#endif
+#ifndef PERSIST_ENQUEUE_TIMEOUT // override this from Settings.h
+  #define PERSIST_ENQUEUE_TIMEOUT 500 // max ms the scan task waits for a free slot before inserting inline
+#endif
+#ifndef PERSIST_DRAIN_TIMEOUT // override this from Settings.h
+  #define PERSIST_DRAIN_TIMEOUT 10000 // max ms to wait for the queue to drain
+#endif
+#define PERSIST_ROUND_END 0xff // job slot marking the end of a scan round
+#define PERSIST_MESSAGE_LEN 20
+
+struct PersistItem
+{
+  BlueToothDevice *device;
+  uint16_t cursor; // position in the scan, for the header text
+  uint16_t count;  // devices in the scan
+  volatile bool pending;
+};
+
+struct PersistJob
+{
+  uint8_t  slot;
+  uint16_t devices;    // PERSIST_ROUND_END only
+  int64_t  roundStart; // esp_timer us, PERSIST_ROUND_END only
+};
+
+static PersistItem PersistItems[PERSIST_POOL_SIZE];
+static QueueHandle_t PersistJobQueue = NULL;  // slots to insert, in order
+static QueueHandle_t PersistFreeQueue = NULL; // slots available to the scan task
+static TaskHandle_t PersistTaskHandle = NULL;
+static char PersistMessage[PERSIST_MESSAGE_LEN]; // persist task header text
+static char PersistInlineMessage[PERSIST_MESSAGE_LEN]; // scan task header text
+static bool PersistAsync = true; // false = insert from the scan task, as before
+static uint32_t PersistQueued = 0;
+static uint32_t PersistInline = 0;  // inserted by the scan task (async off or pool full)
+static uint32_t PersistStalls = 0;  // waits for a drain (address still queued, maintenance)
+static uint32_t PersistFailed = 0;
+static uint16_t PersistMaxDepth = 0;
+static int64_t  PersistRoundStart = 0; // esp_timer us, 0 = no round in progress
+static uint16_t PersistRoundDevices = 0;
+static uint32_t PersistRounds = 0;
+static uint32_t PersistLastEnrichUs = 0;
+static uint32_t PersistLastTotalUs = 0;
+static uint64_t PersistEnrichUsSum = 0;
+static uint64_t PersistTotalUsSum = 0;
+
+
+class PersistQueueUtils
+{
+  public:
+
+    static bool init()
+    {
+      if( PersistJobQueue != NULL ) return true;
+      PersistJobQueue  = xQueueCreate( PERSIST_POOL_SIZE + 2, sizeof( PersistJob ) ); // + end of round markers
+      PersistFreeQueue = xQueueCreate( PERSIST_POOL_SIZE, sizeof( uint8_t ) );
+      if( PersistJobQueue == NULL || PersistFreeQueue == NULL ) {
+        log_e("Failed to create persist queues");
+        return false;
+      }
+      for( uint8_t i = 0; i < PERSIST_POOL_SIZE; i++ ) {
+        PersistItems[i].device = new BlueToothDevice;
+        BLEDevHelper.init( PersistItems[i].device, false ); // same as BLEDevDBCache
+        PersistItems[i].pending = false;
+        xQueueSend( PersistFreeQueue, &i, 0 );
+      }
+      xTaskCreatePinnedToCore( persistTask, "persistTask", 6144, NULL, 5, &PersistTaskHandle, PERSISTTASK_CORE );
+      return true;
+    }
+
+    // scan task
+
+    // hands a device over to the persist task, or inserts it right away
+    static bool save( BlueToothDevice *device, uint16_t cursor, uint16_t count )
+    {
+      if( !PersistAsync || PersistJobQueue == NULL ) {
+        return saveInline( device, cursor, count );
+      }
+      PersistJob job = { .slot = 0, .devices = 0, .roundStart = 0 };
+      if( xQueueReceive( PersistFreeQueue, &job.slot, PERSIST_ENQUEUE_TIMEOUT / portTICK_PERIOD_MS ) != pdTRUE ) {
+        log_w("Persist queue full, inserting %s inline", device->address);
+        return saveInline( device, cursor, count );
+      }
+      BLEDevHelper.copyItem( device, PersistItems[job.slot].device );
+      PersistItems[job.slot].cursor = cursor;
+      PersistItems[job.slot].count = count;
+      PersistItems[job.slot].pending = true;
+      xQueueSend( PersistJobQueue, &job, 0 ); // can't be full: one job per slot + markers
+      PersistQueued++;
+      uint16_t depth = uxQueueMessagesWaiting( PersistJobQueue );
+      if( depth > PersistMaxDepth ) PersistMaxDepth = depth;
+      return true;
+    }
+
+    // true while a copy of this address is waiting for its DB insert
+    static bool isPending( const char* address )
+    {
+      for( uint8_t i = 0; i < PERSIST_POOL_SIZE; i++ ) {
+        if( PersistItems[i].pending && strcmp( PersistItems[i].device->address, address ) == 0 ) return true;
+      }
+      return false;
+    }
+
+    // waits until every queued device reached the DB
+    static bool drain( uint32_t timeout = PERSIST_DRAIN_TIMEOUT )
+    {
+      if( PersistJobQueue == NULL || idle() ) return true;
+      PersistStalls++;
+      uint32_t start = millis();
+      while( !idle() ) {
+        if( millis() - start > timeout ) {
+          log_e("Persist queue still has %d jobs after %d ms", depth(), timeout);
+          return false;
+        }
+        vTaskDelay( 1 );
+      }
+      return true;
+    }
+
+    static void roundBegin( uint16_t devices )
+    {
+      PersistRoundStart = esp_timer_get_time();
+      PersistRoundDevices = devices;
+    }
+
+    // the scan task is done with the round, the persist task may still be busy
+    static void roundEnd()
+    {
+      if( PersistRoundStart == 0 ) return;
+      PersistLastEnrichUs = esp_timer_get_time() - PersistRoundStart;
+      PersistEnrichUsSum += PersistLastEnrichUs;
+      PersistJob job = { .slot = PERSIST_ROUND_END, .devices = PersistRoundDevices, .roundStart = PersistRoundStart };
+      PersistRoundStart = 0;
+      if( !PersistAsync || PersistJobQueue == NULL || xQueueSend( PersistJobQueue, &job, PERSIST_ENQUEUE_TIMEOUT / portTICK_PERIOD_MS ) != pdTRUE ) {
+        drain();
+        roundDone( job );
+      }
+    }
+
+    // stats
+
+    static uint16_t depth()
+    {
+      return PersistJobQueue != NULL ? uxQueueMessagesWaiting( PersistJobQueue ) : 0;
+    }
+
+    static void reset()
+    {
+      PersistQueued = PersistInline = PersistStalls = PersistFailed = 0;
+      PersistMaxDepth = 0;
+      PersistRounds = 0;
+      PersistEnrichUsSum = PersistTotalUsSum = 0;
+    }
+
+    static void dump()
+    {
+      Serial.printf("Persist (%s): %d queued, %d pending (max %d), %d inline, %d stalls, %d failed\n",
+        PersistAsync ? "async" : "inline",
+        PersistQueued,
+        depth(),
+        PersistMaxDepth,
+        PersistInline,
+        PersistStalls,
+        PersistFailed
+      );
+      Serial.printf("Post-scan wall time over %d rounds: enrich %d ms avg (last %d), persist %d ms avg (last %d)\n",
+        PersistRounds,
+        PersistRounds > 0 ? (uint32_t)( PersistEnrichUsSum / PersistRounds / 1000 ) : 0,
+        PersistLastEnrichUs / 1000,
+        PersistRounds > 0 ? (uint32_t)( PersistTotalUsSum / PersistRounds / 1000 ) : 0,
+        PersistLastTotalUs / 1000
+      );
+    }
+
+  private:
+
+    static bool idle()
+    {
+      return uxQueueMessagesWaiting( PersistJobQueue ) == 0 && uxQueueMessagesWaiting( PersistFreeQueue ) == PERSIST_POOL_SIZE;
+    }
+
+    static bool saveInline( BlueToothDevice *device, uint16_t cursor, uint16_t count )
+    {
+      PersistInline++;
+      bool ret = insert( device, cursor, count, PersistInlineMessage );
+      Render.header( PersistInlineMessage );
+      return ret;
+    }
+
+    static bool insert( BlueToothDevice *device, uint16_t cursor, uint16_t count, char* message )
+    {
+      takeDBLock();
+      bool ret = Backend.devices->insert( device );
+      giveDBLock();
+      if( ret ) {
+        snprintf( message, PERSIST_MESSAGE_LEN, "Saved %d / %d", cursor + 1, count );
+        log_d( "Device %d successfully inserted in DB", cursor );
+        entries++;
+        return true;
+      }
+      log_e( "  [!!! BD INSERT FAIL !!!] Device %d could not be inserted", cursor );
+      snprintf( message, PERSIST_MESSAGE_LEN, "Failed %d / %d", cursor + 1, count );
+      PersistFailed++;
+      return false;
+    }
+
+    static void roundDone( const PersistJob &job )
+    {
+      PersistLastTotalUs = esp_timer_get_time() - job.roundStart;
+      PersistTotalUsSum += PersistLastTotalUs;
+      PersistRounds++;
+      log_i("[Post-scan] %d devices, scan task busy %d ms, persisted after %d ms (%s)",
+        job.devices,
+        PersistLastEnrichUs / 1000,
+        PersistLastTotalUs / 1000,
+        PersistAsync ? "async" : "inline"
+      );
+    }
+
+    static void persistTask( void * param )
+    {
+      PersistJob job;
+      while(1) {
+        if( xQueueReceive( PersistJobQueue, &job, portMAX_DELAY ) != pdTRUE ) continue;
+        StageBusy busy( STAGE_PERSIST );
+        if( job.slot == PERSIST_ROUND_END ) {
+          roundDone( job );
+          continue;
+        }
+        PersistItem &item = PersistItems[job.slot];
+        insert( item.device, item.cursor, item.count, PersistMessage );
+        Render.header( PersistMessage );
+        item.pending = false; // before the reset: isPending() may be reading the address
+        BLEDevHelper.reset( item.device );
+        xQueueSend( PersistFreeQueue, &job.slot, 0 );
+      }
+    }
+
+};
+
+
+PersistQueueUtils Persist;
@@ -0,0 +1,299 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Random address grouping
+ *
+ * Private (resolvable or not) random addresses rotate every few minutes, and
+ * without a key there is no way to resolve them. Left alone, every rotation
+ * lands in the cache as a new device and evicts real ones.
+ *
+ * This stage runs in the scan callback before cache insertion and tags
+ * resolvable private addresses with a group id, so a rotation can be told
+ * apart from a new device. A rotation joins a group when:
+ *   - both addresses are resolvable private addresses
+ *   - the payload fingerprint matches: the AD structures layout (types and
+ *     lengths), manufacturer company id, service UUIDs (advertised or with
+ *     service data), TX power level and the payload length; the data bytes
+ *     themselves are left out, most vendors rotate some of them along with
+ *     the address
+ *   - the old address went silent for at least one advertising interval
+ *     (two identical devices side by side are not merged) and the new one
+ *     showed up shortly after (RPA_MAX_HANDOFF_MS); the old address has to
+ *     be heard during the current or the previous scan window, the gap
+ *     between two scans doesn't count as silence since nobody listened
+ * Anything else gets its own group. Groups outlive the scan window: the
+ * post scan steps look the group up in the RAM cache, so a rotated address
+ * updates the cached device instead of taking a new cache slot and DB row.
+ * The stored address is never rewritten, the group id lives next to it
+ * (BlueToothDevice::rpa_group).
+ *
+ */
+
+#ifndef RPA_GROUPS_SIZE // override this from Settings.h
+#define RPA_GROUPS_SIZE 32 // how many random address groups are tracked
+#endif
+#define RPA_MIN_SILENCE_MS   100    // a group's address must be silent at least this long to be rotated (ms)
+#define RPA_MAX_HANDOFF_MS   2000   // the new address must show up within this delay (or two intervals) after the old one stopped (ms)
+#define RPA_MAX_INTERVAL_MS  10240  // max BLE advertising interval, longer gaps are scan pauses
+
+#define AD_TYPE_FLAGS             0x01
+#define AD_TYPE_UUID16_INCOMPLETE 0x02
+#define AD_TYPE_UUID16_COMPLETE   0x03
+#define AD_TYPE_UUID128_INCOMPLETE 0x06
+#define AD_TYPE_UUID128_COMPLETE  0x07
+#define AD_TYPE_TX_POWER          0x0A
+
+struct RPAGroup
+{
+  bool     inUse = false;
+  uint32_t id = 0;               // logical device id, never 0
+  uint32_t fingerprint = 0;
+  uint8_t  address[6];           // current address (native, LSB first)
+  uint32_t firstSeen = 0;        // millis
+  uint32_t lastSeen  = 0;        // millis
+  uint32_t interval  = 0;        // averaged advertising interval of the current address (ms)
+  uint16_t rotations = 0;        // how many addresses were folded into this group
+};
+
+static RPAGroup RPAGroupsTable[RPA_GROUPS_SIZE];
+static uint32_t RPARotationsCount = 0; // for statistics
+static uint32_t RPAGroupNextId = 1;
+static bool     RPAScanning = false;  // rotations are only tracked inside a scan window
+static uint32_t RPAScanStart = 0;     // millis
+static bool     RPAHasPrevScan = false;
+static uint32_t RPAPrevScanStart = 0; // millis
+static uint32_t RPAPrevScanEnd = 0;   // millis, last advertisement heard in the previous window
+static uint32_t RPALastHeard = 0;     // millis, last advertisement heard in the current window
+
+
+class RPAGroupUtils
+{
+  public:
+
+    // true for resolvable private addresses (two most significant bits 01), the only ones grouped
+    static bool isRotating( const uint8_t* address, uint8_t addrType )
+    {
+      if( addrType != BLE_ADDR_RANDOM ) return false;
+      return ( address[5] & 0xC0 ) == 0x40;
+    }
+
+    // opens a scan window, groups last heard before the previous one can't be rotated into
+    static void scanBegin( uint32_t now )
+    {
+      RPAHasPrevScan   = RPAScanStart != 0 || RPALastHeard != 0;
+      RPAPrevScanStart = RPAScanStart;
+      RPAPrevScanEnd   = RPALastHeard;
+      RPAScanStart = now;
+      RPALastHeard = now;
+      RPAScanning = true;
+    }
+
+    static void scanEnd()
+    {
+      RPAScanning = false;
+    }
+
+    // 32 bits FNV-1a over the parts of the payload that survive a rotation, 0 when there isn't enough to go on
+    static uint32_t fingerprint( const uint8_t* payload, size_t len )
+    {
+      uint32_t hash = 2166136261u;
+      bool hasIdentity = false;
+      hashByte( hash, len );
+      size_t offset = 0;
+      while( offset < len ) {
+        uint8_t fieldLen = payload[offset];
+        if( fieldLen == 0 || offset + 1 + fieldLen > len ) break;
+        uint8_t fieldType = payload[offset+1];
+        const uint8_t* data = &payload[offset+2];
+        uint8_t dataLen = fieldLen - 1;
+        offset += 1 + fieldLen;
+        hashByte( hash, fieldType ); // layout
+        hashByte( hash, dataLen );
+        switch( fieldType ) {
+          case AD_TYPE_TX_POWER:
+            if( dataLen > 0 ) hashByte( hash, data[0] );
+          break;
+          case AD_TYPE_MANUFACTURER_DATA: // company id
+          case AD_TYPE_SERVICE_DATA_16:   // service UUID
+            if( dataLen < 2 ) break;
+            hashByte( hash, data[0] );
+            hashByte( hash, data[1] );
+            hasIdentity = true;
+          break;
+          case AD_TYPE_UUID16_INCOMPLETE:
+          case AD_TYPE_UUID16_COMPLETE:
+          case AD_TYPE_UUID128_INCOMPLETE:
+          case AD_TYPE_UUID128_COMPLETE:
+            for( uint8_t i=0; i<dataLen; i++ ) hashByte( hash, data[i] );
+            hasIdentity = dataLen > 0;
+          break;
+          default: // flags, names and others: layout only
+          break;
+        }
+      }
+      if( !hasIdentity ) return 0;
+      return hash == 0 ? 1 : hash;
+    }
+
+    // returns the group id of the logical device, 0 if the address is not grouped
+    static uint32_t resolve( BLEAdvertisedDevice *advertisedDevice )
+    {
+      BLEAddress bleAddress = advertisedDevice->getAddress(); // returned by value, getNative() points inside it
+      const uint8_t* address = bleAddress.getNative();
+      if( !isRotating( address, advertisedDevice->getAddressType() ) ) return 0;
+      uint32_t fp = fingerprint( advertisedDevice->getPayload(), advertisedDevice->getPayloadLength() );
+      if( fp == 0 ) return 0;
+      return resolve( address, fp, millis() );
+    }
+
+    static uint32_t resolve( const uint8_t* address, uint32_t fp, uint32_t now )
+    {
+      heard( now );
+      RPAGroup* group = NULL;
+      RPAGroup* candidate = NULL;
+      RPAGroup* oldest = &RPAGroupsTable[0];
+      for( uint16_t i=0; i<RPA_GROUPS_SIZE; i++ ) {
+        RPAGroup* g = &RPAGroupsTable[i];
+        if( !g->inUse ) {
+          oldest = g;
+          continue;
+        }
+        if( memcmp( g->address, address, 6 ) == 0 ) {
+          group = g; // known address
+          break;
+        }
+        if( g->fingerprint == fp && candidate == NULL && canRotate( g, now ) ) {
+          candidate = g;
+        }
+        if( oldest->inUse && g->lastSeen < oldest->lastSeen ) {
+          oldest = g;
+        }
+      }
+
+      if( group != NULL ) {
+        seen( group, now );
+        return group->id;
+      }
+
+      if( candidate != NULL ) { // address rotation
+        memcpy( candidate->address, address, 6 );
+        candidate->lastSeen = now;
+        candidate->interval = 0; // the new address has its own timing
+        candidate->rotations++;
+        RPARotationsCount++;
+        log_d("Grouped rotated address into group #%d (%d rotations)", candidate->id, candidate->rotations );
+        return candidate->id;
+      }
+
+      // new group, evicts the least recently seen one when full
+      *oldest = RPAGroup();
+      oldest->inUse       = true;
+      oldest->id          = RPAGroupNextId++;
+      if( RPAGroupNextId == 0 ) RPAGroupNextId = 1;
+      oldest->fingerprint = fp;
+      oldest->firstSeen   = now;
+      oldest->lastSeen    = now;
+      memcpy( oldest->address, address, 6 );
+      return oldest->id;
+    }
+
+    // refreshes the timing of a known address, used when resolve() is skipped (e.g. deduplicated advertisements)
+    static void touch( const uint8_t* address, uint32_t now )
+    {
+      heard( now );
+      for( uint16_t i=0; i<RPA_GROUPS_SIZE; i++ ) {
+        if( RPAGroupsTable[i].inUse && memcmp( RPAGroupsTable[i].address, address, 6 ) == 0 ) {
+          seen( &RPAGroupsTable[i], now );
+          return;
+        }
+      }
+    }
+
+    // how many logical devices are backed by more than one address
+    static uint16_t groupedCount()
+    {
+      uint16_t total = 0;
+      for( uint16_t i=0; i<RPA_GROUPS_SIZE; i++ ) {
+        if( RPAGroupsTable[i].inUse && RPAGroupsTable[i].rotations > 0 ) total++;
+      }
+      return total;
+    }
+
+  private:
+
+    static void hashByte( uint32_t &hash, uint8_t b )
+    {
+      hash ^= b;
+      hash *= 16777619u;
+    }
+
+    static void heard( uint32_t now )
+    {
+      if( RPAScanning && (int32_t)( now - RPALastHeard ) > 0 ) RPALastHeard = now;
+    }
+
+    static void seen( RPAGroup* group, uint32_t now )
+    {
+      uint32_t delta = now - group->lastSeen;
+      if( delta < RPA_MAX_INTERVAL_MS ) {
+        group->interval = group->interval == 0 ? delta : ( group->interval*7 + delta ) / 8;
+      }
+      group->lastSeen = now;
+    }
+
+    static bool canRotate( const RPAGroup* group, uint32_t now )
+    {
+      if( !RPAScanning ) return false;
+      uint32_t silence;
+      if( (int32_t)( group->lastSeen - RPAScanStart ) >= 0 ) {
+        silence = now - group->lastSeen; // heard during this scan window
+      } else if( RPAHasPrevScan && (int32_t)( group->lastSeen - RPAPrevScanStart ) >= 0 ) {
+        // heard during the previous window, the gap between the two isn't silence
+        silence = ( RPAPrevScanEnd - group->lastSeen ) + ( now - RPAScanStart );
+      } else {
+        return false;
+      }
+      uint32_t minSilence = group->interval > RPA_MIN_SILENCE_MS ? group->interval : RPA_MIN_SILENCE_MS;
+      uint32_t maxSilence = group->interval*2 > RPA_MAX_HANDOFF_MS ? group->interval*2 : RPA_MAX_HANDOFF_MS;
+      if( maxSilence > RPA_MAX_INTERVAL_MS ) maxSilence = RPA_MAX_INTERVAL_MS;
+      // current address still advertising: not the same device, silent for too long: not a handoff
+      return silence >= minSilence && silence <= maxSilence;
+    }
+
+};
+
+
+RPAGroupUtils RPAGroups;
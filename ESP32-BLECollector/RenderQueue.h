@@ -0,0 +1,315 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Render queue
+ *
+ * Once started, the display task (UIUtils::displayTask) is the only one
+ * drawing, every other task hands it render commands instead of taking the
+ * display lock:
+ *
+ *   - BLE cards are deep copied into a small pool (scan slots are recycled
+ *     as soon as the scan cursor moves on) and queued in order, a card whose
+ *     address is already waiting in the queue is coalesced: its newer data
+ *     overwrites the waiting copy, which keeps its place in the queue
+ *   - text messages for the scroll area are copied into their own queue so
+ *     they stay in order with the cards
+ *   - header text, footer, cache stats, progress bar, heap graph, hall of
+ *     mac and brightness are dirty flags + latest value, so a burst of
+ *     updates between two frames ends up as a single draw
+ *   - icons only change their status, the display task repaints the icon
+ *     bar every STATUSBAR_TICK_MS
+ *
+ * While a scroll or a fade is in progress the display task ticks every
+ * ANIMATION_TICK_MS instead of RENDER_FRAME_MS to advance it.
+ *
+ * Producers only wait for a free card slot or message slot
+ * (RENDER_ENQUEUE_TIMEOUT) and never for the SPI bus, what didn't get a slot
+ * in time is dropped and counted.
+ *
+ * Still drawing directly, under the display lock: UI init and the intro
+ * (before the display task starts), the db init failure path (after the UI
+ * tasks are stopped), screenshots and screenShow (full screen, serial
+ * commands) and the fatal "Out of heap" header. M5.update() takes the lock
+ * to poll the buttons, it doesn't draw.
+ *
+ * Headless builds (see HEADLESS in Settings.h) have no display task: every
+ * command returns right away, header text is echoed to serial at most every
+ * HEADLESS_STATUS_MS as a compact status line.
+ *
+ */
+
+#ifndef RENDER_CARDS_POOL_SIZE // override this from Settings.h
+  #define RENDER_CARDS_POOL_SIZE 8
+#endif
+#ifndef RENDER_FRAME_MS // override this from Settings.h
+  #define RENDER_FRAME_MS 40 // display task period when idle
+#endif
+#ifndef ANIMATION_TICK_MS // override this from Settings.h
+  #define ANIMATION_TICK_MS 16 // display task period while scrolling/fading
+#endif
+#ifndef RENDER_ENQUEUE_TIMEOUT // override this from Settings.h
+  #define RENDER_ENQUEUE_TIMEOUT 100 // max ms a producer waits for a free card slot
+#endif
+#ifndef RENDER_MESSAGES_POOL_SIZE // override this from Settings.h
+  #define RENDER_MESSAGES_POOL_SIZE 4
+#endif
+#ifndef STATUSBAR_TICK_MS // override this from Settings.h
+  #define STATUSBAR_TICK_MS 150 // icon bar, blinking widgets and heap sampling period
+#endif
+#ifndef HEADLESS_STATUS_MS // override this from Settings.h
+  #define HEADLESS_STATUS_MS 5000 // min delay between two serial status lines when headless
+#endif
+#define RENDER_HEADER_LEN 48
+
+enum RenderDirtyFlags : uint8_t
+{
+  RENDER_HEADER     = 1,
+  RENDER_FOOTER     = 2,
+  RENDER_CACHESTATS = 4,
+  RENDER_PROGRESS   = 8,
+  RENDER_GRAPH      = 16,
+  RENDER_HALLOFMAC  = 32,
+  RENDER_BRIGHTNESS = 64
+};
+
+struct RenderCard
+{
+  BlueToothDevice *device;
+  uint16_t cacheIndex;
+  volatile bool pending; // queued and not picked by the display task yet, may still be updated
+};
+
+static RenderCard RenderCards[RENDER_CARDS_POOL_SIZE];
+static QueueHandle_t RenderCardQueue = NULL; // slots to draw, in order
+static QueueHandle_t RenderFreeQueue = NULL; // slots available to producers
+static QueueHandle_t RenderMessageQueue = NULL; // scroll area text lines, copied
+static portMUX_TYPE RenderMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint8_t RenderDirty = 0;
+static char RenderHeaderText[RENDER_HEADER_LEN] = {0};
+static uint16_t RenderProgressWidth = 0;
+static volatile bool RenderTaskIsRunning = false;
+static uint32_t RenderCardsQueued = 0;
+static uint32_t RenderCardsDropped = 0;
+static uint32_t RenderMessagesDropped = 0;
+static uint32_t RenderCoalesced = 0;
+static uint32_t RenderFrames = 0;
+static uint32_t RenderLastStatus = 0; // millis, headless status line
+
+
+class RenderQueueUtils
+{
+  public:
+
+    static bool init()
+    {
+      if( RenderCardQueue != NULL ) return true;
+      RenderCardQueue = xQueueCreate( RENDER_CARDS_POOL_SIZE, sizeof( uint8_t ) );
+      RenderFreeQueue = xQueueCreate( RENDER_CARDS_POOL_SIZE, sizeof( uint8_t ) );
+      RenderMessageQueue = xQueueCreate( RENDER_MESSAGES_POOL_SIZE, RENDER_HEADER_LEN );
+      if( RenderCardQueue == NULL || RenderFreeQueue == NULL || RenderMessageQueue == NULL ) {
+        log_e("Failed to create render queues");
+        return false;
+      }
+      for( uint8_t i = 0; i < RENDER_CARDS_POOL_SIZE; i++ ) {
+        RenderCards[i].device = new BlueToothDevice;
+        BLEDevHelper.init( RenderCards[i].device, false ); // rendered from internal RAM, same as BLEDevTmp
+        RenderCards[i].pending = false;
+        xQueueSend( RenderFreeQueue, &i, 0 );
+      }
+      return true;
+    }
+
+    // producers
+
+    static bool card( BlueToothDeviceLink link )
+    {
+      if( !hasDisplay() ) return true;
+      if( RenderCardQueue == NULL || link.device == NULL || isEmpty( link.device->address ) ) return false;
+      bool coalesced = false;
+      portENTER_CRITICAL( &RenderMux ); // the display task may pick the slot meanwhile
+      for( uint8_t i = 0; i < RENDER_CARDS_POOL_SIZE; i++ ) {
+        if( RenderCards[i].pending && strcmp( RenderCards[i].device->address, link.device->address ) == 0 ) {
+          BLEDevHelper.reset( RenderCards[i].device ); // copyItem() skips empty source fields
+          BLEDevHelper.copyItem( link.device, RenderCards[i].device );
+          RenderCards[i].cacheIndex = link.cacheIndex;
+          coalesced = true;
+          break;
+        }
+      }
+      portEXIT_CRITICAL( &RenderMux );
+      if( coalesced ) {
+        RenderCoalesced++;
+        return true;
+      }
+      uint8_t slot;
+      if( xQueueReceive( RenderFreeQueue, &slot, RENDER_ENQUEUE_TIMEOUT / portTICK_PERIOD_MS ) != pdTRUE ) {
+        RenderCardsDropped++;
+        log_d("Render queue full, dropping card %s", link.device->address);
+        return false;
+      }
+      BLEDevHelper.reset( RenderCards[slot].device ); // copyItem() skips empty source fields
+      BLEDevHelper.copyItem( link.device, RenderCards[slot].device );
+      RenderCards[slot].cacheIndex = link.cacheIndex;
+      portENTER_CRITICAL( &RenderMux );
+      RenderCards[slot].pending = true;
+      portEXIT_CRITICAL( &RenderMux );
+      xQueueSend( RenderCardQueue, &slot, 0 ); // can't be full: there are as many slots as queue items
+      RenderCardsQueued++;
+      return true;
+    }
+
+    // false when the display task isn't there to print it
+    static bool message( const char* text )
+    {
+      if( !RenderTaskIsRunning || RenderMessageQueue == NULL ) return false;
+      char line[RENDER_HEADER_LEN];
+      snprintf( line, RENDER_HEADER_LEN, "%s", text );
+      if( xQueueSend( RenderMessageQueue, line, RENDER_ENQUEUE_TIMEOUT / portTICK_PERIOD_MS ) != pdTRUE ) {
+        RenderMessagesDropped++;
+        log_w("Render queue full, dropping message: %s", text);
+      }
+      return true;
+    }
+
+    static void header( const char* text )
+    {
+      if( !hasDisplay() ) {
+        if( isEmpty( text ) || millis() - RenderLastStatus < HEADLESS_STATUS_MS ) return;
+        RenderLastStatus = millis();
+        Serial.printf("[%s] %s (heap: %d, cache: %d%%)\n", hhmmssString, text, freeheap, BLEDevCacheUsed );
+        return;
+      }
+      portENTER_CRITICAL( &RenderMux );
+      if( RenderDirty & RENDER_HEADER ) RenderCoalesced++;
+      snprintf( RenderHeaderText, RENDER_HEADER_LEN, "%s", text );
+      RenderDirty |= RENDER_HEADER;
+      portEXIT_CRITICAL( &RenderMux );
+    }
+
+    static void progress( uint16_t width )
+    {
+      if( !hasDisplay() ) return;
+      portENTER_CRITICAL( &RenderMux );
+      if( RenderDirty & RENDER_PROGRESS ) RenderCoalesced++;
+      RenderProgressWidth = width;
+      RenderDirty |= RENDER_PROGRESS;
+      portEXIT_CRITICAL( &RenderMux );
+    }
+
+    static void footer()     { setDirty( RENDER_FOOTER ); }
+    static void cacheStats() { setDirty( RENDER_CACHESTATS ); }
+    static void graph()      { setDirty( RENDER_GRAPH ); }
+    static void hallOfMac()  { setDirty( RENDER_HALLOFMAC ); }
+    static void brightness() { setDirty( RENDER_BRIGHTNESS ); }
+
+    // display task
+
+    static bool nextCard( uint8_t &slot, TickType_t wait )
+    {
+      if( RenderCardQueue == NULL ) {
+        vTaskDelay( wait );
+        return false;
+      }
+      if( xQueueReceive( RenderCardQueue, &slot, wait ) != pdTRUE ) return false;
+      portENTER_CRITICAL( &RenderMux );
+      RenderCards[slot].pending = false; // being drawn: later cards for this address get their own slot
+      portEXIT_CRITICAL( &RenderMux );
+      return true;
+    }
+
+    static bool nextMessage( char* line )
+    {
+      return RenderMessageQueue != NULL && xQueueReceive( RenderMessageQueue, line, 0 ) == pdTRUE;
+    }
+
+    static BlueToothDeviceLink cardLink( uint8_t slot )
+    {
+      return (BlueToothDeviceLink){ .cacheIndex=RenderCards[slot].cacheIndex, .device=RenderCards[slot].device };
+    }
+
+    static void releaseCard( uint8_t slot )
+    {
+      BLEDevHelper.reset( RenderCards[slot].device );
+      xQueueSend( RenderFreeQueue, &slot, 0 );
+    }
+
+    // grabs and clears the dirty flags along with the values they refer to
+    static uint8_t takeDirty( char* header, uint16_t &progressWidth )
+    {
+      portENTER_CRITICAL( &RenderMux );
+      uint8_t dirty = RenderDirty;
+      RenderDirty = 0;
+      if( dirty & RENDER_HEADER ) memcpy( header, RenderHeaderText, RENDER_HEADER_LEN );
+      progressWidth = RenderProgressWidth;
+      portEXIT_CRITICAL( &RenderMux );
+      if( dirty ) RenderFrames++;
+      return dirty;
+    }
+
+    static uint16_t depth()
+    {
+      return RenderCardQueue != NULL ? uxQueueMessagesWaiting( RenderCardQueue ) : 0;
+    }
+
+    static void dump()
+    {
+      Serial.printf("Render: %d queued, %d pending, %d dropped, %d messages dropped, %d coalesced, %d frames\n",
+        RenderCardsQueued,
+        depth(),
+        RenderCardsDropped,
+        RenderMessagesDropped,
+        RenderCoalesced,
+        RenderFrames
+      );
+    }
+
+  private:
+
+    static void setDirty( uint8_t flag )
+    {
+      if( !hasDisplay() ) return;
+      portENTER_CRITICAL( &RenderMux );
+      if( RenderDirty & flag ) RenderCoalesced++;
+      RenderDirty |= flag;
+      portEXIT_CRITICAL( &RenderMux );
+    }
+
+};
+
+
+RenderQueueUtils Render;
@@ -0,0 +1,98 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * Rolling min/max
+ *
+ * Min and max over the last <window> samples, kept in two monotonic deques
+ * of (sequence, value): amortized O(1) per sample instead of rescanning the
+ * window. Used to scale the heap graph.
+ *
+ */
+
+struct RollingMinMax
+{
+  struct Sample
+  {
+    uint32_t seq;
+    uint32_t value;
+  };
+  struct Deque
+  {
+    Sample   *items = NULL;
+    uint16_t head = 0;
+    uint16_t size = 0;
+    Sample& front() { return items[head]; }
+    Sample& back() { return items[(head+size-1)%capacity]; }
+    void popFront() { head = (head+1)%capacity; size--; }
+    void popBack() { size--; }
+    void pushBack( Sample sample ) { items[(head+size)%capacity] = sample; size++; }
+    uint16_t capacity = 0;
+  };
+  Deque    mins; // increasing values, front is the window min
+  Deque    maxs; // decreasing values, front is the window max
+  uint16_t window = 0;
+  uint32_t seq = 0; // how many samples were pushed so far
+  bool init( uint16_t _window )
+  {
+    window = _window;
+    mins.capacity = maxs.capacity = _window;
+    mins.items = (Sample*)calloc( _window, sizeof( Sample ) );
+    maxs.items = (Sample*)calloc( _window, sizeof( Sample ) );
+    return mins.items != NULL && maxs.items != NULL;
+  }
+  void reset()
+  {
+    mins.head = mins.size = 0;
+    maxs.head = maxs.size = 0;
+  }
+  // zero values mean "no record", they take a slot in the window but never are min or max
+  void push( uint32_t value )
+  {
+    if( window == 0 ) return;
+    seq++;
+    while( mins.size > 0 && seq - mins.front().seq >= window ) mins.popFront();
+    while( maxs.size > 0 && seq - maxs.front().seq >= window ) maxs.popFront();
+    if( value == 0 ) return;
+    while( mins.size > 0 && mins.back().value >= value ) mins.popBack();
+    mins.pushBack( { seq, value } );
+    while( maxs.size > 0 && maxs.back().value <= value ) maxs.popBack();
+    maxs.pushBack( { seq, value } );
+  }
+  uint32_t min() { return mins.size > 0 ? mins.front().value : 0; }
+  uint32_t max() { return maxs.size > 0 ? maxs.front().value : 0; }
+};
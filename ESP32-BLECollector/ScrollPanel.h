@@ -32,6 +32,12 @@
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
 #define SPACE " "
+#ifndef SCROLL_ANIM_MIN_STEP // override this from Settings.h
+  #define SCROLL_ANIM_MIN_STEP 4 // pixels per animation tick
+#endif
+#ifndef SOFT_SCROLL_BOUNCE_ROWS // override this from Settings.h
+  #define SOFT_SCROLL_BOUNCE_ROWS 8 // software scroll: rows per DMA transfer, twice that is kept in internal RAM
+#endif
 static bool isScrolling = false;
 static bool isInScroll()
 {
@@ -64,11 +70,16 @@ class ScrollableOutput
     RGBColor BGColorStart;
     RGBColor BGColorEnd;
     ScrollType scrollType = SCROLL_HARDWARE;
+    bool bgLineDirty = true; // BGColorStart/BGColorEnd changed since the scanline was built
+    uint16_t yShown = 0; // hardware scroll pointer currently on the panel, catches up with yRef
+    uint16_t scrollLag = 0; // yShown -> yRef distance
+    lgfx::swap565_t *bounce = NULL; // software scroll: DMA capable copy of the ring rows being pushed
 
     void init()
     {
       height = scrollpanel_height();
       width  = scrollpanel_width();
+      scrollType = hasHardwareScroll() ? SCROLL_HARDWARE : SCROLL_SOFTWARE;
     }
 
     int println()
@@ -88,6 +99,7 @@ class ScrollableOutput
       if(strcmp(str, " \n")!=0 && serialEcho) {
         Serial.print( str );
       }
+      if( !hasDisplay() ) return 0;
       return scroll(str);
     }
 
@@ -95,6 +107,7 @@ class ScrollableOutput
     {
       BGColorStart = colorstart;
       BGColorEnd = colorend;
+      bgLineDirty = true;
       tft.setCursor(0, TFA);
       uint16_t VSA = height-(TFA+BFA);
 
@@ -102,11 +115,17 @@ class ScrollableOutput
       scrollBottomFixedArea = BFA;
 
       yRef       = scrollTopFixedArea;
+      yShown     = scrollTopFixedArea;
+      scrollLag  = 0;
       scrollPosY = scrollTopFixedArea;
       yArea = height - scrollTopFixedArea - scrollBottomFixedArea;
 
-      tft_setupHScrollArea(0, 0, 0); // reset ?
-      tft_setupHScrollArea(TFA, VSA, BFA);
+      if( scrollType == SCROLL_HARDWARE ) {
+        tft_setupHScrollArea(0, 0, 0); // reset ?
+        tft_setupHScrollArea(TFA, VSA, BFA);
+      } else {
+        initSoftScroll();
+      }
       s_x_tmp = 0;
       s_y_tmp = scrollTopFixedArea;
       s_w_tmp = width;
@@ -114,13 +133,61 @@ class ScrollableOutput
 
       log_d("*** NEW Scroll Setup: Top=%d Bottom=%d YArea=%d", TFA, BFA, yArea);
       if (clear) {
-        tft_fillGradientHRect( 0, TFA, width/2, yArea, BGColorStart, BGColorEnd );
-        tft_fillGradientHRect( width/2, TFA, width/2, yArea, BGColorEnd, BGColorStart );
+        fillBackground( TFA, yArea );
+      }
+    }
+
+    // background gradient scanline, only rebuilt when the theme or the width changes
+    TFT_eSprite* backgroundLine()
+    {
+      if( scrollBgSprite.getBuffer() == NULL || scrollBgSprite.width() != width ) {
+        scrollBgSprite.deleteSprite();
+        scrollBgSprite.setPsram( false );
+        scrollBgSprite.setColorDepth( 16 );
+        HeapTraceScope trace( HEAP_TAG_SPRITE );
+        if( !scrollBgSprite.createSprite( width, 1 ) ) {
+          log_e("Unable to allocate the background scanline (%d px)", width );
+          return NULL;
+        }
+        bgLineDirty = true;
+      }
+      if( bgLineDirty ) {
+        scrollBgSprite.drawGradientHLine( 0, 0, width/2, BGColorStart, BGColorEnd );
+        scrollBgSprite.drawGradientHLine( width/2, 0, width - width/2, BGColorEnd, BGColorStart );
+        bgLineDirty = false;
+      }
+      return &scrollBgSprite;
+    }
+
+    // paint background rows: one address window, the cached scanline streamed once per row
+    void fillBackground( int y, uint16_t _height )
+    {
+      TFT_eSprite *bgLine = backgroundLine();
+      if( hasSoftScroll() ) {
+        int ringRow = translate( y ) - scrollTopFixedArea;
+        for( uint16_t row = 0; row < _height; row++ ) {
+          ringFillRow( ( ringRow + row ) % yArea, bgLine );
+        }
+        presentRows( ringRow, min( (int)_height, (int)yArea ) );
+        return;
+      }
+      if( bgLine == NULL ) {
+        tft_fillGradientHRect( 0, y, width/2, _height, BGColorStart, BGColorEnd );
+        tft_fillGradientHRect( width/2, y, width/2, _height, BGColorEnd, BGColorStart );
+        return;
       }
+      lgfx::swap565_t *pixels = (lgfx::swap565_t*)bgLine->getBuffer();
+      tft.startWrite();
+      tft.setAddrWindow( 0, y, width, _height );
+      for( uint16_t row = 0; row < _height; row++ ) {
+        tft.pushPixels( pixels, width );
+      }
+      tft.endWrite();
     }
 
     void scrollNextPage()
     {
+      if( !hasDisplay() ) return;
       tft_getTextBounds("O", scrollPosX, scrollPosY, &x1_tmp, &y1_tmp, &w_tmp, &h_tmp);
       int linesInPage = (yArea-(scrollPosY-scrollTopFixedArea)) / h_tmp;
       for(int i=0; i<linesInPage; i++) {
@@ -133,10 +200,36 @@ class ScrollableOutput
       return ( ( yArea + ( ( y - scrollTopFixedArea) + distance) ) % yArea ) + scrollTopFixedArea;
     }
 
+    // text inside the scroll view goes through here so the software scroll ring keeps it
+    void drawString( const char* str, int32_t x, int32_t y )
+    {
+      if( !hasSoftScroll() || y < scrollTopFixedArea || y >= scrollTopFixedArea + yArea ) {
+        tft.drawString( str, x, y );
+        return;
+      }
+      int ringRow = y - scrollTopFixedArea;
+      softScrollSprite.setTextStyle( tft.getTextStyle() );
+      softScrollSprite.drawString( str, x, ringRow );
+      presentRows( ringRow, min( (int)tft.fontHeight(), yArea - ringRow ) );
+    }
+
     // draw rounded corners boxes inside the scroll view, with scroll limit overlap support
     void drawScrollableRoundRect(uint16_t x, uint16_t y, uint16_t _width, uint16_t _height, uint16_t radius, uint16_t bordercolor, bool fill = false )
     {
       int yStart = translate(y, 0); // get the scrollview-translated y position
+      if( hasSoftScroll() ) {
+        int ringRow = yStart - scrollTopFixedArea;
+        // the second pass draws the part crossing the ring end at the top, clipping does the rest
+        for( int offset = 0; offset <= yArea; offset += yArea ) {
+          if( fill ) {
+            softScrollSprite.fillRoundRect(x, ringRow - offset, _width, _height, radius, bordercolor);
+          } else {
+            softScrollSprite.drawRoundRect(x, ringRow - offset, _width, _height, radius, bordercolor);
+          }
+        }
+        presentRows( ringRow, min( (int)_height, (int)yArea ) );
+        return;
+      }
       if ( yStart >= scrollTopFixedArea && (yStart+_height)<(height-scrollBottomFixedArea) ) {
         // no scroll loop point overlap, just render the translated box using the native method
         log_v("Rendering native x:%d, y:%d, width:%d, height:%d, radius:%d", x, y, _width, _height, radius);
@@ -179,8 +272,157 @@ class ScrollableOutput
       }
     }
 
+    // hardware scroll a whole block in one step (no per-line delay), returns the
+    // scroll-translated y where the block must be drawn
+    int scrollBlock( uint16_t blockHeight )
+    {
+      if (scrollPosY == -1) {
+        scrollPosY = tft.getCursorY();
+      }
+      int top = translate( scrollPosY );
+      yRef = translate( yRef, blockHeight );
+      if( hasSoftScroll() ) {
+        presentRows( yRef - scrollTopFixedArea, yArea );
+      } else {
+        showScroll( blockHeight );
+      }
+      scrollPosY = translate( top, blockHeight );
+      tft.setCursor( 0, scrollPosY );
+      return top;
+    }
+
+    // DMA push a full width sprite band at a scroll-translated y, split in two
+    // when it overlaps the scroll loop point, must be called between startWrite/endWrite
+    void pushScrollableSprite( TFT_eSprite *sprite, int y, uint16_t _height )
+    {
+      lgfx::swap565_t *pixels = (lgfx::swap565_t*)sprite->getBuffer();
+      if( hasSoftScroll() ) {
+        int ringRow = y - scrollTopFixedArea;
+        lgfx::swap565_t *ring = (lgfx::swap565_t*)softScrollSprite.getBuffer();
+        for( uint16_t row = 0; row < _height; row++ ) {
+          memcpy( ring + ( ( ringRow + row ) % yArea ) * width, pixels + row * width, width * sizeof(lgfx::swap565_t) );
+        }
+        presentRows( ringRow, _height );
+        return;
+      }
+      int bottom = scrollTopFixedArea + yArea;
+      uint16_t upperHeight = ( y + _height > bottom ) ? bottom - y : _height;
+      tft.pushImageDMA( 0, y, width, upperHeight, pixels );
+      if( upperHeight < _height ) {
+        tft.pushImageDMA( 0, scrollTopFixedArea, width, _height - upperHeight, pixels + width * upperHeight );
+      }
+    }
+
+    // animation tick (display task): moves the panel scroll pointer closer to
+    // yRef with an ease out, returns true while there's still some way to go
+    bool scrollStep()
+    {
+      if( scrollLag == 0 ) return false;
+      uint16_t step = max( (uint16_t)SCROLL_ANIM_MIN_STEP, (uint16_t)(scrollLag / 4) );
+      if( step > scrollLag ) step = scrollLag;
+      yShown = translate( yShown, step );
+      scrollLag -= step;
+      tft_hScrollTo( yShown );
+      return scrollLag > 0;
+    }
+
+    // skip the animation, e.g. before a screenshot
+    void finishScroll()
+    {
+      if( scrollLag == 0 ) return;
+      yShown = yRef;
+      scrollLag = 0;
+      tft_hScrollTo( yShown );
+    }
+
   private:
 
+    // hardware scroll: yRef is already where it should be, the panel follows
+    // through scrollStep() when the display task runs, immediately otherwise
+    void showScroll( uint16_t lines )
+    {
+      scrollLag += lines;
+      // a lag that big means a burst, and rows about to be shown would get overwritten
+      if( !RenderTaskIsRunning || scrollLag > yArea/2 ) {
+        finishScroll();
+      }
+    }
+
+    // software scroll: the scroll area is mirrored in PSRAM as a ring of rows laid
+    // out like the panel memory in hardware mode (row = y - scrollTopFixedArea), yRef
+    // tells which ring row shows at the top, scrolling only changes yRef and re-pushes
+    // the rows: no SPI read-back. The SPI DMA can't read PSRAM, rows go through two
+    // internal RAM bounce buffers, one is filled while the other is being sent
+    bool hasSoftScroll()
+    {
+      return scrollType == SCROLL_SOFTWARE && softScrollSprite.getBuffer() != NULL && bounce != NULL;
+    }
+
+    bool initSoftScroll()
+    {
+      softScrollSprite.deleteSprite();
+      if( bounce != NULL ) {
+        heap_caps_free( bounce );
+        bounce = NULL;
+      }
+      if( !psramInit() ) {
+        log_w("No PSRAM, software scroll will read back from the TFT");
+        return false;
+      }
+      bounce = (lgfx::swap565_t*)heap_caps_malloc( 2 * SOFT_SCROLL_BOUNCE_ROWS * width * sizeof(lgfx::swap565_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL );
+      if( bounce == NULL ) {
+        log_e("Unable to allocate the software scroll bounce buffers (%d rows), will read back from the TFT", 2 * SOFT_SCROLL_BOUNCE_ROWS );
+        return false;
+      }
+      softScrollSprite.setPsram( true );
+      softScrollSprite.setColorDepth( 16 );
+      HeapTraceScope trace( HEAP_TAG_SPRITE );
+      if( !softScrollSprite.createSprite( width, yArea ) ) {
+        log_e("Unable to allocate the software scroll ring (%d x %d), will read back from the TFT", width, yArea );
+        return false;
+      }
+      softScrollSprite.setAttribute( lgfx::cp437_switch, true );
+      TFT_eSprite *bgLine = backgroundLine();
+      for( uint16_t row = 0; row < yArea; row++ ) {
+        ringFillRow( row, bgLine );
+      }
+      return true;
+    }
+
+    void ringFillRow( uint16_t ringRow, TFT_eSprite *bgLine )
+    {
+      if( bgLine == NULL ) {
+        softScrollSprite.drawFastHLine( 0, ringRow, width, BLECARD_BGCOLOR );
+        return;
+      }
+      lgfx::swap565_t *ring = (lgfx::swap565_t*)softScrollSprite.getBuffer();
+      memcpy( ring + ringRow * width, bgLine->getBuffer(), width * sizeof(lgfx::swap565_t) );
+    }
+
+    // push ring rows to wherever they currently show on screen, split at the ring
+    // end and at the scroll area bottom
+    void presentRows( int ringRow, uint16_t rows )
+    {
+      lgfx::swap565_t *ring = (lgfx::swap565_t*)softScrollSprite.getBuffer();
+      int head = yRef - scrollTopFixedArea; // ring row shown at the top of the scroll area
+      uint8_t half = 0;
+      tft.startWrite();
+      while( rows > 0 ) {
+        int screenRow = ( ringRow - head + yArea ) % yArea;
+        uint16_t chunk = min( (int)rows, min( yArea - ringRow, yArea - screenRow ) );
+        if( chunk > SOFT_SCROLL_BOUNCE_ROWS ) chunk = SOFT_SCROLL_BOUNCE_ROWS;
+        lgfx::swap565_t *buffer = bounce + half * SOFT_SCROLL_BOUNCE_ROWS * width;
+        memcpy( buffer, ring + ringRow * width, chunk * width * sizeof(lgfx::swap565_t) ); // this half was sent two chunks ago, the copy overlaps the last transfer
+        tft.waitDMA(); // one transfer in flight at a time
+        tft.pushImageDMA( 0, scrollTopFixedArea + screenRow, width, chunk, buffer );
+        half ^= 1;
+        ringRow = ( ringRow + chunk ) % yArea;
+        rows -= chunk;
+      }
+      tft.waitDMA();
+      tft.endWrite();
+    }
+
     int scroll(const char* str)
     {
       //tft.drawFastHLine( 0, scrollTopFixedArea, 8, BLE_RED );
@@ -198,18 +440,21 @@ class ScrollableOutput
         break;
         case SCROLL_SOFTWARE:
           tft_getTextBounds(str, scrollPosX, scrollPosY, &x1_tmp, &y1_tmp, &w_tmp, &h_tmp);
-          scrollPosY = (scrollTopFixedArea + yArea) - h_tmp;
+          if( hasSoftScroll() ) { // same positioning as the hardware scroll
+            scrollPosY = translate( scrollPosY );
+          } else {
+            scrollPosY = (scrollTopFixedArea + yArea) - h_tmp;
+          }
         break;
       }
 
 
-      tft_fillGradientHRect( 0, scrollPosY, width/2, h_tmp, BGColorStart, BGColorEnd );
-      tft_fillGradientHRect( width/2, scrollPosY, width/2, h_tmp, BGColorEnd, BGColorStart );
+      fillBackground( scrollPosY, h_tmp );
       tft.setCursor(scrollPosX, scrollPosY);
-      scroll_slow(h_tmp, 3); // Scroll lines, 3ms per line
+      scroll_slow(h_tmp, 3); // hardware scroll is animated by the display task
       //tft.print(str);
       if( strcmp(str, " \n")!=0 ) {
-        tft.drawString( str, tft.getCursorX(), tft.getCursorY());
+        drawString( str, tft.getCursorX(), tft.getCursorY());
       }
 
       scrollPosY = tft.getCursorY() + h_tmp;
@@ -225,14 +470,15 @@ class ScrollableOutput
 
       switch( scrollType ) {
         case SCROLL_HARDWARE:
-          for (int i = 0; i < lines; i++) {
-            yRef++;
-            if (yRef == height - scrollBottomFixedArea) yRef = scrollTopFixedArea;
-            tft_hScrollTo( yRef );
-            delay(wait);
-          }
+          yRef = translate( yRef, lines );
+          showScroll( lines );
         break;
         case SCROLL_SOFTWARE:
+          if( hasSoftScroll() ) {
+            yRef = translate( yRef, lines );
+            presentRows( yRef - scrollTopFixedArea, yArea );
+            break;
+          }
           tft_scrollTo(-lines);
           /*
           for (int i = 0; i < lines; i++) {
@@ -57,6 +57,9 @@ float timeZone = 1; // 1 = GMT+1, 2 = GMT+2, etc
 bool summerTime = false;
 
 #define WITH_WIFI          1 // used to download oui databases, NTP sync, can be disabled if HAS_GPS is used
+//#define WITH_HEAP_TRACE    1 // attribute heap usage to sqlite/BLE/String/sprite/cache tags, see the 'heap' command
+//#define HEADLESS           1 // no TFT: skip all rendering for max collection throughput, status goes to serial
+//#define SOFTWARE_SCROLL    1 // for TFT models without hardware scroll: the scroll area is kept in PSRAM and re-pushed
 // or disabled if specified by build flag
 #if defined WITHOUT_WIFI
   #undef WITH_WIFI
@@ -136,7 +139,7 @@ const char* welcomeMessage = R"asciiWelcome(
 
 )asciiWelcome" WELCOME_MESSAGE;
 
-static xSemaphoreHandle mux = NULL; // this is needed to mitigate SPI collisions
+#include "Locks.h" // display, DB and cache locks
 
 // str helpers
 char *substr(const char *src, int pos, int len)
@@ -168,8 +171,6 @@ Preferences preferences;
 #define freeheap heap_caps_get_free_size(MALLOC_CAP_INTERNAL)
 #define freepsheap ESP.getFreePsram()
 #define resetReason (int)rtc_get_reset_reason(0)
-#define takeMuxSemaphore() if( mux ) { xSemaphoreTake(mux, portMAX_DELAY); log_v("Took Semaphore"); }
-#define giveMuxSemaphore() if( mux ) { xSemaphoreGive(mux); log_v("Gave Semaphore"); }
 
 // core affinity
 #define SCANTASK_CORE       0
@@ -183,6 +184,10 @@ Preferences preferences;
 #define STATUSBAR_CORE      1
 #define HEAPGRAPH_CORE      1
 #define SCROLLINTRO_CORE    0
+#define ADVTRACE_CORE       1
+#define TASKPROFILER_CORE   1
+#define DISPLAYTASK_CORE    1
+#define PERSISTTASK_CORE    1
 
 static void destroyTaskNow( TaskHandle_t &task )
 {
@@ -227,9 +232,6 @@ static void destroyTaskNow( TaskHandle_t &task )
 #define CONFIG_NIMBLE_STACK_USE_MEM_POOLS 0
 #define CONFIG_BT_NIMBLE_ENABLED 0
 #include <NimBLEDevice.h> // https://github.com/h2zero/NimBLE-Arduino
-#include "NimBLEEddystoneURL.h"
-#include "NimBLEEddystoneTLM.h"
-#include "NimBLEBeacon.h"
 
 // SQLite stack
 #define NDEBUG // disable sqlite debug
@@ -261,10 +263,27 @@ static unsigned int entries  = 0; // total entries in database
 static uint8_t prune_trigger = 0; // incremented on every insertion, reset on prune()
 
 // load application stack
+#include "AssignedNumbers.h" // BLE SIG assigned numbers lookup tables
+#include "BLEBeacons.h" // beacon payload decoders
+#include "HeapTrace.h" // heap fragmentation and allocation tags
 #include "BLECache.h" // data struct
+#include "Backends.h" // DB, vendor and GATT lookups interfaces
+#include "RPAGroups.h" // random address grouping
+#include "AdvDedup.h" // advertisements deduplication window
+#include "LatencyProbes.h" // pipeline latency histograms
+#include "RollingMinMax.h" // sliding window min/max
+#include "AvatarCache.h" // mac address avatars LRU
+#include "RenderQueue.h" // display task render commands
 #include "ScrollPanel.h" // scrolly methods
 #include "TimeUtils.h"
 #include "UI.h"
 #include "DB.h"
+#include "PersistQueue.h" // DB writes task
+#include "Bench.h" // core micro benchmarks
+#include "AdvTraceFormat.h" // advertisement trace file format
+#include "AdvSynth.h" // synthetic advertisement traces
+#include "AdvTrace.h" // advertisement trace recorder and replay
+#include "TaskProfiler.h" // FreeRTOS tasks cpu/stack profiler
+#include "Metrics.h" // prometheus/json metrics
 #include "BLEFileSharing.h"
 #include "BLE.h"
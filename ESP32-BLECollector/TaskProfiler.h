@@ -0,0 +1,179 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+/*
+ * FreeRTOS tasks profiler
+ *
+ * Two snapshots of uxTaskGetSystemState() taken TASKPROFILER_SAMPLE_MS apart
+ * give the CPU share of every task over that window (runtime counter delta
+ * of the task / runtime counter delta of all tasks, so 100% = both cores
+ * busy), along with its core affinity, priority and stack high-water mark.
+ * The 'top' command prints one sample, 'top [seconds]' starts a periodic
+ * sampler logging the same table and 'top 0' stops it.
+ *
+ * CPU shares need CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS in the sdkconfig,
+ * without it only the stack, core and priority columns are filled.
+ *
+ */
+
+#ifndef TASKPROFILER_SAMPLE_MS // override this from Settings.h
+#define TASKPROFILER_SAMPLE_MS 1000
+#endif
+#define TASKPROFILER_MAX_TASKS 32
+
+#if defined configGENERATE_RUN_TIME_STATS && configGENERATE_RUN_TIME_STATS == 1
+  #define TASKPROFILER_HAS_RUNTIME 1
+#else
+  #define TASKPROFILER_HAS_RUNTIME 0
+#endif
+
+struct TaskSnapshot
+{
+  TaskStatus_t* tasks = NULL;
+  UBaseType_t   count = 0;
+  uint32_t      totalRuntime = 0;
+};
+
+static uint32_t TaskProfilerInterval = 0; // seconds, 0 = periodic sampler stopped
+static bool TaskProfilerRunning = false;
+
+
+class TaskProfilerUtils
+{
+  public:
+
+    // caller must release() the snapshot
+    static bool snapshot( TaskSnapshot &snap )
+    {
+      UBaseType_t capacity = uxTaskGetNumberOfTasks();
+      if( capacity > TASKPROFILER_MAX_TASKS ) capacity = TASKPROFILER_MAX_TASKS;
+      snap.tasks = (TaskStatus_t*)calloc( capacity, sizeof( TaskStatus_t ) );
+      if( snap.tasks == NULL ) {
+        log_e("[ERROR][%d][%d] can't allocate tasks snapshot", freeheap, freepsheap );
+        return false;
+      }
+      snap.count = uxTaskGetSystemState( snap.tasks, capacity, &snap.totalRuntime );
+      return true;
+    }
+
+    static void release( TaskSnapshot &snap )
+    {
+      free( snap.tasks );
+      snap.tasks = NULL;
+      snap.count = 0;
+    }
+
+    // blocks TASKPROFILER_SAMPLE_MS
+    static void top()
+    {
+      TaskSnapshot before, after;
+      if( !snapshot( before ) ) return;
+      vTaskDelay( pdMS_TO_TICKS( TASKPROFILER_SAMPLE_MS ) );
+      if( !snapshot( after ) ) {
+        release( before );
+        return;
+      }
+      print( before, after );
+      release( before );
+      release( after );
+    }
+
+    static void startSampler( uint32_t seconds )
+    {
+      TaskProfilerInterval = seconds;
+      if( seconds == 0 || TaskProfilerRunning ) return;
+      TaskProfilerRunning = true;
+      xTaskCreatePinnedToCore( samplerTask, "TaskProfiler", 3072, NULL, 0, NULL, TASKPROFILER_CORE );
+    }
+
+  private:
+
+    static void samplerTask( void * param = NULL )
+    {
+      while( TaskProfilerInterval > 0 ) {
+        top();
+        vTaskDelay( pdMS_TO_TICKS( TaskProfilerInterval * 1000 ) );
+      }
+      TaskProfilerRunning = false;
+      vTaskDelete( NULL );
+    }
+
+    static const TaskStatus_t* find( const TaskSnapshot &snap, TaskHandle_t handle )
+    {
+      for( UBaseType_t i=0; i<snap.count; i++ ) {
+        if( snap.tasks[i].xHandle == handle ) return &snap.tasks[i];
+      }
+      return NULL;
+    }
+
+    static char stateChar( eTaskState state )
+    {
+      switch( state ) {
+        case eRunning:   return 'R';
+        case eReady:     return 'r';
+        case eBlocked:   return 'B';
+        case eSuspended: return 'S';
+        case eDeleted:   return 'D';
+        default:         return '?';
+      }
+    }
+
+    static void print( const TaskSnapshot &before, const TaskSnapshot &after )
+    {
+      uint32_t window = after.totalRuntime - before.totalRuntime;
+      Serial.printf("[top] %d tasks, %d ms window, heap: %d, psram: %d\n", after.count, TASKPROFILER_SAMPLE_MS, freeheap, freepsheap );
+      Serial.printf("%-16s %5s %4s %3s %7s %11s\n", "Task", "State", "Core", "Pri", "CPU %", "Stack free");
+      for( UBaseType_t i=0; i<after.count; i++ ) {
+        const TaskStatus_t &task = after.tasks[i];
+        BaseType_t core = xTaskGetAffinity( task.xHandle );
+        char coreStr[4];
+        if( core == tskNO_AFFINITY ) snprintf( coreStr, sizeof( coreStr ), "-" );
+        else snprintf( coreStr, sizeof( coreStr ), "%d", core );
+        Serial.printf("%-16s %5c %4s %3d ", task.pcTaskName, stateChar( task.eCurrentState ), coreStr, task.uxCurrentPriority );
+        const TaskStatus_t* previous = find( before, task.xHandle );
+        if( TASKPROFILER_HAS_RUNTIME && previous != NULL && window > 0 ) {
+          Serial.printf("%7.1f ", ( task.ulRunTimeCounter - previous->ulRunTimeCounter ) * 100.0 / window );
+        } else {
+          Serial.printf("%7s ", "n/a");
+        }
+        Serial.printf("%11d\n", task.usStackHighWaterMark );
+      }
+    }
+
+};
+
+
+TaskProfilerUtils TaskProfiler;
@@ -31,138 +31,72 @@
 
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
-char *macAddressToColorStr = new char[MAC_LEN+1];
-
 // github avatar style mac address visual code generation \o/
 // builds a 8x8 vertically symetrical matrix based on the
 // bytes in the mac address, two first bytes are used to
 // allocate a color, the four last bytes are drawn with
-// that color
+// that color, decoded matrices are cached in AvatarCache.h
+// and drawn with a single push
+
+#define MACAVATAR_MAX_SCALE_X 4
+#define MACAVATAR_MAX_SCALE_Y 2
+
+// expanded avatar pixels (byte swapped rgb565), only used with the display lock held
+static uint16_t macAvatarPixels[8*MACAVATAR_MAX_SCALE_X * 8*MACAVATAR_MAX_SCALE_Y];
+
 struct MacAddressColors
 {
-  uint8_t MACBytes[8]; // 8x8
-  uint16_t color;
+  MacAvatar avatar; // 1-bit 8x8 matrix + color, see AvatarCache.h
   uint8_t scaleX, scaleY;
-  int width = -1, height = -1;
-  size_t size;
-  size_t choplevel = 0;
+  int width, height;
   MacAddressColors( const char* address, byte _scaleX, byte _scaleY )
   {
-    scaleX = _scaleX;
-    scaleY = _scaleY;
-    size = 8 * 8 * scaleX * scaleY;
-    memcpy( macAddressToColorStr, address, MAC_LEN+1);
-    uint8_t tokenpos = 0, val = 0, macpos = 0, msb = 0, lsb = 0;
-    char *token;
-    char *ptr;
-    token = strtok(macAddressToColorStr, ":");
-    while(token != NULL) {
-      val = strtol(token, &ptr, 16);
-      switch( tokenpos )  {
-        case 0: msb = val; break;
-        case 1: lsb = val; break;
-        default:
-          macpos = tokenpos-2;
-          MACBytes[macpos] = val;
-          MACBytes[7-macpos]= val;
-        break;
-      }
-      tokenpos++;
-      token = strtok(NULL, ":");
+    scaleX = _scaleX > MACAVATAR_MAX_SCALE_X ? MACAVATAR_MAX_SCALE_X : _scaleX;
+    scaleY = _scaleY > MACAVATAR_MAX_SCALE_Y ? MACAVATAR_MAX_SCALE_Y : _scaleY;
+    width  = scaleX*8;
+    height = scaleY*8;
+    if( !Avatars.get( address, avatar ) ) {
+      memset( avatar.mask, 0, sizeof( avatar.mask ) );
+      avatar.color = BLE_WHITE;
     }
-    color = (msb*256) + lsb;
   }
-  void spriteDraw( TFT_eSprite *sprite, uint16_t x, uint16_t y )
+  // mask => pixels
+  lgfx::swap565_t* expand()
   {
-    if( width==-1 && height==-1 ) {
-      width  = scaleX*8;
-      height = scaleY*8;
-      sprite->setPsram( false );
-      sprite->setColorDepth( 16 );
-      sprite->createSprite( width, height );
-    } // no need to clear sprite, all pixels will be overwritten
-    sprite->setWindow( 0, 0, width, height );
+    uint16_t fg = __builtin_bswap16( avatar.color );
+    uint16_t bg = __builtin_bswap16( BLE_WHITE );
+    uint16_t *pixel = macAvatarPixels;
     for( uint8_t i = 0; i < 8; i++ ) {
-      for( uint8_t sy = 0; sy < scaleY; sy++ ) {
-        for( uint8_t j = 0; j < 8; j++ ) {
-          if( bitRead( MACBytes[j], i ) == 1 ) {
-            sprite->pushBlock( color, scaleX );
-          } else {
-            sprite->pushBlock( BLE_WHITE, scaleX );
-          }
-        }
+      uint16_t *row = pixel;
+      for( uint8_t j = 0; j < 8; j++ ) {
+        uint16_t color = bitRead( avatar.mask[j], i ) == 1 ? fg : bg;
+        for( uint8_t sx = 0; sx < scaleX; sx++ ) *pixel++ = color;
       }
-    }
-    sprite->pushSprite( x, y );
-  }
-  // vertical blitter for upscaled rendering
-  void chopDraw( int32_t posx, int32_t posy, uint16_t _height )
-  {
-    if( width==-1 && height==-1 ) {
-      width  = scaleX*8;
-      height = scaleY*8;
-    }
-    if( _height%scaleY != 0 || _height > height ) { // not a multiple !!
-      log_e("Bad height request, height %d must be a multiple of scaleY %d and inferior to sizeY %d", _height, scaleY, height );
-      return;
-    }
-    uint8_t amount = _height / scaleY;
-    if( choplevel + amount > 8 || amount <= 0 ) { // out of range
-      log_e("Bad height request ( i=%d; i<%d; i++)", choplevel, choplevel+amount );
-      return;
-    }
-    tft.startWrite();
-    tft.setAddrWindow( posx, posy, width, _height );
-    for( uint8_t i = choplevel; i < choplevel + amount; i++ ) {
-      for( uint8_t sy = 0; sy < scaleY; sy++ ) {
-        for( uint8_t j = 0; j < 8; j++ ) {
-          if( bitRead( MACBytes[j], i ) == 1 ) {
-            tft.pushBlock( color, scaleX );
-          } else {
-            tft.pushBlock( BLE_WHITE, scaleX );
-          }
-        }
+      for( uint8_t sy = 1; sy < scaleY; sy++ ) { // scaleY rows are copies
+        memcpy( pixel, row, width * sizeof(uint16_t) );
+        pixel += width;
       }
     }
-    tft.endWrite();
-    choplevel += amount;
+    return (lgfx::swap565_t*)macAvatarPixels;
   }
-};
-
-
-struct MacSwap
-{
-  void swap(int32_t *xp, int32_t *yp) {
-    uint32_t temp = *xp;
-    *xp = *yp;
-    *yp = temp;
-  }
-  bool exists( int32_t needle, int32_t *haystack, size_t haystack_size )
+  void draw( uint16_t x, uint16_t y )
   {
-    for( size_t i=0; i< haystack_size; i++ ) {
-      if( haystack[i] == needle ) return true;
-    }
-    return false;
+    tft.pushImage( x, y, width, height, expand() );
   }
-  int32_t hasRecentActivity( int32_t needle, int32_t *haystack, size_t haystack_size )
+  // draws into a sprite, clipping included (e.g. a scanline band crossing the avatar)
+  void blit( TFT_eSprite *sprite, int32_t posx, int32_t posy )
   {
-    if( haystack_size == 0 ) return true;
-    for( size_t i=0; i< haystack_size; i++ ) {
-      if( BLEDevRAMCache[haystack[i]]->updated_at.unixtime() < BLEDevRAMCache[needle]->updated_at.unixtime() ) return i;
-    }
-    return -1;
+    sprite->pushImage( posx, posy, width, height, expand() );
   }
-  int32_t hasEnoughHits( int32_t needle, int32_t *haystack, size_t haystack_size )
-  {
-    if( haystack_size == 0 ) return true;
-    for( size_t i=0; i< haystack_size; i++ ) {
-      if( BLEDevRAMCache[haystack[i]]->hits < BLEDevRAMCache[needle]->hits ) return i;
-    }
-    return -1;
-  }
-} Mac;
+};
+
 
 
+static RollingMinMax heapWindow; // heapmap visible window
+static uint32_t heapGraphSeq = 0; // last heapWindow sample drawn in heapBarsSprite
+static uint32_t heapGraphMin = 0, heapGraphMax = 0; // heapBarsSprite scale
+static bool heapBarsValid = false; // heapBarsSprite needs a full redraw when false
+
 
 // load icons panel
 #include "UI_Icons.h"
@@ -171,14 +105,50 @@ struct MacSwap
 
 
 TaskHandle_t ClockSyncTaskHandle;
-TaskHandle_t DrawableItemsTaskHandle;
 TaskHandle_t HeapGraphTaskHandle;
+TaskHandle_t DisplayTaskHandle;
+static char* hallOfMacAddresses = NULL; // hall of mac snapshot, hallOfMacSize addresses of MAC_LEN+1 chars
+
+// BLE card border fading from white to its theme color, advanced by UIUtils::animate()
+struct CardFade
+{
+  uint16_t posY;
+  uint16_t height;
+  uint16_t borderColor;
+  int16_t  level; // grey level, done when <= CARDFADE_END
+};
+#define CARDFADE_START 255
+#define CARDFADE_END   64
+#define CARDFADE_STEP  8 // per animation tick
+static CardFade cardFade = { 0, 0, 0, CARDFADE_END };
 
 static bool ClockSyncTaskIsRunning = false;
-static bool DrawableItemsTaskIsRunning = false;
 static bool HeapGraphTaskIsRunning = false;
 
 
+#define BLECARD_MAX_LINES 20
+
+// BLE card text lines, built before rendering so the card height is known upfront
+struct BLECardLine
+{
+  const char* text;    // NULL = empty line
+  const IconSrc* icon; // NULL = no icon
+  uint8_t iconX;
+};
+
+struct BLECardLayout
+{
+  BLECardLine lines[BLECARD_MAX_LINES];
+  uint8_t count = 0;
+  uint8_t avatarLine = 0;
+  void add( const char* text, const IconSrc* icon = NULL, uint8_t iconX = 0 )
+  {
+    if( count >= BLECARD_MAX_LINES ) return;
+    lines[count++] = { text, icon, iconX };
+  }
+};
+
+
 class UIUtils
 {
   public:
@@ -221,6 +191,16 @@ class UIUtils
       );
       Serial.println("Free heap at boot: " + String(initial_free_heap));
 
+      if( !hasDisplay() ) {
+        // headless: board init (SD, RTC) with the LCD left off, only time keeping runs
+        Serial.println("Headless build, status will be printed here");
+        tft_begin();
+        SDSetup();
+        timeSetup();
+        xTaskCreatePinnedToCore(clockSync, "clockSync", 4096, (void*)this, 2, &ClockSyncTaskHandle, CLOCKSYNC_CORE );
+        return;
+      }
+
       bool clearScreen = true;
 
       if (resetReason == 12) { // SW Reset
@@ -299,6 +279,8 @@ class UIUtils
         tft_fillGradientHRect( Out.width/2, headerHeight, Out.width/2, scrollHeight, colorend, colorstart );
         // clear heap map
         for (uint16_t i = 0; i < heapMapBuffLen; i++) heapmap[i] = 0;
+        heapWindow.reset();
+        heapBarsValid = false;
       }
       tft.fillRect(0, 0, Out.width, headerHeight, HEADER_BGCOLOR);// fill header
       tft.fillRect(0, footerBottomPosY - footerHeight, Out.width, footerHeight, FOOTER_BGCOLOR);// fill footer
@@ -362,14 +344,14 @@ class UIUtils
         delay(1000);
         ESP.restart();
       }
-      headerStats();
-      footerStats();
+      Render.header( "" );
+      Render.footer();
     }
 
 
     void playIntro()
     {
-      takeMuxSemaphore();
+      takeDisplayLock();
       uint16_t pos = 0;
 
       for (int i = 0; i < 5; i++) {
@@ -395,30 +377,34 @@ class UIUtils
         Out.println();
       }
 
-      giveMuxSemaphore();
+      giveDisplayLock();
       delay(2000);
-      takeMuxSemaphore();
+      takeDisplayLock();
       Out.scrollNextPage();
-      giveMuxSemaphore();
+      giveDisplayLock();
       xTaskCreatePinnedToCore(introUntilScroll, "introUntilScroll", 2048, NULL, 8, NULL, SCROLLINTRO_CORE );
     }
 
 
     static void stopUITasks( void * param = NULL )
     {
-      takeMuxSemaphore();
+      takeDisplayLock();
       if( ClockSyncTaskIsRunning )     destroyTaskNow( ClockSyncTaskHandle );
-      if( DrawableItemsTaskIsRunning ) destroyTaskNow( DrawableItemsTaskHandle );
       if( HeapGraphTaskIsRunning )     destroyTaskNow( HeapGraphTaskHandle );
-      giveMuxSemaphore();
+      if( RenderTaskIsRunning )        destroyTaskNow( DisplayTaskHandle );
+      RenderTaskIsRunning = false;
+      Out.finishScroll();
+      giveDisplayLock();
     }
 
     #if defined USE_SCREENSHOTS
     static void screenShot()
     {
-      takeMuxSemaphore();
+      if( !hasDisplay() ) return;
+      takeDisplayLock();
       isQuerying = true;
 
+      Out.finishScroll();
       int16_t yRef = Out.yRef - Out.scrollTopFixedArea;
       // match pixel copy area with scroll area
       //log_d("tft.setScrollRect(%d, %d, %d, %d);", 0, Out.scrollTopFixedArea, Out.width, Out.yArea);
@@ -437,13 +423,13 @@ class UIUtils
       tft_hScrollTo( Out.yRef ); // restore hardware scroll
 
       isQuerying = false;
-      giveMuxSemaphore();
+      giveDisplayLock();
     }
     #endif
 
     static void screenShow( void * fileName = NULL )
     {
-      if( fileName == NULL ) return;
+      if( fileName == NULL || !hasDisplay() ) return;
       isQuerying = true;
 
       // reset hardware scroll position before printing
@@ -453,30 +439,30 @@ class UIUtils
         if( !BLE_FS.exists( (const char*)fileName ) ) {
           log_e("File %s does not exist\n", (const char*)fileName );
         } else {
-          takeMuxSemaphore();
+          takeDisplayLock();
           Out.scrollNextPage(); // reset scroll position to zero otherwise image will have offset
           tft.drawJpgFile( BLE_FS, (const char*)fileName, 0, 0, Out.width, Out.height, 0, 0 );
-          giveMuxSemaphore();
+          giveDisplayLock();
           vTaskDelay( 5000 );
         }
       } else if( String( (const char*)fileName ).endsWith(".bmp" ) ) {
         if( !BLE_FS.exists( (const char*)fileName ) ) {
           log_e("File %s does not exist\n", (const char*)fileName );
         } else {
-          takeMuxSemaphore();
+          takeDisplayLock();
           Out.scrollNextPage(); // reset scroll position to zero otherwise image will have offset
           tft.drawBmpFile( BLE_FS, (const char*)fileName, 0, 0 );
-          giveMuxSemaphore();
+          giveDisplayLock();
           vTaskDelay( 5000 );
         }
       } else if( String( (const char*)fileName ).endsWith(".qoi" ) ) {
         if( !BLE_FS.exists( (const char*)fileName ) ) {
           log_e("File %s does not exist\n", (const char*)fileName );
         } else {
-          takeMuxSemaphore();
+          takeDisplayLock();
           Out.scrollNextPage(); // reset scroll position to zero otherwise image will have offset
           tft.drawQoiFile( BLE_FS, (const char*)fileName, 0, 0 );
-          giveMuxSemaphore();
+          giveDisplayLock();
           vTaskDelay( 5000 );
         }
       }
@@ -508,9 +494,9 @@ class UIUtils
         x = hallOfMacPosX + (counter%hallofMacCols) * hallOfMacItemWidth;
         y = hallOfMacPosY + ((counter/hallofMacCols)%hallofMacRows) * hallOfMacItemHeight;
         MacAddressColors AvatarizedMAC( randomAddressStr, 2, 1 );
-        takeMuxSemaphore();
-        AvatarizedMAC.spriteDraw( &hallOfMacSprite, hallOfMacHmargin + x, hallOfMacVmargin + y );
-        giveMuxSemaphore();
+        takeDisplayLock();
+        AvatarizedMAC.draw( hallOfMacHmargin + x, hallOfMacVmargin + y );
+        giveDisplayLock();
         counter++;
         vTaskDelay(30);
       }
@@ -520,8 +506,8 @@ class UIUtils
 
     static void headerStats(const char *status = "")
     {
-      if ( isInScroll() || isInQuery() ) return;
-      takeMuxSemaphore();
+      if ( !hasDisplay() || isInScroll() || isInQuery() ) return;
+      takeDisplayLock();
       int16_t posX = tft.getCursorX();
       int16_t posY = tft.getCursorY();
       int16_t statuspos = 0;
@@ -547,16 +533,17 @@ class UIUtils
       if( !appIconRendered || statuspos > iconAppX ) { // only draw if text has overlapped
         IconRender( Icon_tbz_src, iconAppX, iconAppY ); // app icon
         appIconRendered = true;
+        TextCountersIcon.invalidate(); // text counters may share this line
       }
       tft.setCursor(posX, posY);
-      giveMuxSemaphore();
+      giveDisplayLock();
     }
 
 
     void footerStats()
     {
-      if ( isInScroll() || isInQuery() ) return;
-      takeMuxSemaphore();
+      if ( !hasDisplay() || isInScroll() || isInQuery() ) return;
+      takeDisplayLock();
       int16_t posX = tft.getCursorX();
       int16_t posY = tft.getCursorY();
 
@@ -565,17 +552,18 @@ class UIUtils
       }
       //alignTextAt( UpTimeString, uptimePosX, uptimePosY, BLE_GREENYELLOW, FOOTER_BGCOLOR, ALIGN_FREE );
       tft.setCursor(posX, posY);
-      giveMuxSemaphore();
+      giveDisplayLock();
     }
 
 
     void cacheStats()
     {
-      takeMuxSemaphore();
+      if( !hasDisplay() ) return;
+      takeDisplayLock();
       percentBox( percentBoxX, percentBoxY - 3*(percentBoxSize+2), percentBoxSize, percentBoxSize, BLEDevCacheUsed, BLE_CYAN,        BLE_BLACK);
       percentBox( percentBoxX, percentBoxY - 2*(percentBoxSize+2), percentBoxSize, percentBoxSize, VendorCacheUsed, BLE_ORANGE,      BLE_BLACK);
       percentBox( percentBoxX, percentBoxY - 1*(percentBoxSize+2), percentBoxSize, percentBoxSize, OuiCacheUsed,    BLE_GREENYELLOW, BLE_BLACK);
-      giveMuxSemaphore();
+      giveDisplayLock();
     }
 
 
@@ -620,11 +608,22 @@ class UIUtils
 
     static void PrintMessage( const char* message )
     {
-      takeMuxSemaphore();
+      if( !hasDisplay() ) {
+        Serial.println( message );
+        return;
+      }
+      if( Render.message( message ) ) return;
+      printMessageLine( message );
+    }
+
+    // scroll area text, drawn by the display task once it runs
+    static void printMessageLine( const char* message )
+    {
+      takeDisplayLock();
       tft.setCursor( 0, tft.getCursorY() );
       Out.println( message );
       Out.println( SPACE );
-      giveMuxSemaphore();
+      giveDisplayLock();
     }
 
     static void PrintFatalError( const char* message, uint16_t yPos = AMIGABALL_YPOS )
@@ -639,14 +638,15 @@ class UIUtils
 
     static void PrintProgressBar(uint16_t width)
     {
-      takeMuxSemaphore();
+      if( !hasDisplay() ) return;
+      takeDisplayLock();
       if( width > Out.width || width == 0 ) { // clear
         tft.fillRect(0,     progressBarY, Out.width, 2, BLE_DARKGREY);
       } else {
         tft.fillRect(0,     progressBarY, width,           2, BLUETOOTH_COLOR);
         tft.fillRect(width, progressBarY, Out.width-width, 2, BLE_DARKGREY);
       }
-      giveMuxSemaphore();
+      giveDisplayLock();
     }
 
     static void SetTimeStateIcon()
@@ -707,7 +707,7 @@ class UIUtils
     { // always running
       HeapGraphTaskIsRunning = true;
 
-      takeMuxSemaphore();
+      takeDisplayLock();
       for( uint16_t i = 0; i < hallOfMacSize; i++ ) {
         uint16_t x = hallOfMacPosX + (i%hallofMacCols) * hallOfMacItemWidth;
         uint16_t y = hallOfMacPosY + ((i/hallofMacCols)%hallofMacRows) * hallOfMacItemHeight;
@@ -715,113 +715,176 @@ class UIUtils
       }
       heapGraphSprite.setPsram( false );
       heapGraphSprite.setColorDepth( 16 );
-      heapGraphSprite.createSprite( graphLineWidth, graphLineHeight );
-      giveMuxSemaphore();
+      {
+        HeapTraceScope trace( HEAP_TAG_SPRITE );
+        heapGraphSprite.createSprite( graphLineWidth, graphLineHeight );
+        heapBarsSprite.setPsram( false );
+        heapBarsSprite.setColorDepth( 16 );
+        heapBarsSprite.createSprite( graphLineWidth, graphLineHeight );
+      }
+      giveDisplayLock();
 
       xTaskCreatePinnedToCore(clockSync, "clockSync", 4096, param, 2, &ClockSyncTaskHandle, CLOCKSYNC_CORE ); // RTC wants to run on core 1 or it fails
-      xTaskCreatePinnedToCore(drawableItems, "drawableItems", 6144, param, 2, &DrawableItemsTaskHandle, STATUSBAR_CORE );
+      xTaskCreatePinnedToCore(displayTask, "displayTask", 6144, param, 3, &DisplayTaskHandle, DISPLAYTASK_CORE );
       HeapGraphTaskIsRunning = false;
       vTaskDelete(NULL);
     }
 
-    static void drawableItems( void * param )
+    // owns the whole screen once started, everyone else sends render
+    // commands (see RenderQueue.h)
+    static void displayTask( void * param )
     {
-      log_w("Starting drawableItems task");
-      DrawableItemsTaskIsRunning = true;
+      log_w("Starting displayTask");
+      if( !Render.init() ) {
+        vTaskDelete(NULL);
+        return;
+      }
+      RenderTaskIsRunning = true;
 
       UIUtils *_UI = (UIUtils*)param;
+      char header[RENDER_HEADER_LEN];
+      char message[RENDER_HEADER_LEN];
+      uint16_t progressWidth;
+      uint8_t slot;
+      bool animating = false;
       bool _BLEStarted = _UI->BLEStarted;
+      unsigned long lastStatusBar = 0;
+
+      int32_t *sorted     = new int32_t[hallOfMacSize+1];
+      int32_t *lastsorted = new int32_t[hallOfMacSize+1];
+      for( uint16_t i = 0; i< hallOfMacSize; i++ ) {
+        sorted[i]     = -1;
+      }
 
       while(1) {
-        if( freeheap != lastfreeheap ) {
-          takeMuxSemaphore();
-          heapmap[heapindex++] = freeheap;
-          heapindex = heapindex % heapMapBuffLen;
-          lastfreeheap = freeheap;
-          giveMuxSemaphore();
+        uint32_t wait = animating ? ANIMATION_TICK_MS : RENDER_FRAME_MS;
+        bool hasCard = Render.nextCard( slot, wait / portTICK_PERIOD_MS );
+        StageBusy busy( STAGE_RENDER ); // until the end of the frame, the wait above is idle time
+        while( Render.nextMessage( message ) ) { // queued before the card, or while waiting for it
+          printMessageLine( message );
         }
-
-        if( _UI->BLEStarted != _BLEStarted ) {
-          _BLEStarted = _UI->BLEStarted;
-          takeMuxSemaphore();
-          if( _BLEStarted ) {
-            IconRender( Icon_ble_src, 91, 2 );
-          } else {
-            IconRender( Icon_ble_off_src, 91, 2 );
+        if( hasCard ) {
+          _UI->printBLECard( Render.cardLink( slot ) );
+          Render.releaseCard( slot );
+        }
+        uint8_t dirty = Render.takeDirty( header, progressWidth );
+        if( dirty & RENDER_HEADER )     headerStats( header );
+        if( dirty & RENDER_PROGRESS )   _UI->PrintProgressBar( progressWidth );
+        if( dirty & RENDER_CACHESTATS ) _UI->cacheStats();
+        if( dirty & RENDER_FOOTER )     _UI->footerStats();
+        if( dirty & RENDER_BRIGHTNESS ) tft_setBrightness( _UI->brightness );
+        if( dirty & RENDER_HALLOFMAC ) {
+          for( uint16_t i = 0; i < hallOfMacSize; i++ ) {
+            lastsorted[i] = sorted[i];
           }
-          giveMuxSemaphore();
+          hallOfMac( sorted, lastsorted );
         }
+        if( dirty & RENDER_GRAPH )      heapGraph();
+        if( millis() - lastStatusBar >= STATUSBAR_TICK_MS ) {
+          statusBar( _UI, _BLEStarted );
+          lastStatusBar = millis();
+        }
+        animating = animate();
+      }
+    }
 
-        PrintBlinkableWidgets();
-        BLECollectorIconBar.draw( BLECollectorIconBarX, BLECollectorIconBarY );
-        vTaskDelay(150 / portTICK_PERIOD_MS);
+    // animation tick: scroll catching up and card fade, true while any is running
+    static bool animate()
+    {
+      if( Out.scrollLag == 0 && cardFade.level <= CARDFADE_END ) return false;
+      takeDisplayLock();
+      bool running = Out.scrollStep();
+      if( cardFade.level > CARDFADE_END ) {
+        cardFade.level -= CARDFADE_STEP;
+        if( cardFade.level > CARDFADE_END ) {
+          Out.drawScrollableRoundRect( 1, cardFade.posY, Out.width - 2, cardFade.height, 4, tft_color565(cardFade.level, cardFade.level, cardFade.level) );
+          running = true;
+        } else {
+          Out.drawScrollableRoundRect( 1, cardFade.posY, Out.width - 2, cardFade.height, 4, cardFade.borderColor );
+        }
       }
+      giveDisplayLock();
+      return running;
+    }
+
+    // display task, every STATUSBAR_TICK_MS: heap sampling, BLE icon, blinking widgets and icon bar
+    static void statusBar( UIUtils *_UI, bool &_BLEStarted )
+    {
+      if( freeheap != lastfreeheap ) {
+        heapmap[heapindex++] = freeheap;
+        heapindex = heapindex % heapMapBuffLen;
+        heapWindow.push( freeheap );
+        lastfreeheap = freeheap;
+      }
+
+      if( _UI->BLEStarted != _BLEStarted ) {
+        _BLEStarted = _UI->BLEStarted;
+        takeDisplayLock();
+        if( _BLEStarted ) {
+          IconRender( Icon_ble_src, 91, 2 );
+        } else {
+          IconRender( Icon_ble_off_src, 91, 2 );
+        }
+        giveDisplayLock();
+      }
+
+      PrintBlinkableWidgets();
+      BLECollectorIconBar.draw( BLECollectorIconBarX, BLECollectorIconBarY );
     }
 
     static void hallOfMac( int32_t * sorted, int32_t * lastsorted )
     {
       if( !RamCacheReady ) return;
 
-      // get the n top hits in the cache ( n=hallOfMacSize )
-      size_t macFound = 0;
-      int16_t index = BLEDEVCACHE_SIZE-1;
-
-      takeMuxSemaphore();
+      if( hallOfMacAddresses == NULL ) {
+        hallOfMacAddresses = (char*)calloc( hallOfMacSize, MAC_LEN+1 );
+        if( hallOfMacAddresses == NULL ) return;
+      }
 
-      while( index >= 0 ) {
-        if( isEmpty( BLEDevRAMCache[index]->address ) || BLEDevRAMCache[index]->hits == 0 ) {
-          index--;
+      // lock-free read of the cache: retry when a writer touched it meanwhile
+      size_t macFound = 0;
+      bool consistent = false;
+      for( uint8_t attempt = 0; attempt < 3 && !consistent; attempt++ ) {
+        uint32_t seq;
+        if( !Lock.cacheReadBegin( seq ) ) {
+          vTaskDelay(1);
           continue;
         }
-        if( !Mac.exists( index, sorted, macFound ) ) { // not in list
-          if( macFound < hallOfMacSize ) {
-            sorted[macFound] = index;
-            macFound++;
-          } else {
-            int32_t has = Mac.hasRecentActivity( index, sorted, macFound );
-            if( has > -1 ) { // insertable
-              sorted[has] = index;
-            }
-          }
-        }
-        index--;
-      }
-      if( macFound > 1 ) {
-        // bubble sort by hits
-        for( uint16_t i = 0; i < macFound-1; i++ ) {
-          for ( uint16_t j = 0; j < macFound-i-1; j++ ) {
-            if( BLEDevRAMCache[sorted[j]]->hits < BLEDevRAMCache[sorted[j+1]]->hits ) {
-              Mac.swap(&sorted[j], &sorted[j+1]);
-            }
-          }
+        macFound = BLEDevTopK.read( sorted, hallOfMacSize ); // top hits, maintained by the cache writers
+        for( uint16_t i = 0; i < macFound; i++ ) {
+          memcpy( &hallOfMacAddresses[i*(MAC_LEN+1)], BLEDevRAMCache[sorted[i]]->address, MAC_LEN+1 );
         }
+        consistent = Lock.cacheReadValid( seq );
+      }
+      if( !consistent ) {
+        // keep the previous hall of mac until next round
+        for( uint16_t i = 0; i < hallOfMacSize; i++ ) sorted[i] = lastsorted[i];
+        return;
       }
+
       if( macFound > 0 ) {
+        takeDisplayLock();
         for( uint16_t i = 0; i < hallOfMacSize; i++ ) {
           uint16_t x = hallOfMacPosX + (i%hallofMacCols) * hallOfMacItemWidth;
           uint16_t y = hallOfMacPosY + ((i/hallofMacCols)%hallofMacRows) * hallOfMacItemHeight;
           if( i<macFound ) {
             if( lastsorted[i] != sorted[i] ) {
-              //takeMuxSemaphore();
               // cleanup current slot
               animClear( x, y, hallOfMacItemWidth, hallOfMacItemHeight, FOOTER_BGCOLOR, BLE_WHITE );
               // draw current slot
-              MacAddressColors AvatarizedMAC( BLEDevRAMCache[sorted[i]]->address, 2, 1 );
-              AvatarizedMAC.spriteDraw( &hallOfMacSprite, hallOfMacHmargin + x, hallOfMacVmargin + y );
-              //giveMuxSemaphore();
+              MacAddressColors AvatarizedMAC( &hallOfMacAddresses[i*(MAC_LEN+1)], 2, 1 );
+              AvatarizedMAC.draw( hallOfMacHmargin + x, hallOfMacVmargin + y );
             }
           } else {
             if( lastsorted[i] > 0 ) {
-              //takeMuxSemaphore();
               //tft.fillRect( hallOfMacHmargin + x, hallOfMacVmargin + y, hallOfMacItemWidth, hallOfMacItemHeight, FOOTER_BGCOLOR );
               animClear( x, y, hallOfMacItemWidth, hallOfMacItemHeight, FOOTER_BGCOLOR, BLE_WHITE );
-              //giveMuxSemaphore();
             }
           }
         }
+        giveDisplayLock();
         //Serial.println();
       }
-      giveMuxSemaphore();
     }
 
     static void textCounters()
@@ -915,31 +978,20 @@ class UIUtils
       devGraphFirstStatTime = millis();
       ClockSyncTaskIsRunning = true;
 
-      int32_t *sorted     = new int32_t[hallOfMacSize+1];
-      int32_t *lastsorted = new int32_t[hallOfMacSize+1];
-
-      for( uint16_t i = 0; i< hallOfMacSize; i++ ) {
-        sorted[i]     = -1;
-      }
-
       while(1) {
-        for( uint16_t i = 0; i < hallOfMacSize; i++ ) {
-          lastsorted[i] = sorted[i];
-        }
-
         if( TimeIsSet ) {
-          takeMuxSemaphore();
-          timeHousekeeping();
-          giveMuxSemaphore();
+          timeHousekeeping(); // time strings only, the footer picks them up on next draw
         } else {
           uptimeSet();
         }
 
         SetTimeStateIcon();
-        hallOfMac( sorted, lastsorted );
-        textCounters();
-        devicesGraphStats();
-        heapGraph();
+        if( hasDisplay() ) {
+          Render.hallOfMac();
+          textCounters();
+          devicesGraphStats();
+          Render.graph();
+        }
         // make sure it happens at least once every 1000 ms
         vTaskDelayUntil(&lastWaketime, 1000 / portTICK_PERIOD_MS);
       }
@@ -955,26 +1007,25 @@ class UIUtils
         return;
       }
       devCountWasUpdated = false;
+      if( heapGraphSprite.getBuffer() == NULL || heapBarsSprite.getBuffer() == NULL ) {
+        return;
+      }
 
       // render heatmap
-      uint16_t GRAPH_COLOR = BLE_WHITE;
-      uint32_t graphMin = min_free_heap;
-      uint32_t graphMax = graphMin;
       uint32_t toleranceline = graphLineHeight;
       uint32_t minline = 0;
-      uint16_t GRAPH_BG_COLOR = BLE_BLACK;
-      uint16_t currentheapindex = heapindex;
-      // dynamic scaling
-      for (uint8_t i = 0; i < graphLineWidth; i++) {
-        int thisindex = int(currentheapindex - graphLineWidth + i + heapMapBuffLen) % heapMapBuffLen;
-        uint32_t heapval = heapmap[thisindex];
-        if (heapval != 0 && heapval < graphMin) {
-          graphMin =  heapval;
-        }
-        if (heapval > graphMax) {
-          graphMax = heapval;
-        }
+      // dynamic scaling, from the rolling min/max of the visible samples
+      // heapmap and heapWindow are fed from statusBar(), same task
+      uint32_t graphMin = min_free_heap;
+      uint32_t graphMax = graphMin;
+      if( heapWindow.min() != 0 && heapWindow.min() < graphMin ) {
+        graphMin = heapWindow.min();
       }
+      if( heapWindow.max() > graphMax ) {
+        graphMax = heapWindow.max();
+      }
+      uint16_t currentheapindex = heapindex;
+      uint32_t currentheapseq = heapWindow.seq;
 
       if (graphMin == graphMax) {
         // data isn't relevant enough to render
@@ -983,47 +1034,32 @@ class UIUtils
       // bounds, min and max lines
       minline = map(min_free_heap, graphMin, graphMax, 0, graphLineHeight);
       if (toleranceheap > graphMax) {
-        GRAPH_BG_COLOR = BLE_ORANGE;
         toleranceline = graphLineHeight;
       } else if ( toleranceheap < graphMin ) {
         toleranceline = 0;
       } else {
         toleranceline = map(toleranceheap, graphMin, graphMax, 0, graphLineHeight);
       }
-      // draw graph
-
-      heapGraphSprite.fillSprite( BLE_BLACK );
-
-      for (uint8_t i = 0; i < graphLineWidth; i++) {
+      // draw graph: heap columns only change on new samples or when the scale changes
+      uint32_t newColumns = currentheapseq - heapGraphSeq;
+      uint16_t firstColumn = graphLineWidth;
+      if( !heapBarsValid || graphMin != heapGraphMin || graphMax != heapGraphMax || newColumns >= graphLineWidth ) {
+        firstColumn = 0; // rescale
+      } else if( newColumns > 0 ) {
+        heapBarsSprite.scroll( -(int32_t)newColumns, 0 );
+        firstColumn = graphLineWidth - newColumns;
+      }
+      for (uint16_t i = firstColumn; i < graphLineWidth; i++) {
         int thisindex = int(currentheapindex - graphLineWidth + i + heapMapBuffLen) % heapMapBuffLen;
-        uint32_t heapval = heapmap[thisindex];
-        if ( heapval > toleranceheap ) {
-          // nominal, all green
-          GRAPH_COLOR = BLE_GREEN;
-          GRAPH_BG_COLOR = BLE_DARKGREY;
-        } else {
-          if ( heapval > min_free_heap ) {
-            // in tolerance zone
-            GRAPH_COLOR = BLE_YELLOW;
-            GRAPH_BG_COLOR = BLE_DARKGREEN;
-          } else {
-            // under tolerance zone
-            if (heapval > 0) {
-              GRAPH_COLOR = BLE_RED;
-              GRAPH_BG_COLOR = BLE_ORANGE;
-            } else {
-              // no record
-              GRAPH_BG_COLOR = BLE_BLACK;
-            }
-          }
-        }
-        // fill background
-        heapGraphSprite.drawFastVLine( i, 0, graphLineHeight, GRAPH_BG_COLOR );
-        if ( heapval > 0 ) {
-          uint32_t lineheight = map(heapval, graphMin, graphMax, 0, graphLineHeight);
-          heapGraphSprite.drawFastVLine( i, graphLineHeight-lineheight, lineheight, GRAPH_COLOR );
-        }
+        heapGraphColumn( i, heapmap[thisindex], graphMin, graphMax );
       }
+      heapGraphSeq  = currentheapseq;
+      heapGraphMin  = graphMin;
+      heapGraphMax  = graphMax;
+      heapBarsValid = true;
+
+      // overlays (bounds and device rates) are redrawn over a copy of the columns
+      memcpy( heapGraphSprite.getBuffer(), heapBarsSprite.getBuffer(), graphLineWidth * graphLineHeight * sizeof(uint16_t) );
       heapGraphSprite.drawFastHLine( 0, graphLineHeight - toleranceline, graphLineWidth, BLE_LIGHTGREY );
       heapGraphSprite.drawFastHLine( 0, graphLineHeight - minline, graphLineWidth, BLE_RED );
 
@@ -1076,9 +1112,42 @@ class UIUtils
         // join last/first
         heapGraphSprite.drawLine( dcpmLastX, dcpmLastY, graphLineWidth, dcpmFirstY, BLE_DARKBLUE );
       }
-      takeMuxSemaphore();
+      takeDisplayLock();
       heapGraphSprite.pushSprite( graphX, graphY );
-      giveMuxSemaphore();
+      giveDisplayLock();
+    }
+
+
+    static void heapGraphColumn( uint16_t x, uint32_t heapval, uint32_t graphMin, uint32_t graphMax )
+    {
+      uint16_t GRAPH_COLOR = BLE_WHITE;
+      uint16_t GRAPH_BG_COLOR = BLE_BLACK;
+      if ( heapval > toleranceheap ) {
+        // nominal, all green
+        GRAPH_COLOR = BLE_GREEN;
+        GRAPH_BG_COLOR = BLE_DARKGREY;
+      } else {
+        if ( heapval > min_free_heap ) {
+          // in tolerance zone
+          GRAPH_COLOR = BLE_YELLOW;
+          GRAPH_BG_COLOR = BLE_DARKGREEN;
+        } else {
+          // under tolerance zone
+          if (heapval > 0) {
+            GRAPH_COLOR = BLE_RED;
+            GRAPH_BG_COLOR = BLE_ORANGE;
+          } else {
+            // no record
+            GRAPH_BG_COLOR = BLE_BLACK;
+          }
+        }
+      }
+      // fill background
+      heapBarsSprite.drawFastVLine( x, 0, graphLineHeight, GRAPH_BG_COLOR );
+      if ( heapval > 0 ) {
+        uint32_t lineheight = map(heapval, graphMin, graphMax, 0, graphLineHeight);
+        heapBarsSprite.drawFastVLine( x, graphLineHeight-lineheight, lineheight, GRAPH_COLOR );
+      }
     }
 
 
@@ -1106,18 +1175,19 @@ class UIUtils
 
       log_d("  [printBLECard] %s will be rendered", BleCard->address);
 
-      takeMuxSemaphore();
+      takeDisplayLock();
 
-      //MacScrollView
-      uint16_t blockHeight = 0;
-      uint16_t hop;
-      uint16_t initialPosY = Out.scrollPosY;
-      MacAddressColors AvatarizedMAC( BleCard->address, macAddrColorsScaleX, macAddrColorsScaleY );
+      uint16_t lineHeight = tft.fontHeight();
+      if( !initCardSprites( lineHeight ) ) {
+        giveDisplayLock();
+        return;
+      }
 
       *addressStr = {'\0'};
       sprintf( addressStr, addressTpl, BleCard->address );
       *dbmStr = {'\0'};
-      sprintf( dbmStr, dbmTpl, BleCard->rssi );
+      int rssi = BLEDevHelper.statsRSSI( BleCard ); // smoothed when available
+      sprintf( dbmStr, dbmTpl, rssi );
 
       if( BleCard->in_db ) {
         if( BleCard->is_anonymous ) {
@@ -1132,65 +1202,18 @@ class UIUtils
           BLECardTheme.setTheme( NOT_IN_CACHE_ANON );
         }
       }
-      tft.setTextColor( BLECardTheme.textColor, BLECardTheme.bgColor );
-
       BGCOLOR = BLECardTheme.bgColor;
-      hop = Out.println( SPACE );
-      blockHeight += hop;
-
-      hop = Out.println( addressStr );
-      blockHeight += hop;
-
-      alignTextAt( dbmStr, 0, Out.scrollPosY - hop, BLECardTheme.textColor, BLECardTheme.bgColor, ALIGN_RIGHT );
-      tft.setCursor( 0, Out.scrollPosY );
-      drawRSSIBar( Out.width - 18, Out.scrollPosY - hop - 1, BleCard->rssi, BLECardTheme.textColor );
-      if ( BleCard->in_db ) { // 'already seen this' icon
-        IconRender( Icon8x8_update_src, 138, Out.scrollPosY - hop );
-      } else { // 'just inserted this' icon
-        IconRender( TextCounters_seen_src, 138, Out.scrollPosY - hop );
-      }
-      if ( !isEmpty( BleCard->uuid ) ) { // 'has service UUID' Icon
-        IconRender( Icon8x8_service_src, 128, Out.scrollPosY - hop );
-      }
-
-      switch( BleCard->hits ) {
-        case 0:
-          IconRender( TextCounters_entries_src, 118, Out.scrollPosY - hop );
-        break;
-        case 1:
-          IconRender( TextCounters_scans_src, 118, Out.scrollPosY - hop );
-        break;
-        default:
-          IconRender( TextCounters_heap_src, 118, Out.scrollPosY - hop );
-        break;
-      }
 
+      // layout pass: one entry per text line, same flow as the former println() sequence
+      BLECardLayout card;
+      card.add( NULL );
+      card.add( addressStr ); // + dBm, RSSI bar and status icons, see composeCardLine()
 
       if( TimeIsSet ) {
         if ( BleCard->hits > 1 ) {
           *hitsStr = {'\0'};
           sprintf(hitsStr, "(%s hits)", formatUnit( BleCard->hits ) );
-
-          if( BleCard->updated_at.unixtime() > 0 /* BleCard->created_at.year() > 1970 */) {
-            /*
-            unsigned long age_in_seconds = abs( BleCard->created_at.unixtime() - BleCard->updated_at.unixtime() );
-            unsigned long age_in_minutes = age_in_seconds / 60;
-            unsigned long age_in_hours   = age_in_minutes / 60;
-            unsigned long seconds_since_boot = (millis() / 1000)+1;
-            float freq = ((float)BleCard->hits / (float)scan_rounds+1) * ((float)age_in_seconds / (float)seconds_since_boot+1);
-            Serial.printf(" C: %d, U:%d, (%d / %d) * (%d / %d) = ",
-              BleCard->created_at.unixtime(),
-              BleCard->updated_at.unixtime(),
-              BleCard->hits,
-              scan_rounds+1,
-              age_in_seconds+1,
-              millis() / 1000
-            );
-            Serial.println( freq * 1000 );*/
-          }
-
           if( BleCard->created_at.year() > 1970 ) {
-            blockHeight += Out.println(SPACE);
             *hitsTimeStampStr = {'\0'};
             sprintf(hitsTimeStampStr, hitsTimeStampTpl,
               BleCard->created_at.year(),
@@ -1201,109 +1224,95 @@ class UIUtils
               BleCard->created_at.second(),
               hitsStr
             );
-            hop = Out.println( hitsTimeStampStr );
-            blockHeight += hop;
-            IconRender( TimeIcon_SET_src, 12, Out.scrollPosY - hop );
+            card.add( NULL );
+            card.add( hitsTimeStampStr, TimeIcon_SET_src, 12 );
           }
         }
       }
 
       if( !isEmpty( BleCard->uuid ) ) {
-
-        //BLEUUID tmpID;
-        //tmpID.fromString(BleCard->uuid);
-        BLEGATTService srv = BLEDevHelper.gattServiceDescription( BleCard->uuid );
-        //const char* serviceStr = BLEDevHelper.gattServiceDescription( tmpID );
-
+        BLEGATTService srv = Backend.gatt->service( BleCard->uuid );
         // TODO: icon render
         if( strcmp( srv.name, "Unknown" ) != 0 ) {
-          blockHeight += Out.println( SPACE );
-          *ouiStr = {'\0'};
-          sprintf( ouiStr, ouiTpl, srv.name );
-          hop = Out.println( ouiStr );
-          blockHeight += hop;
+          snprintf( serviceStr, sizeof( serviceStr ), ouiTpl, srv.name );
+          card.add( NULL );
+          card.add( serviceStr );
         }
       }
 
       if ( !isEmpty( BleCard->ouiname ) ) {
-        blockHeight += Out.println( SPACE );
-        *ouiStr = {'\0'};
         sprintf( ouiStr, ouiTpl, BleCard->ouiname );
-        hop = Out.println( ouiStr );
-        blockHeight += hop;
+        card.add( NULL );
         if ( strstr( BleCard->ouiname, "Espressif" ) ) {
-          IconRender( Icon8x8_espressif_src, 11, Out.scrollPosY - hop );
+          card.add( ouiStr, Icon8x8_espressif_src, 11 );
         } else {
-          IconRender( Icon8h_nic16_src, 10, Out.scrollPosY - hop );
+          card.add( ouiStr, Icon8h_nic16_src, 10 );
         }
       }
 
+      // the avatar starts on the last printed line and may span the next ones
+      card.avatarLine = card.count - 1;
       bool jumpNext = true;
-      if( macAddrColorsSizeY <= Out.h_tmp ) {
-        AvatarizedMAC.chopDraw( macAddrColorsPosX, Out.scrollPosY - hop, macAddrColorsSizeY );
-      } else {
-        // chop-chop!
-        int16_t sizeY = macAddrColorsSizeY;
-        while( sizeY >= Out.h_tmp ) {
-          sizeY -= Out.h_tmp;
-          AvatarizedMAC.chopDraw( macAddrColorsPosX, Out.scrollPosY - hop, Out.h_tmp );
-          if( sizeY >= Out.h_tmp ) {
-            blockHeight += Out.println(SPACE);
-          }
+      if( macAddrColorsSizeY > lineHeight ) {
+        for( uint16_t sizeY = macAddrColorsSizeY; sizeY > lineHeight; sizeY -= lineHeight ) {
+          card.add( NULL );
         }
         jumpNext = false;
       }
       if ( BleCard->appearance != 0 ) {
-        if( jumpNext ) {
-          blockHeight += Out.println(SPACE);
+        if( jumpNext ) card.add( NULL );
+        jumpNext = true;
+        *appearanceStr = {'\0'};
+        const BLEAssignedNumber* appearance = appearanceFind( BleCard->appearance );
+        if( appearance != NULL && appearance->assignedNumber != 0 ) {
+          sprintf( appearanceStr, appearanceNamedTpl, appearance->name );
         } else {
-          jumpNext = true;
+          sprintf( appearanceStr, appearanceTpl, BleCard->appearance );
         }
-        *appearanceStr = {'\0'};
-        sprintf( appearanceStr, appearanceTpl, BleCard->appearance );
-        hop = Out.println( appearanceStr );
-        blockHeight += hop;
+        card.add( appearanceStr );
       }
       if ( !isEmpty( BleCard->manufname ) ) {
-        if( jumpNext ) {
-          blockHeight += Out.println(SPACE);
-        } else {
-          jumpNext = true;
-        }
+        if( jumpNext ) card.add( NULL );
+        jumpNext = true;
         *manufStr = {'\0'};
         sprintf( manufStr, manufTpl, BleCard->manufname );
-        hop = Out.println( manufStr );
-        blockHeight += hop;
         if ( strstr( BleCard->manufname, "Apple" ) ) {
-          IconRender( Icon8x8_apple16_src, 12, Out.scrollPosY - hop );
+          card.add( manufStr, Icon8x8_apple16_src, 12 );
         } else if ( strstr( BleCard->manufname, "IBM" ) ) {
-          IconRender( Icon8h_ibm8_src, 10, Out.scrollPosY - hop );
+          card.add( manufStr, Icon8h_ibm8_src, 10 );
         } else if ( strstr (BleCard->manufname, "Microsoft" ) ) {
-          IconRender( Icon8x8_crosoft_src, 12, Out.scrollPosY - hop );
+          card.add( manufStr, Icon8x8_crosoft_src, 12 );
         } else if ( strstr( BleCard->manufname, "Bose" ) ) {
-          IconRender( Icon8h_speaker_src, 12, Out.scrollPosY - hop );
+          card.add( manufStr, Icon8h_speaker_src, 12 );
         } else {
-          IconRender( Icon8x8_generic_src, 12, Out.scrollPosY - hop );
+          card.add( manufStr, Icon8x8_generic_src, 12 );
         }
       }
       if ( !isEmpty( BleCard->name ) ) {
         *nameStr = {'\0'};
         sprintf(nameStr, nameTpl, BleCard->name);
-        if( jumpNext ) {
-          blockHeight += Out.println(SPACE);
-        } else {
-          jumpNext = true;
-        }
-        hop = Out.println( nameStr );
-        blockHeight += hop;
-        IconRender( Icon8h_name_src, 12, Out.scrollPosY - hop );
-      }
-      hop = Out.println( SPACE) ;
-      blockHeight += hop;
-      uint16_t boxHeight = blockHeight-2;
-      uint16_t boxWidth  = Out.width - 2;
-      uint16_t boxPosY   = initialPosY + 1;
-      Out.drawScrollableRoundRect( 1, boxPosY, boxWidth, boxHeight, 4, BLECardTheme.borderColor );
+        if( jumpNext ) card.add( NULL );
+        jumpNext = true;
+        card.add( nameStr, Icon8h_name_src, 12 );
+      }
+      card.add( NULL );
+
+      // render pass: compose each scanline band off-screen, DMA push it while the next one is composed
+      uint16_t blockHeight = card.count * lineHeight;
+      MacAddressColors AvatarizedMAC( BleCard->address, macAddrColorsScaleX, macAddrColorsScaleY );
+      isScrolling = true;
+      int cardPosY = Out.scrollBlock( blockHeight );
+      tft.startWrite();
+      for( uint8_t i = 0; i < card.count; i++ ) {
+        // no wait needed: the DMA reading this buffer (band i-2) ended before band i-1 was sent
+        TFT_eSprite *band = cardBandSprites[i&1];
+        composeCardLine( band, card, i, lineHeight, blockHeight, &AvatarizedMAC, rssi, BleCard );
+        Out.pushScrollableSprite( band, Out.translate( cardPosY, i * lineHeight ), lineHeight );
+      }
+      tft.endWrite();
+      isScrolling = false;
+
+      uint16_t boxPosY = cardPosY + 1;
       lastPrintedMacIndex++;
       lastPrintedMacIndex = lastPrintedMacIndex % BLECARD_MAC_CACHE_SIZE;
       memcpy( MacScrollView[lastPrintedMacIndex].address, BleCard->address, MAC_LEN+1 );
@@ -1311,7 +1320,7 @@ class UIUtils
       MacScrollView[lastPrintedMacIndex].scrollPosY  = boxPosY;//Out.scrollPosY;
       MacScrollView[lastPrintedMacIndex].borderColor = BLECardTheme.borderColor;
       MacScrollView[lastPrintedMacIndex].cacheIndex = BleLink.cacheIndex;
-      giveMuxSemaphore();
+      giveDisplayLock();
 
       //unsigned long rendertime = millis() - renderstart;
       //log_w("Rendered %s in %d ms", BleCard->address, rendertime );
@@ -1347,16 +1356,17 @@ class UIUtils
       if( isEmpty( MacScrollView[card_index].address ) ) return; // empty slot
       int newYPos = Out.translate( Out.scrollPosY, offset );
       headerStats( MacScrollView[card_index].address );
-      takeMuxSemaphore();
-      uint16_t boxHeight = MacScrollView[card_index].blockHeight-2;
-      uint16_t boxWidth  = Out.width - 2;
-      uint16_t boxPosY   = newYPos + 1;
-      for( int16_t color=255; color>64; color-=4 ) {
-        Out.drawScrollableRoundRect( 1, boxPosY, boxWidth, boxHeight, 4, tft_color565(color, color, color) );
-        delay(8); // TODO: use a timer
-      }
-      Out.drawScrollableRoundRect( 1, boxPosY, boxWidth, MacScrollView[card_index].blockHeight-2, 4, MacScrollView[card_index].borderColor );
-      giveMuxSemaphore();
+      takeDisplayLock();
+      if( cardFade.level > CARDFADE_END ) { // settle the previous fade first
+        Out.drawScrollableRoundRect( 1, cardFade.posY, Out.width - 2, cardFade.height, 4, cardFade.borderColor );
+      }
+      cardFade = { (uint16_t)(newYPos + 1), (uint16_t)(MacScrollView[card_index].blockHeight-2), MacScrollView[card_index].borderColor, CARDFADE_START };
+      Out.drawScrollableRoundRect( 1, cardFade.posY, Out.width - 2, cardFade.height, 4, tft_color565(CARDFADE_START, CARDFADE_START, CARDFADE_START) );
+      if( !RenderTaskIsRunning ) { // nobody to animate it
+        cardFade.level = CARDFADE_END;
+        Out.drawScrollableRoundRect( 1, cardFade.posY, Out.width - 2, cardFade.height, 4, cardFade.borderColor );
+      }
+      giveDisplayLock();
     }
 
     static void percentBox(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t percent, uint16_t barcolor, uint16_t bgcolor, uint16_t bordercolor = BLE_DARKGREY)
@@ -1427,7 +1437,27 @@ class UIUtils
     // draws a RSSI Bar for the BLECard
     static void drawRSSIBar(int16_t x, int16_t y, int16_t rssi, uint16_t bgcolor, float size=1.0)
     {
-      uint16_t barColors[4] = { bgcolor, bgcolor, bgcolor, bgcolor };
+      uint16_t barColors[4];
+      RSSIBarColors( rssi, bgcolor, barColors );
+      tft.fillRect(x,          y + 4*size, 2*size, 4*size, barColors[0]);
+      tft.fillRect(x + 3*size, y + 3*size, 2*size, 5*size, barColors[1]);
+      tft.fillRect(x + 6*size, y + 2*size, 2*size, 6*size, barColors[2]);
+      tft.fillRect(x + 9*size, y + 1*size, 2*size, 7*size, barColors[3]);
+    }
+
+    static void drawRSSIBar(TFT_eSprite *sprite, int16_t x, int16_t y, int16_t rssi, uint16_t bgcolor)
+    {
+      uint16_t barColors[4];
+      RSSIBarColors( rssi, bgcolor, barColors );
+      sprite->fillRect(x,     y + 4, 2, 4, barColors[0]);
+      sprite->fillRect(x + 3, y + 3, 2, 5, barColors[1]);
+      sprite->fillRect(x + 6, y + 2, 2, 6, barColors[2]);
+      sprite->fillRect(x + 9, y + 1, 2, 7, barColors[3]);
+    }
+
+    static void RSSIBarColors(int16_t rssi, uint16_t bgcolor, uint16_t *barColors)
+    {
+      for( uint8_t i = 0; i < 4; i++ ) barColors[i] = bgcolor;
       switch(rssi%6) {
       case 5:
           barColors[0] = BLE_GREEN;
@@ -1457,14 +1487,77 @@ class UIUtils
           barColors[0] = BLE_RED; // want: RAINBOW
         break;
       }
-      tft.fillRect(x,          y + 4*size, 2*size, 4*size, barColors[0]);
-      tft.fillRect(x + 3*size, y + 3*size, 2*size, 5*size, barColors[1]);
-      tft.fillRect(x + 6*size, y + 2*size, 2*size, 6*size, barColors[2]);
-      tft.fillRect(x + 9*size, y + 1*size, 2*size, 7*size, barColors[3]);
     }
 
   private:
 
+    // two full width bands of one text line each, in internal RAM so they can be DMA'd
+    static bool initCardSprites( uint16_t lineHeight )
+    {
+      if( cardBandSpriteB.getBuffer() != NULL && cardBandSpriteB.height() == lineHeight ) return true;
+      for( uint8_t i = 0; i < 2; i++ ) {
+        cardBandSprites[i]->deleteSprite();
+        cardBandSprites[i]->setPsram( false );
+        cardBandSprites[i]->setColorDepth( 16 );
+        HeapTraceScope trace( HEAP_TAG_SPRITE );
+        if( !cardBandSprites[i]->createSprite( Out.width, lineHeight ) ) {
+          log_e("Unable to allocate BLE card band sprite (%d x %d)", Out.width, lineHeight );
+          return false;
+        }
+        cardBandSprites[i]->setAttribute( lgfx::cp437_switch, true );
+      }
+      return true;
+    }
+
+    // renders the lineIndex scanline band of a BLE card, everything spanning
+    // several lines (avatar, border) is drawn translated and clipped by the band
+    void composeCardLine( TFT_eSprite *band, BLECardLayout &card, uint8_t lineIndex, uint16_t lineHeight, uint16_t blockHeight, MacAddressColors *avatar, int rssi, BlueToothDevice *BleCard )
+    {
+      BLECardLine *line = &card.lines[lineIndex];
+      int16_t lineY = lineIndex * lineHeight; // card relative
+      // same background as the scroll area, copied from the cached scanline
+      TFT_eSprite *bgLine = Out.backgroundLine();
+      if( bgLine != NULL ) {
+        uint16_t *pixels = (uint16_t*)band->getBuffer();
+        for( uint16_t row = 0; row < lineHeight; row++ ) {
+          memcpy( pixels + row*Out.width, bgLine->getBuffer(), Out.width * sizeof(uint16_t) );
+        }
+      } else {
+        band->fillSprite( BLECARD_BGCOLOR );
+      }
+
+      band->setTextColor( BLECardTheme.textColor, BLECardTheme.bgColor );
+      if( line->text != NULL ) {
+        band->drawString( line->text, 0, 0 );
+        if( Out.serialEcho ) Serial.println( line->text );
+      }
+      if( line->icon != NULL ) {
+        IconRender( band, line->icon, line->iconX, 0 );
+      }
+      if( lineIndex == 1 ) { // address line
+        band->drawString( dbmStr, Out.width - band->textWidth( dbmStr ), 0 );
+        drawRSSIBar( band, Out.width - 18, -1, rssi, BLECardTheme.textColor );
+        if ( BleCard->in_db ) { // 'already seen this' icon
+          IconRender( band, Icon8x8_update_src, 138, 0 );
+        } else { // 'just inserted this' icon
+          IconRender( band, TextCounters_seen_src, 138, 0 );
+        }
+        if ( !isEmpty( BleCard->uuid ) ) { // 'has service UUID' Icon
+          IconRender( band, Icon8x8_service_src, 128, 0 );
+        }
+        switch( BleCard->hits ) {
+          case 0:  IconRender( band, TextCounters_entries_src, 118, 0 ); break;
+          case 1:  IconRender( band, TextCounters_scans_src,    118, 0 ); break;
+          default: IconRender( band, TextCounters_heap_src,     118, 0 ); break;
+        }
+      }
+      int16_t avatarY = card.avatarLine * lineHeight - lineY;
+      if( avatarY < (int16_t)lineHeight && avatarY + macAddrColorsSizeY > 0 ) {
+        avatar->blit( band, macAddrColorsPosX, avatarY );
+      }
+      band->drawRoundRect( 1, 1 - lineY, Out.width - 2, blockHeight - 2, 4, BLECardTheme.borderColor );
+    }
+
     static void animClearRect( int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t color )
     {
       while( w > 0 && h > 0 ) {
@@ -1543,7 +1636,7 @@ class UIUtils
           tft.setCursor(Out.width / 2 - Out.w_tmp / 2, y);
           break;
       }
-      tft.drawString( text, tft.getCursorX(), tft.getCursorY() );
+      Out.drawString( text, tft.getCursorX(), tft.getCursorY() ); // keeps the software scroll ring in sync
     }
 
     static DisplayMode getDisplayMode()
@@ -1803,7 +1896,7 @@ class UIUtils
       }
 
       heapmap = (uint32_t*)calloc( heapMapBuffLen, sizeof( uint32_t ) );
-      if( heapmap != NULL ) {
+      if( heapmap != NULL && heapWindow.init( graphLineWidth ) ) {
         log_d("'heapmap' allocation successful");
       } else {
         log_e("'heapmap' allocation of %d bytes failed!", heapMapBuffLen*sizeof( uint32_t ) );
@@ -102,9 +102,36 @@ struct IconShapeStatus;
 struct Icon;
 struct IconBar;
 
+// bumped on every setRender(), lets IconBar.draw() skip a pass when nothing was touched
+static volatile uint32_t IconsDirtyCount = 0;
+
+#define ICON_HASH_SEED 2166136261UL
+
+// FNV-1a, used to tell whether an icon/widget would look any different once redrawn
+static uint32_t IconHash( uint32_t hash, const void* data, size_t len )
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  for( size_t i=0; i<len; i++ ) {
+    hash ^= bytes[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static uint32_t IconHash( uint32_t hash, uint32_t value )
+{
+  return IconHash( hash, &value, sizeof(value) );
+}
+
 
 bool IconRender( Icon *icon, uint16_t offsetX, uint16_t offsetY );
 void IconRender( const IconSrc* src, uint16_t x, uint16_t y );
+void IconRender( TFT_eSprite* sprite, const IconSrc* src, uint16_t x, uint16_t y );
+void IconRender( TFT_eSprite* sprite, const IconSrc* src, uint16_t x, uint16_t y )
+{
+  sprite->drawJpg( src->jpeg, src->jpeg_len, x, y );
+}
+
 void IconRender( IconWidget* widget, uint16_t posX, uint16_t posY, uint16_t width, uint16_t height, uint16_t offsetX, uint16_t offsetY, uint16_t bgcolor );
 void IconRender( IconShape *shape, uint16_t posX, uint16_t posY, uint16_t width, uint16_t height, uint16_t offsetX, uint16_t offsetY );
 
@@ -159,19 +186,30 @@ struct IconWidget
   char           *text;
   uint16_t       color;
   uint8_t        align;
+  uint32_t       hash; // value hash of what was last handed to the widget
   void (*cb)( uint16_t posX, uint16_t posY, uint16_t bgcolor );
   void setValue( int32_t val )
   {
     if( value != val ) {
       value = val;
+      hash  = IconHash( IconHash( ICON_HASH_SEED, value ), color );
       if( cb ) cb( 0, 0, 0 );
     }
   }
   void setText( char* intext, uint16_t posX, uint16_t posY, uint16_t textcolor, uint16_t bgcolor, uint8_t textalign )
   {
+    uint32_t newhash = IconHash( ICON_HASH_SEED, intext, strlen(intext) );
+    newhash = IconHash( newhash, textcolor | ( textalign << 16 ) );
+    newhash = IconHash( newhash, posX | ( posY << 16 ) ); // text widgets use absolute positioning
+    newhash = IconHash( newhash, bgcolor );
+    if( text == intext && hash == newhash ) {
+      log_v("Text widget unchanged");
+      return;
+    }
     text  = intext;
     color = textcolor;
     align = textalign;
+    hash  = newhash;
     if( cb ) cb( posX, posY, bgcolor );
   }
 };
@@ -198,6 +236,7 @@ struct Icon
   uint16_t    posY;
   uint16_t    bgcolor;
   bool        render;   // does it need rendering ?
+  uint32_t    drawnHash; // hash of what's currently on screen, 0 = never drawn
   IconType          type;     // jpg, geometric, widget, text, hybrid
   IconSrcStatusType status;   // current status
   IconSrcStatus     **srcStatus;    // [optional] jpg images (must match statuses)
@@ -220,6 +259,7 @@ struct Icon
   void init()
   {
     render = true;
+    drawnHash = 0;
     posX = 0;
     posY = 0;
     bgcolor = HEADER_BGCOLOR;
@@ -228,6 +268,27 @@ struct Icon
   void setRender( bool _render = true )
   {
     render = _render;
+    if( _render ) IconsDirtyCount++;
+  }
+  uint32_t hash()
+  {
+    uint32_t h = IconHash( ICON_HASH_SEED, status );
+    h = IconHash( h, posX | ( posY << 16 ) );
+    h = IconHash( h, bgcolor );
+    if( type == ICON_TYPE_WIDGET && status != ICON_STATUS_DISABLED ) {
+      for( byte i=0; i<statuses; i++ ) {
+        if( widgetStatus[i]->status == status ) {
+          h = IconHash( h, widgetStatus[i]->widget->hash );
+          break;
+        }
+      }
+    }
+    return h ? h : 1; // 0 is reserved for "never drawn"
+  }
+  void invalidate()
+  {
+    drawnHash = 0;
+    setRender();
   }
   void setStatus( int8_t _status )
   {
@@ -265,6 +326,7 @@ struct IconBar
   uint16_t    height;
   uint8_t     margin = 2;
   size_t      totalIcons = 0;
+  uint32_t    drawnDirtyCount = 0;
   Icon        **icons;
   IconBar() { };
   void init()
@@ -299,16 +361,27 @@ struct IconBar
   {
     margin = _margin;
   }
+  // force a full repaint, e.g. after something else has drawn over the bar
+  void invalidate()
+  {
+    for( byte i=0; i<totalIcons; i++ ) {
+      icons[i]->invalidate();
+    }
+  }
+  // only icons whose rendered hash changed get their rectangle repainted
   void draw(uint16_t x, uint16_t y )
   {
-    uint16_t posx = 0;
+    uint32_t dirtyCount = IconsDirtyCount;
+    if( dirtyCount == drawnDirtyCount ) return; // nothing was touched since last pass
+    drawnDirtyCount = dirtyCount;
     uint8_t rendered = 0;
     for( byte i=0; i<totalIcons; i++ ) {
-      log_v("Rendering icon %s at [%d, %d]", icons[i]->name, x, y );
       if( IconRender( icons[i], x, y ) ) {
         rendered++;
       }
-      posx += icons[i]->width + 2;
+    }
+    if( rendered > 0 ) {
+      log_v("Rendered %d/%d icons", rendered, totalIcons );
     }
   }
 };
@@ -316,6 +389,7 @@ struct IconBar
 // renderers
 void IconRender( const IconSrc* src, uint16_t x, uint16_t y )
 {
+  if( !hasDisplay() ) return;
   tft_drawJpg( src->jpeg, src->jpeg_len, x, y );
 }
 
@@ -358,15 +432,22 @@ void IconRender( IconShape *shape, uint16_t posX, uint16_t posY, uint16_t width,
 
 bool IconRender( Icon *icon, uint16_t offsetX, uint16_t offsetY )
 {
+  if( !hasDisplay() ) return false;
   if( !icon->render ) {
     log_v("icon '%s' Already rendered", icon->name);
     return false;
   }
   icon->setRender( false );
+  uint32_t hash = icon->hash();
+  if( hash == icon->drawnHash ) {
+    log_v("icon '%s' unchanged since last render", icon->name);
+    return false;
+  }
+  icon->drawnHash = hash;
   if( icon->status == ICON_STATUS_DISABLED ) {
-    takeMuxSemaphore();
+    takeDisplayLock();
     tft.fillRect( offsetX+icon->posX, offsetY+icon->posY, icon->width, icon->height, icon->bgcolor);
-    giveMuxSemaphore();
+    giveDisplayLock();
     return true;
   }
   int statusIndex = -1;
@@ -382,7 +463,7 @@ bool IconRender( Icon *icon, uint16_t offsetX, uint16_t offsetY )
     return false;
   }
   log_v("Will render icon '%s' with statusIndex %d", icon->name, statusIndex);
-  takeMuxSemaphore();
+  takeDisplayLock();
   switch( icon->type ) {
     case ICON_TYPE_JPG:
       //log_n("Will render icon '%s' with statusIndex %d", icon->name, statusIndex);
@@ -400,13 +481,14 @@ bool IconRender( Icon *icon, uint16_t offsetX, uint16_t offsetY )
     default:
     break;
   }
-  giveMuxSemaphore();
+  giveDisplayLock();
   return true;
 }
 
 bool IconRender( Icon *icon, IconSrcStatusType status, uint16_t x, uint16_t y )
 {
   icon->setStatus( status );
+  icon->invalidate(); // explicit draw request, the caller may have cleared the area
   return IconRender(icon,  x, y );
 }
 
@@ -0,0 +1,72 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+/*
+ * Host build of the core headers
+ *
+ * Mirrors the parts of Settings.h the storage-agnostic headers rely on,
+ * then includes them in the same order. Like Settings.h on the target, this
+ * defines globals: include it from a single translation unit per executable.
+ *
+ */
+
+#include "shim/HostArduino.h"
+#include "shim/HostBLE.h"
+
+#define MAX_FIELD_LEN 32 // max chars returned by field
+#define MAC_LEN 17 // chars used by a mac address
+#define SHORT_MAC_LEN 7 // chars used by the oui part of a mac address
+#define BLEDEVCACHE_PSRAM_SIZE 1024
+#define BLEDEVCACHE_HEAP_SIZE 32
+
+float timeZone = 1;
+bool summerTime = false;
+static char unitOutput[21] = {'\0'};
+
+#include "DateTime.h"
+
+// statistical values
+static int devicesCount      = 0; // devices count per scan
+static int sessDevicesCount  = 0; // total devices count per session
+static unsigned int entries  = 0; // total entries in database
+
+#include "AssignedNumbers.h" // BLE SIG assigned numbers lookup tables
+#include "BLEBeacons.h" // beacon payload decoders
+#include "BLECache.h" // data struct
+#include "Backends.h" // DB, vendor and GATT lookups interfaces
+#include "RPAGroups.h" // random address grouping
+#include "AdvDedup.h" // advertisements deduplication window
+#include "RollingMinMax.h" // sliding window min/max
+#include "AdvTraceFormat.h" // advertisement trace file format
+#include "AdvSynth.h" // synthetic advertisement traces
@@ -0,0 +1,82 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+/*
+ * SD card databases on the host
+ *
+ * The host tools read the vendor tables shipped for the SD card
+ * (mac-oui-light.db, ble-oui.db) straight from the repository with sqlite.
+ *
+ */
+
+#include <sqlite3.h>
+
+#ifndef HOST_SD_DIR
+#define HOST_SD_DIR "SD"
+#endif
+
+#define HOST_TABLE_MAX_COLUMNS 4
+
+typedef void (*HostTableRow)( const char** values ); // one per row, NULL columns are skipped
+
+// runs [query] on [path], calls [row] with the columns of each row
+static bool loadTable( const char* path, const char* query, HostTableRow row )
+{
+  sqlite3 *db;
+  if( sqlite3_open_v2( path, &db, SQLITE_OPEN_READONLY, NULL ) != SQLITE_OK ) {
+    fprintf( stderr, "Can't open %s: %s\n", path, sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return false;
+  }
+  sqlite3_stmt *stmt;
+  if( sqlite3_prepare_v2( db, query, -1, &stmt, NULL ) != SQLITE_OK ) {
+    fprintf( stderr, "Can't query %s: %s\n", path, sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return false;
+  }
+  int columns = sqlite3_column_count( stmt );
+  if( columns > HOST_TABLE_MAX_COLUMNS ) columns = HOST_TABLE_MAX_COLUMNS;
+  const char* values[HOST_TABLE_MAX_COLUMNS];
+  while( sqlite3_step( stmt ) == SQLITE_ROW ) {
+    bool complete = true;
+    for( int i=0; i<columns; i++ ) {
+      values[i] = (const char*)sqlite3_column_text( stmt, i );
+      if( values[i] == NULL ) complete = false;
+    }
+    if( complete ) row( values );
+  }
+  sqlite3_finalize( stmt );
+  sqlite3_close( db );
+  return true;
+}
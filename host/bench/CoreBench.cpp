@@ -0,0 +1,202 @@
+// Host micro benchmarks for the core headers
+//
+// Same building blocks as Bench.h (device cache, merge, anonymity check,
+// assigned numbers) plus the scan callback stages (dedup window, RPA groups,
+// beacon decoding), timed on the host so changes can be compared without a
+// device. The OUI and vendor lookups need the SD card and stay in Bench.h.
+//
+// Usage: CoreBench [iterations]
+
+#include "BLECollectorCore.h"
+
+#include <chrono>
+
+typedef void (*BenchFunction)( uint32_t iteration );
+
+#define BENCH_LRU_SIZE 256
+#define BENCH_ITEMS(x) ( sizeof(x) / sizeof(x[0]) )
+
+static BlueToothDeviceLRU BenchLRU;
+static BlueToothDeviceTopK BenchTopK;
+static RollingMinMax BenchWindow;
+static BlueToothDevice* BenchItemA = NULL;
+static BlueToothDevice* BenchItemB = NULL;
+static BlueToothDeviceStats BenchStats;
+static volatile uintptr_t BenchSink = 0; // keeps results alive
+
+static const uint16_t BenchCompanies[]   = { 0x0006, 0x004C, 0x0075, 0x00E0, 0x0131, 0xFFFE };
+static const uint16_t BenchServices[]    = { 0x1800, 0x180F, 0x181A, 0xFE9F, 0xFEAA, 0x1234 };
+static const char*    BenchServiceStrs[] = { "0x180f", "0000feaa-0000-1000-8000-00805f9b34fb", "0x1234" };
+
+static const uint8_t BenchPayload[] = {
+  0x02, 0x01, 0x06,
+  0x04, 0x09, 'F', 'o', 'o',
+  0x05, 0xFF, 0x4C, 0x00, 0x10, 0x05,
+  0x03, 0x03, 0x0F, 0x18,
+};
+static const uint8_t BenchIBeacon[] = {
+  0x02, 0x01, 0x06,
+  0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15,
+  0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0,
+  0x00, 0x01, 0x00, 0x02, 0xC5,
+};
+
+static uint32_t BenchIterations = 1000000;
+
+// 64 resolvable private addresses cycling
+static void benchAddress( uint32_t i, uint8_t address[6] )
+{
+  address[0] = i & 0x3f;
+  address[1] = 0x11;
+  address[2] = 0x22;
+  address[3] = 0x33;
+  address[4] = 0x44;
+  address[5] = 0x40 | ( i & 0x3f );
+}
+
+static void measure( const char* name, BenchFunction fn, uint32_t iterations )
+{
+  auto start = std::chrono::steady_clock::now();
+  for( uint32_t i=0; i<iterations; i++ ) {
+    fn( i );
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+  double perOp = iterations > 0 ? (double)elapsed / iterations : 0;
+  printf("  %-32s %10u ops %12lld ns %10.1f ns/op\n", name, iterations, (long long)elapsed, perOp );
+}
+
+static void benchCompanyFind( uint32_t i )
+{
+  BenchSink = (uintptr_t)companyFind( BenchCompanies[i % BENCH_ITEMS(BenchCompanies)] );
+}
+
+static void benchServiceFind( uint32_t i )
+{
+  BenchSink = (uintptr_t)assignedNumberFind( BLE_gattServices, BenchServices[i % BENCH_ITEMS(BenchServices)] );
+}
+
+static void benchServiceDescription( uint32_t i )
+{
+  BenchSink = BLEDevHelper.gattServiceDescription( BenchServiceStrs[i % BENCH_ITEMS(BenchServiceStrs)] ).assignedNumber;
+}
+
+static void benchIsAnonymous( uint32_t i )
+{
+  BenchSink = BLEDevHelper.isAnonymous( i&1 ? BenchItemA : BenchItemB );
+}
+
+static void benchMergeItems( uint32_t i )
+{
+  BLEDevHelper.mergeItems( BenchItemA, BenchItemB );
+}
+
+static void benchCopyItem( uint32_t i )
+{
+  BLEDevHelper.copyItem( BenchItemA, BenchItemB );
+}
+
+static void benchStore( uint32_t i )
+{
+  uint8_t address[6];
+  benchAddress( i, address );
+  BLEAdvertisedDevice device( address, BLE_ADDR_RANDOM, -60, BenchPayload, sizeof( BenchPayload ) );
+  BLEDevHelper.store( BenchItemB, &device );
+}
+
+static void benchStatsUpdate( uint32_t i )
+{
+  BLEDevHelper.statsUpdate( &BenchStats, i * 100, -60 - ( i & 15 ) );
+}
+
+static void benchLRUAcquire( uint32_t i )
+{
+  BenchSink = BenchLRU.acquire();
+}
+
+static void benchLRUTouch( uint32_t i )
+{
+  BenchLRU.touch( ( i * 7 ) % BENCH_LRU_SIZE );
+}
+
+static void benchTopKUpdate( uint32_t i )
+{
+  BenchTopK.update( ( i * 13 ) % BENCH_LRU_SIZE, i / 8 );
+}
+
+static void benchDedupLookup( uint32_t i )
+{
+  uint8_t address[6];
+  benchAddress( i, address );
+  bool isDuplicate;
+  BenchSink = (uintptr_t)AdvDedup.lookup( address, BLE_ADDR_RANDOM, 0x1234, -60, i / 16, isDuplicate );
+}
+
+static void benchPayloadHash( uint32_t i )
+{
+  BenchSink = AdvDedup.payloadHash( BenchPayload, sizeof( BenchPayload ) );
+}
+
+static void benchRPAFingerprint( uint32_t i )
+{
+  BenchSink = RPAGroups.fingerprint( BenchPayload, sizeof( BenchPayload ) );
+}
+
+static void benchRPAResolve( uint32_t i )
+{
+  uint8_t address[6];
+  benchAddress( i, address );
+  BenchSink = RPAGroups.resolve( address, 0xdeadbeef + ( i & 0x3f ), i / 16 );
+}
+
+static void benchBeaconDecode( uint32_t i )
+{
+  BeaconFrame frame;
+  BenchSink = Beacons.decode( BenchIBeacon, sizeof( BenchIBeacon ), &frame );
+}
+
+static void benchRollingMinMax( uint32_t i )
+{
+  BenchWindow.push( ( i * 2654435761u ) >> 12 );
+  BenchSink = BenchWindow.max();
+}
+
+int main( int argc, char** argv )
+{
+  if( argc > 1 ) BenchIterations = strtoul( argv[1], NULL, 10 );
+
+  BenchItemA = new BlueToothDevice;
+  BenchItemB = new BlueToothDevice;
+  BLEDevHelper.init( BenchItemA, false );
+  BLEDevHelper.init( BenchItemB, false );
+  BLEDevHelper.set( BenchItemA, "address", "de:ad:be:ef:ca:fe" );
+  BLEDevHelper.set( BenchItemA, "name", "BenchItem" );
+  BLEDevHelper.set( BenchItemA, "ouiname", "[random]" );
+  BLEDevHelper.set( BenchItemA, "manufname", "Apple, Inc." );
+  BLEDevHelper.set( BenchItemA, "uuid", "0000feaa-0000-1000-8000-00805f9b34fb" );
+  BLEDevHelper.copyItem( BenchItemA, BenchItemB );
+  if( !BenchLRU.init( BENCH_LRU_SIZE, false ) || !BenchWindow.init( 240 ) ) {
+    fprintf( stderr, "can't allocate bench structures\n" );
+    return 1;
+  }
+  RPAGroups.scanBegin( 0 );
+
+  printf("[Bench] %u iterations\n", BenchIterations );
+  measure( "companyFind",                 benchCompanyFind,        BenchIterations );
+  measure( "assignedNumberFind",          benchServiceFind,        BenchIterations );
+  measure( "gattServiceDescription",      benchServiceDescription, BenchIterations );
+  measure( "isAnonymous",                 benchIsAnonymous,        BenchIterations );
+  measure( "mergeItems",                  benchMergeItems,         BenchIterations );
+  measure( "copyItem",                    benchCopyItem,           BenchIterations );
+  measure( "store",                       benchStore,              BenchIterations );
+  measure( "statsUpdate",                 benchStatsUpdate,        BenchIterations );
+  measure( "BlueToothDeviceLRU.acquire",  benchLRUAcquire,         BenchIterations );
+  measure( "BlueToothDeviceLRU.touch",    benchLRUTouch,           BenchIterations );
+  measure( "BlueToothDeviceTopK.update",  benchTopKUpdate,         BenchIterations );
+  measure( "AdvDedup.lookup",             benchDedupLookup,        BenchIterations );
+  measure( "AdvDedup.payloadHash",        benchPayloadHash,        BenchIterations );
+  measure( "RPAGroups.fingerprint",       benchRPAFingerprint,     BenchIterations );
+  measure( "RPAGroups.resolve",           benchRPAResolve,         BenchIterations );
+  measure( "Beacons.decode",              benchBeaconDecode,       BenchIterations );
+  measure( "RollingMinMax.push",          benchRollingMinMax,      BenchIterations );
+  return 0;
+}
@@ -0,0 +1,688 @@
+// Trace driven host benchmark of the scan pipeline
+//
+// Replays an advertisement trace (see AdvTraceFormat.h) through the same
+// stages as onResult() and the post scan steps of BLE.h: dedup window,
+// beacon decoding, RPA groups, scan cache store, vendor enrichment, RAM
+// cache lookup (address then RPA group, SLRU, top hits) and the DB exists /
+// insert calls, all reached through the Backend interfaces.
+//
+// The backends mimic the firmware ones on the host:
+//   - vendors: the linear PSRam cache lookups of DB.h, on tables loaded
+//     from the SD card databases of the repository
+//   - devices: a sqlite file with the blemacs columns, opened and closed
+//     around every query like DB.h does (no index on address either)
+//
+// The trace is cut into scan rounds like the 'replay pipeline' command
+// (SCAN_DURATION or a full scan cache). With '-p on' the inserts go to a
+// persist thread as in PersistQueue.h, with '-p off' they run inline at
+// the end of each round. The post scan wall time is reported as 'enrich'
+// (until the scan task would be free) and 'persist' (until the last insert
+// of the round landed). Rendering is not modelled.
+//
+// Without a trace file a synthetic one is generated (see AdvSynth.h).
+//
+// Usage: TraceBench [-n devices] [-d seconds] [-s seed] [-p on|off] [-D devices.db] [trace.bin]
+
+#include "BLECollectorCore.h"
+#include "HostSD.h"
+
+#include <getopt.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define MAX_DEVICES_PER_SCAN 4 // same as Settings.h
+#define SCAN_DURATION 20       // seconds, same as Settings.h
+#define PERSIST_POOL_SIZE 16   // same as PersistQueue.h
+#define PERSIST_ROUND_END 0xff
+
+enum TraceBenchStage
+{
+  STAGE_DEDUP = 0,
+  STAGE_BEACONS,
+  STAGE_RPA,
+  STAGE_STORE,
+  STAGE_VENDORS,
+  STAGE_IFEXISTS,
+  STAGE_PERSIST,
+  STAGE_COUNT
+};
+
+static const char* TraceBenchStageNames[STAGE_COUNT] = {
+  "AdvDedup.lookup",
+  "Beacons.decode",
+  "RPAGroups.resolve",
+  "scan cache store",
+  "vendor lookups",
+  "cache + DB exists",
+  "DB insert"
+};
+
+struct TraceBenchMeter
+{
+  uint32_t count;
+  int64_t  ns;
+};
+
+static TraceBenchMeter TraceBenchMeters[STAGE_COUNT];
+static std::vector<AdvTraceRecord> TraceRecords;
+
+static const char* TraceDBPath = "tracebench.db";
+static std::mutex  TraceDBLock; // same role as takeDBLock()
+
+static bool     onScanDone = false;
+static uint32_t TraceRounds = 0;
+static uint32_t TraceStored = 0;
+static uint32_t TraceCacheHits = 0;
+static uint32_t TraceDBHits = 0;
+static uint32_t TraceInserted = 0;
+static uint32_t TraceFailed = 0;
+static uint32_t TraceStalls = 0;
+static int64_t  TraceEnrichNs = 0;  // post scan steps, scan task side
+static int64_t  TraceEnrichMaxNs = 0;
+static int64_t  TracePersistNs = 0; // post scan steps until the last insert landed
+static int64_t  TracePersistMaxNs = 0;
+
+static int64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// times a block into one of the stage meters
+struct TraceBenchProbe
+{
+  TraceBenchStage stage;
+  int64_t start;
+  TraceBenchProbe( TraceBenchStage _stage ) : stage( _stage ), start( nowNs() ) { }
+  ~TraceBenchProbe()
+  {
+    TraceBenchMeters[stage].count++;
+    TraceBenchMeters[stage].ns += nowNs() - start;
+  }
+};
+
+
+// vendor backend, same lookups as the PSRam caches of DB.h
+
+struct TraceOUI
+{
+  char mac[SHORT_MAC_LEN+1];
+  char assignment[MAX_FIELD_LEN+1];
+};
+
+struct TraceVendor
+{
+  uint16_t devid;
+  char vendor[MAX_FIELD_LEN+1];
+};
+
+static std::vector<TraceOUI>    TraceOUIs;
+static std::vector<TraceVendor> TraceVendors;
+
+static void addOUI( const char** values )
+{
+  TraceOUI oui;
+  copy( oui.mac, values[0], sizeof( oui.mac ) );
+  copy( oui.assignment, values[1], sizeof( oui.assignment ) );
+  TraceOUIs.push_back( oui );
+}
+
+static void addVendor( const char** values )
+{
+  TraceVendor vendor;
+  vendor.devid = atoi( values[0] );
+  copy( vendor.vendor, values[1], sizeof( vendor.vendor ) );
+  TraceVendors.push_back( vendor );
+}
+
+static void traceGetOUI( const char* mac, char* dest )
+{
+  char shortmac[7] = {'\0'};
+  uint8_t bytepos = 0;
+  for( uint8_t i=0; i<9; i++ ) {
+    if( mac[i] != ':' ) shortmac[bytepos++] = tolower( mac[i] );
+  }
+  for( size_t i=0; i<TraceOUIs.size(); i++ ) {
+    if( strstr( TraceOUIs[i].mac, shortmac ) ) {
+      strcpy( dest, TraceOUIs[i].assignment );
+      return;
+    }
+  }
+  strcpy( dest, "[private]" );
+}
+
+static void traceGetVendor( uint16_t devid, char* dest )
+{
+  for( size_t i=0; i<TraceVendors.size(); i++ ) {
+    if( TraceVendors[i].devid == devid ) {
+      strcpy( dest, TraceVendors[i].vendor );
+      return;
+    }
+  }
+  strcpy( dest, "[unknown]" );
+}
+
+static const VendorLookup TraceVendorLookup = { traceGetOUI, traceGetVendor };
+
+
+// device backend, a sqlite file queried the way DB.h does
+
+static int traceDBResults = 0;
+
+static int traceExistsCallback( void* data, int argc, char** argv, char** azColName )
+{
+  if( ++traceDBResults > 1 ) return 0;
+  BLEDevHelper.reset( BLEDevDBCache );
+  for( int i=0; i<argc; i++ ) {
+    BLEDevHelper.set( BLEDevDBCache, azColName[i], ( argv[i] ? argv[i] : "" ) );
+  }
+  BLEDevHelper.set( BLEDevDBCache, "in_db", true );
+  BLEDevHelper.set( BLEDevDBCache, "is_anonymous", false );
+  return 0;
+}
+
+static bool traceDBExec( const char* query, sqlite3_callback callback = NULL )
+{
+  sqlite3* db;
+  if( sqlite3_open( TraceDBPath, &db ) != SQLITE_OK ) {
+    fprintf( stderr, "Can't open %s: %s\n", TraceDBPath, sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return false;
+  }
+  char* err = NULL;
+  int rc = sqlite3_exec( db, query, callback, NULL, &err );
+  if( rc != SQLITE_OK ) {
+    fprintf( stderr, "SQL error: %s\n", err );
+    sqlite3_free( err );
+  }
+  sqlite3_close( db );
+  return rc == SQLITE_OK;
+}
+
+// single quotes doubled, like the String::replace() calls of DB.h
+static void traceEscape( const char* src, char* dest, size_t size )
+{
+  size_t pos = 0;
+  for( ; *src != '\0' && pos + 2 < size; src++ ) {
+    if( *src == '\'' ) dest[pos++] = '\'';
+    dest[pos++] = *src;
+  }
+  dest[pos] = '\0';
+}
+
+static int traceDeviceExists( const char* address )
+{
+  char query[128];
+  snprintf( query, sizeof( query ), "SELECT appearance, name, address, ouiname, rssi, manufid, manufname, uuid, hits FROM blemacs WHERE address='%s'", address );
+  traceDBResults = 0;
+  if( !traceDBExec( query, traceExistsCallback ) ) return -2;
+  return traceDBResults > 0 ? 0 : -1;
+}
+
+static bool traceDeviceInsert( BlueToothDevice* device )
+{
+  if( device->appearance == 0 && isEmpty( device->name ) && isEmpty( device->uuid ) && isEmpty( device->ouiname ) && isEmpty( device->manufname ) ) {
+    return false; // INSERTION_IGNORED
+  }
+  char name[MAX_FIELD_LEN*2+1], ouiname[MAX_FIELD_LEN*2+1], manufname[MAX_FIELD_LEN*2+1], uuid[MAX_FIELD_LEN*2+1];
+  traceEscape( device->name, name, sizeof( name ) );
+  traceEscape( device->ouiname, ouiname, sizeof( ouiname ) );
+  traceEscape( device->manufname, manufname, sizeof( manufname ) );
+  traceEscape( device->uuid, uuid, sizeof( uuid ) );
+  char query[512];
+  snprintf( query, sizeof( query ),
+    "INSERT INTO blemacs(appearance, name, address, ouiname, rssi, manufid, manufname, uuid, created_at, updated_at, hits) "
+    "VALUES(%d,'%s','%s','%s',%d,%d,'%s','%s','1970-01-01 00:00:00.000000','1970-01-01 00:00:00.000000', '%d')",
+    device->appearance, name, device->address, ouiname, device->rssi, device->manufid, manufname, uuid, device->hits );
+  bool ret = traceDBExec( query );
+  device->in_db = ret;
+  return ret;
+}
+
+static const DeviceStore TraceDeviceStore = { traceDeviceExists, traceDeviceInsert };
+
+
+// persist thread, same hand over as PersistQueue.h
+
+struct TracePersistItem
+{
+  BlueToothDevice* device;
+  bool pending;
+};
+
+struct TracePersistJob
+{
+  uint8_t slot;
+  int64_t roundStart; // ns, PERSIST_ROUND_END only
+};
+
+static TracePersistItem        TracePersistItems[PERSIST_POOL_SIZE];
+static std::deque<TracePersistJob> TracePersistJobs;
+static std::vector<uint8_t>    TracePersistFree;
+static std::mutex              TracePersistLock;
+static std::condition_variable TracePersistWake;
+static bool    TracePersistAsync = true;
+static bool    TracePersistStop = false;
+
+static void traceInsert( BlueToothDevice* device )
+{
+  std::lock_guard<std::mutex> db( TraceDBLock );
+  TraceBenchProbe probe( STAGE_PERSIST );
+  if( Backend.devices->insert( device ) ) {
+    TraceInserted++;
+  } else {
+    TraceFailed++;
+  }
+}
+
+static void tracePersistRoundDone( int64_t roundStart )
+{
+  int64_t elapsed = nowNs() - roundStart;
+  TracePersistNs += elapsed;
+  if( elapsed > TracePersistMaxNs ) TracePersistMaxNs = elapsed;
+}
+
+static void tracePersistTask()
+{
+  std::unique_lock<std::mutex> lock( TracePersistLock );
+  while( true ) {
+    TracePersistWake.wait( lock, [] { return TracePersistStop || !TracePersistJobs.empty(); } );
+    if( TracePersistJobs.empty() ) return;
+    TracePersistJob job = TracePersistJobs.front();
+    TracePersistJobs.pop_front();
+    uint8_t slot = job.slot;
+    if( slot == PERSIST_ROUND_END ) {
+      tracePersistRoundDone( job.roundStart );
+      TracePersistWake.notify_all();
+      continue;
+    }
+    lock.unlock();
+    traceInsert( TracePersistItems[slot].device );
+    lock.lock();
+    TracePersistItems[slot].pending = false;
+    TracePersistFree.push_back( slot );
+    TracePersistWake.notify_all();
+  }
+}
+
+static void tracePersistSave( BlueToothDevice* device )
+{
+  if( TracePersistAsync ) {
+    std::lock_guard<std::mutex> lock( TracePersistLock );
+    if( !TracePersistFree.empty() ) {
+      uint8_t slot = TracePersistFree.back();
+      TracePersistFree.pop_back();
+      BLEDevHelper.copyItem( device, TracePersistItems[slot].device );
+      TracePersistItems[slot].pending = true;
+      TracePersistJobs.push_back( { slot, 0 } );
+      TracePersistWake.notify_all();
+      return;
+    }
+  }
+  traceInsert( device ); // async off or pool full
+}
+
+static bool tracePersistPending( const char* address )
+{
+  std::lock_guard<std::mutex> lock( TracePersistLock );
+  for( uint8_t i=0; i<PERSIST_POOL_SIZE; i++ ) {
+    if( TracePersistItems[i].pending && strcmp( TracePersistItems[i].device->address, address ) == 0 ) return true;
+  }
+  return false;
+}
+
+static void tracePersistDrain()
+{
+  std::unique_lock<std::mutex> lock( TracePersistLock );
+  if( !TracePersistJobs.empty() || TracePersistFree.size() != PERSIST_POOL_SIZE ) TraceStalls++;
+  TracePersistWake.wait( lock, [] { return TracePersistJobs.empty() && TracePersistFree.size() == PERSIST_POOL_SIZE; } );
+}
+
+static void tracePersistRoundEnd( int64_t roundStart )
+{
+  if( !TracePersistAsync ) {
+    tracePersistRoundDone( roundStart );
+    return;
+  }
+  std::lock_guard<std::mutex> lock( TracePersistLock );
+  TracePersistJobs.push_back( { PERSIST_ROUND_END, roundStart } );
+  TracePersistWake.notify_all();
+}
+
+
+// scan pipeline, same steps as BLE.h
+
+static int traceCacheIndex( const char* address )
+{
+  for( int i=0; i<BLEDEVCACHE_SIZE; i++ ) {
+    if( strcmp( address, BLEDevRAMCache[i]->address ) == 0 ) return i;
+  }
+  return -1;
+}
+
+static int traceGroupCacheIndex( uint32_t rpaGroup )
+{
+  for( int i=0; i<BLEDEVCACHE_SIZE; i++ ) {
+    if( BLEDevRAMCache[i]->rpa_group == rpaGroup ) return i;
+  }
+  return -1;
+}
+
+static bool traceGroupInScan( uint32_t rpaGroup )
+{
+  for( uint16_t i=0; i<scan_cursor; i++ ) {
+    if( BLEDevScanCache[i]->rpa_group == rpaGroup ) return true;
+  }
+  return false;
+}
+
+static void traceRoundBegin( uint32_t now )
+{
+  scan_cursor = 0;
+  onScanDone = false;
+  RPAGroups.scanBegin( now );
+}
+
+// onResult()
+static void traceFeed( const AdvTraceRecord &rec, uint32_t now )
+{
+  bool isDuplicate = false;
+  uint32_t rpaGroup = 0;
+  AdvDedupEntry* advEntry;
+  {
+    TraceBenchProbe probe( STAGE_DEDUP );
+    uint32_t hash = AdvDedup.payloadHash( rec.payload, rec.length );
+    advEntry = AdvDedup.lookup( rec.address, rec.addrType, hash, rec.rssi, now, isDuplicate );
+  }
+  bool isRotating = RPAGroups.isRotating( rec.address, rec.addrType );
+  if( isDuplicate ) {
+    if( isRotating ) RPAGroups.touch( rec.address, now );
+    if( !onScanDone && AdvDedup.isInScan( advEntry ) ) {
+      BLEDevScanCache[advEntry->scanSlot]->rssi = advEntry->rssiLast;
+      BLEDevScanCache[advEntry->scanSlot]->stats = advEntry->stats;
+    }
+    return;
+  }
+  {
+    TraceBenchProbe probe( STAGE_BEACONS );
+    BeaconFrame frame;
+    if( Beacons.decode( rec.payload, rec.length, &frame ) ) Beacons.update( rec.address, rec.rssi, &frame );
+  }
+  if( isRotating ) {
+    TraceBenchProbe probe( STAGE_RPA );
+    uint32_t fp = RPAGroups.fingerprint( rec.payload, rec.length );
+    if( fp != 0 ) rpaGroup = RPAGroups.resolve( rec.address, fp, now );
+  }
+  if( onScanDone ) return;
+  bool refresh = AdvDedup.isInScan( advEntry );
+  uint16_t slot = refresh ? advEntry->scanSlot : scan_cursor;
+  if( !refresh && rpaGroup != 0 && traceGroupInScan( rpaGroup ) ) return;
+  if( slot >= MAX_DEVICES_PER_SCAN ) {
+    onScanDone = true;
+    return;
+  }
+  BlueToothDevice* item = BLEDevScanCache[slot];
+  {
+    TraceBenchProbe probe( STAGE_STORE );
+    BLEDevHelper.storeRaw( item, rec.address, rec.addrType, rec.rssi, rec.payload, rec.length );
+    item->stats = advEntry->stats;
+    item->rpa_group = rpaGroup;
+  }
+  {
+    TraceBenchProbe probe( STAGE_VENDORS );
+    if( item->addr_type != BLE_ADDR_RANDOM ) Backend.vendors->oui( item->address, item->ouiname );
+    if( item->manufid > -1 ) Backend.vendors->vendor( item->manufid, item->manufname );
+    item->is_anonymous = BLEDevHelper.isAnonymous( item );
+  }
+  if( !refresh ) {
+    AdvDedup.setScanSlot( advEntry, slot );
+    scan_cursor++;
+    TraceStored++;
+  }
+  if( scan_cursor == MAX_DEVICES_PER_SCAN ) onScanDone = true;
+}
+
+// onScanIfExists()
+static void traceIfExists( BlueToothDevice* item )
+{
+  TraceBenchProbe probe( STAGE_IFEXISTS );
+  int index = traceCacheIndex( item->address );
+  if( index < 0 && item->rpa_group != 0 ) {
+    index = traceGroupCacheIndex( item->rpa_group );
+    if( index > -1 ) BLEDevHelper.set( item, "address", BLEDevRAMCache[index]->address );
+  }
+  if( index > -1 ) {
+    TraceCacheHits++;
+    BLEDevRAMCache[index]->hits++;
+    BLEDevLRU.touch( index );
+    BLEDevHelper.mergeItems( item, BLEDevRAMCache[index] );
+    BLEDevHelper.copyItem( BLEDevRAMCache[index], item );
+    BLEDevTopK.update( index, BLEDevRAMCache[index]->hits );
+    return;
+  }
+  if( item->is_anonymous ) {
+    uint16_t next = BLEDevLRU.acquire();
+    BLEDevHelper.reset( BLEDevRAMCache[next] );
+    item->hits++;
+    BLEDevHelper.copyItem( item, BLEDevRAMCache[next] );
+    BLEDevTopK.update( next, BLEDevRAMCache[next]->hits );
+    return;
+  }
+  if( tracePersistPending( item->address ) ) tracePersistDrain();
+  int exists;
+  {
+    std::lock_guard<std::mutex> db( TraceDBLock );
+    exists = Backend.devices->exists( item->address );
+  }
+  if( exists > -1 ) {
+    TraceDBHits++;
+    BLEDevDBCache->hits++;
+    BLEDevHelper.mergeItems( item, BLEDevDBCache );
+    uint16_t next = BLEDevLRU.acquire();
+    BLEDevLRU.touch( next );
+    BLEDevHelper.reset( BLEDevRAMCache[next] );
+    BLEDevHelper.copyItem( BLEDevDBCache, BLEDevRAMCache[next] );
+    BLEDevTopK.update( next, BLEDevRAMCache[next]->hits );
+    BLEDevHelper.copyItem( BLEDevDBCache, item );
+  } else {
+    item->in_db = false;
+  }
+}
+
+// onAfterScan() and the post scan steps, without rendering
+static void traceRoundEnd()
+{
+  RPAGroups.scanEnd();
+  scan_rounds++;
+  TraceRounds++;
+  int64_t start = nowNs();
+  devicesCount = scan_cursor;
+  for( uint16_t i=0; i<devicesCount; i++ ) {
+    if( !isEmpty( BLEDevScanCache[i]->address ) ) traceIfExists( BLEDevScanCache[i] );
+  }
+  for( uint16_t i=0; i<devicesCount; i++ ) {
+    BlueToothDevice* item = BLEDevScanCache[i];
+    if( isEmpty( item->address ) ) continue;
+    if( !item->is_anonymous && !item->in_db ) tracePersistSave( item );
+    BLEDevHelper.reset( item );
+  }
+  int64_t elapsed = nowNs() - start;
+  TraceEnrichNs += elapsed;
+  if( elapsed > TraceEnrichMaxNs ) TraceEnrichMaxNs = elapsed;
+  tracePersistRoundEnd( start );
+}
+
+
+// trace input
+
+static bool traceCollect( const AdvTraceRecord &rec, void *ctx )
+{
+  TraceRecords.push_back( rec );
+  return true;
+}
+
+static void synthOUI( uint32_t index, uint8_t oui[3] )
+{
+  const char* mac = TraceOUIs[index].mac;
+  for( uint8_t i=0; i<3; i++ ) oui[i] = BLEDevHelper.hexToUInt16( mac + i*2, 2 );
+}
+
+static uint16_t synthCompany( uint32_t index )
+{
+  return TraceVendors[index].devid;
+}
+
+static bool loadTrace( const char* path )
+{
+  FILE* traceFile = fopen( path, "rb" );
+  if( traceFile == NULL ) {
+    fprintf( stderr, "Can't open %s\n", path );
+    return false;
+  }
+  uint8_t header[ADV_TRACE_HEADER_LEN];
+  if( fread( header, 1, sizeof( header ), traceFile ) != sizeof( header ) || !advTraceHeaderValid( header ) ) {
+    fprintf( stderr, "%s is not a v%d advertisement trace\n", path, ADV_TRACE_VERSION );
+    fclose( traceFile );
+    return false;
+  }
+  AdvTraceRecord rec;
+  while( fread( &rec, 1, ADV_TRACE_RECORD_HEADER_LEN, traceFile ) == ADV_TRACE_RECORD_HEADER_LEN ) {
+    if( rec.length > ADV_TRACE_MAX_PAYLOAD || fread( rec.payload, 1, rec.length, traceFile ) != rec.length ) {
+      fprintf( stderr, "Corrupted trace record after %zu records\n", TraceRecords.size() );
+      break;
+    }
+    TraceRecords.push_back( rec );
+  }
+  fclose( traceFile );
+  return !TraceRecords.empty();
+}
+
+static bool initCaches()
+{
+  BLEDEVCACHE_SIZE = BLEDEVCACHE_PSRAM_SIZE;
+  BLEDevRAMCache  = new BlueToothDevice*[BLEDEVCACHE_SIZE];
+  BLEDevScanCache = new BlueToothDevice*[MAX_DEVICES_PER_SCAN];
+  for( int i=0; i<BLEDEVCACHE_SIZE; i++ ) {
+    BLEDevRAMCache[i] = new BlueToothDevice;
+    BLEDevHelper.init( BLEDevRAMCache[i], true );
+  }
+  for( int i=0; i<MAX_DEVICES_PER_SCAN; i++ ) {
+    BLEDevScanCache[i] = new BlueToothDevice;
+    BLEDevHelper.init( BLEDevScanCache[i], true );
+  }
+  BLEDevDBCache = new BlueToothDevice;
+  BLEDevHelper.init( BLEDevDBCache, false );
+  for( uint8_t i=0; i<PERSIST_POOL_SIZE; i++ ) {
+    TracePersistItems[i].device = new BlueToothDevice;
+    BLEDevHelper.init( TracePersistItems[i].device, false );
+    TracePersistItems[i].pending = false;
+    TracePersistFree.push_back( i );
+  }
+  return BLEDevLRU.init( BLEDEVCACHE_SIZE, true, BLEDevRAMCache );
+}
+
+static void report( const char* name, const TraceBenchMeter &meter )
+{
+  printf("  %-24s %8u calls %10.1f ms %10.1f ns/call\n", name, meter.count, meter.ns / 1e6, meter.count > 0 ? (double)meter.ns / meter.count : 0 );
+}
+
+static void usage( const char* name )
+{
+  fprintf( stderr, "Usage: %s [-n devices] [-d seconds] [-s seed] [-p on|off] [-D devices.db] [-o oui.db] [-v vendors.db] [trace.bin]\n", name );
+}
+
+int main( int argc, char** argv )
+{
+  AdvSynthConfig config;
+  const char* ouiPath    = HOST_SD_DIR "/mac-oui-light.db";
+  const char* vendorPath = HOST_SD_DIR "/ble-oui.db";
+  int opt;
+  while( ( opt = getopt( argc, argv, "n:d:s:p:D:o:v:" ) ) != -1 ) {
+    switch( opt ) {
+      case 'n': config.devices  = atoi( optarg ); break;
+      case 'd': config.duration = atoi( optarg ) * 1000; break;
+      case 's': config.seed     = strtoul( optarg, NULL, 0 ); break;
+      case 'p': TracePersistAsync = strcmp( optarg, "off" ) != 0; break;
+      case 'D': TraceDBPath = optarg; break;
+      case 'o': ouiPath     = optarg; break;
+      case 'v': vendorPath  = optarg; break;
+      default: usage( argv[0] ); return 1;
+    }
+  }
+  if( optind < argc - 1 ) {
+    usage( argv[0] );
+    return 1;
+  }
+
+  if( !loadTable( ouiPath, "SELECT LOWER(assignment) AS mac, SUBSTR(`Organization Name`, 0, 32) AS ouiname FROM 'oui-light' WHERE assignment!=''", addOUI ) ) return 1;
+  if( !loadTable( vendorPath, "SELECT id, SUBSTR(vendor, 0, 32) AS vendor FROM 'ble-oui' WHERE vendor!=''", addVendor ) ) return 1;
+  Backend.vendors = &TraceVendorLookup;
+  Backend.devices = &TraceDeviceStore;
+
+  if( optind == argc - 1 ) {
+    if( !loadTrace( argv[optind] ) ) return 1;
+    printf("[TraceBench] %zu advertisements from %s\n", TraceRecords.size(), argv[optind] );
+  } else {
+    AdvSynthVendors vendors = { (uint32_t)TraceOUIs.size(), synthOUI, (uint32_t)TraceVendors.size(), synthCompany };
+    if( AdvSynth.generate( config, vendors, traceCollect, NULL ) == 0 ) return 1;
+    printf("[TraceBench] %zu synthetic advertisements, %u devices over %u s\n", TraceRecords.size(), config.devices, config.duration / 1000 );
+  }
+
+  remove( TraceDBPath );
+  if( !traceDBExec( "CREATE TABLE IF NOT EXISTS blemacs( appearance INTEGER, name, address, ouiname, rssi INTEGER, manufid INTEGER, manufname, uuid, created_at DATETIME, updated_at DATETIME, hits INTEGER )" ) ) return 1;
+  if( !initCaches() ) {
+    fprintf( stderr, "can't allocate the device caches\n" );
+    return 1;
+  }
+  std::thread persistThread;
+  if( TracePersistAsync ) persistThread = std::thread( tracePersistTask );
+
+  int64_t feedNs = 0;
+  int64_t replayStart = nowNs();
+  uint32_t roundStart = 0;
+  bool inRound = false;
+  for( size_t i=0; i<TraceRecords.size(); i++ ) {
+    const AdvTraceRecord &rec = TraceRecords[i];
+    uint32_t now = rec.timestamp;
+    HostClock = now;
+    if( inRound && ( onScanDone || now - roundStart >= SCAN_DURATION * 1000 ) ) {
+      traceRoundEnd();
+      inRound = false;
+    }
+    if( !inRound ) {
+      traceRoundBegin( now );
+      roundStart = now;
+      inRound = true;
+    }
+    int64_t t0 = nowNs();
+    traceFeed( rec, now );
+    feedNs += nowNs() - t0;
+  }
+  if( inRound ) traceRoundEnd();
+  if( TracePersistAsync ) {
+    tracePersistDrain();
+    {
+      std::lock_guard<std::mutex> lock( TracePersistLock );
+      TracePersistStop = true;
+      TracePersistWake.notify_all();
+    }
+    persistThread.join();
+  }
+  int64_t replayNs = nowNs() - replayStart;
+  remove( TraceDBPath );
+
+  size_t records = TraceRecords.size();
+  printf("[TraceBench] persist %s, %u rounds, %u stored, %u cache hits, %u DB hits, %u inserted, %u not inserted, %u drain stalls\n",
+    TracePersistAsync ? "on (persist thread)" : "off (inline)", TraceRounds, TraceStored, TraceCacheHits, TraceDBHits, TraceInserted, TraceFailed, TraceStalls );
+  printf("  %-24s %8zu adv    %10.1f ms %10.0f adv/s\n", "callback stages", records, feedNs / 1e6, feedNs > 0 ? records * 1e9 / feedNs : 0 );
+  printf("  %-24s %8zu adv    %10.1f ms %10.0f adv/s\n", "end to end", records, replayNs / 1e6, replayNs > 0 ? records * 1e9 / replayNs : 0 );
+  for( uint8_t i=0; i<STAGE_COUNT; i++ ) {
+    report( TraceBenchStageNames[i], TraceBenchMeters[i] );
+  }
+  printf("  post scan wall time over %u rounds: enrich %.1f ms (max %.3f ms/round), persist %.1f ms (max %.3f ms/round)\n",
+    TraceRounds, TraceEnrichNs / 1e6, TraceEnrichMaxNs / 1e6, TracePersistNs / 1e6, TracePersistMaxNs / 1e6 );
+  return 0;
+}
@@ -0,0 +1,126 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+/*
+ * Host shim for the Arduino/ESP-IDF calls made by the core headers
+ *
+ * Lets the storage-agnostic parts of the scan pipeline (assigned numbers,
+ * beacon decoders, device cache, LRU, top hits, RPA groups, dedup window,
+ * rolling min/max) compile and run on a Linux host, for unit tests and
+ * benchmarks. Only what those headers touch is provided.
+ *
+ * The clock is manual: tests drive millis() through HostClock so time
+ * dependent code is deterministic. Critical sections are no-ops, the host
+ * builds are single threaded.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+
+// clock
+
+static uint32_t HostClock = 0; // millis, set by the caller
+
+static uint32_t millis()
+{
+  return HostClock;
+}
+
+static void delay( uint32_t ms )
+{
+  HostClock += ms;
+}
+
+// logging, silent unless HOST_LOG is defined
+
+#ifdef HOST_LOG
+  #define log_n(format, ...) fprintf(stderr, "[N] " format "\n", ##__VA_ARGS__)
+  #define log_e(format, ...) fprintf(stderr, "[E] " format "\n", ##__VA_ARGS__)
+  #define log_w(format, ...) fprintf(stderr, "[W] " format "\n", ##__VA_ARGS__)
+  #define log_i(format, ...) fprintf(stderr, "[I] " format "\n", ##__VA_ARGS__)
+  #define log_d(format, ...) fprintf(stderr, "[D] " format "\n", ##__VA_ARGS__)
+  #define log_v(format, ...) fprintf(stderr, "[V] " format "\n", ##__VA_ARGS__)
+#else
+  #define log_n(format, ...) do {} while(0)
+  #define log_e(format, ...) do {} while(0)
+  #define log_w(format, ...) do {} while(0)
+  #define log_i(format, ...) do {} while(0)
+  #define log_d(format, ...) do {} while(0)
+  #define log_v(format, ...) do {} while(0)
+#endif
+
+// memory, no PSRam on the host
+
+#define ps_malloc  malloc
+#define ps_calloc  calloc
+#define freeheap   0
+#define freepsheap 0
+
+// critical sections
+
+struct portMUX_TYPE
+{
+  uint32_t owner;
+  uint32_t count;
+};
+
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+#define portENTER_CRITICAL(mux) do { (void)(mux); } while(0)
+#define portEXIT_CRITICAL(mux)  do { (void)(mux); } while(0)
+
+// serial console, goes to stdout
+
+struct HostSerial
+{
+  void printf( const char* format, ... ) __attribute__((format(printf, 2, 3)))
+  {
+    va_list args;
+    va_start( args, format );
+    vprintf( format, args );
+    va_end( args );
+  }
+  void print( const char* str ) { fputs( str, stdout ); }
+  void println( const char* str = "" ) { puts( str ); }
+};
+
+static HostSerial Serial;
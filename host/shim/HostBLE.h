@@ -0,0 +1,164 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+/*
+ * Host shim for the NimBLE advertised device
+ *
+ * A BLEAdvertisedDevice built from an address and a raw advertisement
+ * payload, the name, appearance, manufacturer data and service UUID
+ * accessors parse the AD structures the way NimBLE does, so
+ * BlueToothDeviceHelper::store() sees the same values as on the target.
+ *
+ */
+
+#define BLE_ADDR_PUBLIC 0x00
+#define BLE_ADDR_RANDOM 0x01
+
+#define HOST_AD_TYPE_NAME_SHORT    0x08
+#define HOST_AD_TYPE_NAME_COMPLETE 0x09
+#define HOST_AD_TYPE_UUID16_INC    0x02
+#define HOST_AD_TYPE_UUID16_CMP    0x03
+#define HOST_AD_TYPE_SVC_DATA16    0x16
+#define HOST_AD_TYPE_APPEARANCE    0x19
+#define HOST_AD_TYPE_MANUF_DATA    0xFF
+
+class BLEAddress
+{
+  public:
+    BLEAddress() { memset( native, 0, 6 ); }
+    BLEAddress( const uint8_t* address ) { memcpy( native, address, 6 ); }
+    const uint8_t* getNative() const { return native; }
+    // msb first, lowercase, like NimBLE
+    std::string toString() const
+    {
+      char out[18];
+      snprintf( out, sizeof(out), "%02x:%02x:%02x:%02x:%02x:%02x", native[5], native[4], native[3], native[2], native[1], native[0] );
+      return std::string( out );
+    }
+  private:
+    uint8_t native[6];
+};
+
+class BLEUUID
+{
+  public:
+    BLEUUID( uint16_t _uuid16 = 0 ) : uuid16( _uuid16 ) { }
+    std::string toString() const
+    {
+      char out[7];
+      snprintf( out, sizeof(out), "0x%04x", uuid16 );
+      return std::string( out );
+    }
+  private:
+    uint16_t uuid16;
+};
+
+class BLEAdvertisedDevice
+{
+  public:
+
+    BLEAdvertisedDevice( const uint8_t* address, uint8_t _addrType, int _rssi, const uint8_t* _payload, size_t len )
+    : addr( address ), addrType( _addrType ), rssi( _rssi ), payloadLength( len )
+    {
+      if( payloadLength > sizeof( payload ) ) payloadLength = sizeof( payload );
+      memcpy( payload, _payload, payloadLength );
+    }
+
+    BLEAddress getAddress()     { return addr; }
+    uint8_t getAddressType()    { return addrType; }
+    int getRSSI()               { return rssi; }
+    uint8_t* getPayload()       { return payload; }
+    size_t getPayloadLength()   { return payloadLength; }
+
+    bool haveName()             { return findField( HOST_AD_TYPE_NAME_COMPLETE ) != NULL || findField( HOST_AD_TYPE_NAME_SHORT ) != NULL; }
+    std::string getName()
+    {
+      uint8_t len = 0;
+      const uint8_t* data = findField( HOST_AD_TYPE_NAME_COMPLETE, &len );
+      if( data == NULL ) data = findField( HOST_AD_TYPE_NAME_SHORT, &len );
+      return data == NULL ? std::string() : std::string( (const char*)data, len );
+    }
+
+    bool haveAppearance()       { return findField( HOST_AD_TYPE_APPEARANCE ) != NULL; }
+    uint16_t getAppearance()
+    {
+      uint8_t len = 0;
+      const uint8_t* data = findField( HOST_AD_TYPE_APPEARANCE, &len );
+      return data == NULL || len < 2 ? 0 : data[0] | ( data[1] << 8 );
+    }
+
+    bool haveManufacturerData() { return findField( HOST_AD_TYPE_MANUF_DATA ) != NULL; }
+    std::string getManufacturerData()
+    {
+      uint8_t len = 0;
+      const uint8_t* data = findField( HOST_AD_TYPE_MANUF_DATA, &len );
+      return data == NULL ? std::string() : std::string( (const char*)data, len );
+    }
+
+    bool haveServiceData()      { return findField( HOST_AD_TYPE_SVC_DATA16 ) != NULL; }
+
+    bool haveServiceUUID()      { return findField( HOST_AD_TYPE_UUID16_CMP ) != NULL || findField( HOST_AD_TYPE_UUID16_INC ) != NULL; }
+    BLEUUID getServiceUUID()
+    {
+      uint8_t len = 0;
+      const uint8_t* data = findField( HOST_AD_TYPE_UUID16_CMP, &len );
+      if( data == NULL ) data = findField( HOST_AD_TYPE_UUID16_INC, &len );
+      return data == NULL || len < 2 ? BLEUUID() : BLEUUID( data[0] | ( data[1] << 8 ) );
+    }
+
+  private:
+
+    BLEAddress addr;
+    uint8_t    addrType;
+    int        rssi;
+    uint8_t    payload[62]; // advertisement + scan response
+    size_t     payloadLength;
+
+    // returns the data of the first AD structure of this type, NULL if none
+    const uint8_t* findField( uint8_t type, uint8_t* dataLen = NULL )
+    {
+      size_t offset = 0;
+      while( offset < payloadLength ) {
+        uint8_t fieldLen = payload[offset];
+        if( fieldLen == 0 || offset + 1 + fieldLen > payloadLength ) break;
+        if( payload[offset+1] == type ) {
+          if( dataLen != NULL ) *dataLen = fieldLen - 1;
+          return &payload[offset+2];
+        }
+        offset += 1 + fieldLen;
+      }
+      return NULL;
+    }
+
+};
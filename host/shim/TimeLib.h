@@ -0,0 +1,79 @@
+/*
+
+  ESP32 BLE Collector - A BLE scanner with sqlite data persistence on the SD Card
+  Source: https://github.com/tobozo/ESP32-BLECollector
+
+  MIT License
+
+  Copyright (c) 2018 tobozo
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  -----------------------------------------------------------------------------
+
+*/
+
+
+
+
+/*
+ * Host shim for the TimeLib calls made by DateTime.h
+ *
+ * Same tmElements_t layout and semantics as PaulStoffregen's Time library:
+ * Year is an offset from 1970, Wday starts at 1 on sundays.
+ *
+ */
+
+#include <time.h>
+
+typedef struct
+{
+  uint8_t Second;
+  uint8_t Minute;
+  uint8_t Hour;
+  uint8_t Wday; // day of week, sunday is day 1
+  uint8_t Day;
+  uint8_t Month;
+  uint8_t Year; // offset from 1970
+} tmElements_t;
+
+static void breakTime( time_t timeInput, tmElements_t &tm )
+{
+  struct tm info;
+  gmtime_r( &timeInput, &info );
+  tm.Second = info.tm_sec;
+  tm.Minute = info.tm_min;
+  tm.Hour   = info.tm_hour;
+  tm.Wday   = info.tm_wday + 1;
+  tm.Day    = info.tm_mday;
+  tm.Month  = info.tm_mon + 1;
+  tm.Year   = info.tm_year - 70;
+}
+
+static time_t makeTime( const tmElements_t &tm )
+{
+  struct tm info = {};
+  info.tm_sec  = tm.Second;
+  info.tm_min  = tm.Minute;
+  info.tm_hour = tm.Hour;
+  info.tm_mday = tm.Day;
+  info.tm_mon  = tm.Month - 1;
+  info.tm_year = tm.Year + 70;
+  return timegm( &info );
+}
@@ -0,0 +1,104 @@
+// Host unit tests for AdvDedup.h
+
+#include "BLECollectorCore.h"
+
+#include <gtest/gtest.h>
+
+class AdvDedupTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+      for( uint16_t i=0; i<ADV_DEDUP_SIZE; i++ ) AdvDedupTable[i] = AdvDedupEntry();
+      scan_rounds = 0;
+      scan_cursor = 0;
+    }
+};
+
+static const uint8_t Address[6] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+
+TEST_F( AdvDedupTest, RepeatsInsideWindowAreDuplicates )
+{
+  bool isDuplicate;
+  AdvDedupEntry* entry = AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -70, 1000, isDuplicate );
+  ASSERT_NE( entry, nullptr );
+  EXPECT_FALSE( isDuplicate );
+  EXPECT_EQ( AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -60, 1100, isDuplicate ), entry );
+  EXPECT_TRUE( isDuplicate );
+  AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -80, 1200, isDuplicate );
+  EXPECT_EQ( entry->count, 3 );
+  EXPECT_EQ( entry->rssiMin, -80 );
+  EXPECT_EQ( entry->rssiMax, -60 );
+  EXPECT_EQ( entry->rssiLast, -80 );
+  EXPECT_EQ( entry->stats.samples, 3u );
+}
+
+TEST_F( AdvDedupTest, ChangedPayloadGoesThrough )
+{
+  bool isDuplicate;
+  AdvDedupEntry* entry = AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -70, 1000, isDuplicate );
+  AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x5678, -70, 1100, isDuplicate );
+  EXPECT_FALSE( isDuplicate );
+  EXPECT_EQ( entry->payloadHash, 0x5678u );
+  AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x5678, -70, 1200, isDuplicate );
+  EXPECT_TRUE( isDuplicate );
+}
+
+TEST_F( AdvDedupTest, WindowExpires )
+{
+  bool isDuplicate;
+  AdvDedupEntry* entry = AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -70, 1000, isDuplicate );
+  AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -70, 1000 + ADV_DEDUP_WINDOW_MS + 1, isDuplicate );
+  EXPECT_FALSE( isDuplicate );
+  EXPECT_EQ( entry->count, 1 );
+  EXPECT_EQ( entry->stats.samples, 2u ); // statistics survive the window change
+}
+
+TEST_F( AdvDedupTest, WindowNeverSpansTwoScans )
+{
+  bool isDuplicate;
+  AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -70, 1000, isDuplicate );
+  scan_rounds++;
+  AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -70, 1500, isDuplicate );
+  EXPECT_FALSE( isDuplicate );
+}
+
+TEST_F( AdvDedupTest, ScanSlotIsRoundRelative )
+{
+  bool isDuplicate;
+  AdvDedupEntry* entry = AdvDedup.lookup( Address, BLE_ADDR_PUBLIC, 0x1234, -70, 1000, isDuplicate );
+  EXPECT_FALSE( AdvDedup.isInScan( entry ) );
+  AdvDedup.setScanSlot( entry, 3 );
+  scan_cursor = 3;
+  EXPECT_FALSE( AdvDedup.isInScan( entry ) ); // slot not filled yet
+  scan_cursor = 4;
+  EXPECT_TRUE( AdvDedup.isInScan( entry ) );
+  scan_rounds++;
+  EXPECT_FALSE( AdvDedup.isInScan( entry ) );
+}
+
+TEST_F( AdvDedupTest, DeviceLookupHashesThePayload )
+{
+  const uint8_t payload[] = { 0x02, 0x01, 0x06 };
+  BLEAdvertisedDevice device( Address, BLE_ADDR_PUBLIC, -70, payload, sizeof( payload ) );
+  HostClock = 5000;
+  bool isDuplicate;
+  AdvDedupEntry* entry = AdvDedup.lookup( &device, isDuplicate );
+  EXPECT_EQ( entry->payloadHash, AdvDedup.payloadHash( payload, sizeof( payload ) ) );
+  EXPECT_EQ( entry->windowStart, 5000u );
+  AdvDedup.lookup( &device, isDuplicate );
+  EXPECT_TRUE( isDuplicate );
+}
+
+TEST_F( AdvDedupTest, TableStaysBoundedUnderChurn )
+{
+  bool isDuplicate;
+  uint8_t address[6] = { 0 };
+  for( uint32_t i=0; i<4*ADV_DEDUP_SIZE; i++ ) {
+    address[0] = i & 0xff;
+    address[1] = i >> 8;
+    ASSERT_NE( AdvDedup.lookup( address, BLE_ADDR_PUBLIC, i, -70, 1000 + i, isDuplicate ), nullptr );
+    EXPECT_FALSE( isDuplicate );
+  }
+  EXPECT_LE( AdvDedup.activeCount( 1000 + 4*ADV_DEDUP_SIZE ), ADV_DEDUP_SIZE );
+}
@@ -0,0 +1,157 @@
+// Host unit tests for AdvSynth.h and AdvTraceFormat.h
+
+#include "BLECollectorCore.h"
+
+#include <gtest/gtest.h>
+#include <set>
+#include <vector>
+
+static const uint8_t TestOUIs[][3] = { { 0xB4, 0x99, 0xBA }, { 0xDC, 0xA6, 0x32 } };
+static const uint16_t TestCompanies[] = { 0x0006, 0x02E5 };
+
+static void testOUI( uint32_t index, uint8_t oui[3] )
+{
+  memcpy( oui, TestOUIs[index], 3 );
+}
+
+static uint16_t testCompany( uint32_t index )
+{
+  return TestCompanies[index];
+}
+
+static const AdvSynthVendors TestVendors = { 2, testOUI, 2, testCompany };
+
+static bool collect( const AdvTraceRecord &rec, void *ctx )
+{
+  ((std::vector<AdvTraceRecord>*)ctx)->push_back( rec );
+  return true;
+}
+
+static std::vector<AdvTraceRecord> generate( const AdvSynthConfig &config )
+{
+  std::vector<AdvTraceRecord> records;
+  AdvSynth.generate( config, TestVendors, collect, &records );
+  return records;
+}
+
+static AdvSynthConfig smallConfig()
+{
+  AdvSynthConfig config;
+  config.devices  = 100;
+  config.duration = 20000;
+  return config;
+}
+
+TEST( AdvTraceFormat, Header )
+{
+  uint8_t header[ADV_TRACE_HEADER_LEN];
+  advTraceHeader( header );
+  EXPECT_EQ( memcmp( header, "BLET", 4 ), 0 );
+  EXPECT_EQ( header[4], ADV_TRACE_VERSION );
+  EXPECT_TRUE( advTraceHeaderValid( header ) );
+  header[4]++;
+  EXPECT_FALSE( advTraceHeaderValid( header ) );
+}
+
+TEST( AdvTraceFormat, RecordLayout )
+{
+  EXPECT_EQ( ADV_TRACE_RECORD_HEADER_LEN, 13u ); // the file format, not an implementation detail
+  AdvTraceRecord rec;
+  rec.length = 3;
+  EXPECT_EQ( advTraceRecordLen( rec ), 16u );
+}
+
+TEST( AdvSynth, SameSeedSameTrace )
+{
+  std::vector<AdvTraceRecord> first = generate( smallConfig() );
+  std::vector<AdvTraceRecord> second = generate( smallConfig() );
+  ASSERT_FALSE( first.empty() );
+  ASSERT_EQ( first.size(), second.size() );
+  for( size_t i=0; i<first.size(); i++ ) {
+    ASSERT_EQ( memcmp( &first[i], &second[i], advTraceRecordLen( first[i] ) ), 0 ) << "record " << i;
+  }
+  AdvSynthConfig other = smallConfig();
+  other.seed++;
+  std::vector<AdvTraceRecord> third = generate( other );
+  EXPECT_TRUE( third.size() != first.size() || memcmp( &first[0], &third[0], advTraceRecordLen( first[0] ) ) != 0 );
+}
+
+TEST( AdvSynth, RecordsAreWellFormed )
+{
+  uint32_t last = 0;
+  for( const AdvTraceRecord &rec : generate( smallConfig() ) ) {
+    ASSERT_GE( rec.timestamp, last );
+    ASSERT_LT( rec.timestamp, 20000u );
+    ASSERT_LE( rec.length, ADV_TRACE_MAX_PAYLOAD );
+    last = rec.timestamp;
+    // AD structures must tile the payload
+    size_t offset = 0;
+    while( offset < rec.length ) offset += 1 + rec.payload[offset];
+    ASSERT_EQ( offset, rec.length );
+  }
+}
+
+TEST( AdvSynth, VendorsComeFromTheTables )
+{
+  std::set<uint16_t> companies;
+  for( const AdvTraceRecord &rec : generate( smallConfig() ) ) {
+    if( rec.addrType == BLE_ADDR_PUBLIC ) {
+      bool known = false;
+      for( auto &oui : TestOUIs ) {
+        known |= rec.address[5] == oui[0] && rec.address[4] == oui[1] && rec.address[3] == oui[2];
+      }
+      ASSERT_TRUE( known );
+      ASSERT_EQ( rec.payload[4], AD_TYPE_MANUFACTURER_DATA );
+      companies.insert( rec.payload[5] | ( rec.payload[6] << 8 ) );
+    }
+  }
+  EXPECT_EQ( companies, std::set<uint16_t>( { 0x0006, 0x02E5 } ) );
+}
+
+TEST( AdvSynth, PopulationMix )
+{
+  AdvSynthConfig config = smallConfig();
+  config.publicPct = 0;
+  config.rpaPct = 100;
+  config.rotation = 5000;
+  std::set<uint64_t> addresses;
+  for( const AdvTraceRecord &rec : generate( config ) ) {
+    ASSERT_EQ( rec.addrType, BLE_ADDR_RANDOM );
+    ASSERT_TRUE( RPAGroups.isRotating( rec.address, rec.addrType ) );
+    uint64_t address = 0;
+    memcpy( &address, rec.address, 6 );
+    addresses.insert( address );
+  }
+  // every device rotates about 4 times in 20s
+  EXPECT_GT( addresses.size(), 4u * config.devices );
+  EXPECT_LT( addresses.size(), 6u * config.devices );
+}
+
+TEST( AdvSynth, AdvertisingRate )
+{
+  AdvSynthConfig config = smallConfig();
+  config.minInterval = 100;
+  config.maxInterval = 101;
+  std::vector<AdvTraceRecord> records = generate( config );
+  // 100ms interval + 5ms mean advDelay
+  double expected = config.devices * config.duration / 105.0;
+  EXPECT_NEAR( records.size(), expected, expected * 0.03 );
+}
+
+static bool failAfter10( const AdvTraceRecord &rec, void *ctx )
+{
+  return ++*(int*)ctx <= 10;
+}
+
+TEST( AdvSynth, StopsOnWriterFailure )
+{
+  int calls = 0;
+  EXPECT_EQ( AdvSynth.generate( smallConfig(), TestVendors, failAfter10, &calls ), 10u );
+}
+
+TEST( AdvSynth, RejectsEmptyTables )
+{
+  AdvSynthVendors empty = { 0, testOUI, 0, testCompany };
+  int calls = 0;
+  EXPECT_EQ( AdvSynth.generate( smallConfig(), empty, failAfter10, &calls ), 0u );
+}
@@ -0,0 +1,91 @@
+// Host unit tests for the assigned numbers lookups of AssignedNumbers.h and BLECache.h
+
+#include "BLECollectorCore.h"
+
+#include <gtest/gtest.h>
+
+// linear scan, the reference for the binary search
+template <size_t N>
+static const BLEAssignedNumber* linearFind( const BLEAssignedNumber (&table)[N], uint32_t assignedNumber )
+{
+  for( size_t i=0; i<N; i++ ) {
+    if( table[i].assignedNumber == assignedNumber ) return &table[i];
+  }
+  return NULL;
+}
+
+template <size_t N>
+static void expectSameAsLinear( const BLEAssignedNumber (&table)[N], uint32_t upTo )
+{
+  for( uint32_t number=0; number<=upTo; number++ ) {
+    ASSERT_EQ( assignedNumberFind( table, number ), linearFind( table, number ) ) << "assigned number " << number;
+  }
+}
+
+TEST( AssignedNumbers, BinarySearchMatchesLinearScan )
+{
+  expectSameAsLinear( BLE_gattServices,         0xFFFF );
+  expectSameAsLinear( BLE_gattCharacteristics,  0xFFFF );
+  expectSameAsLinear( BLE_appearanceCategories, 0x3FF );
+  expectSameAsLinear( BLE_companyIdentifiers,   0xFFFF );
+}
+
+TEST( AssignedNumbers, FindsEveryEntry )
+{
+  for( const BLEAssignedNumber &entry : BLE_gattServices ) {
+    EXPECT_EQ( assignedNumberFind( BLE_gattServices, entry.assignedNumber ), &entry );
+  }
+  for( const BLEAssignedNumber &entry : BLE_companyIdentifiers ) {
+    EXPECT_EQ( companyFind( entry.assignedNumber ), &entry );
+  }
+}
+
+TEST( AssignedNumbers, TableBounds )
+{
+  EXPECT_EQ( assignedNumberFind( BLE_gattServices, BLE_gattServices[0].assignedNumber - 1 ), nullptr );
+  EXPECT_EQ( assignedNumberFind( BLE_gattServices, 0xFFFFFFFF ), nullptr );
+  EXPECT_STREQ( assignedNumberFind( BLE_gattServices, 0x1800 )->name, "Generic Access" );
+  EXPECT_STREQ( assignedNumberFind( BLE_gattServices, 0x1825 )->name, "Object Transfer" );
+}
+
+TEST( AssignedNumbers, Lookups )
+{
+  EXPECT_STREQ( companyFind( 0x004C )->name, "Apple, Inc." );
+  EXPECT_EQ( companyFind( 0xFFFE ), nullptr );
+  EXPECT_STREQ( gattCharacteristicFind( 0x2A19 )->name, "Battery Level" );
+  EXPECT_EQ( gattCharacteristicFind( 0x2A02 ), nullptr );
+}
+
+TEST( AssignedNumbers, AppearanceUsesTheCategory )
+{
+  EXPECT_STREQ( appearanceFind( 0x00C0 )->name, "Watch" );       // generic watch
+  EXPECT_STREQ( appearanceFind( 0x00C1 )->name, "Watch" );       // sports watch
+  EXPECT_STREQ( appearanceFind( 0x03C1 )->name, "Human Interface Device" ); // keyboard
+  EXPECT_STREQ( appearanceFind( 0 )->name, "Unknown" );
+}
+
+TEST( AssignedNumbers, ServiceDescriptionFromUUIDString )
+{
+  EXPECT_STREQ( BLEDevHelper.gattServiceDescription( "0x180f" ).name, "Battery Service" );
+  EXPECT_STREQ( BLEDevHelper.gattServiceDescription( "0x180F" ).name, "Battery Service" );
+  EXPECT_STREQ( BLEDevHelper.gattServiceDescription( "0x0000180f" ).name, "Battery Service" ); // 32 bits, last 4 digits
+  EXPECT_STREQ( BLEDevHelper.gattServiceDescription( "0000180a-0000-1000-8000-00805f9b34fb" ).name, "Device Information" );
+  EXPECT_STREQ( BLEDevHelper.gattServiceDescription( "0x1234" ).name, "Unknown" );
+  EXPECT_STREQ( BLEDevHelper.gattServiceDescription( "<NULL>" ).name, "Unknown" );
+  EXPECT_STREQ( BLEDevHelper.gattServiceDescription( NULL ).name, "Unknown" );
+  EXPECT_STREQ( BLEDevHelper.gattServiceDescription( "" ).name, "Unknown" );
+}
+
+TEST( AssignedNumbers, DefaultGATTBackend )
+{
+  EXPECT_STREQ( Backend.gatt->service( "0x180f" ).name, "Battery Service" );
+  EXPECT_STREQ( Backend.gatt->service( "0x1234" ).name, "Unknown" );
+}
+
+TEST( AssignedNumbers, HexParsingStopsOnNonHex )
+{
+  EXPECT_EQ( BLEDevHelper.hexToUInt16( "180f", 4 ), 0x180F );
+  EXPECT_EQ( BLEDevHelper.hexToUInt16( "AbCd", 4 ), 0xABCD );
+  EXPECT_EQ( BLEDevHelper.hexToUInt16( "18-0f", 5 ), 0x18 );
+  EXPECT_EQ( BLEDevHelper.hexToUInt16( "1234567", 7 ), 0x1234 ); // 4 digits max
+}
@@ -0,0 +1,286 @@
+// Host unit tests for BLEBeacons.h
+
+#include "BLECollectorCore.h"
+
+#include <gtest/gtest.h>
+
+class BLEBeaconsTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+      for( uint16_t i=0; i<BEACON_TABLE_SIZE; i++ ) BeaconTable[i] = BeaconTableEntry();
+      BeaconFramesCount = 0;
+      HostClock = 0;
+    }
+};
+
+// full advertisement payloads, flags AD structure first, the way the
+// controller hands them over (identities from the vendors' reference frames)
+
+// Estimote default UUID, major 1, minor 2, measured power -59
+static const uint8_t iBeaconAdv[] = {
+  0x02, 0x01, 0x06,
+  0x1a, 0xff, 0x4c, 0x00, 0x02, 0x15,
+  0xb9, 0x40, 0x7f, 0x30, 0xf5, 0xf8, 0x46, 0x6e, 0xaf, 0xf9, 0x25, 0x55, 0x6b, 0x57, 0xfe, 0x6d,
+  0x00, 0x01, 0x00, 0x02, 0xc5
+};
+
+// Apple "Nearby" manufacturer data: same company id, not an iBeacon
+static const uint8_t appleNearbyAdv[] = {
+  0x02, 0x01, 0x1a,
+  0x0a, 0xff, 0x4c, 0x00, 0x10, 0x05, 0x0b, 0x1c, 0x2e, 0x7f, 0x44
+};
+
+// Radius Networks AltBeacon spec example, reference RSSI -59
+static const uint8_t altBeaconAdv[] = {
+  0x02, 0x01, 0x06,
+  0x1b, 0xff, 0x18, 0x01, 0xbe, 0xac,
+  0x2f, 0x23, 0x44, 0x54, 0xcf, 0x6d, 0x4a, 0x0f, 0xad, 0xf2, 0xf4, 0x91, 0x1b, 0xa9, 0xff, 0xa6,
+  0x00, 0x01, 0x00, 0x02,
+  0xc5, 0x00
+};
+
+// Eddystone UID, calibrated power -25 dBm at 0m
+static const uint8_t eddystoneUIDAdv[] = {
+  0x02, 0x01, 0x06,
+  0x03, 0x03, 0xaa, 0xfe,
+  0x17, 0x16, 0xaa, 0xfe, 0x00, 0xe7,
+  0xed, 0xd1, 0xeb, 0xea, 0xc0, 0x4e, 0x5d, 0xef, 0xa0, 0x17,
+  0x0b, 0xdb, 0x87, 0x53, 0x9b, 0x67,
+  0x00, 0x00
+};
+
+// Eddystone URL "https://www." + "google" + ".com/"
+static const uint8_t eddystoneURLAdv[] = {
+  0x02, 0x01, 0x06,
+  0x03, 0x03, 0xaa, 0xfe,
+  0x0d, 0x16, 0xaa, 0xfe, 0x10, 0xeb, 0x01, 'g', 'o', 'o', 'g', 'l', 'e', 0x00
+};
+
+// Eddystone URL "http://" + "esp32" + ".org" (no trailing slash expansion)
+static const uint8_t eddystoneURLNoSlashAdv[] = {
+  0x02, 0x01, 0x06,
+  0x03, 0x03, 0xaa, 0xfe,
+  0x0c, 0x16, 0xaa, 0xfe, 0x10, 0xeb, 0x02, 'e', 's', 'p', '3', '2', 0x08
+};
+
+// Eddystone URL with a reserved scheme prefix
+static const uint8_t eddystoneURLBadSchemeAdv[] = {
+  0x02, 0x01, 0x06,
+  0x03, 0x03, 0xaa, 0xfe,
+  0x08, 0x16, 0xaa, 0xfe, 0x10, 0xeb, 0x04, 'a', 0x00
+};
+
+// Eddystone TLM v0: 3000 mV, 25.5 C, 1000 advertisements, 1000 s uptime
+static const uint8_t eddystoneTLMAdv[] = {
+  0x02, 0x01, 0x06,
+  0x03, 0x03, 0xaa, 0xfe,
+  0x11, 0x16, 0xaa, 0xfe, 0x20, 0x00,
+  0x0b, 0xb8, 0x19, 0x80,
+  0x00, 0x00, 0x03, 0xe8,
+  0x00, 0x00, 0x27, 0x10
+};
+
+// Eddystone TLM v1 (encrypted), not supported
+static const uint8_t eddystoneETLMAdv[] = {
+  0x02, 0x01, 0x06,
+  0x03, 0x03, 0xaa, 0xfe,
+  0x11, 0x16, 0xaa, 0xfe, 0x20, 0x01,
+  0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 0x12, 0x34, 0x56, 0x78
+};
+
+// Eddystone EID, calibrated power -16 dBm at 0m
+static const uint8_t eddystoneEIDAdv[] = {
+  0x02, 0x01, 0x06,
+  0x03, 0x03, 0xaa, 0xfe,
+  0x0d, 0x16, 0xaa, 0xfe, 0x30, 0xf0,
+  0x3e, 0xa3, 0x61, 0x1b, 0xc9, 0x02, 0x5d, 0x77
+};
+
+static const uint8_t BeaconAddress[6] = { 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 };
+
+static BeaconFrame decoded( const uint8_t* payload, size_t len )
+{
+  BeaconFrame frame;
+  EXPECT_TRUE( Beacons.decode( payload, len, &frame ) );
+  return frame;
+}
+
+static void tlmFrame( BeaconFrame &frame, uint16_t vbatt, int16_t temp, uint32_t advCount )
+{
+  frame.type          = BEACON_EDDYSTONE_TLM;
+  frame.tlm.version   = 0;
+  frame.tlm.vbatt     = vbatt;
+  frame.tlm.temp      = temp;
+  frame.tlm.advCount  = advCount;
+  frame.tlm.secCount  = advCount * 10;
+}
+
+TEST_F( BLEBeaconsTest, DecodesIBeacon )
+{
+  BeaconFrame frame = decoded( iBeaconAdv, sizeof iBeaconAdv );
+  ASSERT_EQ( frame.type, BEACON_IBEACON );
+  EXPECT_EQ( frame.iBeacon.major, 1 );
+  EXPECT_EQ( frame.iBeacon.minor, 2 );
+  EXPECT_EQ( Beacons.txPower( &frame ), -59 );
+  char ident[BEACON_IDENT_LEN+1];
+  Beacons.describe( &frame, ident );
+  EXPECT_STREQ( ident, "b9407f30-f5f8-466e-aff9-25556b57fe6d 1/2" );
+}
+
+TEST_F( BLEBeaconsTest, AppleNonBeaconIsIgnored )
+{
+  BeaconFrame frame;
+  EXPECT_FALSE( Beacons.decode( appleNearbyAdv, sizeof appleNearbyAdv, &frame ) );
+  EXPECT_EQ( frame.type, BEACON_NONE );
+}
+
+TEST_F( BLEBeaconsTest, DecodesAltBeacon )
+{
+  BeaconFrame frame = decoded( altBeaconAdv, sizeof altBeaconAdv );
+  ASSERT_EQ( frame.type, BEACON_ALTBEACON );
+  EXPECT_EQ( frame.altBeacon.manufid, 0x0118 );
+  EXPECT_EQ( Beacons.txPower( &frame ), -59 );
+  char ident[BEACON_IDENT_LEN+1];
+  Beacons.describe( &frame, ident );
+  EXPECT_STREQ( ident, "0118:2f234454cf6d4a0fadf2f4911ba9ffa600010002" );
+}
+
+TEST_F( BLEBeaconsTest, DecodesEddystoneUID )
+{
+  BeaconFrame frame = decoded( eddystoneUIDAdv, sizeof eddystoneUIDAdv );
+  ASSERT_EQ( frame.type, BEACON_EDDYSTONE_UID );
+  EXPECT_EQ( Beacons.txPower( &frame ), -25 );
+  char ident[BEACON_IDENT_LEN+1];
+  Beacons.describe( &frame, ident );
+  EXPECT_STREQ( ident, "edd1ebeac04e5defa017:0bdb87539b67" );
+}
+
+TEST_F( BLEBeaconsTest, ExpandsEddystoneURL )
+{
+  BeaconFrame frame = decoded( eddystoneURLAdv, sizeof eddystoneURLAdv );
+  ASSERT_EQ( frame.type, BEACON_EDDYSTONE_URL );
+  EXPECT_EQ( Beacons.txPower( &frame ), -21 );
+  EXPECT_STREQ( frame.url.url, "https://www.google.com/" );
+
+  frame = decoded( eddystoneURLNoSlashAdv, sizeof eddystoneURLNoSlashAdv );
+  ASSERT_EQ( frame.type, BEACON_EDDYSTONE_URL );
+  EXPECT_STREQ( frame.url.url, "http://esp32.org" );
+
+  EXPECT_FALSE( Beacons.decode( eddystoneURLBadSchemeAdv, sizeof eddystoneURLBadSchemeAdv, &frame ) );
+}
+
+TEST_F( BLEBeaconsTest, DecodesEddystoneTLM )
+{
+  BeaconFrame frame = decoded( eddystoneTLMAdv, sizeof eddystoneTLMAdv );
+  ASSERT_EQ( frame.type, BEACON_EDDYSTONE_TLM );
+  EXPECT_EQ( frame.tlm.vbatt, 3000 );
+  EXPECT_FLOAT_EQ( Beacons.TLMTemperature( frame.tlm.temp ), 25.5f );
+  EXPECT_EQ( frame.tlm.advCount, 1000u );
+  EXPECT_EQ( frame.tlm.secCount, 10000u );
+
+  EXPECT_FALSE( Beacons.decode( eddystoneETLMAdv, sizeof eddystoneETLMAdv, &frame ) );
+}
+
+TEST_F( BLEBeaconsTest, DecodesEddystoneEID )
+{
+  BeaconFrame frame = decoded( eddystoneEIDAdv, sizeof eddystoneEIDAdv );
+  ASSERT_EQ( frame.type, BEACON_EDDYSTONE_EID );
+  EXPECT_EQ( Beacons.txPower( &frame ), -16 );
+  char ident[BEACON_IDENT_LEN+1];
+  Beacons.describe( &frame, ident );
+  EXPECT_STREQ( ident, "3ea3611bc9025d77" );
+}
+
+TEST_F( BLEBeaconsTest, TruncatedPayloadIsRejected )
+{
+  BeaconFrame frame;
+  EXPECT_FALSE( Beacons.decode( iBeaconAdv, sizeof iBeaconAdv - 1, &frame ) );
+  EXPECT_FALSE( Beacons.decode( eddystoneUIDAdv, sizeof eddystoneUIDAdv - 4, &frame ) );
+  EXPECT_FALSE( Beacons.decode( NULL, 0, &frame ) );
+}
+
+TEST_F( BLEBeaconsTest, OnAdvertisementFillsTheTable )
+{
+  BLEAdvertisedDevice device( BeaconAddress, BLE_ADDR_PUBLIC, -70, iBeaconAdv, sizeof iBeaconAdv );
+  Beacons.onAdvertisement( &device );
+  ASSERT_EQ( Beacons.count(), 1 );
+  BeaconTableEntry copy;
+  ASSERT_TRUE( Beacons.snapshot( 0, copy ) );
+  char address[MAC_LEN+1];
+  Beacons.addressToString( copy.address, address );
+  EXPECT_STREQ( address, "11:22:33:44:55:66" );
+  EXPECT_EQ( copy.rssi, -70 );
+  EXPECT_EQ( copy.frame.type, BEACON_IBEACON );
+}
+
+TEST_F( BLEBeaconsTest, TLMHistoryKeepsTheLatestSamples )
+{
+  BeaconFrame uid = decoded( eddystoneUIDAdv, sizeof eddystoneUIDAdv );
+  Beacons.update( BeaconAddress, -60, &uid );
+  BeaconFrame tlm;
+  const uint16_t samples = BEACON_TLM_HISTORY_SIZE + 3;
+  BeaconTableEntry* entry = NULL;
+  for( uint16_t i=0; i<samples; i++ ) {
+    HostClock = i * 10000;
+    tlmFrame( tlm, 3000 - i, (20 + i) << 8, i );
+    entry = Beacons.update( BeaconAddress, -60, &tlm );
+  }
+  ASSERT_NE( entry, nullptr );
+  EXPECT_EQ( entry->frame.type, BEACON_EDDYSTONE_UID ); // telemetry doesn't replace the identity
+  EXPECT_EQ( entry->seen, samples + 1u );
+  EXPECT_EQ( entry->tlmCount, BEACON_TLM_HISTORY_SIZE );
+
+  const BeaconTLMSample* last = Beacons.lastTLM( entry );
+  ASSERT_NE( last, nullptr );
+  EXPECT_EQ( last->vbatt, 3000 - ( samples - 1 ) );
+  EXPECT_FLOAT_EQ( Beacons.TLMTemperature( last->temp ), 20.0f + samples - 1 );
+  EXPECT_EQ( last->advCount, samples - 1u );
+  EXPECT_EQ( last->seenAt, ( samples - 1 ) * 10u );
+
+  // oldest sample still in the history, in the same order dump() walks it
+  const BeaconTLMSample* oldest = &entry->tlm[ ( entry->tlmIndex + BEACON_TLM_HISTORY_SIZE - entry->tlmCount ) % BEACON_TLM_HISTORY_SIZE ];
+  EXPECT_EQ( oldest->advCount, samples - BEACON_TLM_HISTORY_SIZE );
+}
+
+TEST_F( BLEBeaconsTest, TLMOnlyBeaconIsNotFlushed )
+{
+  BeaconFrame tlm = decoded( eddystoneTLMAdv, sizeof eddystoneTLMAdv );
+  Beacons.update( BeaconAddress, -60, &tlm );
+  EXPECT_EQ( Beacons.count(), 1 );
+  EXPECT_FALSE( Beacons.hasDirty() );
+  BeaconTableEntry copy;
+  EXPECT_FALSE( Beacons.takeDirty( 0, copy ) );
+
+  // the identity shows up, the telemetry collected so far goes along
+  BeaconFrame url = decoded( eddystoneURLAdv, sizeof eddystoneURLAdv );
+  Beacons.update( BeaconAddress, -60, &url );
+  EXPECT_TRUE( Beacons.hasDirty() );
+  ASSERT_TRUE( Beacons.takeDirty( 0, copy ) );
+  EXPECT_EQ( copy.frame.type, BEACON_EDDYSTONE_URL );
+  EXPECT_EQ( copy.tlmCount, 1 );
+  EXPECT_FALSE( Beacons.hasDirty() );
+
+  // failed insert: flagged again
+  Beacons.markDirty( 0, BeaconAddress );
+  EXPECT_TRUE( Beacons.hasDirty() );
+}
+
+TEST_F( BLEBeaconsTest, FullTableEvictsTheLeastRecentlySeen )
+{
+  BeaconFrame frame = decoded( iBeaconAdv, sizeof iBeaconAdv );
+  uint8_t address[6] = { 0, 0, 0, 0, 0, 0 };
+  for( uint16_t i=0; i<BEACON_TABLE_SIZE; i++ ) {
+    HostClock = ( i + 1 ) * 1000;
+    address[0] = i;
+    Beacons.update( address, -60, &frame );
+  }
+  EXPECT_EQ( Beacons.count(), BEACON_TABLE_SIZE );
+  HostClock = ( BEACON_TABLE_SIZE + 1 ) * 1000;
+  BeaconTableEntry* entry = Beacons.update( BeaconAddress, -60, &frame );
+  EXPECT_EQ( Beacons.count(), BEACON_TABLE_SIZE );
+  EXPECT_EQ( entry, &BeaconTable[0] ); // seen at 1s, the oldest
+  EXPECT_EQ( memcmp( entry->address, BeaconAddress, 6 ), 0 );
+  EXPECT_EQ( entry->seen, 1u );
+}
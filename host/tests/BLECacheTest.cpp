@@ -0,0 +1,302 @@
+// Host unit tests for the device cache helpers, LRU and top hits of BLECache.h
+
+#include "BLECollectorCore.h"
+
+#include <gtest/gtest.h>
+
+static const uint8_t RandomAddress[6] = { 0x06, 0x05, 0x04, 0x03, 0x02, 0x41 }; // native, LSB first
+static const uint8_t PublicAddress[6] = { 0x03, 0x02, 0x01, 0xba, 0x99, 0xb4 };
+
+static BlueToothDevice* newItem()
+{
+  BlueToothDevice* item = new BlueToothDevice;
+  BLEDevHelper.init( item, false );
+  return item;
+}
+
+// LRU
+
+TEST( BlueToothDeviceLRU, FillsFreeSlotsInOrder )
+{
+  BlueToothDeviceLRU lru;
+  ASSERT_TRUE( lru.init( 10, false ) );
+  for( uint16_t i=0; i<10; i++ ) {
+    EXPECT_EQ( lru.acquire(), i );
+  }
+  EXPECT_EQ( lru.used(), 10 );
+  EXPECT_EQ( lru.protectedCount(), 0 );
+}
+
+TEST( BlueToothDeviceLRU, EvictsOneShotDevicesFirst )
+{
+  BlueToothDeviceLRU lru;
+  ASSERT_TRUE( lru.init( 10, false ) );
+  for( uint16_t i=0; i<10; i++ ) lru.acquire();
+  for( uint16_t i=0; i<4; i++ ) lru.touch( i ); // seen twice: protected
+  EXPECT_EQ( lru.protectedCount(), 4 );
+  uint32_t evictions = BLEDevCacheEvictions;
+  // probation holds 4..9, 4 is the least recent
+  EXPECT_EQ( lru.acquire(), 4 );
+  EXPECT_EQ( lru.acquire(), 5 );
+  EXPECT_EQ( BLEDevCacheEvictions, evictions + 2 );
+}
+
+TEST( BlueToothDeviceLRU, DemotesOverflowingProtectedDevices )
+{
+  BlueToothDeviceLRU lru;
+  ASSERT_TRUE( lru.init( 10, false ) ); // 8 protected slots
+  for( uint16_t i=0; i<10; i++ ) lru.acquire();
+  for( uint16_t i=0; i<9; i++ ) lru.touch( i );
+  EXPECT_EQ( lru.protectedCount(), 8 );
+  // 0 was demoted to the probation head, 9 is still the probation tail
+  EXPECT_EQ( lru.acquire(), 9 );
+  EXPECT_EQ( lru.acquire(), 0 );
+}
+
+TEST( BlueToothDeviceLRU, ReleasedSlotsAreReusedFirst )
+{
+  BlueToothDeviceLRU lru;
+  ASSERT_TRUE( lru.init( 4, false ) );
+  for( uint16_t i=0; i<4; i++ ) lru.acquire();
+  lru.release( 2 );
+  EXPECT_EQ( lru.used(), 3 );
+  EXPECT_EQ( lru.acquire(), 2 );
+  lru.release( 2 );
+  lru.release( 2 ); // already free, ignored
+  lru.touch( 2 );   // free, ignored
+  EXPECT_EQ( lru.used(), 3 );
+}
+
+TEST( BlueToothDeviceLRU, EvictsTheMostOverdueProbationDevice )
+{
+  BlueToothDevice* items[10];
+  for( uint16_t i=0; i<10; i++ ) items[i] = newItem();
+  BlueToothDeviceLRU lru;
+  ASSERT_TRUE( lru.init( 10, false, items ) );
+  for( uint16_t i=0; i<10; i++ ) lru.acquire();
+  // probation tail is 0, 1, 2, 3: slow advertiser heard recently, fast one silent for long, no stats
+  HostClock = 0;
+  for( uint32_t t=0; t<=30000; t+=10000 ) BLEDevHelper.statsUpdate( &items[0]->stats, t, -60 );
+  for( uint32_t t=0; t<=1000; t+=100 )    BLEDevHelper.statsUpdate( &items[1]->stats, t, -60 );
+  HostClock = 40000;
+  EXPECT_EQ( lru.acquire(), 1 ); // missed ~390 advertisements vs 1 for the slow one
+  EXPECT_EQ( lru.acquire(), 0 ); // 10s interval, 40s silence
+  EXPECT_EQ( lru.acquire(), 2 ); // no statistics: LRU order
+  for( uint16_t i=0; i<10; i++ ) delete items[i];
+}
+
+// top hits
+
+TEST( BlueToothDeviceTopK, KeepsMostHitFirst )
+{
+  BlueToothDeviceTopK topk;
+  topk.update( 1, 5 );
+  topk.update( 2, 9 );
+  topk.update( 3, 1 );
+  topk.update( 3, 12 ); // moves up
+  int32_t sorted[4];
+  ASSERT_EQ( topk.read( sorted, 4 ), 3u );
+  EXPECT_EQ( sorted[0], 3 );
+  EXPECT_EQ( sorted[1], 2 );
+  EXPECT_EQ( sorted[2], 1 );
+  topk.remove( 2 );
+  ASSERT_EQ( topk.read( sorted, 4 ), 2u );
+  EXPECT_EQ( sorted[0], 3 );
+  EXPECT_EQ( sorted[1], 1 );
+}
+
+TEST( BlueToothDeviceTopK, EvictsLeastHitWhenFull )
+{
+  BlueToothDeviceTopK topk;
+  for( uint16_t i=0; i<BLEDEVCACHE_TOPK; i++ ) {
+    topk.update( i, 100 + i );
+  }
+  topk.update( 500, 50 ); // not a contender
+  topk.update( 501, 1000 );
+  int32_t sorted[BLEDEVCACHE_TOPK+1];
+  ASSERT_EQ( topk.read( sorted, BLEDEVCACHE_TOPK+1 ), (size_t)BLEDEVCACHE_TOPK );
+  EXPECT_EQ( sorted[0], 501 );
+  for( size_t i=0; i<BLEDEVCACHE_TOPK; i++ ) {
+    EXPECT_NE( sorted[i], 500 );
+    EXPECT_NE( sorted[i], 0 ); // least hit one was evicted
+  }
+}
+
+TEST( BlueToothDeviceTopK, MatchesBruteForce )
+{
+  BlueToothDeviceTopK topk;
+  uint32_t hits[64] = {0};
+  srand( 42 );
+  for( int i=0; i<2000; i++ ) {
+    uint16_t index = rand() % 64;
+    hits[index] += 1 + rand() % 3;
+    topk.update( index, hits[index] );
+  }
+  int32_t sorted[BLEDEVCACHE_TOPK];
+  size_t count = topk.read( sorted, BLEDEVCACHE_TOPK );
+  ASSERT_EQ( count, (size_t)BLEDEVCACHE_TOPK );
+  for( size_t i=1; i<count; i++ ) {
+    EXPECT_GE( hits[sorted[i-1]], hits[sorted[i]] );
+  }
+  // nothing outside the top entries beats the last one
+  uint32_t last = hits[sorted[count-1]];
+  uint16_t better = 0;
+  for( uint16_t i=0; i<64; i++ ) {
+    if( hits[i] > last ) better++;
+  }
+  EXPECT_LT( better, BLEDEVCACHE_TOPK );
+}
+
+// helpers
+
+TEST( BlueToothDeviceHelper, StoresAdvertisedDevice )
+{
+  const uint8_t payload[] = {
+    0x02, 0x01, 0x06,                         // flags
+    0x04, 0x09, 'F', 'o', 'o',                // complete name
+    0x03, 0x19, 0xC1, 0x03,                   // appearance 0x03C1 (keyboard)
+    0x05, 0xFF, 0x4C, 0x00, 0x10, 0x05,       // manufacturer data, Apple
+    0x03, 0x03, 0x0F, 0x18,                   // battery service
+  };
+  BLEAdvertisedDevice device( RandomAddress, BLE_ADDR_RANDOM, -67, payload, sizeof( payload ) );
+  BlueToothDevice* item = newItem();
+  BLEDevHelper.store( item, &device );
+  EXPECT_STREQ( item->address, "41:02:03:04:05:06" );
+  EXPECT_EQ( item->rssi, -67 );
+  EXPECT_EQ( item->addr_type, BLE_ADDR_RANDOM );
+  EXPECT_STREQ( item->ouiname, "[random]" );
+  EXPECT_STREQ( item->name, "Foo" );
+  EXPECT_EQ( item->appearance, 0x03C1 );
+  EXPECT_EQ( item->manufid, 0x004C );
+  EXPECT_STREQ( item->manufname, "[unpopulated]" );
+  EXPECT_STREQ( item->uuid, "0x180f" );
+  EXPECT_EQ( item->hits, 1 );
+  EXPECT_FALSE( BLEDevHelper.isAnonymous( item ) );
+}
+
+TEST( BlueToothDeviceHelper, AnonymousRandomDevice )
+{
+  const uint8_t payload[] = { 0x02, 0x01, 0x06 };
+  BLEAdvertisedDevice device( RandomAddress, BLE_ADDR_RANDOM, -80, payload, sizeof( payload ) );
+  BlueToothDevice* item = newItem();
+  BLEDevHelper.store( item, &device );
+  EXPECT_TRUE( BLEDevHelper.isAnonymous( item ) );
+  BLEDevHelper.set( item, "ouiname", "Raspberry Pi Foundation" );
+  BLEDevHelper.set( item, "manufname", "Espressif Incorporated" );
+  EXPECT_FALSE( BLEDevHelper.isAnonymous( item ) ); // anonymous but qualified
+}
+
+TEST( BlueToothDeviceHelper, PublicDeviceWaitsForPopulation )
+{
+  const uint8_t payload[] = { 0x02, 0x01, 0x06 };
+  BLEAdvertisedDevice device( PublicAddress, BLE_ADDR_PUBLIC, -80, payload, sizeof( payload ) );
+  BlueToothDevice* item = newItem();
+  BLEDevHelper.store( item, &device );
+  EXPECT_STREQ( item->address, "b4:99:ba:01:02:03" );
+  EXPECT_STREQ( item->ouiname, "[unpopulated]" );
+  EXPECT_FALSE( BLEDevHelper.isAnonymous( item ) ); // don't know yet
+}
+
+static void expectSameItem( BlueToothDevice* a, BlueToothDevice* b )
+{
+  EXPECT_STREQ( a->address, b->address );
+  EXPECT_EQ( a->rssi, b->rssi );
+  EXPECT_EQ( a->addr_type, b->addr_type );
+  EXPECT_STREQ( a->ouiname, b->ouiname );
+  EXPECT_STREQ( a->name, b->name );
+  EXPECT_EQ( a->appearance, b->appearance );
+  EXPECT_EQ( a->manufid, b->manufid );
+  EXPECT_STREQ( a->manufname, b->manufname );
+  EXPECT_STREQ( a->uuid, b->uuid );
+  EXPECT_EQ( a->hits, b->hits );
+  EXPECT_EQ( BLEDevHelper.isAnonymous( a ), BLEDevHelper.isAnonymous( b ) );
+}
+
+TEST( BlueToothDeviceHelper, StoreRawMatchesStore )
+{
+  const uint8_t full[] = {
+    0x02, 0x01, 0x06,
+    0x08, 0x08, 'S', 'h', 'o', 'r', 't', 'e', 'r', // shortened name
+    0x03, 0x19, 0xC1, 0x03,
+    0x05, 0xFF, 0xE5, 0x02, 0x01, 0x02,
+    0x03, 0x02, 0x0F, 0x18,                         // incomplete uuid list
+  };
+  const uint8_t empty[] = { 0x02, 0x01, 0x06 };
+  const uint8_t truncated[] = { 0x02, 0x01, 0x06, 0x09, 0x09, 'B', 'r' }; // name field runs past the payload
+  std::string longName( MAX_FIELD_LEN + 5, 'n' );
+  uint8_t named[2 + MAX_FIELD_LEN + 5];
+  named[0] = 1 + longName.size();
+  named[1] = 0x09;
+  memcpy( named + 2, longName.data(), longName.size() );
+  struct { const uint8_t* address; uint8_t type; const uint8_t* payload; size_t len; } cases[] = {
+    { RandomAddress, BLE_ADDR_RANDOM, full, sizeof( full ) },
+    { PublicAddress, BLE_ADDR_PUBLIC, full, sizeof( full ) },
+    { PublicAddress, BLE_ADDR_PUBLIC, empty, sizeof( empty ) },
+    { RandomAddress, BLE_ADDR_RANDOM, truncated, sizeof( truncated ) },
+    { PublicAddress, BLE_ADDR_PUBLIC, named, sizeof( named ) },
+  };
+  BlueToothDevice* stored = newItem();
+  BlueToothDevice* raw    = newItem();
+  for( auto &c : cases ) {
+    BLEAdvertisedDevice device( c.address, c.type, -71, c.payload, c.len );
+    BLEDevHelper.store( stored, &device );
+    BLEDevHelper.storeRaw( raw, c.address, c.type, -71, c.payload, c.len );
+    expectSameItem( stored, raw );
+  }
+}
+
+TEST( BlueToothDeviceHelper, MergeKeepsKnownFields )
+{
+  BlueToothDevice* cached = newItem();
+  BlueToothDevice* fresh  = newItem();
+  BLEDevHelper.set( cached, "address", "b4:99:ba:01:02:03" );
+  BLEDevHelper.set( cached, "name", "Known" );
+  BLEDevHelper.set( cached, "hits", 7 );
+  BLEDevHelper.set( fresh,  "address", "b4:99:ba:01:02:03" );
+  BLEDevHelper.set( fresh,  "name", "Other" );
+  BLEDevHelper.set( fresh,  "ouiname", "Raspberry Pi Foundation" );
+  BLEDevHelper.set( fresh,  "hits", 1 );
+  BLEDevHelper.set( fresh,  "manufid", 0x02E5 );
+  fresh->rpa_group = 12;
+  BLEDevHelper.mergeItems( fresh, cached );
+  EXPECT_STREQ( cached->name, "Known" );
+  EXPECT_STREQ( cached->ouiname, "Raspberry Pi Foundation" );
+  EXPECT_EQ( cached->hits, 7 );
+  EXPECT_EQ( cached->manufid, 0x02E5 );
+  EXPECT_EQ( cached->rpa_group, 12u );
+  fresh->rpa_group = 13;
+  BLEDevHelper.mergeItems( fresh, cached );
+  EXPECT_EQ( cached->rpa_group, 12u ); // a known group sticks
+}
+
+TEST( BlueToothDeviceHelper, CopyOverwrites )
+{
+  BlueToothDevice* source = newItem();
+  BlueToothDevice* dest   = newItem();
+  BLEDevHelper.set( source, "address", "b4:99:ba:01:02:03" );
+  BLEDevHelper.set( source, "name", "Fresh" );
+  BLEDevHelper.set( source, "hits", 3 );
+  BLEDevHelper.set( dest, "address", "00:00:00:00:00:01" );
+  BLEDevHelper.set( dest, "name", "Stale" );
+  dest->rpa_group = 4;
+  BLEDevHelper.copyItem( source, dest );
+  EXPECT_STREQ( dest->address, "b4:99:ba:01:02:03" );
+  EXPECT_STREQ( dest->name, "Fresh" );
+  EXPECT_EQ( dest->hits, 3 );
+  EXPECT_EQ( dest->rpa_group, 0u );
+}
+
+TEST( BlueToothDeviceHelper, TruncatesLongFields )
+{
+  BlueToothDevice* item = newItem();
+  std::string longName( MAX_FIELD_LEN + 10, 'x' );
+  BLEDevHelper.set( item, "name", longName.c_str() );
+  EXPECT_EQ( strlen( item->name ), (size_t)MAX_FIELD_LEN );
+}
+
+TEST( BlueToothDeviceHelper, FormatsUnits )
+{
+  EXPECT_STREQ( formatUnit( 999 ), "999" );
+  EXPECT_STREQ( formatUnit( 1500 ), "1K" );
+  EXPECT_STREQ( formatUnit( 2500000 ), "2M" );
+}
@@ -0,0 +1,163 @@
+// Host unit tests for the advertising statistics estimator of BLECache.h,
+// checked against synthetic advertisement traces with known interval and RSSI
+
+#include "BLECollectorCore.h"
+
+#include <gtest/gtest.h>
+#include <random>
+
+// one device advertising every <interval> ms plus BLE's 0-10ms random advDelay,
+// with a gaussian RSSI, a share of advertisements missed by the scanner
+struct SyntheticAdvertiser
+{
+  uint32_t interval;
+  float    rssiMean;
+  float    rssiSigma;
+  float    lossRate;
+  std::mt19937 rng;
+
+  SyntheticAdvertiser( uint32_t _interval, float _rssiMean, float _rssiSigma, float _lossRate, uint32_t seed )
+  : interval( _interval ), rssiMean( _rssiMean ), rssiSigma( _rssiSigma ), lossRate( _lossRate ), rng( seed ) { }
+
+  // feeds <count> received advertisements starting at <now>, returns the time of the last one
+  uint32_t feed( BlueToothDeviceStats *stats, uint32_t now, uint32_t count )
+  {
+    std::uniform_int_distribution<uint32_t> advDelay( 0, 10 );
+    std::normal_distribution<float> rssi( rssiMean, rssiSigma );
+    std::uniform_real_distribution<float> loss( 0, 1 );
+    uint32_t received = 0;
+    while( received < count ) {
+      now += interval + advDelay( rng );
+      if( loss( rng ) < lossRate ) continue;
+      BLEDevHelper.statsUpdate( stats, now, (int)lroundf( rssi( rng ) ) );
+      received++;
+    }
+    return now;
+  }
+};
+
+TEST( BlueToothDeviceStats, FirstSampleInitializes )
+{
+  BlueToothDeviceStats stats = {};
+  BLEDevHelper.statsUpdate( &stats, 1000, -70 );
+  EXPECT_EQ( stats.samples, 1u );
+  EXPECT_EQ( stats.intervals, 0u );
+  EXPECT_EQ( stats.firstSeen, 1000u );
+  EXPECT_EQ( stats.lastSeen, 1000u );
+  EXPECT_FLOAT_EQ( stats.rssiAvg, -70 );
+  EXPECT_FLOAT_EQ( stats.rssiVar, 0 );
+}
+
+TEST( BlueToothDeviceStats, PeriodicAdvertiserHasNoJitter )
+{
+  BlueToothDeviceStats stats = {};
+  for( uint32_t i=0; i<50; i++ ) {
+    BLEDevHelper.statsUpdate( &stats, 1000 + i*100, -60 );
+  }
+  EXPECT_EQ( stats.intervals, 49u );
+  EXPECT_FLOAT_EQ( stats.intervalAvg, 100 );
+  EXPECT_FLOAT_EQ( BLEDevHelper.statsJitter( &stats ), 0 );
+  EXPECT_EQ( stats.firstSeen, 1000u );
+  EXPECT_EQ( stats.lastSeen, 1000u + 49*100 );
+}
+
+TEST( BlueToothDeviceStats, IgnoresIllegalIntervals )
+{
+  BlueToothDeviceStats stats = {};
+  BLEDevHelper.statsUpdate( &stats, 1000, -60 );
+  BLEDevHelper.statsUpdate( &stats, 1005, -60 );  // scan response, too close
+  BLEDevHelper.statsUpdate( &stats, 1105, -60 );
+  BLEDevHelper.statsUpdate( &stats, 31105, -60 ); // scan pause, too far
+  EXPECT_EQ( stats.samples, 4u );
+  EXPECT_EQ( stats.intervals, 1u );
+  EXPECT_FLOAT_EQ( stats.intervalAvg, 100 );
+}
+
+TEST( BlueToothDeviceStats, ConvergesOnSyntheticTrace )
+{
+  const uint32_t intervals[] = { 20, 100, 250, 1000, 2000 };
+  for( uint32_t interval : intervals ) {
+    BlueToothDeviceStats stats = {};
+    SyntheticAdvertiser advertiser( interval, -72, 3, 0, interval );
+    advertiser.feed( &stats, 0, 500 );
+    // advDelay is uniform over 0-10ms: mean +5ms, standard deviation ~3.2ms
+    EXPECT_NEAR( stats.intervalAvg, interval + 5, 3 ) << "interval " << interval;
+    EXPECT_NEAR( BLEDevHelper.statsJitter( &stats ), 3.2, 2 ) << "interval " << interval;
+    EXPECT_NEAR( stats.rssiAvg, -72, 3 ) << "interval " << interval;
+    EXPECT_NEAR( sqrtf( stats.rssiVar ), 3, 1.5 ) << "interval " << interval;
+    EXPECT_EQ( stats.samples, 500u );
+  }
+}
+
+TEST( BlueToothDeviceStats, TracksAMovingDevice )
+{
+  BlueToothDeviceStats stats = {};
+  SyntheticAdvertiser advertiser( 100, -50, 2, 0, 7 );
+  uint32_t now = advertiser.feed( &stats, 0, 200 );
+  EXPECT_NEAR( stats.rssiAvg, -50, 2 );
+  advertiser.rssiMean = -85; // walked away
+  advertiser.feed( &stats, now, 64 ); // 8 time constants
+  EXPECT_NEAR( stats.rssiAvg, -85, 2 );
+}
+
+TEST( BlueToothDeviceStats, LossWidensTheEstimate )
+{
+  BlueToothDeviceStats clean = {}, lossy = {};
+  SyntheticAdvertiser cleanAdvertiser( 100, -70, 2, 0, 3 );
+  SyntheticAdvertiser lossyAdvertiser( 100, -70, 2, 0.3, 3 );
+  cleanAdvertiser.feed( &clean, 0, 1000 );
+  lossyAdvertiser.feed( &lossy, 0, 1000 );
+  // missed advertisements show up as 2x, 3x intervals
+  EXPECT_GT( lossy.intervalAvg, clean.intervalAvg + 20 );
+  EXPECT_GT( BLEDevHelper.statsJitter( &lossy ), BLEDevHelper.statsJitter( &clean ) * 5 );
+}
+
+TEST( BlueToothDeviceStats, RoundedRSSI )
+{
+  BlueToothDevice item;
+  BLEDevHelper.init( &item, false );
+  item.rssi = -40;
+  EXPECT_EQ( BLEDevHelper.statsRSSI( &item ), -40 ); // not enough samples
+  BLEDevHelper.statsUpdate( &item.stats, 1000, -70 );
+  BLEDevHelper.statsUpdate( &item.stats, 1100, -70 );
+  EXPECT_EQ( BLEDevHelper.statsRSSI( &item ), -70 );
+}
+
+TEST( BlueToothDeviceStats, MergeContinuation )
+{
+  BlueToothDeviceStats cached = {}, fresh = {};
+  SyntheticAdvertiser advertiser( 100, -70, 2, 0, 11 );
+  uint32_t now = advertiser.feed( &cached, 1000, 10 );
+  fresh = cached;
+  advertiser.feed( &fresh, now, 10 ); // same estimator, carried by the dedup table
+  BLEDevHelper.statsMerge( &fresh, &cached );
+  EXPECT_EQ( cached.samples, 20u );
+  EXPECT_EQ( cached.lastSeen, fresh.lastSeen );
+  EXPECT_FLOAT_EQ( cached.intervalAvg, fresh.intervalAvg );
+}
+
+TEST( BlueToothDeviceStats, MergeRestartBlendsIn )
+{
+  BlueToothDeviceStats cached = {}, fresh = {};
+  SyntheticAdvertiser advertiser( 100, -70, 0, 0, 13 );
+  uint32_t now = advertiser.feed( &cached, 1000, 40 );
+  uint32_t firstSeen = cached.firstSeen;
+  advertiser.rssiMean = -60;
+  advertiser.feed( &fresh, now + 60000, 5 ); // evicted from the dedup table, restarted
+  BLEDevHelper.statsMerge( &fresh, &cached );
+  EXPECT_EQ( cached.samples, 45u );
+  EXPECT_EQ( cached.firstSeen, firstSeen ); // oldest first seen is kept
+  EXPECT_EQ( cached.lastSeen, fresh.lastSeen );
+  EXPECT_GT( cached.rssiAvg, -70 );
+  EXPECT_LT( cached.rssiAvg, -60 );
+}
+
+TEST( BlueToothDeviceStats, MergeIntoEmptyCopies )
+{
+  BlueToothDeviceStats cached = {}, fresh = {}, empty = {};
+  BLEDevHelper.statsUpdate( &fresh, 1000, -70 );
+  BLEDevHelper.statsMerge( &fresh, &cached );
+  EXPECT_EQ( cached.samples, 1u );
+  BLEDevHelper.statsMerge( &empty, &cached ); // nothing to merge
+  EXPECT_EQ( cached.samples, 1u );
+}
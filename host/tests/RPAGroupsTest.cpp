@@ -0,0 +1,203 @@
+// Host unit tests for RPAGroups.h
+
+#include "BLECollectorCore.h"
+
+#include <gtest/gtest.h>
+
+class RPAGroupsTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+      for( uint16_t i=0; i<RPA_GROUPS_SIZE; i++ ) RPAGroupsTable[i] = RPAGroup();
+      RPAScanning = false;
+      RPAScanStart = 0;
+      RPAHasPrevScan = false;
+      RPAPrevScanStart = 0;
+      RPAPrevScanEnd = 0;
+      RPALastHeard = 0;
+    }
+
+    // resolvable private address, two most significant bits 01
+    static void rpa( uint8_t address[6], uint8_t seed )
+    {
+      for( uint8_t i=0; i<5; i++ ) address[i] = seed + i;
+      address[5] = 0x40 | ( seed & 0x3F );
+    }
+
+    // advertises every <interval> ms from <from> to <to> included, returns the group id
+    static uint32_t advertise( const uint8_t* address, uint32_t fp, uint32_t from, uint32_t to, uint32_t interval )
+    {
+      uint32_t id = 0;
+      for( uint32_t now=from; now<=to; now+=interval ) {
+        id = RPAGroups.resolve( address, fp, now );
+      }
+      return id;
+    }
+};
+
+static const uint8_t PayloadA[] = { 0x02, 0x01, 0x1A, 0x07, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0B, 0x00 };
+static const uint8_t PayloadB[] = { 0x02, 0x01, 0x1A, 0x07, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0B, 0x01 }; // rotated data bytes
+static const uint8_t PayloadOtherVendor[] = { 0x02, 0x01, 0x1A, 0x07, 0xFF, 0x06, 0x00, 0x10, 0x02, 0x0B, 0x00 };
+static const uint8_t PayloadLonger[] = { 0x02, 0x01, 0x1A, 0x08, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0B, 0x00, 0x00 };
+static const uint8_t PayloadTxPower[] = { 0x02, 0x01, 0x1A, 0x07, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0B, 0x00, 0x02, 0x0A, 0x08 };
+static const uint8_t PayloadTxPower2[] = { 0x02, 0x01, 0x1A, 0x07, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0B, 0x00, 0x02, 0x0A, 0x0C };
+static const uint8_t PayloadUUIDs[] = { 0x02, 0x01, 0x06, 0x05, 0x03, 0x0F, 0x18, 0x0A, 0x18 };
+static const uint8_t PayloadUUIDs2[] = { 0x02, 0x01, 0x06, 0x05, 0x03, 0x0F, 0x18, 0x0D, 0x18 };
+static const uint8_t PayloadNoIdentity[] = { 0x02, 0x01, 0x06, 0x04, 0x09, 'F', 'o', 'o' };
+
+TEST_F( RPAGroupsTest, OnlyResolvableAddressesRotate )
+{
+  uint8_t address[6];
+  rpa( address, 1 );
+  EXPECT_TRUE( RPAGroups.isRotating( address, BLE_ADDR_RANDOM ) );
+  EXPECT_FALSE( RPAGroups.isRotating( address, BLE_ADDR_PUBLIC ) );
+  address[5] = 0xC1; // static random
+  EXPECT_FALSE( RPAGroups.isRotating( address, BLE_ADDR_RANDOM ) );
+  address[5] = 0x01; // non resolvable
+  EXPECT_FALSE( RPAGroups.isRotating( address, BLE_ADDR_RANDOM ) );
+}
+
+TEST_F( RPAGroupsTest, FingerprintIgnoresRotatingDataBytes )
+{
+  uint32_t a = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  EXPECT_NE( a, 0u );
+  EXPECT_EQ( RPAGroups.fingerprint( PayloadB, sizeof( PayloadB ) ), a );
+  EXPECT_EQ( RPAGroups.fingerprint( PayloadNoIdentity, sizeof( PayloadNoIdentity ) ), 0u );
+}
+
+TEST_F( RPAGroupsTest, FingerprintKeysOnLayoutVendorServicesAndPower )
+{
+  uint32_t a = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  EXPECT_NE( RPAGroups.fingerprint( PayloadOtherVendor, sizeof( PayloadOtherVendor ) ), a );
+  EXPECT_NE( RPAGroups.fingerprint( PayloadLonger, sizeof( PayloadLonger ) ), a );
+  uint32_t tx = RPAGroups.fingerprint( PayloadTxPower, sizeof( PayloadTxPower ) );
+  EXPECT_NE( tx, a );
+  EXPECT_NE( RPAGroups.fingerprint( PayloadTxPower2, sizeof( PayloadTxPower2 ) ), tx );
+  uint32_t uuids = RPAGroups.fingerprint( PayloadUUIDs, sizeof( PayloadUUIDs ) );
+  EXPECT_NE( uuids, 0u );
+  EXPECT_NE( RPAGroups.fingerprint( PayloadUUIDs2, sizeof( PayloadUUIDs2 ) ), uuids );
+}
+
+TEST_F( RPAGroupsTest, UngroupedDevicesResolveToZero )
+{
+  uint8_t address[6];
+  rpa( address, 1 );
+  BLEAdvertisedDevice noIdentity( address, BLE_ADDR_RANDOM, -60, PayloadNoIdentity, sizeof( PayloadNoIdentity ) );
+  EXPECT_EQ( RPAGroups.resolve( &noIdentity ), 0u );
+  address[5] = 0xC1;
+  BLEAdvertisedDevice staticRandom( address, BLE_ADDR_RANDOM, -60, PayloadA, sizeof( PayloadA ) );
+  EXPECT_EQ( RPAGroups.resolve( &staticRandom ), 0u );
+}
+
+TEST_F( RPAGroupsTest, GroupsRotationInsideScanWindow )
+{
+  uint8_t oldAddress[6], newAddress[6];
+  rpa( oldAddress, 1 );
+  rpa( newAddress, 9 );
+  uint32_t fp = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  RPAGroups.scanBegin( 1000 );
+  uint32_t id = advertise( oldAddress, fp, 1000, 1500, 100 );
+  EXPECT_NE( id, 0u );
+  uint32_t rotations = RPARotationsCount;
+  EXPECT_EQ( RPAGroups.resolve( newAddress, fp, 1700 ), id ); // silent for two intervals, then handoff
+  EXPECT_EQ( RPARotationsCount, rotations + 1 );
+  EXPECT_EQ( RPAGroups.groupedCount(), 1 );
+  EXPECT_EQ( RPAGroups.resolve( newAddress, fp, 1800 ), id ); // now a known address
+}
+
+TEST_F( RPAGroupsTest, TwoIdenticalDevicesStayApart )
+{
+  uint8_t first[6], second[6];
+  rpa( first, 1 );
+  rpa( second, 9 );
+  uint32_t fp = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  RPAGroups.scanBegin( 1000 );
+  uint32_t id = advertise( first, fp, 1000, 1500, 100 );
+  EXPECT_NE( RPAGroups.resolve( second, fp, 1550 ), id ); // first one is still advertising
+}
+
+TEST_F( RPAGroupsTest, GroupsRotationAcrossScanGap )
+{
+  uint8_t oldAddress[6], newAddress[6];
+  rpa( oldAddress, 1 );
+  rpa( newAddress, 9 );
+  uint32_t fp = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  RPAGroups.scanBegin( 1000 );
+  uint32_t id = advertise( oldAddress, fp, 1000, 1500, 100 );
+  RPAGroups.scanEnd();
+  EXPECT_NE( RPAGroups.resolve( newAddress, fp, 1700 ), id ); // nobody is listening between scans
+  RPAGroups.scanBegin( 30000 ); // long post scan processing, not silence
+  uint8_t otherAddress[6];
+  rpa( otherAddress, 17 );
+  EXPECT_EQ( RPAGroups.resolve( otherAddress, fp, 30100 ), id );
+}
+
+TEST_F( RPAGroupsTest, NoRotationFromOlderScans )
+{
+  uint8_t oldAddress[6], newAddress[6];
+  rpa( oldAddress, 1 );
+  rpa( newAddress, 9 );
+  uint32_t fp = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  RPAGroups.scanBegin( 1000 );
+  uint32_t id = advertise( oldAddress, fp, 1000, 1500, 100 );
+  RPAGroups.scanEnd();
+  RPAGroups.scanBegin( 10000 ); // old address not heard in this one
+  RPAGroups.scanEnd();
+  RPAGroups.scanBegin( 20000 );
+  EXPECT_NE( RPAGroups.resolve( newAddress, fp, 20100 ), id );
+}
+
+TEST_F( RPAGroupsTest, NoRotationAfterLongSilenceBeforeScanEnd )
+{
+  uint8_t oldAddress[6], newAddress[6], otherAddress[6];
+  rpa( oldAddress, 1 );
+  rpa( newAddress, 9 );
+  rpa( otherAddress, 17 );
+  uint32_t fp = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  uint32_t otherFp = RPAGroups.fingerprint( PayloadUUIDs, sizeof( PayloadUUIDs ) );
+  RPAGroups.scanBegin( 1000 );
+  uint32_t id = advertise( oldAddress, fp, 1000, 1500, 100 );
+  advertise( otherAddress, otherFp, 1000, 1600 + RPA_MAX_HANDOFF_MS, 100 ); // the scan went on without it
+  RPAGroups.scanEnd();
+  RPAGroups.scanBegin( 30000 );
+  EXPECT_NE( RPAGroups.resolve( newAddress, fp, 30000 ), id );
+}
+
+TEST_F( RPAGroupsTest, NoRotationAfterLongSilence )
+{
+  uint8_t oldAddress[6], newAddress[6];
+  rpa( oldAddress, 1 );
+  rpa( newAddress, 9 );
+  uint32_t fp = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  RPAGroups.scanBegin( 1000 );
+  uint32_t id = advertise( oldAddress, fp, 1000, 1500, 100 );
+  EXPECT_NE( RPAGroups.resolve( newAddress, fp, 1500 + RPA_MAX_HANDOFF_MS + 1 ), id );
+}
+
+TEST_F( RPAGroupsTest, NoRotationOnDifferentPayload )
+{
+  uint8_t oldAddress[6], newAddress[6];
+  rpa( oldAddress, 1 );
+  rpa( newAddress, 9 );
+  RPAGroups.scanBegin( 1000 );
+  uint32_t id = advertise( oldAddress, RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) ), 1000, 1500, 100 );
+  EXPECT_NE( RPAGroups.resolve( newAddress, RPAGroups.fingerprint( PayloadOtherVendor, sizeof( PayloadOtherVendor ) ), 1700 ), id );
+}
+
+TEST_F( RPAGroupsTest, EvictsLeastRecentGroupWhenFull )
+{
+  uint32_t fp = RPAGroups.fingerprint( PayloadA, sizeof( PayloadA ) );
+  uint8_t address[6];
+  uint32_t ids[RPA_GROUPS_SIZE];
+  for( uint16_t i=0; i<RPA_GROUPS_SIZE; i++ ) {
+    rpa( address, i );
+    ids[i] = RPAGroups.resolve( address, fp, 1000 + i );
+  }
+  rpa( address, 0 );
+  EXPECT_EQ( RPAGroups.resolve( address, fp, 2000 ), ids[0] ); // refreshed, 1 is now the least recent
+  rpa( address, 200 );
+  RPAGroups.resolve( address, fp, 2001 );
+  rpa( address, 1 );
+  EXPECT_NE( RPAGroups.resolve( address, fp, 2002 ), ids[1] );
+}
@@ -0,0 +1,67 @@
+// Host unit tests for RollingMinMax.h
+
+#include "BLECollectorCore.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <deque>
+
+TEST( RollingMinMax, EmptyWindowReportsZero )
+{
+  RollingMinMax window;
+  ASSERT_TRUE( window.init( 8 ) );
+  EXPECT_EQ( window.min(), 0u );
+  EXPECT_EQ( window.max(), 0u );
+}
+
+TEST( RollingMinMax, ZeroValuesAreNoRecord )
+{
+  RollingMinMax window;
+  ASSERT_TRUE( window.init( 4 ) );
+  window.push( 0 );
+  window.push( 50 );
+  window.push( 0 );
+  EXPECT_EQ( window.min(), 50u );
+  EXPECT_EQ( window.max(), 50u );
+  // zeros still take a slot: 50 slides out after 4 more samples
+  for( int i=0; i<4; i++ ) window.push( 0 );
+  EXPECT_EQ( window.min(), 0u );
+  EXPECT_EQ( window.max(), 0u );
+}
+
+TEST( RollingMinMax, ResetForgetsSamples )
+{
+  RollingMinMax window;
+  ASSERT_TRUE( window.init( 4 ) );
+  window.push( 10 );
+  window.push( 20 );
+  window.reset();
+  EXPECT_EQ( window.min(), 0u );
+  EXPECT_EQ( window.max(), 0u );
+  window.push( 30 );
+  EXPECT_EQ( window.min(), 30u );
+  EXPECT_EQ( window.max(), 30u );
+}
+
+TEST( RollingMinMax, MatchesBruteForce )
+{
+  const uint16_t size = 37;
+  RollingMinMax window;
+  ASSERT_TRUE( window.init( size ) );
+  std::deque<uint32_t> last;
+  srand( 1234 );
+  for( int i=0; i<5000; i++ ) {
+    uint32_t value = ( rand() % 8 == 0 ) ? 0 : 1 + rand() % 100000;
+    window.push( value );
+    last.push_back( value );
+    if( last.size() > size ) last.pop_front();
+    uint32_t min = 0, max = 0;
+    for( uint32_t v : last ) {
+      if( v == 0 ) continue;
+      if( min == 0 || v < min ) min = v;
+      if( v > max ) max = v;
+    }
+    ASSERT_EQ( window.min(), min ) << "sample " << i;
+    ASSERT_EQ( window.max(), max ) << "sample " << i;
+  }
+}
@@ -0,0 +1,160 @@
+// Synthetic BLE environment generator, host tool
+//
+// Writes a synthetic advertisement trace (see AdvSynth.h) with the vendor
+// mix drawn from the real OUI and company tables shipped for the SD card.
+// Copy the output to the SD as /advtrace.bin and use the 'replay' command,
+// or feed it to TraceReplay on the host.
+//
+// Usage: AdvSynthTool [options] output.bin
+//   -n, --devices N       population size (default 500, max 2000)
+//   -d, --duration S      simulated time span in seconds (default 60)
+//   -s, --seed N          generator seed
+//   -r, --rotation S      RPA rotation period in seconds (default 30)
+//   -i, --interval A-B    advertising interval range in ms (default 100-2000)
+//   -m, --mix P,R         % of public and rotating devices, the rest are beacons (default 40,45)
+//   -M, --mobile P        % of moving devices (default 20)
+//   -N, --named P         % of named public devices (default 50)
+//   -w, --walk M,S        random walk step in meters of mobile and static devices (default 1.5,0.05)
+//   -o, --oui PATH        OUI table (default SD/mac-oui-light.db)
+//   -v, --vendors PATH    company table (default SD/ble-oui.db)
+
+#include "BLECollectorCore.h"
+#include "HostSD.h"
+
+#include <getopt.h>
+#include <vector>
+
+struct SynthOUI
+{
+  uint8_t bytes[3];
+};
+
+static std::vector<SynthOUI> SynthOUIs;
+static std::vector<uint16_t> SynthCompanies;
+
+static void synthOUI( uint32_t index, uint8_t oui[3] )
+{
+  memcpy( oui, SynthOUIs[index].bytes, 3 );
+}
+
+static uint16_t synthCompany( uint32_t index )
+{
+  return SynthCompanies[index];
+}
+
+static bool synthWrite( const AdvTraceRecord &rec, void *ctx )
+{
+  return fwrite( &rec, 1, advTraceRecordLen( rec ), (FILE*)ctx ) == advTraceRecordLen( rec );
+}
+
+static void synthProgress( uint32_t now, uint32_t written )
+{
+  if( now % 10000 == 0 ) fprintf( stderr, "[Synth] %u s simulated, %u advertisements\n", now / 1000, written );
+}
+
+static void addOUI( const char** values )
+{
+  const char* assignment = values[0];
+  if( strlen( assignment ) < 6 ) return;
+  SynthOUI oui;
+  for( uint8_t i=0; i<3; i++ ) {
+    oui.bytes[i] = BLEDevHelper.hexToUInt16( assignment + i*2, 2 );
+  }
+  SynthOUIs.push_back( oui );
+}
+
+static void addCompany( const char** values )
+{
+  SynthCompanies.push_back( (uint16_t)strtoul( values[0], NULL, 16 ) );
+}
+
+static bool parsePair( const char* arg, char separator, float &a, float &b )
+{
+  char *end;
+  a = strtof( arg, &end );
+  if( *end != separator ) return false;
+  b = strtof( end + 1, &end );
+  return *end == '\0';
+}
+
+static void usage( const char* name )
+{
+  fprintf( stderr, "Usage: %s [-n devices] [-d seconds] [-s seed] [-r rotation seconds] [-i min-max ms] [-m public%%,rpa%%]\n"
+                   "       [-M mobile%%] [-N named%%] [-w mobile,static meters] [-o oui.db] [-v vendors.db] output.bin\n", name );
+}
+
+int main( int argc, char** argv )
+{
+  AdvSynthConfig config;
+  const char* ouiPath    = HOST_SD_DIR "/mac-oui-light.db";
+  const char* vendorPath = HOST_SD_DIR "/ble-oui.db";
+  static const struct option options[] = {
+    { "devices",  required_argument, NULL, 'n' },
+    { "duration", required_argument, NULL, 'd' },
+    { "seed",     required_argument, NULL, 's' },
+    { "rotation", required_argument, NULL, 'r' },
+    { "interval", required_argument, NULL, 'i' },
+    { "mix",      required_argument, NULL, 'm' },
+    { "mobile",   required_argument, NULL, 'M' },
+    { "named",    required_argument, NULL, 'N' },
+    { "walk",     required_argument, NULL, 'w' },
+    { "oui",      required_argument, NULL, 'o' },
+    { "vendors",  required_argument, NULL, 'v' },
+    { NULL, 0, NULL, 0 }
+  };
+  int opt;
+  float a, b;
+  while( ( opt = getopt_long( argc, argv, "n:d:s:r:i:m:M:N:w:o:v:", options, NULL ) ) != -1 ) {
+    switch( opt ) {
+      case 'n': config.devices  = atoi( optarg ); break;
+      case 'd': config.duration = atoi( optarg ) * 1000; break;
+      case 's': config.seed     = strtoul( optarg, NULL, 0 ); break;
+      case 'r': config.rotation = atoi( optarg ) * 1000; break;
+      case 'i':
+        if( !parsePair( optarg, '-', a, b ) ) { usage( argv[0] ); return 1; }
+        config.minInterval = a;
+        config.maxInterval = b;
+      break;
+      case 'm':
+        if( !parsePair( optarg, ',', a, b ) || a + b > 100 ) { usage( argv[0] ); return 1; }
+        config.publicPct = a;
+        config.rpaPct    = b;
+      break;
+      case 'M': config.mobilePct = atoi( optarg ); break;
+      case 'N': config.namedPct  = atoi( optarg ); break;
+      case 'w':
+        if( !parsePair( optarg, ',', a, b ) ) { usage( argv[0] ); return 1; }
+        config.mobileStep = a;
+        config.staticStep = b;
+      break;
+      case 'o': ouiPath    = optarg; break;
+      case 'v': vendorPath = optarg; break;
+      default: usage( argv[0] ); return 1;
+    }
+  }
+  if( optind != argc - 1 ) {
+    usage( argv[0] );
+    return 1;
+  }
+
+  if( !loadTable( ouiPath, "SELECT Assignment FROM 'oui-light'", addOUI ) ) return 1;
+  if( !loadTable( vendorPath, "SELECT mac FROM 'ble-oui'", addCompany ) ) return 1;
+  fprintf( stderr, "[Synth] %zu OUIs, %zu companies\n", SynthOUIs.size(), SynthCompanies.size() );
+
+  FILE* traceFile = fopen( argv[optind], "wb" );
+  if( traceFile == NULL ) {
+    fprintf( stderr, "Can't open %s for writing\n", argv[optind] );
+    return 1;
+  }
+  uint8_t header[ADV_TRACE_HEADER_LEN];
+  advTraceHeader( header );
+  fwrite( header, 1, sizeof( header ), traceFile );
+  AdvSynthVendors vendors = { (uint32_t)SynthOUIs.size(), synthOUI, (uint32_t)SynthCompanies.size(), synthCompany };
+  uint32_t written = AdvSynth.generate( config, vendors, synthWrite, traceFile, synthProgress );
+  if( fclose( traceFile ) != 0 || written == 0 ) {
+    fprintf( stderr, "Failed to write %s\n", argv[optind] );
+    return 1;
+  }
+  fprintf( stderr, "[Synth] %u advertisements written to %s\n", written, argv[optind] );
+  return 0;
+}